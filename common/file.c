@@ -22,18 +22,84 @@
 #include <config_ac.h>
 #endif
 
+#include <ctype.h>
+#include <sys/stat.h>
+
 #include "arch.h"
 #include "os_calls.h"
 #include "string_calls.h"
 #include "list.h"
 #include "file.h"
 #include "parse.h"
+#include "thread_calls.h"
 
 #define FILE_MAX_LINE_BYTES 2048
+#define FILE_CACHE_MAX_FILES 64
+#define FILE_CACHE_HASH_SIZE 64 /* power of 2 */
+
+/* stat times with nanoseconds, so an edit within the same second as the
+   parse is still seen */
+#if defined(__APPLE__)
+#define FILE_ST_MTIM(st) ((st)->st_mtimespec)
+#define FILE_ST_CTIM(st) ((st)->st_ctimespec)
+#else
+#define FILE_ST_MTIM(st) ((st)->st_mtim)
+#define FILE_ST_CTIM(st) ((st)->st_ctim)
+#endif
+
+/* one section of a parsed file, values are kept as written so $VARs are
+   expanded when read, like they were when every read parsed the file */
+struct file_cache_section
+{
+    char *name;
+    int next; /* next section in the same hash chain, -1 for none */
+    struct list *names;
+    struct list *values;
+};
+
+/* a parse of a whole file, never changed once built, a changed file gets a
+   new entry */
+struct file_cache_entry
+{
+    char *file_name;
+    int refs; /* the cache and each snapshot, under g_file_cache_mutex */
+    off_t size;
+    struct timespec mtime;
+    struct timespec ctime;
+    dev_t dev;
+    ino_t ino;
+    int section_count;
+    struct file_cache_section *sections;
+    int hash[FILE_CACHE_HASH_SIZE]; /* first section of each chain */
+};
+
+/* a file_cache_entry kept alive for reading without the cache lock */
+struct file_snapshot
+{
+    struct file_cache_entry *entry;
+};
+
+/* most recently used first */
+static struct list *g_file_cache = NULL;
+static tbus g_file_cache_mutex = 0;
+static int g_file_cache_parses = 0; /* parses added to the cache */
 
 static int
 file_read_ini_line(struct stream *s, char *text, int text_bytes);
 
+/*****************************************************************************/
+/* the mutex is created by the first file read, every program reads its
+   configuration from the main thread before it starts any other thread */
+static tbus
+file_cache_mutex(void)
+{
+    if (g_file_cache_mutex == 0)
+    {
+        g_file_cache_mutex = tc_mutex_create();
+    }
+    return g_file_cache_mutex;
+}
+
 /*****************************************************************************/
 /* look up for a section name within str (i.e. pattern [section_name])
  * if a section name is found, this function return 1 and copy the section
@@ -237,6 +303,22 @@ file_split_name_value(char *text, char *name, char *value)
     return 0;
 }
 
+/*****************************************************************************/
+/* a copy of value, or of the environment variable it names with a
+   leading $ */
+static char *
+file_expand_value(const char *value)
+{
+    const char *lvalue;
+
+    if (value[0] == '$')
+    {
+        lvalue = g_getenv(value + 1);
+        return g_strdup(lvalue != 0 ? lvalue : "");
+    }
+    return g_strdup(value);
+}
+
 /*****************************************************************************/
 /* return error */
 static int
@@ -248,7 +330,6 @@ l_file_read_section(int fd, int max_file_size, const char *section,
     char *text;
     char *name;
     char *value;
-    char *lvalue;
     int len;
     int file_size;
 
@@ -287,24 +368,8 @@ l_file_read_section(int fd, int max_file_size, const char *section,
                         {
                             file_split_name_value(text, name, value);
                             list_add_item(names, (tbus)g_strdup(name));
-
-                            if (value[0] == '$')
-                            {
-                                lvalue = g_getenv(value + 1);
-
-                                if (lvalue != 0)
-                                {
-                                    list_add_item(values, (tbus)g_strdup(lvalue));
-                                }
-                                else
-                                {
-                                    list_add_item(values, (tbus)g_strdup(""));
-                                }
-                            }
-                            else
-                            {
-                                list_add_item(values, (tbus)g_strdup(value));
-                            }
+                            list_add_item(values,
+                                          (tbus)file_expand_value(value));
                         }
                     }
                     free_stream(s);
@@ -320,6 +385,313 @@ l_file_read_section(int fd, int max_file_size, const char *section,
     return 1;
 }
 
+/*****************************************************************************/
+static unsigned int
+file_cache_hash(const char *name)
+{
+    unsigned int hash;
+
+    hash = 5381;
+
+    while (*name != 0)
+    {
+        hash = hash * 33 + (unsigned int)tolower((unsigned char)*name);
+        name++;
+    }
+
+    return hash & (FILE_CACHE_HASH_SIZE - 1);
+}
+
+/*****************************************************************************/
+/* drops a reference to entry, called with g_file_cache_mutex held unless
+   entry was never shared */
+static void
+file_cache_release(struct file_cache_entry *entry)
+{
+    int index;
+
+    if (entry == NULL || --entry->refs > 0)
+    {
+        return;
+    }
+
+    for (index = 0; index < entry->section_count; index++)
+    {
+        g_free(entry->sections[index].name);
+        list_delete(entry->sections[index].names);
+        list_delete(entry->sections[index].values);
+    }
+
+    g_free(entry->sections);
+    g_free(entry->file_name);
+    g_free(entry);
+}
+
+/*****************************************************************************/
+/* the first section called name, section names are case insensitive */
+static const struct file_cache_section *
+file_cache_find_section(const struct file_cache_entry *entry,
+                        const char *name)
+{
+    int index;
+
+    index = entry->hash[file_cache_hash(name)];
+
+    while (index >= 0)
+    {
+        if (g_strcasecmp(entry->sections[index].name, name) == 0)
+        {
+            return entry->sections + index;
+        }
+
+        index = entry->sections[index].next;
+    }
+
+    return NULL;
+}
+
+/*****************************************************************************/
+/* adds the last parsed section to its hash chain, after any section with
+   the same name so that one is still found first */
+static void
+file_cache_add_section(struct file_cache_entry *entry)
+{
+    struct file_cache_section *section;
+    int *link;
+
+    section = entry->sections + entry->section_count;
+    section->next = -1;
+    link = entry->hash + file_cache_hash(section->name);
+
+    while (*link >= 0)
+    {
+        link = &(entry->sections[*link].next);
+    }
+
+    *link = entry->section_count;
+    entry->section_count++;
+}
+
+/*****************************************************************************/
+/* parses a whole file, returns NULL if it can't be read */
+static struct file_cache_entry *
+file_cache_parse(const char *file_name, const struct stat *st)
+{
+    struct file_cache_entry *entry;
+    struct file_cache_section *section;
+    struct stream *s;
+    char *data;
+    char *text;
+    char *name;
+    char *value;
+    int fd;
+    int len;
+    int count;
+    int index;
+
+    if (st->st_size < 1 || st->st_size > 16 * 1024 * 1024)
+    {
+        return NULL;
+    }
+
+    fd = g_file_open_ex(file_name, 1, 0, 0, 0);
+
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    make_stream(s);
+    init_stream(s, (int)st->st_size);
+    len = g_file_read(fd, s->data, (int)st->st_size);
+    g_file_close(fd);
+
+    if (len < 1)
+    {
+        free_stream(s);
+        return NULL;
+    }
+
+    s->end = s->data + len;
+    data = (char *) g_malloc(FILE_MAX_LINE_BYTES * 3, 0);
+    text = data;
+    name = text + FILE_MAX_LINE_BYTES;
+    value = name + FILE_MAX_LINE_BYTES;
+
+    /* count the sections first so they fit in one array */
+    count = 0;
+
+    while (file_read_ini_line(s, text, FILE_MAX_LINE_BYTES) == 0)
+    {
+        if (line_lookup_for_section_name(text, FILE_MAX_LINE_BYTES) != 0)
+        {
+            count++;
+        }
+    }
+
+    entry = g_new0(struct file_cache_entry, 1);
+    entry->file_name = g_strdup(file_name);
+    entry->refs = 1;
+    entry->size = st->st_size;
+    entry->mtime = FILE_ST_MTIM(st);
+    entry->ctime = FILE_ST_CTIM(st);
+    entry->dev = st->st_dev;
+    entry->ino = st->st_ino;
+    entry->sections = g_new0(struct file_cache_section, count + 1);
+
+    for (index = 0; index < FILE_CACHE_HASH_SIZE; index++)
+    {
+        entry->hash[index] = -1;
+    }
+
+    section = NULL;
+    s->p = s->data;
+
+    while (file_read_ini_line(s, text, FILE_MAX_LINE_BYTES) == 0 &&
+            entry->section_count <= count)
+    {
+        if (line_lookup_for_section_name(text, FILE_MAX_LINE_BYTES) != 0)
+        {
+            section = entry->sections + entry->section_count;
+            section->name = g_strdup(text);
+            section->names = list_create();
+            section->names->auto_free = 1;
+            section->values = list_create();
+            section->values->auto_free = 1;
+            file_cache_add_section(entry);
+        }
+        else if (section != NULL && g_strlen(text) > 0)
+        {
+            file_split_name_value(text, name, value);
+            list_add_item(section->names, (tbus)g_strdup(name));
+            list_add_item(section->values, (tbus)g_strdup(value));
+        }
+    }
+
+    free_stream(s);
+    g_free(data);
+    return entry;
+}
+
+/*****************************************************************************/
+/* returns the index of the entry for file_name, -1 if there is none,
+   called with g_file_cache_mutex held */
+static int
+file_cache_find(const char *file_name)
+{
+    struct file_cache_entry *entry;
+    int index;
+
+    for (index = 0; index < g_file_cache->count; index++)
+    {
+        entry = (struct file_cache_entry *)list_get_item(g_file_cache, index);
+
+        if (g_strcmp(entry->file_name, file_name) == 0)
+        {
+            return index;
+        }
+    }
+
+    return -1;
+}
+
+/*****************************************************************************/
+/* non-zero if entry is a parse of the file st describes as it is now */
+static int
+file_cache_is_current(const struct file_cache_entry *entry,
+                      const struct stat *st)
+{
+    return entry->size == st->st_size &&
+           entry->mtime.tv_sec == FILE_ST_MTIM(st).tv_sec &&
+           entry->mtime.tv_nsec == FILE_ST_MTIM(st).tv_nsec &&
+           entry->ctime.tv_sec == FILE_ST_CTIM(st).tv_sec &&
+           entry->ctime.tv_nsec == FILE_ST_CTIM(st).tv_nsec &&
+           entry->dev == st->st_dev && entry->ino == st->st_ino;
+}
+
+/*****************************************************************************/
+/* returns the current parse of file_name with g_file_cache_mutex held,
+   or NULL without it if the file can't be read */
+static struct file_cache_entry *
+file_cache_lock(const char *file_name)
+{
+    struct file_cache_entry *entry;
+    struct stat st;
+    int pass;
+    int index;
+    int parsed;
+
+    if (stat(file_name, &st) != 0)
+    {
+        return NULL;
+    }
+
+    entry = NULL;
+
+    for (pass = 0; pass < 2; pass++)
+    {
+        tc_mutex_lock(file_cache_mutex());
+
+        if (g_file_cache == NULL)
+        {
+            g_file_cache = list_create();
+        }
+
+        index = file_cache_find(file_name);
+        parsed = entry != NULL;
+
+        if (index >= 0)
+        {
+            struct file_cache_entry *found;
+
+            found = (struct file_cache_entry *)
+                    list_get_item(g_file_cache, index);
+            list_remove_item(g_file_cache, index);
+
+            if (file_cache_is_current(found, &st))
+            {
+                /* another thread may have parsed it in the meantime */
+                file_cache_release(entry);
+                entry = found;
+                parsed = 0;
+            }
+            else
+            {
+                file_cache_release(found);
+            }
+        }
+
+        if (entry != NULL)
+        {
+            g_file_cache_parses += parsed;
+            list_insert_item(g_file_cache, 0, (tbus)entry);
+
+            while (g_file_cache->count > FILE_CACHE_MAX_FILES)
+            {
+                index = g_file_cache->count - 1;
+                file_cache_release((struct file_cache_entry *)
+                                   list_get_item(g_file_cache, index));
+                list_remove_item(g_file_cache, index);
+            }
+
+            return entry;
+        }
+
+        tc_mutex_unlock(g_file_cache_mutex);
+
+        /* parse without the lock held, other files can be read meanwhile */
+        entry = file_cache_parse(file_name, &st);
+
+        if (entry == NULL)
+        {
+            return NULL;
+        }
+    }
+
+    /* not reached, the second pass always has an entry */
+    return NULL;
+}
+
 /*****************************************************************************/
 /* returns error
    returns 0 if everything is ok
@@ -331,34 +703,70 @@ file_read_sections(int fd, struct list *names)
     return l_file_read_sections(fd, 32 * 1024, names);
 }
 
+/*****************************************************************************/
+static void
+file_cache_read_sections(const struct file_cache_entry *entry,
+                         struct list *names)
+{
+    int index;
+
+    list_clear(names);
+
+    for (index = 0; index < entry->section_count; index++)
+    {
+        list_add_item(names, (tbus)g_strdup(entry->sections[index].name));
+    }
+}
+
 /*****************************************************************************/
 /* return error */
-/* this function should be preferred over file_read_sections because it can
-   read any file size */
-int
-file_by_name_read_sections(const char *file_name, struct list *names)
+static int
+file_cache_read_section(const struct file_cache_entry *entry,
+                        const char *section,
+                        struct list *names, struct list *values)
 {
-    int fd;
-    int file_size;
-    int rv;
+    const struct file_cache_section *sect;
+    int index;
 
-    file_size = g_file_get_size(file_name);
+    list_clear(names);
+    list_clear(values);
+    sect = file_cache_find_section(entry, section);
 
-    if (file_size < 1)
+    if (sect == NULL)
     {
         return 1;
     }
 
-    fd = g_file_open_ex(file_name, 1, 0, 0, 0);
+    for (index = 0; index < sect->names->count; index++)
+    {
+        list_add_item(names, (tbus)g_strdup(
+                          (const char *)list_get_item(sect->names, index)));
+        list_add_item(values, (tbus)file_expand_value(
+                          (const char *)list_get_item(sect->values, index)));
+    }
 
-    if (fd < 0)
+    return 0;
+}
+
+/*****************************************************************************/
+/* return error */
+/* this function should be preferred over file_read_sections because it can
+   read any file size, and the file is only parsed again when it changed */
+int
+file_by_name_read_sections(const char *file_name, struct list *names)
+{
+    struct file_cache_entry *entry;
+
+    entry = file_cache_lock(file_name);
+
+    if (entry == NULL)
     {
         return 1;
     }
 
-    rv = l_file_read_sections(fd, file_size, names);
-    g_file_close(fd);
-    return rv;
+    file_cache_read_sections(entry, names);
+    tc_mutex_unlock(g_file_cache_mutex);
+    return 0;
 }
 
 /*****************************************************************************/
@@ -374,30 +782,118 @@ file_read_section(int fd, const char *section,
 /*****************************************************************************/
 /* return error */
 /* this function should be preferred over file_read_section because it can
-   read any file size */
+   read any file size, and the file is only parsed again when it changed */
 int
 file_by_name_read_section(const char *file_name, const char *section,
                           struct list *names, struct list *values)
 {
-    int fd;
-    int file_size;
+    struct file_cache_entry *entry;
     int rv;
 
-    file_size = g_file_get_size(file_name);
+    entry = file_cache_lock(file_name);
 
-    if (file_size < 1)
+    if (entry == NULL)
     {
         return 1;
     }
 
-    fd = g_file_open_ex(file_name, 1, 0, 0, 0);
+    rv = file_cache_read_section(entry, section, names, values);
+    tc_mutex_unlock(g_file_cache_mutex);
+    return rv;
+}
 
-    if (fd < 0)
+/*****************************************************************************/
+struct file_snapshot *
+file_snapshot_create(const char *file_name)
+{
+    struct file_snapshot *self;
+    struct file_cache_entry *entry;
+
+    self = g_new0(struct file_snapshot, 1);
+
+    if (self == NULL)
     {
-        return 1;
+        return NULL;
     }
 
-    rv = l_file_read_section(fd, file_size, section, names, values);
-    g_file_close(fd);
-    return rv;
+    entry = file_cache_lock(file_name);
+
+    if (entry == NULL)
+    {
+        g_free(self);
+        return NULL;
+    }
+
+    /* the entry is never changed, so it can be read without the lock for
+       as long as this reference keeps it */
+    entry->refs++;
+    tc_mutex_unlock(g_file_cache_mutex);
+    self->entry = entry;
+    return self;
+}
+
+/*****************************************************************************/
+void
+file_snapshot_delete(struct file_snapshot *self)
+{
+    if (self == NULL)
+    {
+        return;
+    }
+
+    tc_mutex_lock(file_cache_mutex());
+    file_cache_release(self->entry);
+    tc_mutex_unlock(g_file_cache_mutex);
+    g_free(self);
+}
+
+/*****************************************************************************/
+int
+file_snapshot_read_sections(const struct file_snapshot *self,
+                            struct list *names)
+{
+    file_cache_read_sections(self->entry, names);
+    return 0;
+}
+
+/*****************************************************************************/
+/* return error */
+int
+file_snapshot_read_section(const struct file_snapshot *self,
+                           const char *section,
+                           struct list *names, struct list *values)
+{
+    return file_cache_read_section(self->entry, section, names, values);
+}
+
+/*****************************************************************************/
+void
+file_cache_flush(void)
+{
+    int index;
+
+    tc_mutex_lock(file_cache_mutex());
+
+    if (g_file_cache != NULL)
+    {
+        for (index = 0; index < g_file_cache->count; index++)
+        {
+            file_cache_release((struct file_cache_entry *)
+                               list_get_item(g_file_cache, index));
+        }
+
+        list_clear(g_file_cache);
+    }
+
+    tc_mutex_unlock(g_file_cache_mutex);
+}
+
+/*****************************************************************************/
+void
+file_cache_get_stats(int *parses, int *files)
+{
+    tc_mutex_lock(file_cache_mutex());
+    *parses = g_file_cache_parses;
+    *files = g_file_cache != NULL ? g_file_cache->count : 0;
+    tc_mutex_unlock(g_file_cache_mutex);
 }
@@ -34,4 +34,31 @@ int
 file_by_name_read_section(const char *file_name, const char *section,
                           struct list *names, struct list *values);
 
+/* the file_by_name_ functions keep each file parsed until it changes on
+   disk, this drops those copies so the next read parses the file again */
+void
+file_cache_flush(void);
+
+/* the number of parses added to the cache since start and the number of
+   files cached now, for tests */
+void
+file_cache_get_stats(int *parses, int *files);
+
+/* a parse of a file taken once, reading several sections from it checks
+   the file once and sees one version of it, even if it is edited
+   meanwhile */
+struct file_snapshot;
+
+struct file_snapshot *
+file_snapshot_create(const char *file_name);
+void
+file_snapshot_delete(struct file_snapshot *self);
+int
+file_snapshot_read_sections(const struct file_snapshot *self,
+                            struct list *names);
+int
+file_snapshot_read_section(const struct file_snapshot *self,
+                           const char *section,
+                           struct list *names, struct list *values);
+
 #endif
@@ -42,6 +42,7 @@
 
 /* Here we store the current state and configuration of the log */
 static struct log_config *g_staticLogConfig = NULL;
+static int g_log_atfork_done = 0;
 
 /* This file first start with all private functions.
    In the end of the file the public functions is defined */
@@ -139,6 +140,29 @@ internal_log_lvl2str(const enum logLevels lvl, char *str)
     }
 }
 
+/******************************************************************************/
+/* a thread writing a message when another one forks leaves the child
+   with the log lock, or a lock inside syslog or localtime, held for
+   good, so forks wait for the message to be written */
+static void
+internal_log_fork_prepare(void)
+{
+    if (g_staticLogConfig != NULL)
+    {
+        pthread_mutex_lock(&(g_staticLogConfig->log_lock));
+    }
+}
+
+/******************************************************************************/
+static void
+internal_log_fork_done(void)
+{
+    if (g_staticLogConfig != NULL)
+    {
+        pthread_mutex_unlock(&(g_staticLogConfig->log_lock));
+    }
+}
+
 /******************************************************************************/
 enum logReturns
 internal_log_start(struct log_config *l_cfg)
@@ -180,10 +204,17 @@ internal_log_start(struct log_config *l_cfg)
         openlog(l_cfg->program_name, LOG_CONS | LOG_PID, LOG_DAEMON);
     }
 
-#ifdef LOG_ENABLE_THREAD
+    /* recursive, a message can log a warning about itself */
     pthread_mutexattr_init(&(l_cfg->log_lock_attr));
+    pthread_mutexattr_settype(&(l_cfg->log_lock_attr),
+                              PTHREAD_MUTEX_RECURSIVE);
     pthread_mutex_init(&(l_cfg->log_lock), &(l_cfg->log_lock_attr));
-#endif
+    if (!g_log_atfork_done)
+    {
+        pthread_atfork(internal_log_fork_prepare, internal_log_fork_done,
+                       internal_log_fork_done);
+        g_log_atfork_done = 1;
+    }
 
     return LOG_STARTUP_OK;
 }
@@ -219,6 +250,9 @@ internal_log_end(struct log_config *l_cfg)
         l_cfg->log_file = 0;
     }
 
+    pthread_mutex_destroy(&(l_cfg->log_lock));
+    pthread_mutexattr_destroy(&(l_cfg->log_lock_attr));
+
     ret = LOG_STARTUP_OK;
     return ret;
 }
@@ -919,6 +953,8 @@ internal_log_message(const enum logLevels lvl,
         return LOG_STARTUP_OK;
     }
 
+    pthread_mutex_lock(&(g_staticLogConfig->log_lock));
+
     now_t = time(&now_t);
     now = localtime(&now_t);
 
@@ -979,23 +1015,17 @@ internal_log_message(const enum logLevels lvl,
         /* log to application logfile */
         if (g_staticLogConfig->fd >= 0)
         {
-#ifdef LOG_ENABLE_THREAD
-            pthread_mutex_lock(&(g_staticLogConfig->log_lock));
-#endif
-
             writereply = g_file_write(g_staticLogConfig->fd, buff, g_strlen(buff));
 
             if (writereply <= 0)
             {
                 rv = LOG_ERROR_NULL_FILE;
             }
-
-#ifdef LOG_ENABLE_THREAD
-            pthread_mutex_unlock(&(g_staticLogConfig->log_lock));
-#endif
         }
     }
 
+    pthread_mutex_unlock(&(g_staticLogConfig->log_lock));
+
     return rv;
 }
 
@@ -63,9 +63,6 @@ enum logReturns
 #define SESMAN_CFG_LOG_SYSLOG_LEVEL   "SyslogLevel"
 #define SESMAN_CFG_LOG_ENABLE_PID     "EnableProcessId"
 
-/* enable threading */
-/*#define LOG_ENABLE_THREAD*/
-
 #ifdef XRDP_DEBUG
 
 #define LOG_PER_LOGGER_LEVEL
@@ -37,6 +37,7 @@ enum NTSTATUS
     STATUS_OBJECT_NAME_INVALID   = 0xc0000033,
     STATUS_OBJECT_NAME_NOT_FOUND = 0xc0000034,
     STATUS_SHARING_VIOLATION     = 0xc0000043,
+    STATUS_DISK_FULL             = 0xc000007f,
     STATUS_NOT_SUPPORTED         = 0xc00000bb
 };
 
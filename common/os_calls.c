@@ -326,6 +326,14 @@ g_memcpy(void *d_ptr, const void *s_ptr, int size)
     memcpy(d_ptr, s_ptr, size);
 }
 
+/*****************************************************************************/
+/* the areas may overlap */
+void
+g_memmove(void *d_ptr, const void *s_ptr, int size)
+{
+    memmove(d_ptr, s_ptr, size);
+}
+
 /*****************************************************************************/
 int
 g_getchar(void)
@@ -2842,6 +2850,17 @@ g_setsid(void)
 #endif
 }
 
+/*****************************************************************************/
+int
+g_setpgid(int pid, int pgid)
+{
+#if defined(_WIN32)
+    return -1;
+#else
+    return setpgid(pid, pgid);
+#endif
+}
+
 /*****************************************************************************/
 int
 g_getlogin(char *name, unsigned int len)
@@ -2967,6 +2986,45 @@ g_waitpid_status(int pid)
 #endif
 }
 
+/*****************************************************************************/
+/* does not work in win32
+   waits for any child process and returns its pid and exit status,
+   returns 0 if none has exited (block is zero or a signal occurred) and
+   -1 if there are no children left */
+int
+g_waitchild_status(struct exit_status *exit_status, int block)
+{
+    exit_status->exit_code = -1;
+    exit_status->signal_no = 0;
+
+#if defined(_WIN32)
+    return -1;
+#else
+    int rv;
+    int status;
+
+    rv = waitpid(-1, &status, block ? 0 : WNOHANG);
+
+    if (rv > 0)
+    {
+        if (WIFEXITED(status))
+        {
+            exit_status->exit_code = WEXITSTATUS(status);
+        }
+        if (WIFSIGNALED(status))
+        {
+            exit_status->signal_no = WTERMSIG(status);
+        }
+    }
+    else if (rv == -1 && errno == EINTR) /* signal occurred */
+    {
+        rv = 0;
+    }
+
+    return rv;
+#endif
+}
+
 /*****************************************************************************/
 /* does not work in win32 */
 void
@@ -3199,6 +3257,22 @@ g_time3(void)
 #endif
 }
 
+/*****************************************************************************/
+/* returns a monotonic time in microseconds, for measuring intervals
+   does not work in win32 */
+tui64
+g_time4(void)
+{
+#if defined(_WIN32)
+    return 0;
+#else
+    struct timespec tp;
+
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return ((tui64)tp.tv_sec * 1000000) + (tp.tv_nsec / 1000);
+#endif
+}
+
 /******************************************************************************/
 /******************************************************************************/
 struct bmp_magic
@@ -3367,6 +3441,24 @@ g_shmat(int shmid)
 #endif
 }
 
+/*****************************************************************************/
+/* returns the size of the segment in bytes, -1 on error */
+long
+g_shmsize(int shmid)
+{
+#if defined(_WIN32)
+    return -1;
+#else
+    struct shmid_ds ds;
+
+    if (shmctl(shmid, IPC_STAT, &ds) != 0)
+    {
+        return -1;
+    }
+    return (long)ds.shm_segsz;
+#endif
+}
+
 /*****************************************************************************/
 /* returns -1 on error 0 on success */
 int
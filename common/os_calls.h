@@ -62,6 +62,7 @@ void g_write(const char *format, ...) printflike(1, 2);
 void     g_hexdump(const char *p, int len);
 void     g_memset(void *ptr, int val, int size);
 void     g_memcpy(void *d_ptr, const void *s_ptr, int size);
+void     g_memmove(void *d_ptr, const void *s_ptr, int size);
 int      g_getchar(void);
 int      g_tcp_set_no_delay(int sck);
 int      g_tcp_set_keepalive(int sck);
@@ -150,11 +151,13 @@ int      g_getuid(void);
 int      g_getgid(void);
 int      g_setuid(int pid);
 int      g_setsid(void);
+int      g_setpgid(int pid, int pgid);
 int      g_getlogin(char *name, unsigned int len);
 int      g_setlogin(const char *name);
 int      g_waitchild(void);
 int      g_waitpid(int pid);
 struct exit_status g_waitpid_status(int pid);
+int      g_waitchild_status(struct exit_status *exit_status, int block);
 void     g_clearenv(void);
 int      g_setenv(const char *name, const char *value, int rewrite);
 char    *g_getenv(const char *name);
@@ -168,9 +171,11 @@ int      g_check_user_in_group(const char *username, int gid, int *ok);
 int      g_time1(void);
 int      g_time2(void);
 int      g_time3(void);
+tui64    g_time4(void);
 int      g_save_to_bmp(const char *filename, char *data, int stride_bytes,
                        int width, int height, int depth, int bits_per_pixel);
 void    *g_shmat(int shmid);
+long     g_shmsize(int shmid);
 int      g_shmdt(const void *shmaddr);
 int      g_gethostname(char *name, int len);
 int      g_mirror_memcpy(void *dst, const void *src, int len);
@@ -72,5 +72,7 @@ pixman_bool_t           pixman_region_intersect          (pixman_region16_t *new
         /**/                                              pixman_region16_t *reg2);
 pixman_box16_t         *pixman_region_rectangles         (pixman_region16_t *region,
         /**/                                              int               *n_rects);
+pixman_region_overlap_t pixman_region_contains_rectangle (pixman_region16_t *region,
+        /**/                                              pixman_box16_t    *prect);
 
 #endif
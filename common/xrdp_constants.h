@@ -51,6 +51,10 @@
 #define XR_MIN_KEY_CODE 8
 #define XR_MAX_KEY_CODE 256
 
+/* largest piece of static channel data chansrv sends xrdp in one
+   message, xrdp splits it in chunks for the client */
+#define XRDP_CHANSRV_MAX_FRAME_BYTES (1024 * 1024)
+
 /*
  * Constants come from ITU-T Recommendations
  */
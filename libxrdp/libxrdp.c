@@ -1362,35 +1362,18 @@ libxrdp_send_to_channel(struct xrdp_session *session, int channel_id,
     struct xrdp_rdp *rdp = NULL;
     struct xrdp_sec *sec = NULL;
     struct xrdp_channel *chan = NULL;
-    struct stream *s = NULL;
 
     rdp = (struct xrdp_rdp *)session->rdp;
     sec = rdp->sec_layer;
     chan = sec->chan_layer;
-    make_stream(s);
-    init_stream(s, data_len + 1024); /* this should be big enough */
 
-    if (xrdp_channel_init(chan, s) != 0)
+    /* data_len can be more than one chunk, it is split here */
+    if (xrdp_channel_send_data(chan, channel_id, data, data_len,
+                               total_data_len, flags) != 0)
     {
-        LOG(LOG_LEVEL_ERROR, "libxrdp_send_to_channel: xrdp_channel_init failed");
-        free_stream(s);
+        LOG(LOG_LEVEL_ERROR, "libxrdp_send_to_channel: xrdp_channel_send_data failed");
         return 1;
     }
-
-    /* here we make a copy of the data */
-    out_uint8a(s, data, data_len);
-    s_mark_end(s);
-    LOG_DEVEL(LOG_LEVEL_TRACE, "Sending [MS-RDPBCGR] Virtual Channel PDU "
-              "data <omitted from log>");
-
-    if (xrdp_channel_send(chan, s, channel_id, total_data_len, flags) != 0)
-    {
-        LOG(LOG_LEVEL_ERROR, "libxrdp_send_to_channel: xrdp_channel_send failed");
-        free_stream(s);
-        return 1;
-    }
-
-    free_stream(s);
     return 0;
 }
 
@@ -570,6 +570,10 @@ int
 xrdp_channel_send(struct xrdp_channel *self, struct stream *s, int channel_id,
                   int total_data_len, int flags);
 int
+xrdp_channel_send_data(struct xrdp_channel *self, int channel_id,
+                       const char *data, int data_len,
+                       int total_data_len, int flags);
+int
 xrdp_channel_process(struct xrdp_channel *self, struct stream *s,
                      int chanid);
 int
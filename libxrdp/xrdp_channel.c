@@ -26,8 +26,9 @@
 #include "string_calls.h"
 
 /* todo, move these to constants.h */
-//#define CHANNEL_CHUNK_LENGTH 1600 /* todo, why is this so small? */
-#define CHANNEL_CHUNK_LENGTH 8192
+/* no virtual channel capability set is sent, so clients expect chunks of
+   at most the default size [MS-RDPBCGR] 2.2.7.1.10 */
+#define CHANNEL_CHUNK_LENGTH 1600
 #define CHANNEL_FLAG_FIRST 0x01
 #define CHANNEL_FLAG_LAST 0x02
 #define CHANNEL_FLAG_SHOW_PROTOCOL 0x10
@@ -175,6 +176,59 @@ xrdp_channel_send(struct xrdp_channel *self, struct stream *s, int channel_id,
     return 0;
 }
 
+/*****************************************************************************/
+/* returns error */
+/* sends data_len bytes of a message of total_data_len bytes, split in
+   chunks the client accepts. flags tell if the data starts and / or ends
+   the message */
+int
+xrdp_channel_send_data(struct xrdp_channel *self, int channel_id,
+                       const char *data, int data_len,
+                       int total_data_len, int flags)
+{
+    struct stream *s;
+    int chunk_len;
+    int chunk_flags;
+    int rv;
+
+    rv = 0;
+    make_stream(s);
+    chunk_flags = flags & ~CHANNEL_FLAG_LAST;
+    do
+    {
+        chunk_len = MIN(data_len, CHANNEL_CHUNK_LENGTH);
+        if (chunk_len == data_len)
+        {
+            chunk_flags |= flags & CHANNEL_FLAG_LAST;
+        }
+        if (xrdp_channel_init(self, s) != 0)
+        {
+            LOG(LOG_LEVEL_ERROR, "xrdp_channel_send_data: "
+                "xrdp_channel_init failed");
+            rv = 1;
+            break;
+        }
+        out_uint8a(s, data, chunk_len);
+        s_mark_end(s);
+        LOG_DEVEL(LOG_LEVEL_TRACE, "Sending [MS-RDPBCGR] Virtual Channel PDU "
+                  "data <omitted from log>");
+        if (xrdp_channel_send(self, s, channel_id, total_data_len,
+                              chunk_flags) != 0)
+        {
+            LOG(LOG_LEVEL_ERROR, "xrdp_channel_send_data: "
+                "xrdp_channel_send failed");
+            rv = 1;
+            break;
+        }
+        data += chunk_len;
+        data_len -= chunk_len;
+        chunk_flags &= ~CHANNEL_FLAG_FIRST;
+    }
+    while (data_len > 0);
+    free_stream(s);
+    return rv;
+}
+
 /*****************************************************************************/
 /* returns error */
 /* this will inform the callback, whatever it is that some channel data is
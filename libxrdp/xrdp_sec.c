@@ -362,7 +362,6 @@ hex_str_to_bin(char *in, char *out, int out_len)
 static void
 xrdp_load_keyboard_layout(struct xrdp_client_info *client_info)
 {
-    int fd;
     int index = 0;
     int bytes;
     struct list *names = (struct list *)NULL;
@@ -397,9 +396,7 @@ xrdp_load_keyboard_layout(struct xrdp_client_info *client_info)
     g_snprintf(keyboard_cfg_file, 255, "%s/xrdp_keyboard.ini", XRDP_CFG_PATH);
     LOG(LOG_LEVEL_DEBUG, "keyboard_cfg_file %s", keyboard_cfg_file);
 
-    fd = g_file_open(keyboard_cfg_file);
-
-    if (fd >= 0)
+    if (g_file_exist(keyboard_cfg_file))
     {
         int section_found = -1;
         char section_rdp_layouts[256] = { 0 };
@@ -412,7 +409,7 @@ xrdp_load_keyboard_layout(struct xrdp_client_info *client_info)
         values = list_create();
         values->auto_free = 1;
 
-        file_read_sections(fd, names);
+        file_by_name_read_sections(keyboard_cfg_file, names);
         for (index = 0; index < names->count; index++)
         {
             q = (char *)list_get_item(names, index);
@@ -420,7 +417,8 @@ xrdp_load_keyboard_layout(struct xrdp_client_info *client_info)
             {
                 int i;
 
-                file_read_section(fd, q, items, values);
+                file_by_name_read_section(keyboard_cfg_file,
+                                          q, items, values);
 
                 for (i = 0; i < items->count; i++)
                 {
@@ -510,7 +508,8 @@ xrdp_load_keyboard_layout(struct xrdp_client_info *client_info)
             g_memset(section_rdp_layouts, 0, sizeof(char) * 256);
             g_memset(section_layouts_map, 0, sizeof(char) * 256);
             // read default section
-            file_read_section(fd, "default", items, values);
+            file_by_name_read_section(keyboard_cfg_file,
+                                      "default", items, values);
             for (index = 0; index < items->count; index++)
             {
                 item = (char *)list_get_item(items, index);
@@ -529,7 +528,8 @@ xrdp_load_keyboard_layout(struct xrdp_client_info *client_info)
         }
 
         /* load the map */
-        file_read_section(fd, section_rdp_layouts, items, values);
+        file_by_name_read_section(keyboard_cfg_file,
+                                  section_rdp_layouts, items, values);
         for (index = 0; index < items->count; index++)
         {
             int rdp_layout_id;
@@ -544,7 +544,8 @@ xrdp_load_keyboard_layout(struct xrdp_client_info *client_info)
         }
         list_clear(items);
         list_clear(values);
-        file_read_section(fd, section_layouts_map, items, values);
+        file_by_name_read_section(keyboard_cfg_file,
+                                  section_layouts_map, items, values);
         for (index = 0; index < items->count; index++)
         {
             item = (char *)list_get_item(items, index);
@@ -564,7 +565,6 @@ xrdp_load_keyboard_layout(struct xrdp_client_info *client_info)
         LOG(LOG_LEVEL_INFO, "xrdp_load_keyboard_layout: model [%s] variant [%s] "
             "layout [%s] options [%s]", client_info->model,
             client_info->variant, client_info->layout, client_info->options);
-        g_file_close(fd);
     }
     else
     {
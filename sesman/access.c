@@ -39,6 +39,7 @@ access_login_allowed(const char *user)
 {
     int gid;
     int ok;
+    int rv;
 
     if ((0 == g_strncmp(user, "root", 5)) && (0 == g_cfg->sec.allow_root))
     {
@@ -53,7 +54,10 @@ access_login_allowed(const char *user)
         return 1;
     }
 
-    if (0 != g_getuser_info(user, &gid, 0, 0, 0, 0))
+    scp_userdb_lock();
+    rv = g_getuser_info(user, &gid, 0, 0, 0, 0);
+    scp_userdb_unlock();
+    if (0 != rv)
     {
         LOG(LOG_LEVEL_ERROR, "Cannot read user info! - login denied");
         return 0;
@@ -65,7 +69,10 @@ access_login_allowed(const char *user)
         return 1;
     }
 
-    if (0 != g_check_user_in_group(user, g_cfg->sec.ts_users, &ok))
+    scp_userdb_lock();
+    rv = g_check_user_in_group(user, g_cfg->sec.ts_users, &ok);
+    scp_userdb_unlock();
+    if (0 != rv)
     {
         LOG(LOG_LEVEL_ERROR, "Cannot read group info! - login denied");
         return 0;
@@ -87,6 +94,7 @@ access_login_mng_allowed(const char *user)
 {
     int gid;
     int ok;
+    int rv;
 
     if ((0 == g_strncmp(user, "root", 5)) && (0 == g_cfg->sec.allow_root))
     {
@@ -102,7 +110,10 @@ access_login_mng_allowed(const char *user)
         return 1;
     }
 
-    if (0 != g_getuser_info(user, &gid, 0, 0, 0, 0))
+    scp_userdb_lock();
+    rv = g_getuser_info(user, &gid, 0, 0, 0, 0);
+    scp_userdb_unlock();
+    if (0 != rv)
     {
         LOG(LOG_LEVEL_ERROR, "[MNG] Cannot read user info! - login denied");
         return 0;
@@ -114,7 +125,10 @@ access_login_mng_allowed(const char *user)
         return 1;
     }
 
-    if (0 != g_check_user_in_group(user, g_cfg->sec.ts_admins, &ok))
+    scp_userdb_lock();
+    rv = g_check_user_in_group(user, g_cfg->sec.ts_admins, &ok);
+    scp_userdb_unlock();
+    if (0 != rv)
     {
         LOG(LOG_LEVEL_ERROR, "[MNG] Cannot read group info! - login denied");
         return 0;
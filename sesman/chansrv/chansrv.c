@@ -38,17 +38,30 @@
 #include "xcommon.h"
 #include "chansrv_fuse.h"
 #include "chansrv_config.h"
+#include "chansrv_reactor.h"
 #include "xrdp_sockets.h"
+#include "xrdp_constants.h"
 #include "audin.h"
 
 #include "ms-rdpbcgr.h"
 
 #define MAX_PATH 260
 
+/* wait objects not owned by the reactor: the term event, the xrdp
+   connection or its listener, xcommon, sound, smartcard and fuse */
+#define CHANSRV_FIXED_WAIT_OBJS 16
+
 static struct trans *g_lis_trans = 0;
 static struct trans *g_con_trans = 0;
 static struct trans *g_api_lis_trans = 0;
 static struct list *g_api_con_trans_list = 0; /* list of apps using api functions */
+static struct reactor *g_reactor = 0;
+/* cliprdr channel data read while the clipboard holds it, copies of the
+   channel data messages, given to the clipboard in order once released.
+   All the channels share g_con_trans, so it is kept reading for the others */
+static struct list *g_cliprdr_held = NULL;
+static int g_cliprdr_hold = 0;
+static struct reactor_timer *g_cliprdr_release_timer = NULL;
 static struct chan_item g_chan_items[32];
 static int g_num_chan_items = 0;
 static int g_cliprdr_index = -1;
@@ -76,7 +89,7 @@ int g_exec_pid = 0;
 #define ARRAYSIZE(x) (sizeof(x)/sizeof(*(x)))
 /* max total channel bytes size */
 #define MAX_CHANNEL_BYTES (1 * 1024 * 1024 * 1024) /* 1 GB */
-#define MAX_CHANNEL_FRAG_BYTES 1600
+#define MAX_CHANNEL_FRAG_BYTES XRDP_CHANSRV_MAX_FRAME_BYTES
 
 #define CHANSRV_DRDYNVC_STATUS_CLOSED       0
 #define CHANSRV_DRDYNVC_STATUS_OPEN_SENT    1
@@ -103,145 +116,9 @@ struct xrdp_api_data
 {
     int chan_flags;
     int chan_id;
+    struct reactor_source *source;
 };
 
-struct timeout_obj
-{
-    tui32 mstime;
-    void *data;
-    void (*callback)(void *data);
-    struct timeout_obj *next;
-};
-
-static struct timeout_obj *g_timeout_head = 0;
-static struct timeout_obj *g_timeout_tail = 0;
-
-/*****************************************************************************/
-int
-add_timeout(int msoffset, void (*callback)(void *data), void *data)
-{
-    struct timeout_obj *tobj;
-    tui32 now;
-
-    LOG_DEVEL(LOG_LEVEL_DEBUG, "add_timeout:");
-    now = g_time3();
-    tobj = g_new0(struct timeout_obj, 1);
-    tobj->mstime = now + msoffset;
-    tobj->callback = callback;
-    tobj->data = data;
-    if (g_timeout_tail == 0)
-    {
-        g_timeout_head = tobj;
-        g_timeout_tail = tobj;
-    }
-    else
-    {
-        g_timeout_tail->next = tobj;
-        g_timeout_tail = tobj;
-    }
-    return 0;
-}
-
-/*****************************************************************************/
-static int
-get_timeout(int *timeout)
-{
-    struct timeout_obj *tobj;
-    tui32 now;
-    int ltimeout;
-
-    LOG_DEVEL(LOG_LEVEL_DEBUG, "get_timeout:");
-    ltimeout = *timeout;
-    if (ltimeout < 1)
-    {
-        ltimeout = 0;
-    }
-    tobj = g_timeout_head;
-    if (tobj != 0)
-    {
-        now = g_time3();
-        while (tobj != 0)
-        {
-            LOG_DEVEL(LOG_LEVEL_DEBUG, "  now %u tobj->mstime %u", now, tobj->mstime);
-            if (now < tobj->mstime)
-            {
-                ltimeout = tobj->mstime - now;
-            }
-            tobj = tobj->next;
-        }
-    }
-    if (ltimeout > 0)
-    {
-        LOG_DEVEL(LOG_LEVEL_DEBUG, "  ltimeout %d", ltimeout);
-        if (*timeout < 1)
-        {
-            *timeout = ltimeout;
-        }
-        else
-        {
-            if (*timeout > ltimeout)
-            {
-                *timeout = ltimeout;
-            }
-        }
-    }
-    return 0;
-}
-
-/*****************************************************************************/
-static int
-check_timeout(void)
-{
-    struct timeout_obj *tobj;
-    struct timeout_obj *last_tobj;
-    struct timeout_obj *temp_tobj;
-    int count;
-    tui32 now;
-
-    LOG_DEVEL(LOG_LEVEL_DEBUG, "check_timeout:");
-    count = 0;
-    tobj = g_timeout_head;
-    if (tobj != 0)
-    {
-        last_tobj = 0;
-        while (tobj != 0)
-        {
-            count++;
-            now = g_time3();
-            if (now >= tobj->mstime)
-            {
-                tobj->callback(tobj->data);
-                if (last_tobj == 0)
-                {
-                    g_timeout_head = tobj->next;
-                    if (g_timeout_head == 0)
-                    {
-                        g_timeout_tail = 0;
-                    }
-                }
-                else
-                {
-                    last_tobj->next = tobj->next;
-                    if (g_timeout_tail == tobj)
-                    {
-                        g_timeout_tail = last_tobj;
-                    }
-                }
-                temp_tobj = tobj;
-                tobj = tobj->next;
-                g_free(temp_tobj);
-            }
-            else
-            {
-                last_tobj = tobj;
-                tobj = tobj->next;
-            }
-        }
-    }
-    LOG_DEVEL(LOG_LEVEL_DEBUG, "  count %d", count);
-    return 0;
-}
-
 /*****************************************************************************/
 int
 g_is_term(void)
@@ -252,7 +129,7 @@ g_is_term(void)
 /*****************************************************************************/
 /* send data to a static virtual channel
    size can be > MAX_CHANNEL_FRAG_BYTES, in which case, > 1 message
-   will be sent*/
+   will be sent, xrdp splits each in chunks the client accepts */
 /* returns error */
 int
 send_channel_data(int chan_id, const char *data, int size)
@@ -279,18 +156,18 @@ send_channel_data(int chan_id, const char *data, int size)
         {
             chan_flags |= 2; /* last */
         }
-        s = trans_get_out_s(g_con_trans, 26 + sending_bytes);
+        s = trans_get_out_s(g_con_trans, 28 + sending_bytes);
         if (s == NULL)
         {
             return 2;
         }
         out_uint32_le(s, 0); /* version */
-        out_uint32_le(s, 26 + sending_bytes);
-        out_uint32_le(s, 8); /* msg id */
-        out_uint32_le(s, 18 + sending_bytes);
+        out_uint32_le(s, 28 + sending_bytes);
+        out_uint32_le(s, 20); /* msg id, channel data with a 32 bit length */
+        out_uint32_le(s, 20 + sending_bytes);
         out_uint16_le(s, chan_id);
         out_uint16_le(s, chan_flags);
-        out_uint16_le(s, sending_bytes);
+        out_uint32_le(s, sending_bytes);
         out_uint32_le(s, total_size);
         out_uint8a(s, data, sending_bytes);
         s_mark_end(s);
@@ -423,6 +300,125 @@ process_message_channel_setup(struct stream *s)
     return rv;
 }
 
+/*****************************************************************************/
+struct reactor *
+chansrv_get_reactor(void)
+{
+    return g_reactor;
+}
+
+/*****************************************************************************/
+/* gives the clipboard the cliprdr data held for it until it holds again */
+static void
+cliprdr_held_release(void *data)
+{
+    struct stream *ls;
+    int chan_flags;
+    int length;
+    int total_length;
+
+    g_cliprdr_release_timer = NULL;
+    while (!g_cliprdr_hold && g_cliprdr_held != NULL &&
+            g_cliprdr_held->count > 0)
+    {
+        ls = (struct stream *) list_get_item(g_cliprdr_held, 0);
+        list_remove_item(g_cliprdr_held, 0);
+        in_uint16_le(ls, chan_flags);
+        in_uint16_le(ls, length);
+        in_uint32_le(ls, total_length);
+        clipboard_data_in(ls, g_cliprdr_chan_id, chan_flags, length,
+                          total_length);
+        free_stream(ls);
+    }
+}
+
+/*****************************************************************************/
+/* returns error */
+static int
+cliprdr_held_add(struct stream *s, int chan_flags, int length,
+                 int total_length)
+{
+    struct stream *ls;
+
+    if (!s_check_rem(s, length))
+    {
+        return 1;
+    }
+    if (g_cliprdr_held == NULL)
+    {
+        g_cliprdr_held = list_create();
+        if (g_cliprdr_held == NULL)
+        {
+            return 1;
+        }
+    }
+    make_stream(ls);
+    init_stream(ls, length + 8);
+    out_uint16_le(ls, chan_flags);
+    out_uint16_le(ls, length);
+    out_uint32_le(ls, total_length);
+    out_uint8a(ls, s->p, length);
+    s_mark_end(ls);
+    ls->p = ls->data;
+    list_add_item(g_cliprdr_held, (tintptr) ls);
+    return 0;
+}
+
+/*****************************************************************************/
+/* drops the cliprdr data held for a clipboard that is gone */
+static void
+cliprdr_held_clear(void)
+{
+    int index;
+
+    if (g_cliprdr_release_timer != NULL)
+    {
+        reactor_cancel_timer(g_cliprdr_release_timer);
+        g_cliprdr_release_timer = NULL;
+    }
+    if (g_cliprdr_held != NULL)
+    {
+        for (index = 0; index < g_cliprdr_held->count; index++)
+        {
+            free_stream((struct stream *) list_get_item(g_cliprdr_held,
+                        index));
+        }
+        list_delete(g_cliprdr_held);
+        g_cliprdr_held = NULL;
+    }
+    g_cliprdr_hold = 0;
+}
+
+/*****************************************************************************/
+void
+chansrv_hold_cliprdr_data(int hold)
+{
+    g_cliprdr_hold = hold;
+    /* released from the loop, the clipboard may be inside
+       clipboard_data_in() now */
+    if (!hold && g_cliprdr_held != NULL && g_cliprdr_held->count > 0 &&
+            g_cliprdr_release_timer == NULL)
+    {
+        g_cliprdr_release_timer = reactor_add_timer(g_reactor, 0,
+                                                    cliprdr_held_release, 0);
+    }
+}
+
+/*****************************************************************************/
+/* waits for the api connection to be writable while output is queued */
+static void
+api_con_trans_update_events(struct trans *trans)
+{
+    struct xrdp_api_data *ad;
+
+    ad = (struct xrdp_api_data *) (trans->callback_data);
+    if (ad != NULL)
+    {
+        reactor_set_events(ad->source, trans->wait_s != NULL ?
+                           REACTOR_READ | REACTOR_WRITE : REACTOR_READ);
+    }
+}
+
 /*****************************************************************************/
 /* returns error */
 static int
@@ -451,7 +447,17 @@ process_message_channel_data(struct stream *s)
     {
         if (chan_id == g_cliprdr_chan_id)
         {
-            rv = clipboard_data_in(s, chan_id, chan_flags, length, total_length);
+            if (g_cliprdr_hold ||
+                    (g_cliprdr_held != NULL && g_cliprdr_held->count > 0))
+            {
+                /* behind what is already held, the order is kept */
+                rv = cliprdr_held_add(s, chan_flags, length, total_length);
+            }
+            else
+            {
+                rv = clipboard_data_in(s, chan_id, chan_flags, length,
+                                       total_length);
+            }
         }
         else if (chan_id == g_rdpsnd_chan_id)
         {
@@ -489,6 +495,7 @@ process_message_channel_data(struct stream *s)
                             {
                                 s_mark_end(ls);
                                 rv = trans_write_copy(ltran);
+                                api_con_trans_update_events(ltran);
                             }
                             break;
                         }
@@ -964,6 +971,7 @@ my_api_open_response(int chan_id, int creation_status)
     {
         return 1;
     }
+    api_con_trans_update_events(trans);
     return 0;
 }
 
@@ -999,6 +1007,7 @@ my_api_data_first(int chan_id, char *data, int bytes, int total_bytes)
     {
         return 1;
     }
+    api_con_trans_update_events(trans);
     return 0;
 }
 
@@ -1026,6 +1035,7 @@ my_api_data(int chan_id, char *data, int bytes)
     {
         return 1;
     }
+    api_con_trans_update_events(trans);
     return 0;
 }
 
@@ -1200,6 +1210,63 @@ my_trans_conn_in(struct trans *trans, struct trans *new_trans)
     return 0;
 }
 
+/*****************************************************************************/
+static void
+api_con_trans_delete(struct trans *ltran)
+{
+    int drdynvc_index;
+    struct xrdp_api_data *ad;
+
+    list_remove_item(g_api_con_trans_list,
+                     list_index_of(g_api_con_trans_list, (tintptr) ltran));
+    ad = (struct xrdp_api_data *) (ltran->callback_data);
+    if (ad->chan_flags != 0)
+    {
+        chansrv_drdynvc_close(ad->chan_id);
+    }
+    for (drdynvc_index = 0;
+            drdynvc_index < (int) ARRAYSIZE(g_drdynvcs);
+            drdynvc_index++)
+    {
+        if (g_drdynvcs[drdynvc_index].xrdp_api_trans == ltran)
+        {
+            g_drdynvcs[drdynvc_index].xrdp_api_trans = NULL;
+        }
+    }
+    reactor_remove(ad->source);
+    g_free(ad);
+    trans_delete(ltran);
+}
+
+/*****************************************************************************/
+/* called by the reactor when an api connection is ready */
+static void
+api_con_trans_ready(void *data)
+{
+    struct trans *ltran;
+
+    ltran = (struct trans *) data;
+    if (trans_check_wait_objs(ltran) != 0)
+    {
+        /* disconnect */
+        api_con_trans_delete(ltran);
+        return;
+    }
+    api_con_trans_update_events(ltran);
+}
+
+/*****************************************************************************/
+/* called by the reactor when an app connects */
+static void
+api_lis_trans_ready(void *data)
+{
+    if (trans_check_wait_objs(g_api_lis_trans) != 0)
+    {
+        LOG_DEVEL(LOG_LEVEL_ERROR, "api_lis_trans_ready: "
+                  "trans_check_wait_objs failed");
+    }
+}
+
 /*
  * called when WTSVirtualChannelOpenEx is invoked in xrdpapi.c
  *
@@ -1224,6 +1291,14 @@ my_api_trans_conn_in(struct trans *trans, struct trans *new_trans)
         LOG_DEVEL(LOG_LEVEL_ERROR, "my_api_trans_conn_in: error");
         return 1;
     }
+    ad->source = reactor_add(g_reactor, new_trans->sck, REACTOR_READ,
+                             api_con_trans_ready, new_trans);
+    if (ad->source == NULL)
+    {
+        LOG_DEVEL(LOG_LEVEL_ERROR, "my_api_trans_conn_in: error");
+        g_free(ad);
+        return 1;
+    }
     new_trans->callback_data = ad;
     list_add_item(g_api_con_trans_list, (intptr_t) new_trans);
     return 0;
@@ -1287,41 +1362,21 @@ setup_api_listen(void)
         return 1;
     }
 
-    return 0;
-}
-
-/*****************************************************************************/
-static int
-api_con_trans_list_get_wait_objs_rw(intptr_t *robjs, int *rcount,
-                                    intptr_t *wobjs, int *wcount,
-                                    int *timeout)
-{
-    int api_con_index;
-    struct trans *ltran;
-
-    for (api_con_index = g_api_con_trans_list->count - 1;
-            api_con_index >= 0;
-            api_con_index--)
+    if (reactor_add(g_reactor, g_api_lis_trans->sck, REACTOR_READ,
+                    api_lis_trans_ready, NULL) == NULL)
     {
-        ltran = (struct trans *)
-                list_get_item(g_api_con_trans_list, api_con_index);
-        if (ltran != NULL)
-        {
-            trans_get_wait_objs_rw(ltran, robjs, rcount, wobjs, wcount,
-                                   timeout);
-        }
+        return 1;
     }
+
     return 0;
 }
 
 /*****************************************************************************/
 static int
-api_con_trans_list_check_wait_objs(void)
+api_con_trans_list_remove_all(void)
 {
     int api_con_index;
-    int drdynvc_index;
     struct trans *ltran;
-    struct xrdp_api_data *ad;
 
     for (api_con_index = g_api_con_trans_list->count - 1;
             api_con_index >= 0;
@@ -1331,52 +1386,42 @@ api_con_trans_list_check_wait_objs(void)
                 list_get_item(g_api_con_trans_list, api_con_index);
         if (ltran != NULL)
         {
-            if (trans_check_wait_objs(ltran) != 0)
-            {
-                /* disconnect */
-                list_remove_item(g_api_con_trans_list, api_con_index);
-                ad = (struct xrdp_api_data *) (ltran->callback_data);
-                if (ad->chan_flags != 0)
-                {
-                    chansrv_drdynvc_close(ad->chan_id);
-                }
-                for (drdynvc_index = 0;
-                        drdynvc_index < (int) ARRAYSIZE(g_drdynvcs);
-                        drdynvc_index++)
-                {
-                    if (g_drdynvcs[drdynvc_index].xrdp_api_trans == ltran)
-                    {
-                        g_drdynvcs[drdynvc_index].xrdp_api_trans = NULL;
-                    }
-                }
-                g_free(ad);
-                trans_delete(ltran);
-            }
+            list_remove_item(g_api_con_trans_list, api_con_index);
+            reactor_remove(((struct xrdp_api_data *)
+                            (ltran->callback_data))->source);
+            g_free(ltran->callback_data);
+            trans_delete(ltran);
         }
     }
     return 0;
 }
 
 /*****************************************************************************/
+/* makes room in the wait object arrays for the fixed objects and the
+   reactor's, returns error */
 static int
-api_con_trans_list_remove_all(void)
+wait_objs_reserve(tbus **objs, tbus **wobjs, int *size)
 {
-    int api_con_index;
-    struct trans *ltran;
+    int needed;
 
-    for (api_con_index = g_api_con_trans_list->count - 1;
-            api_con_index >= 0;
-            api_con_index--)
+    needed = CHANSRV_FIXED_WAIT_OBJS + reactor_get_wait_obj_count(g_reactor);
+    if (needed <= *size)
     {
-        ltran = (struct trans *)
-                list_get_item(g_api_con_trans_list, api_con_index);
-        if (ltran != NULL)
-        {
-            list_remove_item(g_api_con_trans_list, api_con_index);
-            g_free(ltran->callback_data);
-            trans_delete(ltran);
-        }
+        return 0;
     }
+    /* some slack so a growing source count doesn't realloc every time */
+    needed += 32;
+    g_free(*objs);
+    g_free(*wobjs);
+    *objs = g_new(tbus, needed);
+    *wobjs = g_new(tbus, needed);
+    if (*objs == NULL || *wobjs == NULL)
+    {
+        LOG(LOG_LEVEL_ERROR, "wait_objs_reserve: out of memory");
+        *size = 0;
+        return 1;
+    }
+    *size = needed;
     return 0;
 }
 
@@ -1384,8 +1429,9 @@ api_con_trans_list_remove_all(void)
 THREAD_RV THREAD_CC
 channel_thread_loop(void *in_val)
 {
-    tbus objs[32];
-    tbus wobjs[32];
+    tbus *objs;
+    tbus *wobjs;
+    int objs_size;
     int num_objs;
     int num_wobjs;
     int timeout;
@@ -1394,9 +1440,25 @@ channel_thread_loop(void *in_val)
 
     LOG_DEVEL(LOG_LEVEL_INFO, "channel_thread_loop: thread start");
     rv = 0;
+    objs = NULL;
+    wobjs = NULL;
+    objs_size = 0;
     g_api_con_trans_list = list_create();
-    setup_api_listen();
-    error = setup_listen();
+    g_reactor = reactor_create();
+    if (g_reactor == NULL)
+    {
+        LOG(LOG_LEVEL_ERROR, "channel_thread_loop: reactor_create failed");
+        error = 1;
+    }
+    else
+    {
+        setup_api_listen();
+        error = setup_listen();
+    }
+    if (error == 0)
+    {
+        error = wait_objs_reserve(&objs, &wobjs, &objs_size);
+    }
 
     if (error == 0)
     {
@@ -1406,16 +1468,17 @@ channel_thread_loop(void *in_val)
         objs[num_objs] = g_term_event;
         num_objs++;
         trans_get_wait_objs(g_lis_trans, objs, &num_objs);
-        trans_get_wait_objs(g_api_lis_trans, objs, &num_objs);
+        reactor_get_wait_objs(g_reactor, objs, &num_objs,
+                              wobjs, &num_wobjs, &timeout);
 
         //g_writeln("timeout %d", timeout);
         while (g_obj_wait(objs, num_objs, wobjs, num_wobjs, timeout) == 0)
         {
-            check_timeout();
             if (g_is_wait_obj_set(g_term_event))
             {
                 LOG_DEVEL(LOG_LEVEL_INFO, "channel_thread_loop: g_term_event set");
                 clipboard_deinit();
+                cliprdr_held_clear();
                 sound_deinit();
                 devredir_deinit();
                 rail_deinit();
@@ -1438,6 +1501,7 @@ channel_thread_loop(void *in_val)
                     LOG_DEVEL(LOG_LEVEL_INFO, "channel_thread_loop: "
                               "trans_check_wait_objs error resetting");
                     clipboard_deinit();
+                    cliprdr_held_clear();
                     sound_deinit();
                     devredir_deinit();
                     rail_deinit();
@@ -1454,19 +1518,17 @@ channel_thread_loop(void *in_val)
                 }
             }
 
-            if (g_api_lis_trans != 0)
-            {
-                if (trans_check_wait_objs(g_api_lis_trans) != 0)
-                {
-                    LOG_DEVEL(LOG_LEVEL_ERROR, "channel_thread_loop: trans_check_wait_objs failed");
-                }
-            }
-            /* check the wait_objs in g_api_con_trans_list */
-            api_con_trans_list_check_wait_objs();
+            /* the api listener and connections, smartcard clients and
+               the timers */
+            reactor_check_wait_objs(g_reactor);
             xcommon_check_wait_objs();
             sound_check_wait_objs();
             devredir_check_wait_objs();
             xfuse_check_wait_objs();
+            if (wait_objs_reserve(&objs, &wobjs, &objs_size) != 0)
+            {
+                break;
+            }
             timeout = -1;
             num_objs = 0;
             num_wobjs = 0;
@@ -1476,17 +1538,12 @@ channel_thread_loop(void *in_val)
                                    wobjs, &num_wobjs, &timeout);
             trans_get_wait_objs_rw(g_con_trans, objs, &num_objs,
                                    wobjs, &num_wobjs, &timeout);
-            trans_get_wait_objs_rw(g_api_lis_trans, objs, &num_objs,
-                                   wobjs, &num_wobjs, &timeout);
-            /* get the wait_objs from in g_api_con_trans_list */
-            api_con_trans_list_get_wait_objs_rw(objs, &num_objs,
-                                                wobjs, &num_wobjs,
-                                                &timeout);
+            reactor_get_wait_objs(g_reactor, objs, &num_objs,
+                                  wobjs, &num_wobjs, &timeout);
             xcommon_get_wait_objs(objs, &num_objs, &timeout);
             sound_get_wait_objs(objs, &num_objs, &timeout);
             devredir_get_wait_objs(objs, &num_objs, &timeout);
             xfuse_get_wait_objs(objs, &num_objs, &timeout);
-            get_timeout(&timeout);
         } /* end while (g_obj_wait(objs, num_objs, 0, 0, timeout) == 0) */
     }
 
@@ -1498,6 +1555,10 @@ channel_thread_loop(void *in_val)
     g_api_lis_trans = 0;
     api_con_trans_list_remove_all();
     list_delete(g_api_con_trans_list);
+    reactor_delete(g_reactor);
+    g_reactor = 0;
+    g_free(objs);
+    g_free(wobjs);
     LOG_DEVEL(LOG_LEVEL_INFO, "channel_thread_loop: thread stop");
     g_set_wait_obj(g_thread_done_event);
     return rv;
@@ -37,7 +37,11 @@ g_is_term(void);
 int send_channel_data(int chan_id, const char *data, int size);
 int send_rail_drawing_orders(char* data, int size);
 int main_cleanup(void);
-int add_timeout(int msoffset, void (*callback)(void* data), void* data);
+/* event sources of the channel thread */
+struct reactor *chansrv_get_reactor(void);
+/* while held the cliprdr channel data is kept back from the clipboard,
+   the other channels are not held */
+void chansrv_hold_cliprdr_data(int hold);
 
 #ifndef GSET_UINT8
 #define GSET_UINT8(_ptr, _offset, _data) \
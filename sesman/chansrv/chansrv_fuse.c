@@ -155,6 +155,7 @@ void xfuse_devredir_cb_file_close(struct state_close *fip)
 #include "chansrv_xfs.h"
 #include "chansrv.h"
 #include "chansrv_config.h"
+#include "chansrv_reactor.h"
 #include "devredir.h"
 #include "list.h"
 #include "file.h"
@@ -163,9 +164,23 @@ void xfuse_devredir_cb_file_close(struct state_close *fip)
 #define EREMOTEIO EIO
 #endif
 
-#define XFUSE_ATTR_TIMEOUT      5.0
+#define XFUSE_ATTR_TIMEOUT      5.0   /* local entries */
 #define XFUSE_ENTRY_TIMEOUT     5.0
 
+/* cache of entries on a redirected drive, timeouts adapt in this range */
+#define XFUSE_CACHE_MIN_TTL_MS  1000
+#define XFUSE_CACHE_MAX_TTL_MS  32000
+#define XFUSE_NEGATIVE_COUNT    256 /* names known not to exist */
+
+/* read-ahead for files read sequentially on a redirected drive */
+#define XFUSE_RA_BLOCK_SIZE     (64 * 1024)
+#define XFUSE_RA_MAX_BLOCKS     16  /* in flight or cached per open file */
+
+/* write-behind for files written on a redirected drive */
+#define XFUSE_WB_BLOCK_SIZE     (64 * 1024)
+#define XFUSE_WB_MAX_IN_FLIGHT  4   /* write IRPs per open file */
+#define XFUSE_WB_IDLE_MS        1000 /* a partial block waits this long */
+
 
 /* Type of buffer used for fuse_add_direntry() calls */
 struct dirbuf1
@@ -182,6 +197,9 @@ struct state_dirscan
     fuse_req_t             req;   /* Original FUSE request from opendir */
     struct fuse_file_info  fi;    /* File info struct passed to opendir */
     fuse_ino_t             pinum; /* inum of parent directory           */
+    tui32                  scan_id; /* marks the entries seen           */
+    tui32                  dir_generation; /* expected for pinum        */
+    int                    changed; /* listing differs from the last    */
 };
 
 
@@ -242,6 +260,7 @@ struct state_create
 struct state_read
 {
     fuse_req_t        req;        /* Original FUSE request from lookup  */
+    struct xfuse_ra_block *block; /* read-ahead block, or NULL          */
 };
 
 /*
@@ -249,8 +268,9 @@ struct state_read
  */
 struct state_write
 {
-    fuse_req_t        req;        /* Original FUSE request from lookup  */
+    struct xfuse_handle *fh;      /* handle the write-behind belongs to */
     fuse_ino_t        inum;       /* inum of file we're writing         */
+    size_t            length;     /* bytes sent                         */
 };
 
 /*
@@ -260,6 +280,7 @@ struct state_remove
 {
     fuse_req_t        req;        /* Original FUSE request from lookup  */
     fuse_ino_t        inum;       /* inum of file we're removing        */
+    fuse_ino_t        pinum;      /* inum of parent directory           */
 };
 
 /*
@@ -297,9 +318,87 @@ struct xfuse_handle
      *       fields of this structure contain invalid values.
      */
     struct xfs_dir_handle *dir_handle;
+
+    /* read-ahead state, for redirected files */
+    off_t ra_next_off;      /* where the next sequential read starts      */
+    off_t ra_end;           /* end of the last block asked for            */
+    off_t ra_eof;           /* end of file seen by a short read, or -1    */
+    int ra_window;          /* blocks to keep ahead, 0 for random access  */
+    struct list *ra_blocks; /* struct xfuse_ra_block, by offset           */
+    struct list *ra_waiters; /* struct xfuse_ra_waiter                    */
+
+    /* write-behind state, for redirected files */
+    fuse_ino_t wb_inum;     /* inode written to                           */
+    char *wb_data;          /* writes not sent yet, XFUSE_WB_BLOCK_SIZE   */
+    off_t wb_off;           /* file offset of wb_data                     */
+    size_t wb_len;          /* bytes in wb_data                           */
+    int wb_in_flight;       /* write IRPs not answered yet                */
+    int wb_error;           /* errno of a failed write, not reported yet  */
+    int wb_running;         /* xfuse_wb_run() is on the stack             */
+    struct reactor_timer *wb_timer; /* sends a partial wb_data            */
+    struct list *wb_waiters; /* struct xfuse_wb_waiter, in arrival order  */
 };
 typedef struct xfuse_handle XFUSE_HANDLE;
 
+enum xfuse_ra_state
+{
+    XFUSE_RA_PENDING,
+    XFUSE_RA_DONE,
+    XFUSE_RA_FAILED
+};
+
+/* a range of a file asked for ahead of the kernel */
+struct xfuse_ra_block
+{
+    off_t off;
+    size_t len;               /* bytes asked for                        */
+    char *data;
+    size_t data_len;          /* bytes received, < len at end of file   */
+    enum xfuse_ra_state state;
+    XFUSE_HANDLE *fh;         /* NULL once dropped while pending        */
+};
+
+/* a kernel read waiting for pending blocks */
+struct xfuse_ra_waiter
+{
+    fuse_req_t req;
+    off_t off;
+    size_t size;
+};
+
+enum xfuse_wb_op
+{
+    XFUSE_WB_WRITE,
+    XFUSE_WB_READ,
+    XFUSE_WB_SETATTR,
+    XFUSE_WB_FLUSH,
+    XFUSE_WB_RELEASE
+};
+
+/* a request on a handle that has to wait for the writes before it */
+struct xfuse_wb_waiter
+{
+    enum xfuse_wb_op op;
+    fuse_req_t req;
+    fuse_ino_t ino;
+    off_t off;
+    size_t size;
+    char *data;               /* XFUSE_WB_WRITE                         */
+    struct stat attr;         /* XFUSE_WB_SETATTR                       */
+    int to_set;
+    struct fuse_file_info fi; /* XFUSE_WB_RELEASE                       */
+};
+
+/* a name the client reported missing from a directory */
+struct xfuse_negative
+{
+    fuse_ino_t pinum;
+    tui32 generation;         /* of the directory inode                 */
+    tui32 dir_generation;     /* of the directory entries               */
+    tui64 until;
+    char name[XFS_MAXFILENAMELEN + 1];
+};
+
 /* used for file data request sent to client */
 struct req_list_item
 {
@@ -319,6 +418,9 @@ static char *g_mount_point = 0;              /* our FUSE mount point        */
 static struct fuse_lowlevel_ops g_xfuse_ops; /* setup FUSE callbacks        */
 static int g_xfuse_inited = 0;               /* true when FUSE is inited    */
 static struct fuse_chan *g_ch = 0;
+static struct xfuse_negative g_negative[XFUSE_NEGATIVE_COUNT];
+static int g_negative_next = 0;
+static tui32 g_scan_id = 0;
 static struct fuse_session *g_se = 0;
 static char *g_buffer = 0;
 static int g_fd = 0;
@@ -365,84 +467,929 @@ static void xfuse_cb_open(fuse_req_t req, fuse_ino_t ino,
 static void xfuse_cb_release(fuse_req_t req, fuse_ino_t ino, struct
                              fuse_file_info *fi);
 
+/* this is not a callback, but it's used by xfuse_cb_release() */
+static void xfuse_release_redirected(fuse_req_t req, fuse_ino_t ino,
+                                     struct fuse_file_info *fi,
+                                     XFUSE_HANDLE *handle);
+
+static void xfuse_cb_flush(fuse_req_t req, fuse_ino_t ino,
+                           struct fuse_file_info *fi);
+
 static void xfuse_cb_read(fuse_req_t req, fuse_ino_t ino, size_t size,
                           off_t off, struct fuse_file_info *fi);
 
 static void xfuse_cb_write(fuse_req_t req, fuse_ino_t ino, const char *buf,
                            size_t size, off_t off, struct fuse_file_info *fi);
 
-static void xfuse_cb_create(fuse_req_t req, fuse_ino_t parent,
-                            const char *name, mode_t mode,
-                            struct fuse_file_info *fi);
+static void xfuse_cb_create(fuse_req_t req, fuse_ino_t parent,
+                            const char *name, mode_t mode,
+                            struct fuse_file_info *fi);
+
+static void xfuse_cb_fsync(fuse_req_t req, fuse_ino_t ino, int datasync,
+                           struct fuse_file_info *fi);
+
+static void xfuse_cb_setattr(fuse_req_t req, fuse_ino_t ino, struct stat *attr,
+                             int to_set, struct fuse_file_info *fi);
+
+static void xfuse_cb_opendir(fuse_req_t req, fuse_ino_t ino,
+                             struct fuse_file_info *fi);
+
+static void xfuse_cb_releasedir(fuse_req_t req, fuse_ino_t ino,
+                                struct fuse_file_info *fi);
+
+/* miscellaneous functions */
+static void xfs_inode_to_fuse_entry_param(const XFS_INODE *xinode,
+        struct fuse_entry_param *e);
+static void make_fuse_entry_reply(fuse_req_t req, const XFS_INODE *xinode);
+static void make_fuse_attr_reply(fuse_req_t req, const XFS_INODE *xinode);
+static const char *filename_on_device(const char *full_path);
+static void update_inode_file_attributes(const struct file_attr *fattr,
+        tui32 change_mask, XFS_INODE *xinode);
+static char *get_name_for_entry_in_parent(fuse_ino_t parent, const char *name);
+static unsigned int format_user_info(char *dest, unsigned int len,
+                                     const char *format);
+static void xfuse_ra_reset(XFUSE_HANDLE *fh);
+static void xfuse_wb_drop_waiters(XFUSE_HANDLE *fh);
+
+/*****************************************************************************/
+int
+load_fuse_config(void)
+{
+    return 0;
+}
+
+/*****************************************************************************/
+XFUSE_HANDLE *
+xfuse_handle_create()
+{
+    XFUSE_HANDLE *self = g_new0(XFUSE_HANDLE, 1);
+
+    if (self != NULL)
+    {
+        self->ra_eof = -1;
+    }
+    return self;
+}
+
+/*****************************************************************************/
+void
+xfuse_handle_delete(XFUSE_HANDLE *self)
+{
+    if (self == NULL)
+    {
+        return;
+    }
+
+    if (self->dir_handle != NULL)
+    {
+        free(self->dir_handle);
+    }
+    if (self->ra_blocks != NULL)
+    {
+        xfuse_ra_reset(self);
+        list_delete(self->ra_blocks);
+        list_delete(self->ra_waiters);
+    }
+    if (self->wb_timer != NULL)
+    {
+        reactor_cancel_timer(self->wb_timer);
+    }
+    if (self->wb_waiters != NULL)
+    {
+        xfuse_wb_drop_waiters(self);
+        list_delete(self->wb_waiters);
+    }
+    free(self->wb_data);
+    free(self);
+}
+
+/*****************************************************************************/
+uint64_t
+xfuse_handle_to_fuse_handle(XFUSE_HANDLE *self)
+{
+    return (uint64_t) (tintptr) self;
+}
+
+/*****************************************************************************/
+XFUSE_HANDLE *
+xfuse_handle_from_fuse_handle(uint64_t handle)
+{
+    return (XFUSE_HANDLE *) (tintptr) handle;
+}
+
+/*****************************************************************************
+**                                                                          **
+**         read-ahead for redirected files                                  **
+**                                                                          **
+**  A file read sequentially gets blocks after the kernel's offset asked    **
+**  for ahead of time, the window doubles with every sequential read up to  **
+**  XFUSE_RA_MAX_BLOCKS. Kernel reads covered by blocks are answered from   **
+**  them, or wait for them to arrive. A read elsewhere drops the blocks     **
+**  and falls back to one IRP_MJ_READ per kernel read.                      **
+**                                                                          **
+*****************************************************************************/
+
+/*****************************************************************************/
+/* sends the kernel read to the client as it is */
+static void
+xfuse_ra_direct_read(XFUSE_HANDLE *fh, fuse_req_t req, size_t size, off_t off)
+{
+    struct state_read *fusep;
+
+    fusep = g_new0(struct state_read, 1);
+    if (fusep == NULL)
+    {
+        LOG_DEVEL(LOG_LEVEL_ERROR, "system out of memory");
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+    fusep->req = req;
+
+    /*
+     * If this call succeeds, further request processing happens in
+     * xfuse_devredir_cb_read_file()
+     */
+    devredir_file_read(fusep, fh->DeviceId, fh->FileId, size, off);
+}
+
+/*****************************************************************************/
+static void
+xfuse_ra_block_free(struct xfuse_ra_block *block)
+{
+    free(block->data);
+    free(block);
+}
+
+/*****************************************************************************/
+/* a block still pending is freed when its data arrives */
+static void
+xfuse_ra_block_drop(struct xfuse_ra_block *block)
+{
+    if (block->state == XFUSE_RA_PENDING)
+    {
+        block->fh = NULL;
+    }
+    else
+    {
+        xfuse_ra_block_free(block);
+    }
+}
+
+/*****************************************************************************/
+/* the block holding off, or NULL */
+static struct xfuse_ra_block *
+xfuse_ra_find(XFUSE_HANDLE *fh, off_t off)
+{
+    struct xfuse_ra_block *block;
+    int index;
+
+    if (fh->ra_blocks == NULL)
+    {
+        return NULL;
+    }
+    for (index = 0; index < fh->ra_blocks->count; index++)
+    {
+        block = (struct xfuse_ra_block *) list_get_item(fh->ra_blocks, index);
+        if (off >= block->off && off < block->off + (off_t) block->len)
+        {
+            return block;
+        }
+    }
+    return NULL;
+}
+
+/*****************************************************************************/
+/* answers a kernel read from the blocks
+   returns 1 if answered, 0 if it has to wait for pending blocks, -1 if the
+   blocks don't cover it */
+static int
+xfuse_ra_serve(XFUSE_HANDLE *fh, fuse_req_t req, size_t size, off_t off)
+{
+    struct xfuse_ra_block *block;
+    struct iovec *iov;
+    off_t pos;
+    off_t end;
+    off_t avail;
+    int count;
+    int wait;
+
+    /* first pass, check the whole range is there */
+    wait = 0;
+    count = 0;
+    end = off + (off_t) size;
+    for (pos = off; pos < end; pos = block->off + (off_t) block->len)
+    {
+        block = xfuse_ra_find(fh, pos);
+        if (block == NULL || block->state == XFUSE_RA_FAILED)
+        {
+            return -1;
+        }
+        if (block->state == XFUSE_RA_PENDING)
+        {
+            wait = 1;
+            continue;
+        }
+        count++;
+        if (block->data_len < block->len)
+        {
+            /* end of file */
+            break;
+        }
+    }
+    if (wait)
+    {
+        return 0;
+    }
+
+    /* second pass, reply without copying */
+    iov = g_new(struct iovec, count + 1);
+    if (iov == NULL)
+    {
+        return -1;
+    }
+    count = 0;
+    for (pos = off; pos < end; pos = block->off + (off_t) block->len)
+    {
+        block = xfuse_ra_find(fh, pos);
+        avail = block->off + (off_t) block->data_len;
+        if (avail > end)
+        {
+            avail = end;
+        }
+        if (avail > pos)
+        {
+            iov[count].iov_base = block->data + (pos - block->off);
+            iov[count].iov_len = (size_t) (avail - pos);
+            count++;
+        }
+        if (block->data_len < block->len)
+        {
+            break;
+        }
+    }
+    fuse_reply_iov(req, iov, count);
+    free(iov);
+    return 1;
+}
+
+/*****************************************************************************/
+/* drops the blocks, waiting kernel reads are sent to the client */
+static void
+xfuse_ra_reset(XFUSE_HANDLE *fh)
+{
+    struct xfuse_ra_waiter *waiter;
+    int index;
+
+    if (fh->ra_blocks == NULL)
+    {
+        return;
+    }
+    for (index = 0; index < fh->ra_blocks->count; index++)
+    {
+        xfuse_ra_block_drop((struct xfuse_ra_block *)
+                            list_get_item(fh->ra_blocks, index));
+    }
+    list_clear(fh->ra_blocks);
+    for (index = 0; index < fh->ra_waiters->count; index++)
+    {
+        waiter = (struct xfuse_ra_waiter *)
+                 list_get_item(fh->ra_waiters, index);
+        xfuse_ra_direct_read(fh, waiter->req, waiter->size, waiter->off);
+        free(waiter);
+    }
+    list_clear(fh->ra_waiters);
+    fh->ra_end = 0;
+    fh->ra_eof = -1;
+    fh->ra_window = 0;
+}
+
+/*****************************************************************************/
+/* frees the blocks the kernel has read past and asks for new ones up to
+   the window */
+static void
+xfuse_ra_fill(XFUSE_HANDLE *fh)
+{
+    struct xfuse_ra_block *block;
+    struct state_read *fusep;
+    off_t limit;
+
+    while (fh->ra_blocks->count > 0)
+    {
+        block = (struct xfuse_ra_block *) list_get_item(fh->ra_blocks, 0);
+        if (block->off + (off_t) block->len > fh->ra_next_off ||
+                block->state == XFUSE_RA_PENDING)
+        {
+            break;
+        }
+        xfuse_ra_block_free(block);
+        list_remove_item(fh->ra_blocks, 0);
+    }
+
+    if (fh->ra_end < fh->ra_next_off)
+    {
+        fh->ra_end = fh->ra_next_off;
+    }
+    limit = fh->ra_next_off + (off_t) fh->ra_window * XFUSE_RA_BLOCK_SIZE;
+    if (fh->ra_eof >= 0 && limit > fh->ra_eof)
+    {
+        limit = fh->ra_eof;
+    }
+    while (fh->ra_end < limit && fh->ra_blocks->count < XFUSE_RA_MAX_BLOCKS)
+    {
+        block = g_new0(struct xfuse_ra_block, 1);
+        fusep = g_new0(struct state_read, 1);
+        if (block == NULL || fusep == NULL)
+        {
+            free(block);
+            free(fusep);
+            break;
+        }
+        block->off = fh->ra_end;
+        block->len = XFUSE_RA_BLOCK_SIZE;
+        block->state = XFUSE_RA_PENDING;
+        block->fh = fh;
+        fusep->block = block;
+        list_add_item(fh->ra_blocks, (tintptr) block);
+        fh->ra_end += XFUSE_RA_BLOCK_SIZE;
+        devredir_file_read(fusep, fh->DeviceId, fh->FileId,
+                           block->len, block->off);
+    }
+}
+
+/*****************************************************************************/
+/* a kernel read of a redirected file */
+static void
+xfuse_ra_read(XFUSE_HANDLE *fh, fuse_req_t req, size_t size, off_t off)
+{
+    struct xfuse_ra_waiter *waiter;
+    int rv;
+
+    if (fh->ra_blocks == NULL)
+    {
+        fh->ra_blocks = list_create();
+        fh->ra_waiters = list_create();
+        if (fh->ra_blocks == NULL || fh->ra_waiters == NULL)
+        {
+            list_delete(fh->ra_blocks);
+            list_delete(fh->ra_waiters);
+            fh->ra_blocks = NULL;
+            fh->ra_waiters = NULL;
+            xfuse_ra_direct_read(fh, req, size, off);
+            return;
+        }
+    }
+
+    /* the kernel can have a few sequential reads out of order */
+    if (off != fh->ra_next_off && xfuse_ra_find(fh, off) == NULL)
+    {
+        xfuse_ra_reset(fh);
+    }
+    else if (fh->ra_window < XFUSE_RA_MAX_BLOCKS)
+    {
+        fh->ra_window = fh->ra_window == 0 ? 2 : fh->ra_window * 2;
+    }
+    if (off + (off_t) size > fh->ra_next_off)
+    {
+        fh->ra_next_off = off + (off_t) size;
+    }
+
+    rv = xfuse_ra_serve(fh, req, size, off);
+    if (rv == 0)
+    {
+        waiter = g_new0(struct xfuse_ra_waiter, 1);
+        if (waiter == NULL)
+        {
+            rv = -1;
+        }
+        else
+        {
+            waiter->req = req;
+            waiter->off = off;
+            waiter->size = size;
+            list_add_item(fh->ra_waiters, (tintptr) waiter);
+        }
+    }
+    if (rv < 0)
+    {
+        xfuse_ra_direct_read(fh, req, size, off);
+    }
+    xfuse_ra_fill(fh);
+}
+
+/*****************************************************************************/
+/* data for a read-ahead block arrived */
+static void
+xfuse_ra_block_done(struct xfuse_ra_block *block, enum NTSTATUS IoStatus,
+                    const char *buf, size_t length)
+{
+    XFUSE_HANDLE *fh;
+    struct xfuse_ra_waiter *waiter;
+    int index;
+    int rv;
+
+    fh = block->fh;
+    if (fh == NULL)
+    {
+        /* dropped while pending */
+        xfuse_ra_block_free(block);
+        return;
+    }
+    block->state = XFUSE_RA_FAILED;
+    if (IoStatus == STATUS_SUCCESS && length <= block->len)
+    {
+        block->data = (char *) g_malloc(length > 0 ? length : 1, 0);
+        if (block->data != NULL)
+        {
+            g_memcpy(block->data, buf, length);
+            block->data_len = length;
+            block->state = XFUSE_RA_DONE;
+            if (length < block->len)
+            {
+                fh->ra_eof = block->off + (off_t) length;
+            }
+        }
+    }
+
+    for (index = fh->ra_waiters->count - 1; index >= 0; index--)
+    {
+        waiter = (struct xfuse_ra_waiter *)
+                 list_get_item(fh->ra_waiters, index);
+        rv = xfuse_ra_serve(fh, waiter->req, waiter->size, waiter->off);
+        if (rv < 0)
+        {
+            xfuse_ra_direct_read(fh, waiter->req, waiter->size, waiter->off);
+        }
+        if (rv != 0)
+        {
+            free(waiter);
+            list_remove_item(fh->ra_waiters, index);
+        }
+    }
+    xfuse_ra_fill(fh);
+}
+
+/*****************************************************************************
+**                                                                          **
+**         write-behind for redirected files                                **
+**                                                                          **
+**  Contiguous writes are gathered in a block of XFUSE_WB_BLOCK_SIZE and    **
+**  answered at once, a full block goes to the client as one               **
+**  IRP_MJ_WRITE with up to XFUSE_WB_MAX_IN_FLIGHT of them outstanding.     **
+**  Other requests on the handle wait for the writes before them. A failed  **
+**  write fails the later writes and is reported by the next flush or       **
+**  fsync, so close() sees it.                                              **
+**                                                                          **
+*****************************************************************************/
+
+/*****************************************************************************/
+/* true if the handle has writes not answered by the client */
+static int
+xfuse_wb_busy(XFUSE_HANDLE *fh)
+{
+    return fh->wb_len > 0 || fh->wb_in_flight > 0 ||
+           (fh->wb_waiters != NULL && fh->wb_waiters->count > 0);
+}
+
+/*****************************************************************************/
+/* sends len bytes at off as one IRP_MJ_WRITE */
+static void
+xfuse_wb_send_irp(XFUSE_HANDLE *fh, const char *buf, size_t len, off_t off)
+{
+    struct state_write *fusep;
+
+    fusep = g_new0(struct state_write, 1);
+    if (fusep == NULL)
+    {
+        LOG_DEVEL(LOG_LEVEL_ERROR, "system out of memory");
+        if (fh->wb_error == 0)
+        {
+            fh->wb_error = ENOMEM;
+        }
+        return;
+    }
+    fusep->fh = fh;
+    fusep->inum = fh->wb_inum;
+    fusep->length = len;
+    fh->wb_in_flight++;
+
+    /*
+     * If this call succeeds, further request processing happens in
+     * xfuse_devredir_cb_write_file()
+     */
+    devredir_file_write(fusep, fh->DeviceId, fh->FileId, buf, (int) len, off);
+}
+
+/*****************************************************************************/
+/* sends the gathered writes */
+static void
+xfuse_wb_send(XFUSE_HANDLE *fh)
+{
+    size_t len;
+
+    if (fh->wb_timer != NULL)
+    {
+        reactor_cancel_timer(fh->wb_timer);
+        fh->wb_timer = NULL;
+    }
+    if (fh->wb_len > 0)
+    {
+        len = fh->wb_len;
+        fh->wb_len = 0;
+        xfuse_wb_send_irp(fh, fh->wb_data, len, fh->wb_off);
+    }
+}
+
+/*****************************************************************************/
+/* no more writes came, send what is there */
+static void
+xfuse_wb_timer_proc(void *data)
+{
+    XFUSE_HANDLE *fh = (XFUSE_HANDLE *) data;
+
+    fh->wb_timer = NULL;
+    if (fh->wb_in_flight < XFUSE_WB_MAX_IN_FLIGHT)
+    {
+        xfuse_wb_send(fh);
+    }
+    /* else it goes once a write is answered */
+}
+
+/*****************************************************************************/
+/* takes a kernel write
+   returns 1 if it can be answered, 0 if it has to wait for a write IRP */
+static int
+xfuse_wb_accept(XFUSE_HANDLE *fh, const char *buf, size_t size, off_t off)
+{
+    if (fh->wb_len > 0 &&
+            (off != fh->wb_off + (off_t) fh->wb_len ||
+             fh->wb_len + size > XFUSE_WB_BLOCK_SIZE))
+    {
+        if (fh->wb_in_flight >= XFUSE_WB_MAX_IN_FLIGHT)
+        {
+            return 0;
+        }
+        xfuse_wb_send(fh);
+    }
+    if (size >= XFUSE_WB_BLOCK_SIZE ||
+            (fh->wb_data == NULL &&
+             (fh->wb_data = (char *) g_malloc(XFUSE_WB_BLOCK_SIZE, 0)) == NULL))
+    {
+        /* large enough as it is, or nowhere to gather it */
+        if (fh->wb_in_flight >= XFUSE_WB_MAX_IN_FLIGHT)
+        {
+            return 0;
+        }
+        xfuse_wb_send_irp(fh, buf, size, off);
+        return 1;
+    }
+    if (fh->wb_len == 0)
+    {
+        fh->wb_off = off;
+    }
+    g_memcpy(fh->wb_data + fh->wb_len, buf, size);
+    fh->wb_len += size;
+    if (fh->wb_len == XFUSE_WB_BLOCK_SIZE &&
+            fh->wb_in_flight < XFUSE_WB_MAX_IN_FLIGHT)
+    {
+        xfuse_wb_send(fh);
+    }
+    else if (fh->wb_len > 0 && fh->wb_timer == NULL)
+    {
+        fh->wb_timer = reactor_add_timer(chansrv_get_reactor(),
+                                         XFUSE_WB_IDLE_MS,
+                                         xfuse_wb_timer_proc, fh);
+    }
+    return 1;
+}
+
+/*****************************************************************************/
+/* queues a request behind the writes, returns NULL if out of memory */
+static struct xfuse_wb_waiter *
+xfuse_wb_add_waiter(XFUSE_HANDLE *fh, enum xfuse_wb_op op,
+                    fuse_req_t req, fuse_ino_t ino)
+{
+    struct xfuse_wb_waiter *waiter;
+
+    if (fh->wb_waiters == NULL && (fh->wb_waiters = list_create()) == NULL)
+    {
+        return NULL;
+    }
+    waiter = g_new0(struct xfuse_wb_waiter, 1);
+    if (waiter != NULL)
+    {
+        waiter->op = op;
+        waiter->req = req;
+        waiter->ino = ino;
+        list_add_item(fh->wb_waiters, (tintptr) waiter);
+    }
+    return waiter;
+}
+
+/*****************************************************************************/
+/* answers the queued requests whose writes are done
+   the handle is freed if a release was queued */
+static void
+xfuse_wb_run(XFUSE_HANDLE *fh)
+{
+    struct xfuse_wb_waiter *waiter;
+
+    if (fh->wb_running)
+    {
+        /* the caller up the stack carries on */
+        return;
+    }
+    fh->wb_running = 1;
+    if (fh->wb_in_flight < XFUSE_WB_MAX_IN_FLIGHT &&
+            (fh->wb_len == XFUSE_WB_BLOCK_SIZE ||
+             (fh->wb_len > 0 && fh->wb_timer == NULL)))
+    {
+        xfuse_wb_send(fh);
+    }
+    while (fh->wb_waiters != NULL && fh->wb_waiters->count > 0)
+    {
+        waiter = (struct xfuse_wb_waiter *) list_get_item(fh->wb_waiters, 0);
+        if (waiter->op == XFUSE_WB_WRITE)
+        {
+            if (fh->wb_error != 0)
+            {
+                fuse_reply_err(waiter->req, fh->wb_error);
+            }
+            else if (xfuse_wb_accept(fh, waiter->data, waiter->size,
+                                     waiter->off))
+            {
+                fuse_reply_write(waiter->req, waiter->size);
+            }
+            else
+            {
+                break;
+            }
+        }
+        else
+        {
+            /* everything written before it has to be answered first */
+            if (fh->wb_len > 0 && fh->wb_in_flight < XFUSE_WB_MAX_IN_FLIGHT)
+            {
+                xfuse_wb_send(fh);
+            }
+            if (fh->wb_len > 0 || fh->wb_in_flight > 0)
+            {
+                break;
+            }
+        }
+        list_remove_item(fh->wb_waiters, 0);
+
+        switch (waiter->op)
+        {
+            case XFUSE_WB_READ:
+                xfuse_ra_read(fh, waiter->req, waiter->size, waiter->off);
+                break;
+
+            case XFUSE_WB_SETATTR:
+                xfuse_cb_setattr(waiter->req, waiter->ino, &waiter->attr,
+                                 waiter->to_set, NULL);
+                break;
+
+            case XFUSE_WB_FLUSH:
+                fuse_reply_err(waiter->req, fh->wb_error);
+                fh->wb_error = 0;
+                break;
+
+            case XFUSE_WB_RELEASE:
+                /* nothing comes after a release */
+                xfuse_release_redirected(waiter->req, waiter->ino,
+                                         &waiter->fi, fh);
+                free(waiter);
+                return;
+
+            default:
+                break;
+        }
+        free(waiter->data);
+        free(waiter);
+    }
+    fh->wb_running = 0;
+}
+
+/*****************************************************************************/
+/* a write IRP was answered */
+static void
+xfuse_wb_done(XFUSE_HANDLE *fh, enum NTSTATUS IoStatus,
+              size_t sent, size_t written)
+{
+    fh->wb_in_flight--;
+    if (IoStatus != STATUS_SUCCESS || written != sent)
+    {
+        LOG_DEVEL(LOG_LEVEL_ERROR, "Write NTSTATUS is %d, %zd of %zd bytes",
+                  (int) IoStatus, written, sent);
+        if (fh->wb_error == 0)
+        {
+            fh->wb_error = (IoStatus == STATUS_DISK_FULL) ? ENOSPC : EIO;
+        }
+    }
+    xfuse_wb_run(fh);
+}
+
+/*****************************************************************************/
+/* a handle freed with requests still queued */
+static void
+xfuse_wb_drop_waiters(XFUSE_HANDLE *fh)
+{
+    struct xfuse_wb_waiter *waiter;
+    int index;
 
-#if 0
-static void xfuse_cb_fsync(fuse_req_t req, fuse_ino_t ino, int datasync,
-                           struct fuse_file_info *fi);
-#endif
+    for (index = 0; index < fh->wb_waiters->count; index++)
+    {
+        waiter = (struct xfuse_wb_waiter *)
+                 list_get_item(fh->wb_waiters, index);
+        fuse_reply_err(waiter->req, EBADF);
+        free(waiter->data);
+        free(waiter);
+    }
+    list_clear(fh->wb_waiters);
+}
 
-static void xfuse_cb_setattr(fuse_req_t req, fuse_ino_t ino, struct stat *attr,
-                             int to_set, struct fuse_file_info *fi);
+/*****************************************************************************
+**                                                                          **
+**         entry and attribute cache for redirected drives                  **
+**                                                                          **
+**  Entries are trusted for their own timeout, which doubles each time the  **
+**  client reports them unchanged and drops back when they change. The      **
+**  same timeout is given to the kernel. A directory listing is kept while  **
+**  the directory's generation is the one listed, so it answers opendir()   **
+**  and lookups of names which aren't there without asking the client.      **
+**  Names the client reported missing are kept in a small ring as well.     **
+**                                                                          **
+*****************************************************************************/
 
-static void xfuse_cb_opendir(fuse_req_t req, fuse_ino_t ino,
-                             struct fuse_file_info *fi);
+/*****************************************************************************/
+static int
+xfuse_cache_next_ttl(int ttl_ms, int changed)
+{
+    if (changed || ttl_ms < XFUSE_CACHE_MIN_TTL_MS)
+    {
+        return XFUSE_CACHE_MIN_TTL_MS;
+    }
+    return (ttl_ms * 2 > XFUSE_CACHE_MAX_TTL_MS) ?
+           XFUSE_CACHE_MAX_TTL_MS : ttl_ms * 2;
+}
 
-static void xfuse_cb_releasedir(fuse_req_t req, fuse_ino_t ino,
-                                struct fuse_file_info *fi);
+/*****************************************************************************/
+/* the client reported the attributes, changed or not */
+static void
+xfuse_cache_update(XFS_INODE *xinode, int changed)
+{
+    xinode->cache_ttl_ms = xfuse_cache_next_ttl(xinode->cache_ttl_ms, changed);
+    xinode->cache_until = g_time4() + (tui64) xinode->cache_ttl_ms * 1000;
+    if (changed && (xinode->mode & S_IFDIR) != 0)
+    {
+        /* the entries have probably changed too */
+        xinode->snap_until = 0;
+    }
+}
 
-/* miscellaneous functions */
-static void xfs_inode_to_fuse_entry_param(const XFS_INODE *xinode,
-        struct fuse_entry_param *e);
-static void make_fuse_entry_reply(fuse_req_t req, const XFS_INODE *xinode);
-static void make_fuse_attr_reply(fuse_req_t req, const XFS_INODE *xinode);
-static const char *filename_on_device(const char *full_path);
-static void update_inode_file_attributes(const struct file_attr *fattr,
-        tui32 change_mask, XFS_INODE *xinode);
-static char *get_name_for_entry_in_parent(fuse_ino_t parent, const char *name);
-static unsigned int format_user_info(char *dest, unsigned int len,
-                                     const char *format);
+/*****************************************************************************/
+/* a change made through us, the next lookup asks the client again */
+static void
+xfuse_cache_expire(XFS_INODE *xinode)
+{
+    xinode->cache_ttl_ms = 0;
+    xinode->cache_until = 0;
+}
 
 /*****************************************************************************/
-int
-load_fuse_config(void)
+/* the timeout given to the kernel for a ttl which may not be set yet */
+static double
+xfuse_cache_seconds(int ttl_ms)
 {
-    return 0;
+    return (ttl_ms < XFUSE_CACHE_MIN_TTL_MS ?
+            XFUSE_CACHE_MIN_TTL_MS : ttl_ms) / 1000.0;
 }
 
 /*****************************************************************************/
-XFUSE_HANDLE *
-xfuse_handle_create()
+static double
+xfuse_cache_timeout(const XFS_INODE *xinode, double local_timeout)
 {
-    return g_new0(XFUSE_HANDLE, 1);
+    return xinode->is_redirected ?
+           xfuse_cache_seconds(xinode->cache_ttl_ms) : local_timeout;
 }
 
 /*****************************************************************************/
-void
-xfuse_handle_delete(XFUSE_HANDLE *self)
+/* true if the attributes from the client differ from ours */
+static int
+xfuse_cache_attr_differ(const struct file_attr *fattr,
+                        const XFS_INODE *xinode)
+{
+    return fattr->mode != xinode->mode ||
+           fattr->size != xinode->size ||
+           fattr->mtime != xinode->mtime;
+}
+
+/*****************************************************************************/
+/* drops the kernel's copy of the attributes, which may have a long
+   timeout. The page cache is left alone, it is dropped on each open anyway
+   and invalidating it could wait on a page locked by a read we have yet to
+   answer */
+static void
+xfuse_cache_notify_attr(const XFS_INODE *xinode)
 {
-    if (self == NULL)
+    if (g_ch != 0)
     {
-        return;
+        fuse_lowlevel_notify_inval_inode(g_ch, xinode->inum, -1, 0);
     }
+}
 
-    if (self->dir_handle != NULL)
+/*****************************************************************************/
+/* true if the last listing of the directory has all its entries */
+static int
+xfuse_snapshot_valid(const XFS_INODE *dir)
+{
+    return dir->snap_until > g_time4() &&
+           dir->snap_generation == dir->dir_generation;
+}
+
+/*****************************************************************************/
+/* called before a change the client has confirmed is applied to the
+   directory, returns a value for xfuse_snapshot_follow() */
+static int
+xfuse_snapshot_hold(fuse_ino_t dir_inum)
+{
+    XFS_INODE *dir = xfs_get(g_xfs, dir_inum);
+
+    return dir != NULL && xfuse_snapshot_valid(dir);
+}
+
+/*****************************************************************************/
+/* the change is in the listing now, and the directory was modified */
+static void
+xfuse_snapshot_follow(fuse_ino_t dir_inum, int held)
+{
+    XFS_INODE *dir = xfs_get(g_xfs, dir_inum);
+
+    if (dir != NULL)
     {
-        free(self->dir_handle);
+        if (held)
+        {
+            dir->snap_generation = dir->dir_generation;
+        }
+        dir->mtime = time(0);
+        dir->ctime = dir->mtime;
+        xfuse_cache_notify_attr(dir);
     }
-    free(self);
 }
 
 /*****************************************************************************/
-uint64_t
-xfuse_handle_to_fuse_handle(XFUSE_HANDLE *self)
+/* remembers that the client has no name in dir */
+static void
+xfuse_negative_add(const XFS_INODE *dir, const char *name)
+{
+    struct xfuse_negative *neg;
+
+    neg = &g_negative[g_negative_next];
+    g_negative_next = (g_negative_next + 1) % XFUSE_NEGATIVE_COUNT;
+    neg->pinum = dir->inum;
+    neg->generation = dir->generation;
+    neg->dir_generation = dir->dir_generation;
+    neg->until = g_time4() +
+                 (tui64) (xfuse_cache_seconds(dir->snap_ttl_ms) * 1000000);
+    g_strncpy(neg->name, name, sizeof(neg->name) - 1);
+}
+
+/*****************************************************************************/
+/* true if the client had no name in dir, and nothing changed since */
+static int
+xfuse_negative_find(const XFS_INODE *dir, const char *name)
 {
-    return (uint64_t) (tintptr) self;
+    const struct xfuse_negative *neg;
+    tui64 now;
+    int index;
+
+    now = g_time4();
+    for (index = 0; index < XFUSE_NEGATIVE_COUNT; index++)
+    {
+        neg = &g_negative[index];
+        if (neg->pinum == dir->inum &&
+                neg->generation == dir->generation &&
+                neg->dir_generation == dir->dir_generation &&
+                neg->until > now &&
+                xfs_names_match(dir, neg->name, name))
+        {
+            return 1;
+        }
+    }
+    return 0;
 }
 
 /*****************************************************************************/
-XFUSE_HANDLE *
-xfuse_handle_from_fuse_handle(uint64_t handle)
+/* the kernel keeps a negative entry for the directory's timeout */
+static void
+make_fuse_negative_entry_reply(fuse_req_t req, const XFS_INODE *dir)
 {
-    return (XFUSE_HANDLE *) (tintptr) handle;
+    struct fuse_entry_param e;
+
+    memset(&e, 0, sizeof(e));
+    e.ino = 0;
+    e.entry_timeout = xfuse_cache_seconds(dir->snap_ttl_ms);
+    fuse_reply_entry(req, &e);
 }
 
 /*****************************************************************************
@@ -536,11 +1483,12 @@ xfuse_init(void)
     g_xfuse_ops.unlink      = xfuse_cb_unlink;
     g_xfuse_ops.rename      = xfuse_cb_rename;
     g_xfuse_ops.open        = xfuse_cb_open;
+    g_xfuse_ops.flush       = xfuse_cb_flush;
     g_xfuse_ops.release     = xfuse_cb_release;
     g_xfuse_ops.read        = xfuse_cb_read;
     g_xfuse_ops.write       = xfuse_cb_write;
     g_xfuse_ops.create      = xfuse_cb_create;
-    //g_xfuse_ops.fsync     = xfuse_cb_fsync; /* LK_TODO delete this */
+    g_xfuse_ops.fsync       = xfuse_cb_fsync;
     g_xfuse_ops.getattr     = xfuse_cb_getattr;
     g_xfuse_ops.setattr     = xfuse_cb_setattr;
     g_xfuse_ops.opendir     = xfuse_cb_opendir;
@@ -949,7 +1897,8 @@ static int xfuse_deinit_xrdp_fs(void)
  * Add a file or directory to xrdp file system as part of a
  * directory request
  *
- * If the file or directory already exists, no changes are made to it.
+ * If the file or directory already exists and isn't open, its attributes
+ * are updated.
  *****************************************************************************/
 
 void xfuse_devredir_cb_enum_dir_add_entry(
@@ -958,8 +1907,11 @@ void xfuse_devredir_cb_enum_dir_add_entry(
     const struct file_attr *fattr)
 {
     XFS_INODE *xinode = NULL;
+    XFS_INODE *parent_xinode;
+    int ours;
+    int changed;
 
-    if (!xfs_get(g_xfs, fip->pinum))
+    if ((parent_xinode = xfs_get(g_xfs, fip->pinum)) == NULL)
     {
         LOG_DEVEL(LOG_LEVEL_ERROR, "inode %ld is not valid", fip->pinum);
     }
@@ -973,8 +1925,9 @@ void xfuse_devredir_cb_enum_dir_add_entry(
         LOG_DEVEL(LOG_LEVEL_DEBUG, "parent_inode=%ld name=%s", fip->pinum, name);
 
         /* Does the file already exist ? If it does it's important we
-         * don't mess with it, as we're only enumerating the directory, and
-         * we don't want to disrupt any existing operations on the file
+         * don't mess with it if it's open, as we're only enumerating the
+         * directory, and we don't want to disrupt any existing operations
+         * on the file
          */
         xinode = xfs_lookup_in_dir(g_xfs, fip->pinum, name);
         if (xinode == NULL)
@@ -982,6 +1935,7 @@ void xfuse_devredir_cb_enum_dir_add_entry(
             /* Add a new node to the file system */
             LOG_DEVEL(LOG_LEVEL_DEBUG, "Creating name=%s in parent=%ld in xrdp_fs",
                       name, fip->pinum);
+            ours = parent_xinode->dir_generation == fip->dir_generation;
             xinode = xfs_add_entry(g_xfs, fip->pinum, name, fattr->mode);
             if (xinode == NULL)
             {
@@ -997,9 +1951,75 @@ void xfuse_devredir_cb_enum_dir_add_entry(
                 xinode->ctime = fattr->mtime;
 
                 /* device_id is inherited from parent */
+                xfuse_cache_update(xinode, 1);
+                if (ours)
+                {
+                    /* our own change, the listing can still be kept */
+                    fip->dir_generation = parent_xinode->dir_generation;
+                }
+                fip->changed = 1;
+            }
+        }
+        else if ((xinode->mode & (S_IFREG | S_IFDIR)) ==
+                 (fattr->mode & (S_IFREG | S_IFDIR)) &&
+                 xfs_get_file_open_count(g_xfs, xinode->inum) == 0)
+        {
+            changed = xfuse_cache_attr_differ(fattr, xinode);
+            update_inode_file_attributes(fattr, TO_SET_ALL, xinode);
+            xfuse_cache_update(xinode, changed);
+            if (changed)
+            {
+                xfuse_cache_notify_attr(xinode);
+                fip->changed = 1;
+            }
+        }
+
+        if (xinode != NULL)
+        {
+            xinode->scan_id = fip->scan_id;
+        }
+    }
+}
+
+/**
+ * Removes the entries of a directory the last scan didn't see, and keeps
+ * the listing if nothing else changed the directory during the scan
+ *****************************************************************************/
+
+static void xfuse_enum_dir_snapshot(struct state_dirscan *fip,
+                                    XFS_INODE *dir)
+{
+    struct xfs_dir_handle *dh;
+    XFS_INODE *xinode;
+    off_t off;
+
+    if (dir->dir_generation != fip->dir_generation)
+    {
+        /* a lookup or a change of ours came in between */
+        dir->snap_until = 0;
+        return;
+    }
+    /* entries are marked by the last scan started, another one may have
+     * marked some of ours */
+    if (g_scan_id == fip->scan_id &&
+            (dh = xfs_opendir(g_xfs, dir->inum)) != NULL)
+    {
+        off = 0;
+        while ((xinode = xfs_readdir(g_xfs, dh, &off)) != NULL)
+        {
+            if (xinode->scan_id != fip->scan_id)
+            {
+                LOG_DEVEL(LOG_LEVEL_DEBUG, "inode=%ld name=%s has gone",
+                          xinode->inum, xinode->name);
+                xfs_remove_entry(g_xfs, xinode->inum);
+                fip->changed = 1;
             }
         }
+        xfs_closedir(g_xfs, dh);
     }
+    dir->snap_ttl_ms = xfuse_cache_next_ttl(dir->snap_ttl_ms, fip->changed);
+    dir->snap_until = g_time4() + (tui64) dir->snap_ttl_ms * 1000;
+    dir->snap_generation = dir->dir_generation;
 }
 
 /**
@@ -1036,7 +2056,10 @@ void xfuse_devredir_cb_enum_dir_done(struct state_dirscan *fip,
     else
     {
         struct fuse_file_info *fi = &fip->fi;
-        XFUSE_HANDLE *xhandle = xfuse_handle_create();
+        XFUSE_HANDLE *xhandle;
+
+        xfuse_enum_dir_snapshot(fip, xfs_get(g_xfs, fip->pinum));
+        xhandle = xfuse_handle_create();
 
         if (xhandle == NULL
                 || (xhandle->dir_handle = xfs_opendir(g_xfs, fip->pinum)) == NULL)
@@ -1090,7 +2113,15 @@ void xfuse_devredir_cb_lookup_entry(struct state_lookup *fip,
                 {
                     xfs_remove_entry(g_xfs, fip->existing_inum);
                 }
-                fuse_reply_err(fip->req, ENOENT);
+                if ((xinode = xfs_get(g_xfs, fip->pinum)) != NULL)
+                {
+                    xfuse_negative_add(xinode, fip->name);
+                    make_fuse_negative_entry_reply(fip->req, xinode);
+                }
+                else
+                {
+                    fuse_reply_err(fip->req, ENOENT);
+                }
                 break;
 
             default:
@@ -1131,8 +2162,11 @@ void xfuse_devredir_cb_lookup_entry(struct state_lookup *fip,
                 }
                 else
                 {
+                    int changed = xfuse_cache_attr_differ(file_info, xinode);
+
                     LOG_DEVEL(LOG_LEVEL_DEBUG, "Updating attributes of inode=%ld", xinode->inum);
                     update_inode_file_attributes(file_info, TO_SET_ALL, xinode);
+                    xfuse_cache_update(xinode, changed);
                 }
             }
             else
@@ -1166,6 +2200,7 @@ void xfuse_devredir_cb_lookup_entry(struct state_lookup *fip,
                    change time */
                 xinode->ctime = file_info->mtime;
                 /* device_id is inherited from parent */
+                xfuse_cache_update(xinode, 1);
             }
         }
         if (xinode != NULL)
@@ -1220,6 +2255,7 @@ void xfuse_devredir_cb_setattr(struct state_setattr *fip,
     else
     {
         update_inode_file_attributes(&fip->fattr, fip->change_mask, xinode);
+        xfuse_cache_expire(xinode);
         make_fuse_attr_reply(fip->req, xinode);
     }
     free(fip);
@@ -1277,6 +2313,8 @@ void xfuse_devredir_cb_create_file(struct state_create *fip,
         else
         {
             XFS_INODE   *xinode;
+            int held = xfuse_snapshot_hold(fip->pinum);
+
             /* create entry in xrdp file system */
             xinode = xfs_add_entry(g_xfs, fip->pinum, fip->name, fip->mode);
             if (xinode == NULL)
@@ -1307,6 +2345,8 @@ void xfuse_devredir_cb_create_file(struct state_create *fip,
             }
             else
             {
+                xfuse_cache_expire(xinode);
+                xfuse_snapshot_follow(fip->pinum, held);
 
                 if ((fip->mode & S_IFDIR) != 0)
                 {
@@ -1388,7 +2428,11 @@ void xfuse_devredir_cb_read_file(struct state_read *fip,
                                  enum NTSTATUS IoStatus,
                                  const char *buf, size_t length)
 {
-    if (IoStatus != STATUS_SUCCESS)
+    if (fip->block != NULL)
+    {
+        xfuse_ra_block_done(fip->block, IoStatus, buf, length);
+    }
+    else if (IoStatus != STATUS_SUCCESS)
     {
         LOG_DEVEL(LOG_LEVEL_ERROR, "Read NTSTATUS is %d", (int) IoStatus);
         fuse_reply_err(fip->req, EIO);
@@ -1407,16 +2451,12 @@ void xfuse_devredir_cb_write_file(
     size_t length)
 {
     XFS_INODE   *xinode;
+    XFUSE_HANDLE *fh = fip->fh;
+    size_t sent = fip->length;
 
-    if (IoStatus != STATUS_SUCCESS)
-    {
-        LOG_DEVEL(LOG_LEVEL_ERROR, "Write NTSTATUS is %d", (int) IoStatus);
-        fuse_reply_err(fip->req, EIO);
-    }
-    else
+    if (IoStatus == STATUS_SUCCESS)
     {
         off_t new_size = offset + length;
-        fuse_reply_write(fip->req, length);
 
         /* update file size */
         if ((xinode = xfs_get(g_xfs, fip->inum)) != NULL)
@@ -1425,6 +2465,11 @@ void xfuse_devredir_cb_write_file(
             {
                 xinode->size = new_size;
             }
+            /* the client has a new modification time */
+            xinode->mtime = time(0);
+            xinode->ctime = xinode->mtime;
+            xfuse_cache_expire(xinode);
+            xfuse_cache_notify_attr(xinode);
         }
         else
         {
@@ -1433,18 +2478,37 @@ void xfuse_devredir_cb_write_file(
     }
 
     free(fip);
+
+    /* this may free the handle */
+    xfuse_wb_done(fh, IoStatus, sent, length);
 }
 
 void xfuse_devredir_cb_rmdir_or_file(struct state_remove *fip,
                                      enum NTSTATUS IoStatus)
 {
     XFS_INODE   *xinode = xfs_get(g_xfs, fip->inum);
+    XFS_INODE   *parent_xinode;
+    char        name[XFS_MAXFILENAMELEN + 1];
+    int         held;
 
     switch (IoStatus)
     {
         case STATUS_SUCCESS:
         case STATUS_NO_SUCH_FILE:
+            if (xinode == NULL)
+            {
+                /* already gone locally, e.g. the share went away */
+                fuse_reply_err(fip->req, 0);
+                break;
+            }
+            held = xfuse_snapshot_hold(fip->pinum);
+            g_strncpy(name, xinode->name, sizeof(name) - 1);
             xfs_remove_entry(g_xfs, xinode->inum); /* Remove local copy */
+            xfuse_snapshot_follow(fip->pinum, held);
+            if ((parent_xinode = xfs_get(g_xfs, fip->pinum)) != NULL)
+            {
+                xfuse_negative_add(parent_xinode, name);
+            }
             fuse_reply_err(fip->req, 0);
             break;
 
@@ -1475,8 +2539,19 @@ void xfuse_devredir_cb_rename_file(struct state_rename *fip,
     }
     else
     {
+        int held = xfuse_snapshot_hold(fip->pinum);
+        int new_held = xfuse_snapshot_hold(fip->new_pinum);
+
         status = xfs_move_entry(g_xfs, fip->pinum,
                                 fip->new_pinum, fip->name);
+        if (status == 0)
+        {
+            xfuse_snapshot_follow(fip->pinum, held);
+            if (fip->new_pinum != fip->pinum)
+            {
+                xfuse_snapshot_follow(fip->new_pinum, new_held);
+            }
+        }
     }
 
     fuse_reply_err(fip->req, status);
@@ -1533,12 +2608,23 @@ static void xfuse_cb_lookup(fuse_req_t req, fuse_ino_t parent, const char *name)
                 fuse_reply_err(req, ENOENT);
             }
         }
+        else if ((xinode = xfs_lookup_in_dir(g_xfs, parent, name)) != NULL &&
+                 xinode->cache_until > g_time4())
+        {
+            /* specified file resides on redirected share, and the client
+             * told us about it recently */
+            make_fuse_entry_reply(req, xinode);
+        }
+        else if (xinode == NULL &&
+                 (xfuse_snapshot_valid(parent_xinode) ||
+                  xfuse_negative_find(parent_xinode, name)))
+        {
+            /* the client hasn't got it */
+            make_fuse_negative_entry_reply(req, parent_xinode);
+        }
         else
         {
-            /* specified file resides on redirected share
-             *
-             * We always look these up, and relying on libfuse to do sane
-             * caching */
+            /* specified file resides on redirected share */
             struct state_lookup *fip = g_new0(struct state_lookup, 1);
             char *full_path = get_name_for_entry_in_parent(parent, name);
 
@@ -1564,7 +2650,7 @@ static void xfuse_cb_lookup(fuse_req_t req, fuse_ino_t parent, const char *name)
                  * and generation. If it's not remote any more this means we
                  * can remove it when we get the response
                  */
-                if ((xinode = xfs_lookup_in_dir(g_xfs, parent, name)) != NULL)
+                if (xinode != NULL)
                 {
                     fip->existing_inum = xinode->inum;
                     fip->existing_generation = xinode->generation;
@@ -1781,6 +2867,7 @@ static void xfuse_cb_unlink(fuse_req_t req, fuse_ino_t parent,
 
             fip->req = req;
             fip->inum = xinode->inum;
+            fip->pinum = parent;
 
             /* we want path minus 'root node of the share' */
             cptr = filename_on_device(full_path);
@@ -2102,6 +3189,7 @@ static void xfuse_cb_release(fuse_req_t req, fuse_ino_t ino, struct
                              fuse_file_info *fi)
 {
     XFS_INODE   *xinode;
+    struct xfuse_wb_waiter *waiter;
 
     XFUSE_HANDLE *handle = xfuse_handle_from_fuse_handle(fi->fh);
 
@@ -2118,18 +3206,55 @@ static void xfuse_cb_release(fuse_req_t req, fuse_ino_t ino, struct
         /* specified file is a local resource */
         fuse_reply_err(req, 0);
     }
-    else
+    else if (!xfuse_wb_busy(handle))
     {
         /* specified file resides on redirected share */
+        xfuse_release_redirected(req, ino, fi, handle);
+    }
+    else if ((waiter = xfuse_wb_add_waiter(handle, XFUSE_WB_RELEASE,
+                                           req, ino)) == NULL)
+    {
+        /* the handle can't go while writes still refer to it */
+        LOG_DEVEL(LOG_LEVEL_ERROR, "system out of memory");
+        fuse_reply_err(req, ENOMEM);
+    }
+    else
+    {
+        /* the file is closed once the writes are answered */
+        waiter->fi = *fi;
+        xfuse_wb_run(handle);
+    }
+}
 
-        struct state_close *fip = g_new0(struct state_close, 1);
-        if (fip == NULL)
-        {
-            LOG_DEVEL(LOG_LEVEL_ERROR, "system out of memory");
-            fuse_reply_err(req, ENOMEM);
-            return;
-        }
+/**
+ * Closes a file on a redirected share and frees its handle
+ *****************************************************************************/
+
+static void xfuse_release_redirected(fuse_req_t req, fuse_ino_t ino,
+                                     struct fuse_file_info *fi,
+                                     XFUSE_HANDLE *handle)
+{
+    XFS_INODE   *xinode;
+    struct state_close *fip;
 
+    if (handle->wb_error != 0)
+    {
+        LOG(LOG_LEVEL_WARNING, "a write to inode %ld failed and was not "
+            "reported before the file was closed", ino);
+    }
+
+    if ((xinode = xfs_get(g_xfs, ino)) == NULL)
+    {
+        LOG_DEVEL(LOG_LEVEL_ERROR, "inode %ld is not valid", ino);
+        fuse_reply_err(req, ENOENT);
+    }
+    else if ((fip = g_new0(struct state_close, 1)) == NULL)
+    {
+        LOG_DEVEL(LOG_LEVEL_ERROR, "system out of memory");
+        fuse_reply_err(req, ENOMEM);
+    }
+    else
+    {
         fip->req = req;
         fip->inum = ino;
         fip->fi = *fi;
@@ -2146,8 +3271,37 @@ static void xfuse_cb_release(fuse_req_t req, fuse_ino_t ino, struct
             fuse_reply_err(req, EREMOTEIO);
             free(fip);
         }
+    }
+
+    xfuse_handle_delete(handle);
+}
+
+/**
+ * Called on each close() of a file, the writes gathered for the handle
+ * are sent and their status returned
+ *****************************************************************************/
+
+static void xfuse_cb_flush(fuse_req_t req, fuse_ino_t ino,
+                           struct fuse_file_info *fi)
+{
+    XFUSE_HANDLE *fh = xfuse_handle_from_fuse_handle(fi->fh);
+    struct xfuse_wb_waiter *waiter;
+
+    LOG_DEVEL(LOG_LEVEL_DEBUG, "entered: ino=%ld", ino);
 
-        xfuse_handle_delete(handle);
+    if (fh == NULL || fh->is_loc_resource)
+    {
+        fuse_reply_err(req, 0);
+    }
+    else if ((waiter = xfuse_wb_add_waiter(fh, XFUSE_WB_FLUSH,
+                                           req, ino)) == NULL)
+    {
+        LOG_DEVEL(LOG_LEVEL_ERROR, "system out of memory");
+        fuse_reply_err(req, ENOMEM);
+    }
+    else
+    {
+        xfuse_wb_run(fh);
     }
 }
 
@@ -2161,9 +3315,9 @@ static void xfuse_cb_read(fuse_req_t req, fuse_ino_t ino, size_t size,
                           off_t off, struct fuse_file_info *fi)
 {
     XFUSE_HANDLE          *fh;
-    struct state_read *fusep;
     XFS_INODE            *xinode;
     struct req_list_item  *rli;
+    struct xfuse_wb_waiter *waiter;
 
     LOG_DEVEL(LOG_LEVEL_DEBUG, "want_bytes %zd bytes at off %lld", size, (long long) off);
 
@@ -2202,27 +3356,28 @@ static void xfuse_cb_read(fuse_req_t req, fuse_ino_t ino, size_t size,
                                         (int) off, (int) size);
         }
     }
-    else
+    else if (xfuse_wb_busy(fh))
     {
-        /* target file is on a remote device */
-
-        fusep = g_new0(struct state_read, 1);
-        if (fusep == NULL)
+        /* target file is on a remote device, the read has to see the
+         * writes before it */
+        if ((waiter = xfuse_wb_add_waiter(fh, XFUSE_WB_READ,
+                                          req, ino)) == NULL)
         {
             LOG_DEVEL(LOG_LEVEL_ERROR, "system out of memory");
             fuse_reply_err(req, ENOMEM);
         }
         else
         {
-            fusep->req = req;
-
-            /*
-             * If this call succeeds, further request processing happens in
-             * xfuse_devredir_cb_read_file()
-             */
-            devredir_file_read(fusep, fh->DeviceId, fh->FileId, size, off);
+            waiter->size = size;
+            waiter->off = off;
+            xfuse_wb_run(fh);
         }
     }
+    else
+    {
+        /* target file is on a remote device */
+        xfuse_ra_read(fh, req, size, off);
+    }
 }
 
 /**
@@ -2235,7 +3390,9 @@ static void xfuse_cb_write(fuse_req_t req, fuse_ino_t ino, const char *buf,
                            size_t size, off_t off, struct fuse_file_info *fi)
 {
     XFUSE_HANDLE *fh;
-    struct state_write *fusep;
+    XFS_INODE *xinode;
+    struct xfuse_wb_waiter *waiter;
+    char *data = NULL;
 
     LOG_DEVEL(LOG_LEVEL_DEBUG, "write %zd bytes at off %lld to inode=%ld",
               size, (long long) off, ino);
@@ -2255,23 +3412,45 @@ static void xfuse_cb_write(fuse_req_t req, fuse_ino_t ino, const char *buf,
     {
         /* target file is on a remote device */
 
-        fusep = g_new0(struct state_write, 1);
-        if (fusep == NULL)
+        /* cached blocks may hold what is overwritten */
+        xfuse_ra_reset(fh);
+        fh->wb_inum = ino;
+
+        if (fh->wb_error != 0)
+        {
+            /* an earlier write failed */
+            fuse_reply_err(req, fh->wb_error);
+            return;
+        }
+
+        /* the size the kernel sees includes the writes not sent yet */
+        if ((xinode = xfs_get(g_xfs, ino)) != NULL &&
+                off + (off_t) size > xinode->size)
+        {
+            xinode->size = off + (off_t) size;
+        }
+
+        if ((fh->wb_waiters == NULL || fh->wb_waiters->count == 0) &&
+                xfuse_wb_accept(fh, buf, size, off))
+        {
+            fuse_reply_write(req, size);
+        }
+        else if ((data = (char *) g_malloc(size > 0 ? size : 1, 0)) == NULL ||
+                 (waiter = xfuse_wb_add_waiter(fh, XFUSE_WB_WRITE,
+                                               req, ino)) == NULL)
         {
             LOG_DEVEL(LOG_LEVEL_ERROR, "system out of memory");
+            free(data);
             fuse_reply_err(req, ENOMEM);
         }
         else
         {
-            fusep->req = req;
-            fusep->inum = ino;
-
-            /*
-             * If this call succeeds, further request processing happens in
-             * xfuse_devredir_cb_write_file()
-             */
-            devredir_file_write(fusep, fh->DeviceId, fh->FileId, buf,
-                                size, off);
+            /* buf is only valid during this call */
+            g_memcpy(data, buf, size);
+            waiter->data = data;
+            waiter->size = size;
+            waiter->off = off;
+            xfuse_wb_run(fh);
         }
     }
 }
@@ -2297,15 +3476,16 @@ static void xfuse_cb_create(fuse_req_t req, fuse_ino_t parent,
 /**
  *****************************************************************************/
 
-#if 0
+/*
+ * There is no IRP_MJ_FLUSH_BUFFERS in devredir, fsync waits for the client
+ * to answer the writes the same as a flush
+ */
 static void xfuse_cb_fsync(fuse_req_t req, fuse_ino_t ino, int datasync,
                            struct fuse_file_info *fi)
 {
-    LOG_DEVEL(LOG_LEVEL_DEBUG, "#################### entered: ino=%ld datasync=%d", ino, datasync);
-    LOG_DEVEL(LOG_LEVEL_DEBUG, "function not required");
-    fuse_reply_err(req, EINVAL);
+    LOG_DEVEL(LOG_LEVEL_DEBUG, "entered: ino=%ld datasync=%d", ino, datasync);
+    xfuse_cb_flush(req, ino, fi);
 }
-#endif
 
 /**
  * Sets attributes for a directory entry.
@@ -2324,10 +3504,30 @@ static void xfuse_cb_setattr(fuse_req_t req, fuse_ino_t ino, struct stat *attr,
                              int to_set, struct fuse_file_info *fi)
 {
     XFS_INODE   *xinode;
+    XFUSE_HANDLE *fh;
+    struct xfuse_wb_waiter *waiter;
 
     LOG_DEVEL(LOG_LEVEL_DEBUG, "entered to_set=0x%x", to_set);
 
-    if ((xinode = xfs_get(g_xfs, ino)) == NULL)
+    if (fi != NULL &&
+            (fh = xfuse_handle_from_fuse_handle(fi->fh)) != NULL &&
+            xfuse_wb_busy(fh))
+    {
+        /* an ftruncate() has to come after the writes before it */
+        if ((waiter = xfuse_wb_add_waiter(fh, XFUSE_WB_SETATTR,
+                                          req, ino)) == NULL)
+        {
+            LOG_DEVEL(LOG_LEVEL_ERROR, "system out of memory");
+            fuse_reply_err(req, ENOMEM);
+        }
+        else
+        {
+            waiter->attr = *attr;
+            waiter->to_set = to_set;
+            xfuse_wb_run(fh);
+        }
+    }
+    else if ((xinode = xfs_get(g_xfs, ino)) == NULL)
     {
         LOG_DEVEL(LOG_LEVEL_ERROR, "inode %ld is not valid", ino);
         fuse_reply_err(req, ENOENT);
@@ -2446,8 +3646,9 @@ static void xfuse_cb_opendir(fuse_req_t req, fuse_ino_t ino,
         LOG_DEVEL(LOG_LEVEL_ERROR, "inode %ld is not valid", ino);
         fuse_reply_err(req, ENOENT);
     }
-    else if (!xinode->is_redirected)
+    else if (!xinode->is_redirected || xfuse_snapshot_valid(xinode))
     {
+        /* local, or listed recently enough */
         if ((xhandle = xfuse_handle_create()) == NULL)
         {
             fuse_reply_err(req, ENOMEM);
@@ -2487,6 +3688,8 @@ static void xfuse_cb_opendir(fuse_req_t req, fuse_ino_t ino,
             fip->req = req;
             fip->pinum = ino;
             fip->fi = *fi;
+            fip->scan_id = ++g_scan_id;
+            fip->dir_generation = xinode->dir_generation;
 
             /* we want path minus 'root node of the share' */
             cptr = filename_on_device(full_path);
@@ -2534,8 +3737,8 @@ static void xfs_inode_to_fuse_entry_param(const XFS_INODE *xinode,
 {
     memset(e, 0, sizeof(*e));
     e->ino = xinode->inum;
-    e->attr_timeout = XFUSE_ATTR_TIMEOUT;
-    e->entry_timeout = XFUSE_ENTRY_TIMEOUT;
+    e->attr_timeout = xfuse_cache_timeout(xinode, XFUSE_ATTR_TIMEOUT);
+    e->entry_timeout = xfuse_cache_timeout(xinode, XFUSE_ENTRY_TIMEOUT);
     e->attr.st_ino = xinode->inum;
     e->attr.st_mode = xinode->mode & ~g_cfg->file_umask;
     e->attr.st_nlink = 1;
@@ -2570,7 +3773,7 @@ static void make_fuse_attr_reply(fuse_req_t req, const XFS_INODE *xinode)
     st.st_mtime = xinode->mtime;
     st.st_ctime = xinode->ctime;
 
-    fuse_reply_attr(req, &st, XFUSE_ATTR_TIMEOUT);
+    fuse_reply_attr(req, &st, xfuse_cache_timeout(xinode, XFUSE_ATTR_TIMEOUT));
 }
 
 /*
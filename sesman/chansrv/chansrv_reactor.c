@@ -0,0 +1,624 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Copyright (C) Jay Sorg 2021
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * event sources registered once with chansrv's main loop
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include <config_ac.h>
+#endif
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+#ifdef HAVE_SYS_TIMERFD_H
+#include <sys/timerfd.h>
+#endif
+#include <unistd.h>
+
+#include "chansrv_reactor.h"
+#include "list.h"
+#include "log.h"
+#include "os_calls.h"
+
+/* sources called per reactor_check_wait_objs() at most, the others are
+   still ready on the next call */
+#define REACTOR_MAX_EVENTS 64
+
+struct reactor_source
+{
+    struct reactor *reactor;
+    int index; /* in reactor::sources */
+    int fd;
+    int events;
+    int removed;
+    reactor_proc proc;
+    void *data;
+};
+
+struct reactor_timer
+{
+    tui64 deadline; /* g_time4() */
+    tui64 seq; /* equal deadlines run in the order they were added */
+    int index; /* in reactor::timers, -1 once it is due */
+    reactor_proc proc;
+    void *data;
+    struct reactor *reactor;
+};
+
+struct reactor
+{
+    int epoll_fd; /* -1 without epoll */
+    struct list *sources; /* struct reactor_source */
+    struct list *removed; /* freed when no callback is running */
+    int checking;
+    struct list *timers; /* struct reactor_timer, a min-heap */
+    tui64 timer_seq;
+    int timer_fd; /* -1 without timerfd */
+    tui64 timer_armed; /* deadline timer_fd is set to, 0 if none */
+};
+
+/*****************************************************************************/
+static void
+reactor_free_removed(struct reactor *self)
+{
+    int index;
+
+    for (index = 0; index < self->removed->count; index++)
+    {
+        g_free((void *)list_get_item(self->removed, index));
+    }
+    list_clear(self->removed);
+}
+
+/*****************************************************************************/
+static int
+reactor_timer_before(const struct reactor_timer *a,
+                     const struct reactor_timer *b)
+{
+    if (a->deadline != b->deadline)
+    {
+        return a->deadline < b->deadline;
+    }
+    return a->seq < b->seq;
+}
+
+/*****************************************************************************/
+static struct reactor_timer *
+reactor_timer_at(struct reactor *self, int index)
+{
+    return (struct reactor_timer *)list_get_item(self->timers, index);
+}
+
+/*****************************************************************************/
+static void
+reactor_timer_place(struct reactor *self, struct reactor_timer *timer,
+                    int index)
+{
+    self->timers->items[index] = (tintptr)timer;
+    timer->index = index;
+}
+
+/*****************************************************************************/
+/* moves the timer at index up or down to where it belongs in the heap */
+static void
+reactor_timer_sift(struct reactor *self, int index)
+{
+    struct reactor_timer *timer;
+    struct reactor_timer *other;
+    int parent;
+    int child;
+
+    timer = reactor_timer_at(self, index);
+    while (index > 0)
+    {
+        parent = (index - 1) / 2;
+        other = reactor_timer_at(self, parent);
+        if (!reactor_timer_before(timer, other))
+        {
+            break;
+        }
+        reactor_timer_place(self, other, index);
+        index = parent;
+    }
+    for (;;)
+    {
+        child = 2 * index + 1;
+        if (child >= self->timers->count)
+        {
+            break;
+        }
+        if (child + 1 < self->timers->count &&
+                reactor_timer_before(reactor_timer_at(self, child + 1),
+                                     reactor_timer_at(self, child)))
+        {
+            child++;
+        }
+        other = reactor_timer_at(self, child);
+        if (!reactor_timer_before(other, timer))
+        {
+            break;
+        }
+        reactor_timer_place(self, other, index);
+        index = child;
+    }
+    reactor_timer_place(self, timer, index);
+}
+
+/*****************************************************************************/
+static void
+reactor_timer_unlink(struct reactor_timer *timer)
+{
+    struct reactor *self;
+    struct reactor_timer *last;
+    int index;
+
+    self = timer->reactor;
+    index = timer->index;
+    last = reactor_timer_at(self, self->timers->count - 1);
+    self->timers->count--;
+    timer->index = -1;
+    if (last != timer)
+    {
+        reactor_timer_place(self, last, index);
+        reactor_timer_sift(self, index);
+    }
+}
+
+/*****************************************************************************/
+/* sets the timerfd to the earliest deadline if that changed */
+static void
+reactor_timer_arm(struct reactor *self)
+{
+#ifdef HAVE_SYS_TIMERFD_H
+    struct itimerspec its;
+    tui64 deadline;
+
+    if (self->timer_fd < 0)
+    {
+        return;
+    }
+    deadline = 0;
+    if (self->timers->count > 0)
+    {
+        deadline = reactor_timer_at(self, 0)->deadline;
+    }
+    if (deadline == self->timer_armed)
+    {
+        return;
+    }
+    /* a zero it_value disarms it */
+    g_memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = deadline / 1000000;
+    its.it_value.tv_nsec = (deadline % 1000000) * 1000;
+    if (timerfd_settime(self->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) != 0)
+    {
+        LOG(LOG_LEVEL_ERROR, "reactor_timer_arm: timerfd_settime failed (%s)",
+            g_get_strerror());
+        return;
+    }
+    self->timer_armed = deadline;
+#endif
+}
+
+#ifdef HAVE_SYS_TIMERFD_H
+/*****************************************************************************/
+/* the due timers are run by reactor_check_wait_objs() */
+static void
+reactor_timer_fd_ready(void *data)
+{
+    struct reactor *self;
+    tui64 expirations;
+
+    self = (struct reactor *)data;
+    if (read(self->timer_fd, &expirations, sizeof(expirations)) ==
+            (int)sizeof(expirations))
+    {
+        self->timer_armed = 0;
+    }
+}
+#endif
+
+/*****************************************************************************/
+static void
+reactor_run_timers(struct reactor *self)
+{
+    struct reactor_timer *timer;
+    tui64 now;
+
+    now = g_time4();
+    while (self->timers->count > 0)
+    {
+        timer = reactor_timer_at(self, 0);
+        if (timer->deadline > now)
+        {
+            break;
+        }
+        reactor_timer_unlink(timer);
+        timer->proc(timer->data);
+        g_free(timer);
+    }
+    reactor_timer_arm(self);
+}
+
+/*****************************************************************************/
+struct reactor *
+reactor_create(void)
+{
+    struct reactor *self;
+
+    self = g_new0(struct reactor, 1);
+    if (self == NULL)
+    {
+        return NULL;
+    }
+    self->sources = list_create();
+    self->removed = list_create();
+    self->timers = list_create();
+    if (self->sources == NULL || self->removed == NULL ||
+            self->timers == NULL)
+    {
+        list_delete(self->sources);
+        list_delete(self->removed);
+        list_delete(self->timers);
+        g_free(self);
+        return NULL;
+    }
+    self->epoll_fd = -1;
+#ifdef HAVE_SYS_EPOLL_H
+    self->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (self->epoll_fd < 0)
+    {
+        LOG(LOG_LEVEL_WARNING, "reactor_create: epoll_create1 failed (%s), "
+            "polling every source", g_get_strerror());
+    }
+#endif
+    self->timer_fd = -1;
+#ifdef HAVE_SYS_TIMERFD_H
+    self->timer_fd = timerfd_create(CLOCK_MONOTONIC,
+                                    TFD_NONBLOCK | TFD_CLOEXEC);
+    if (self->timer_fd >= 0 &&
+            reactor_add(self, self->timer_fd, REACTOR_READ,
+                        reactor_timer_fd_ready, self) == NULL)
+    {
+        close(self->timer_fd);
+        self->timer_fd = -1;
+    }
+#endif
+    return self;
+}
+
+/*****************************************************************************/
+void
+reactor_delete(struct reactor *self)
+{
+    int index;
+
+    if (self == NULL)
+    {
+        return;
+    }
+    for (index = 0; index < self->sources->count; index++)
+    {
+        g_free((void *)list_get_item(self->sources, index));
+    }
+    list_delete(self->sources);
+    reactor_free_removed(self);
+    list_delete(self->removed);
+    for (index = 0; index < self->timers->count; index++)
+    {
+        g_free((void *)list_get_item(self->timers, index));
+    }
+    list_delete(self->timers);
+    if (self->timer_fd >= 0)
+    {
+        close(self->timer_fd);
+    }
+    if (self->epoll_fd >= 0)
+    {
+        close(self->epoll_fd);
+    }
+    g_free(self);
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+/*****************************************************************************/
+static int
+reactor_epoll_ctl(struct reactor_source *source, int op, int events)
+{
+    struct epoll_event event;
+
+    g_memset(&event, 0, sizeof(event));
+    if (events & REACTOR_READ)
+    {
+        event.events |= EPOLLIN;
+    }
+    if (events & REACTOR_WRITE)
+    {
+        event.events |= EPOLLOUT;
+    }
+    event.data.ptr = source;
+    return epoll_ctl(source->reactor->epoll_fd, op, source->fd, &event);
+}
+#endif
+
+/*****************************************************************************/
+struct reactor_source *
+reactor_add(struct reactor *self, int fd, int events,
+            reactor_proc proc, void *data)
+{
+    struct reactor_source *source;
+
+    if (self == NULL || fd < 0)
+    {
+        return NULL;
+    }
+    source = g_new0(struct reactor_source, 1);
+    if (source == NULL)
+    {
+        return NULL;
+    }
+    source->reactor = self;
+    source->fd = fd;
+    source->events = events;
+    source->proc = proc;
+    source->data = data;
+#ifdef HAVE_SYS_EPOLL_H
+    if (self->epoll_fd >= 0 &&
+            reactor_epoll_ctl(source, EPOLL_CTL_ADD, events) != 0)
+    {
+        LOG(LOG_LEVEL_ERROR, "reactor_add: epoll_ctl failed for fd %d (%s)",
+            fd, g_get_strerror());
+        g_free(source);
+        return NULL;
+    }
+#endif
+    source->index = self->sources->count;
+    list_add_item(self->sources, (tintptr)source);
+    return source;
+}
+
+/*****************************************************************************/
+int
+reactor_set_events(struct reactor_source *source, int events)
+{
+    if (source == NULL || source->removed)
+    {
+        return 1;
+    }
+    if (source->events == events)
+    {
+        return 0;
+    }
+#ifdef HAVE_SYS_EPOLL_H
+    if (source->reactor->epoll_fd >= 0 &&
+            reactor_epoll_ctl(source, EPOLL_CTL_MOD, events) != 0)
+    {
+        return 1;
+    }
+#endif
+    source->events = events;
+    return 0;
+}
+
+/*****************************************************************************/
+void
+reactor_remove(struct reactor_source *source)
+{
+    struct reactor *self;
+    struct reactor_source *last;
+
+    if (source == NULL || source->removed)
+    {
+        return;
+    }
+    self = source->reactor;
+#ifdef HAVE_SYS_EPOLL_H
+    if (self->epoll_fd >= 0)
+    {
+        /* fails harmlessly if the fd is already closed */
+        reactor_epoll_ctl(source, EPOLL_CTL_DEL, 0);
+    }
+#endif
+    /* move the last source into the gap */
+    last = (struct reactor_source *)
+           list_get_item(self->sources, self->sources->count - 1);
+    self->sources->items[source->index] = (tintptr)last;
+    last->index = source->index;
+    self->sources->count--;
+    source->removed = 1;
+    if (self->checking)
+    {
+        /* a ready list being walked may still point at it */
+        list_add_item(self->removed, (tintptr)source);
+    }
+    else
+    {
+        g_free(source);
+    }
+}
+
+/*****************************************************************************/
+int
+reactor_get_wait_obj_count(struct reactor *self)
+{
+    if (self == NULL)
+    {
+        return 0;
+    }
+    if (self->epoll_fd >= 0)
+    {
+        return 1;
+    }
+    return self->sources->count;
+}
+
+/*****************************************************************************/
+int
+reactor_get_wait_objs(struct reactor *self, tbus *robjs, int *rcount,
+                      tbus *wobjs, int *wcount, int *timeout)
+{
+    struct reactor_source *source;
+    tui64 now;
+    tui64 deadline;
+    int ms;
+    int index;
+
+    if (self == NULL)
+    {
+        return 0;
+    }
+    if (self->timer_fd < 0 && self->timers->count > 0)
+    {
+        now = g_time4();
+        deadline = reactor_timer_at(self, 0)->deadline;
+        /* a timeout below 1 waits forever */
+        ms = 1;
+        if (deadline > now)
+        {
+            ms = (int)((deadline - now + 999) / 1000);
+        }
+        if (*timeout < 1 || ms < *timeout)
+        {
+            *timeout = ms;
+        }
+    }
+    if (self->epoll_fd >= 0)
+    {
+        /* readable while any source is ready */
+        robjs[*rcount] = self->epoll_fd;
+        (*rcount)++;
+        return 0;
+    }
+    for (index = 0; index < self->sources->count; index++)
+    {
+        source = (struct reactor_source *)list_get_item(self->sources, index);
+        if (source->events & REACTOR_READ)
+        {
+            robjs[*rcount] = source->fd;
+            (*rcount)++;
+        }
+        if (source->events & REACTOR_WRITE)
+        {
+            wobjs[*wcount] = source->fd;
+            (*wcount)++;
+        }
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+int
+reactor_check_wait_objs(struct reactor *self)
+{
+    struct reactor_source *source;
+    int index;
+    int ready;
+
+    if (self == NULL)
+    {
+        return 0;
+    }
+    self->checking = 1;
+#ifdef HAVE_SYS_EPOLL_H
+    if (self->epoll_fd >= 0)
+    {
+        struct epoll_event events[REACTOR_MAX_EVENTS];
+        int count;
+
+        count = epoll_wait(self->epoll_fd, events, REACTOR_MAX_EVENTS, 0);
+        for (index = 0; index < count; index++)
+        {
+            source = (struct reactor_source *)events[index].data.ptr;
+            if (!source->removed)
+            {
+                source->proc(source->data);
+            }
+        }
+        self->checking = 0;
+        reactor_free_removed(self);
+        reactor_run_timers(self);
+        return 0;
+    }
+#endif
+    /* sources added by a callback are checked too, a source moved into
+       the gap left by a removed one waits for the next call */
+    for (index = 0; index < self->sources->count; index++)
+    {
+        source = (struct reactor_source *)list_get_item(self->sources, index);
+        ready = ((source->events & REACTOR_READ) &&
+                 g_sck_can_recv(source->fd, 0)) ||
+                ((source->events & REACTOR_WRITE) &&
+                 g_sck_can_send(source->fd, 0));
+        if (ready)
+        {
+            source->proc(source->data);
+        }
+    }
+    self->checking = 0;
+    reactor_free_removed(self);
+    reactor_run_timers(self);
+    return 0;
+}
+
+/*****************************************************************************/
+struct reactor_timer *
+reactor_add_timer(struct reactor *self, int msoffset,
+                  reactor_proc proc, void *data)
+{
+    struct reactor_timer *timer;
+
+    if (self == NULL)
+    {
+        return NULL;
+    }
+    timer = g_new0(struct reactor_timer, 1);
+    if (timer == NULL)
+    {
+        return NULL;
+    }
+    if (msoffset < 0)
+    {
+        msoffset = 0;
+    }
+    timer->deadline = g_time4() + (tui64)msoffset * 1000;
+    timer->seq = self->timer_seq++;
+    timer->proc = proc;
+    timer->data = data;
+    timer->reactor = self;
+    list_add_item(self->timers, (tintptr)timer);
+    timer->index = self->timers->count - 1;
+    reactor_timer_sift(self, timer->index);
+    reactor_timer_arm(self);
+    return timer;
+}
+
+/*****************************************************************************/
+void
+reactor_cancel_timer(struct reactor_timer *timer)
+{
+    struct reactor *self;
+
+    if (timer == NULL || timer->index < 0)
+    {
+        return;
+    }
+    self = timer->reactor;
+    reactor_timer_unlink(timer);
+    g_free(timer);
+    reactor_timer_arm(self);
+}
@@ -0,0 +1,90 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Copyright (C) Jay Sorg 2021
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * event sources registered once with chansrv's main loop
+ *
+ * A source is a file descriptor and a callback. With epoll the whole set
+ * is a single wait object and a wake up only visits the sources that are
+ * ready, so the cost does not grow with the number of sources. Without
+ * epoll every source is added to the wait object list as before.
+ *
+ * Timers are kept in a binary heap ordered by deadline, adding or
+ * cancelling one is O(log n). A timerfd set to the earliest deadline wakes
+ * the loop, without timerfd the loop's timeout is lowered instead.
+ */
+
+#if !defined(CHANSRV_REACTOR_H)
+#define CHANSRV_REACTOR_H
+
+#include "arch.h"
+
+#define REACTOR_READ  (1 << 0)
+#define REACTOR_WRITE (1 << 1)
+
+struct reactor;
+struct reactor_source;
+struct reactor_timer;
+
+/* called when the source is ready or the timer is due, it may remove any
+   source and add or cancel any timer */
+typedef void (*reactor_proc)(void *data);
+
+struct reactor *
+reactor_create(void);
+
+/* removes and frees all sources and timers */
+void
+reactor_delete(struct reactor *self);
+
+/* returns NULL on error */
+struct reactor_source *
+reactor_add(struct reactor *self, int fd, int events,
+            reactor_proc proc, void *data);
+
+/* events is a mask of REACTOR_READ and REACTOR_WRITE, returns error */
+int
+reactor_set_events(struct reactor_source *source, int events);
+
+/* safe to call from any callback, the source is not called again */
+void
+reactor_remove(struct reactor_source *source);
+
+/* number of wait objects reactor_get_wait_objs() may add */
+int
+reactor_get_wait_obj_count(struct reactor *self);
+
+/* timeout is in milliseconds, lowered for the next timer if needed */
+int
+reactor_get_wait_objs(struct reactor *self, tbus *robjs, int *rcount,
+                      tbus *wobjs, int *wcount, int *timeout);
+
+/* calls the sources that are ready and the timers that are due,
+   does not block */
+int
+reactor_check_wait_objs(struct reactor *self);
+
+/* calls proc once after msoffset milliseconds, returns NULL on error,
+   the handle is freed when proc returns */
+struct reactor_timer *
+reactor_add_timer(struct reactor *self, int msoffset,
+                  reactor_proc proc, void *data);
+
+/* does nothing for the timer whose callback is running */
+void
+reactor_cancel_timer(struct reactor_timer *timer);
+
+#endif
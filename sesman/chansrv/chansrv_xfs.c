@@ -41,6 +41,9 @@
 #define INODE_TABLE_ALLOCATION_INITIAL     4096
 #define INODE_TABLE_ALLOCATION_GRANULARITY 100
 
+/* Initial number of buckets in a directory's name index */
+#define DIR_INDEX_INITIAL_SIZE 16
+
 /* inum of the delete pending directory */
 #define DELETE_PENDING_ID 2
 
@@ -74,7 +77,16 @@ typedef struct xfs_inode_all
     struct xfs_inode_all *parent;      /* Parent inode                     */
     struct xfs_inode_all *next;        /* Next entry in parent             */
     struct xfs_inode_all *previous;    /* Previous entry in parent         */
+    struct xfs_inode_all *hash_next;   /* Next entry in parent's bucket    */
+    tui32                name_hash;    /* Hash of the case-folded name     */
     XFS_LIST             dir;          /* Directory only - children        */
+    /*
+     * Directory only - name index of the children. Either NULL, or
+     * every child is in it
+     */
+    struct xfs_inode_all **dir_index;
+    unsigned int         dir_index_size; /* Buckets, a power of two        */
+    unsigned int         dir_count;    /* Number of children               */
     /*
      * Other private elements
      */
@@ -238,19 +250,162 @@ remove_inode_from_list(XFS_LIST *list, XFS_INODE_ALL *xino)
 
 }
 
+/*  ------------------------------------------------------------------------ */
+/*
+ * Names are hashed with ASCII letters folded to lower case, so names which
+ * differ only in case share a bucket. Redirected drives are case
+ * insensitive, see xfs_names_match()
+ */
+static tui32
+name_hash(const char *name)
+{
+    tui32 hash = 2166136261U; /* FNV-1a */
+    unsigned char c;
+
+    while ((c = (unsigned char)*name++) != '\0')
+    {
+        if (c >= 'A' && c <= 'Z')
+        {
+            c += 'a' - 'A';
+        }
+        hash = (hash ^ c) * 16777619U;
+    }
+
+    return hash;
+}
+
+/*  ------------------------------------------------------------------------ */
+int
+xfs_names_match(const XFS_INODE *dir, const char *a, const char *b)
+{
+    unsigned char ca;
+    unsigned char cb;
+
+    if (!dir->is_redirected)
+    {
+        return strcmp(a, b) == 0;
+    }
+
+    do
+    {
+        ca = (unsigned char)*a++;
+        cb = (unsigned char)*b++;
+        if (ca >= 'A' && ca <= 'Z')
+        {
+            ca += 'a' - 'A';
+        }
+        if (cb >= 'A' && cb <= 'Z')
+        {
+            cb += 'a' - 'A';
+        }
+    }
+    while (ca == cb && ca != '\0');
+
+    return ca == cb;
+}
+
+/*  ------------------------------------------------------------------------ */
+static void
+add_inode_to_bucket(XFS_INODE_ALL *dinode, XFS_INODE_ALL *xino)
+{
+    XFS_INODE_ALL **bucket;
+
+    bucket = &dinode->dir_index[xino->name_hash & (dinode->dir_index_size - 1)];
+    xino->hash_next = *bucket;
+    *bucket = xino;
+}
+
+/*  ------------------------------------------------------------------------ */
+/*
+ * (Re)builds the name index of a directory from its list of children.
+ *
+ * If memory can't be allocated the old index is kept, as a longer
+ * chain is only slower. Without any index, lookups walk the list.
+ */
+static int
+rebuild_dir_index(XFS_INODE_ALL *dinode, unsigned int size)
+{
+    int result = 0;
+    XFS_INODE_ALL **new_index;
+    XFS_INODE_ALL *p;
+
+    new_index = g_new0(XFS_INODE_ALL *, size);
+    if (new_index != NULL)
+    {
+        free(dinode->dir_index);
+        dinode->dir_index = new_index;
+        dinode->dir_index_size = size;
+
+        for (p = dinode->dir.begin ; p != NULL ; p = p->next)
+        {
+            add_inode_to_bucket(dinode, p);
+        }
+        result = 1;
+    }
+
+    return result;
+}
+
+/*  ------------------------------------------------------------------------ */
+/* Called with xino already in the list of children */
+static void
+add_inode_to_dir_index(XFS_INODE_ALL *dinode, XFS_INODE_ALL *xino)
+{
+    xino->name_hash = name_hash(xino->pub.name);
+
+    if (dinode->dir_index == NULL)
+    {
+        rebuild_dir_index(dinode, DIR_INDEX_INITIAL_SIZE);
+    }
+    else if (dinode->dir_count <= dinode->dir_index_size ||
+             !rebuild_dir_index(dinode, dinode->dir_index_size * 2))
+    {
+        add_inode_to_bucket(dinode, xino);
+    }
+}
+
+/*  ------------------------------------------------------------------------ */
+static void
+remove_inode_from_dir_index(XFS_INODE_ALL *dinode, XFS_INODE_ALL *xino)
+{
+    XFS_INODE_ALL **pp;
+
+    if (dinode->dir_index != NULL)
+    {
+        pp = &dinode->dir_index[xino->name_hash &
+                                (dinode->dir_index_size - 1)];
+        while (*pp != NULL && *pp != xino)
+        {
+            pp = &(*pp)->hash_next;
+        }
+
+        if (*pp != NULL)
+        {
+            *pp = xino->hash_next;
+        }
+    }
+    xino->hash_next = NULL;
+}
+
 /*  ------------------------------------------------------------------------ */
 static void
 link_inode_into_directory_node(XFS_INODE_ALL *dinode, XFS_INODE_ALL *xino)
 {
     xino->parent = dinode;
     add_inode_to_list(&dinode->dir, xino);
+    ++dinode->dir_count;
+    add_inode_to_dir_index(dinode, xino);
+    ++dinode->pub.dir_generation;
 }
 
 /*  ------------------------------------------------------------------------ */
 static void
 unlink_inode_from_parent(XFS_INODE_ALL *xino)
 {
+    remove_inode_from_dir_index(xino->parent, xino);
     remove_inode_from_list(&xino->parent->dir, xino);
+    --xino->parent->dir_count;
+    ++xino->parent->pub.dir_generation;
 
     xino->next = NULL;
     xino->previous = NULL;
@@ -363,7 +518,11 @@ xfs_delete_xfs_fs(struct xfs_fs *xfs)
         size_t i;
         for (i = 0 ; i < xfs->inode_count; ++i)
         {
-            free(xfs->inode_table[i]);
+            if (xfs->inode_table[i] != NULL)
+            {
+                free(xfs->inode_table[i]->dir_index);
+                free(xfs->inode_table[i]);
+            }
         }
     }
     free(xfs->inode_table);
@@ -498,6 +657,7 @@ xfs_remove_entry(struct xfs_fs *xfs, fuse_ino_t inum)
              * so that the caller can distinguish re-uses of the same inum.
              */
             ++xfs->generation;
+            free(xino->dir_index);
             free(xino);
         }
     }
@@ -570,12 +730,29 @@ xfs_lookup_in_dir(struct xfs_fs *xfs, fuse_ino_t inum, const char *name)
             (xino->pub.mode & S_IFDIR) != 0)
     {
         XFS_INODE_ALL *p;
-        for (p = xino->dir.begin ; p != NULL; p = p->next)
+        if (xino->dir_index != NULL)
         {
-            if (strcmp(p->pub.name, name) == 0)
+            tui32 hash = name_hash(name);
+            p = xino->dir_index[hash & (xino->dir_index_size - 1)];
+            for ( ; p != NULL; p = p->hash_next)
             {
-                result = &p->pub;
-                break;
+                if (p->name_hash == hash &&
+                        xfs_names_match(&xino->pub, p->pub.name, name))
+                {
+                    result = &p->pub;
+                    break;
+                }
+            }
+        }
+        else
+        {
+            for (p = xino->dir.begin ; p != NULL; p = p->next)
+            {
+                if (xfs_names_match(&xino->pub, p->pub.name, name))
+                {
+                    result = &p->pub;
+                    break;
+                }
             }
         }
     }
@@ -861,17 +1038,22 @@ xfs_move_entry(struct xfs_fs *xfs, fuse_ino_t inum,
             }
 
             unlink_inode_from_parent(xino);
-            link_inode_into_directory_node(parent, xino);
             strcpy(xino->pub.name, name);
+            link_inode_into_directory_node(parent, xino);
         }
         else if (strcmp(xino->pub.name, name) != 0)
         {
-            /* Same directory, but name has changed */
-            if ((dest = xfs_lookup_in_dir(xfs, new_parent_inum, name)) != NULL)
+            /* Same directory, but name has changed. On a case-insensitive
+             * drive the target may be this entry under its old name */
+            if ((dest = xfs_lookup_in_dir(xfs, new_parent_inum, name)) != NULL &&
+                    dest != &xino->pub)
             {
                 xfs_remove_entry(xfs, dest->inum);
             }
+            remove_inode_from_dir_index(parent, xino);
             strcpy(xino->pub.name, name);
+            add_inode_to_dir_index(parent, xino);
+            ++parent->pub.dir_generation;
         }
         result = 0;
     }
@@ -52,6 +52,15 @@ typedef struct xfs_inode
     char            is_redirected;     /* file is on redirected device      */
     tui32           device_id;         /* device ID of redirected device    */
     int             lindex;            /* used in clipboard operations      */
+    tui32           dir_generation;    /* Dir only - bumped on entry change */
+
+    /* Cache state of redirected entries, kept by chansrv_fuse.c */
+    int             cache_ttl_ms;      /* Entry and attribute timeout       */
+    tui64           cache_until;       /* g_time4() the attributes expire   */
+    tui32           scan_id;           /* Last enumeration that saw it      */
+    int             snap_ttl_ms;       /* Dir only - listing timeout        */
+    tui64           snap_until;        /* Dir only - g_time4() it expires   */
+    tui32           snap_generation;   /* Dir only - dir_generation listed  */
 } XFS_INODE;
 
 /*
@@ -151,6 +160,19 @@ xfs_get(struct xfs_fs *xfs, fuse_ino_t inum);
 char *
 xfs_get_full_path(struct xfs_fs *xfs, fuse_ino_t inum);
 
+/*
+ * Compare two names in a directory the way lookups in it do
+ *
+ * Names in a redirected directory are compared ignoring ASCII case
+ *
+ * @param dir  The directory
+ * @param a    First name
+ * @param b    Second name
+ * @return Non-zero if the names refer to the same entry
+ */
+int
+xfs_names_match(const XFS_INODE *dir, const char *a, const char *b);
+
 /*
  * Lookup a file in a directory
  *
@@ -172,6 +172,7 @@ x-special/gnome-copied-files
 #include "string_calls.h"
 #include "chansrv.h"
 #include "chansrv_config.h"
+#include "chansrv_reactor.h"
 #include "clipboard.h"
 #include "clipboard_file.h"
 #include "clipboard_common.h"
@@ -228,6 +229,16 @@ static XSelectionRequestEvent g_saved_selection_req_event;
 /* xserver maximum request size in bytes */
 static int g_incr_max_req_size = 0;
 
+/* a paste streamed to a requestor, see ss_start(), holds the cliprdr data
+   when this much is waiting and is given up when no more goes for
+   SS_STALL_MS */
+#define SS_HIGH_WATER (2 * g_incr_max_req_size)
+#define SS_STALL_MS 10000
+static struct reactor_timer *g_ss_stall_timer = NULL;
+
+/* most allocated up front for an INCR transfer from a linux app */
+#define S2C_INCR_MAX_HINT (64 * 1024 * 1024)
+
 /* server to client, pasting from linux app to mstsc */
 struct clip_s2c g_clip_s2c;
 /* client to server, pasting from mstsc to linux app */
@@ -485,6 +496,13 @@ clipboard_deinit(void)
 
     xfuse_deinit();
 
+    if (g_ss_stall_timer != NULL)
+    {
+        reactor_cancel_timer(g_ss_stall_timer);
+        g_ss_stall_timer = NULL;
+    }
+    chansrv_hold_cliprdr_data(0);
+    g_clip_c2s.streaming = 0;
     g_free(g_clip_c2s.data);
     g_clip_c2s.data = 0;
     g_free(g_clip_s2c.data);
@@ -507,6 +525,8 @@ clipboard_send_data_request(int format_id)
     LOG_DEVEL(LOG_LEVEL_DEBUG, "clipboard_send_data_request:");
     LOG_DEVEL(LOG_LEVEL_DEBUG, "clipboard_send_data_request: %d", format_id);
     g_clip_c2s.in_request = 1;
+    /* the cache is for the format being requested now */
+    g_clip_c2s.converted = 0;
     make_stream(s);
     init_stream(s, 8192);
     out_uint16_le(s, CB_FORMAT_DATA_REQUEST); /* 4 CLIPRDR_DATA_REQUEST */
@@ -1082,6 +1102,27 @@ clipboard_send_data_response_failed(void)
     return rv;
 }
 
+/*****************************************************************************/
+/* sends the data kept from the last conversion of the current selection */
+static int
+clipboard_send_data_response_s2c(void)
+{
+    if (g_clip_s2c.xrdp_clip_type == XRDP_CB_BITMAP)
+    {
+        if (g_clip_s2c.total_bytes < 15)
+        {
+            return clipboard_send_data_response_failed();
+        }
+        /* skip header */
+        return clipboard_send_data_response(XRDP_CB_BITMAP,
+                                            g_clip_s2c.data + 14,
+                                            g_clip_s2c.total_bytes - 14);
+    }
+    return clipboard_send_data_response(g_clip_s2c.xrdp_clip_type,
+                                        g_clip_s2c.data,
+                                        g_clip_s2c.total_bytes);
+}
+
 /*****************************************************************************/
 /* sent from server to client
  * sent by recipient of CB_FORMAT_LIST; used to request data for one
@@ -1103,14 +1144,14 @@ clipboard_process_data_request(struct stream *s, int clip_msg_status,
             if ((g_clip_s2c.xrdp_clip_type == XRDP_CB_FILE) && g_clip_s2c.converted)
             {
                 LOG_DEVEL(LOG_LEVEL_DEBUG, "clipboard_process_data_request: CB_FORMAT_FILE");
-                clipboard_send_data_response(XRDP_CB_FILE, g_clip_s2c.data,
-                                             g_clip_s2c.total_bytes);
+                clipboard_send_data_response_s2c();
             }
             else
             {
                 LOG_DEVEL(LOG_LEVEL_DEBUG, "clipboard_process_data_request: CB_FORMAT_FILE, "
                           "calling XConvertSelection to g_utf8_atom");
                 g_clip_s2c.xrdp_clip_type = XRDP_CB_FILE;
+                g_clip_s2c.converted = 0;
                 XConvertSelection(g_display, g_clipboard_atom, g_clip_s2c.type,
                                   g_clip_property_atom, g_wnd, CurrentTime);
             }
@@ -1119,14 +1160,14 @@ clipboard_process_data_request(struct stream *s, int clip_msg_status,
             if ((g_clip_s2c.xrdp_clip_type == XRDP_CB_BITMAP) && g_clip_s2c.converted)
             {
                 LOG_DEVEL(LOG_LEVEL_DEBUG, "clipboard_process_data_request: CB_FORMAT_DIB");
-                clipboard_send_data_response(XRDP_CB_BITMAP, g_clip_s2c.data,
-                                             g_clip_s2c.total_bytes);
+                clipboard_send_data_response_s2c();
             }
             else
             {
                 LOG_DEVEL(LOG_LEVEL_DEBUG, "clipboard_process_data_request: CB_FORMAT_DIB, "
                           "calling XConvertSelection to g_image_bmp_atom");
                 g_clip_s2c.xrdp_clip_type = XRDP_CB_BITMAP;
+                g_clip_s2c.converted = 0;
                 XConvertSelection(g_display, g_clipboard_atom, g_image_bmp_atom,
                                   g_clip_property_atom, g_wnd, CurrentTime);
             }
@@ -1135,14 +1176,14 @@ clipboard_process_data_request(struct stream *s, int clip_msg_status,
             if ((g_clip_s2c.xrdp_clip_type == XRDP_CB_TEXT) && g_clip_s2c.converted)
             {
                 LOG_DEVEL(LOG_LEVEL_DEBUG, "clipboard_process_data_request: CB_FORMAT_UNICODETEXT");
-                clipboard_send_data_response(XRDP_CB_TEXT, g_clip_s2c.data,
-                                             g_clip_s2c.total_bytes);
+                clipboard_send_data_response_s2c();
             }
             else
             {
                 LOG_DEVEL(LOG_LEVEL_DEBUG, "clipboard_process_data_request: CB_FORMAT_UNICODETEXT, "
                           "calling XConvertSelection to g_utf8_atom");
                 g_clip_s2c.xrdp_clip_type = XRDP_CB_TEXT;
+                g_clip_s2c.converted = 0;
                 XConvertSelection(g_display, g_clipboard_atom, g_utf8_atom,
                                   g_clip_property_atom, g_wnd, CurrentTime);
             }
@@ -1193,6 +1234,7 @@ clipboard_process_data_response_for_image(struct stream *s,
     g_clip_c2s.read_bytes_done = g_clip_c2s.total_bytes;
     g_memcpy(g_clip_c2s.data, g_bmp_image_header, 14);
     in_uint8a(s, g_clip_c2s.data + 14, len);
+    g_clip_c2s.converted = 1;
     LOG_DEVEL(LOG_LEVEL_DEBUG, "clipboard_process_data_response_for_image: calling "
               "clipboard_provide_selection_c2s");
     clipboard_provide_selection_c2s(lxev, lxev->target);
@@ -1246,6 +1288,7 @@ clipboard_process_data_response(struct stream *s, int clip_msg_status,
         }
         g_clip_c2s.total_bytes = g_strlen(g_clip_c2s.data);
         g_clip_c2s.read_bytes_done = g_clip_c2s.total_bytes;
+        g_clip_c2s.converted = 1;
         clipboard_provide_selection_c2s(lxev, lxev->target);
         return 0;
     }
@@ -1291,6 +1334,9 @@ clipboard_process_data_response(struct stream *s, int clip_msg_status,
     {
         g_clip_c2s.total_bytes = g_strlen(g_clip_c2s.data);
         g_clip_c2s.read_bytes_done = g_clip_c2s.total_bytes;
+        /* kept for both text targets until the client's clipboard
+           changes */
+        g_clip_c2s.converted = 1;
         clipboard_provide_selection_c2s(lxev, lxev->target);
     }
     g_free(wtext);
@@ -1345,60 +1391,198 @@ clipboard_process_clip_caps(struct stream *s, int clip_msg_status,
     return 0;
 }
 
+/*****************************************************************************/
+/* forgets a paste being streamed to the requestor */
+static void
+ss_drop(void)
+{
+    XSelectInput(g_display, g_clip_c2s.window, NoEventMask);
+    g_clip_c2s.incr_in_progress = 0;
+    g_clip_c2s.streaming = 0;
+    g_clip_c2s.incr_bytes_done = 0;
+    g_clip_c2s.read_bytes_done = 0;
+    g_clip_c2s.total_bytes = 0;
+    g_clip_c2s.data_size = 0;
+    g_free(g_clip_c2s.data);
+    g_clip_c2s.data = 0;
+    if (g_ss_stall_timer != NULL)
+    {
+        reactor_cancel_timer(g_ss_stall_timer);
+        g_ss_stall_timer = NULL;
+    }
+    chansrv_hold_cliprdr_data(0);
+}
+
+/*****************************************************************************/
+static void
+ss_stalled(void *data)
+{
+    g_ss_stall_timer = NULL;
+    LOG(LOG_LEVEL_WARNING, "clipboard: window 0x%lx took no clipboard data "
+        "for %d ms, giving up the paste", g_clip_c2s.window, SS_STALL_MS);
+    /* INCR has no way to abort, but an empty chunk would tell the
+       requestor the paste is complete. Without the property the requestor
+       gets no more chunks and fails the paste once it times out */
+    XDeleteProperty(g_display, g_clip_c2s.window, g_clip_c2s.property);
+    XFlush(g_display);
+    ss_drop();
+}
+
+/*****************************************************************************/
+/* holds the cliprdr data in chansrv while the requestor is too far behind,
+   the paste is given up if it stays that way */
+static void
+ss_update_hold(void)
+{
+    int hold;
+
+    hold = g_clip_c2s.streaming && g_clip_c2s.doing_response_ss &&
+           (g_clip_c2s.read_bytes_done - g_clip_c2s.incr_bytes_done >=
+            SS_HIGH_WATER);
+    chansrv_hold_cliprdr_data(hold);
+    if (hold)
+    {
+        if (g_ss_stall_timer == NULL)
+        {
+            g_ss_stall_timer = reactor_add_timer(chansrv_get_reactor(),
+                                                 SS_STALL_MS, ss_stalled, 0);
+        }
+    }
+    else if (g_ss_stall_timer != NULL)
+    {
+        reactor_cancel_timer(g_ss_stall_timer);
+        g_ss_stall_timer = NULL;
+    }
+}
+
+/*****************************************************************************/
+/* returns where the next data_bytes go, NULL on error */
+static char *
+ss_reserve(int data_bytes)
+{
+    int pending;
+    char *data;
+
+    pending = g_clip_c2s.read_bytes_done - g_clip_c2s.incr_bytes_done;
+    if (g_clip_c2s.read_bytes_done + data_bytes > g_clip_c2s.data_size)
+    {
+        /* what was sent is in the property now, reuse its space */
+        g_memmove(g_clip_c2s.data,
+                  g_clip_c2s.data + g_clip_c2s.incr_bytes_done, pending);
+        g_clip_c2s.incr_bytes_done = 0;
+        g_clip_c2s.read_bytes_done = pending;
+    }
+    if (pending + data_bytes > g_clip_c2s.data_size)
+    {
+        /* only for the message that came in as the data was held */
+        data = (char *)g_malloc(pending + data_bytes, 0);
+        if (data == NULL)
+        {
+            return NULL;
+        }
+        g_memcpy(data, g_clip_c2s.data, pending);
+        g_free(g_clip_c2s.data);
+        g_clip_c2s.data = data;
+        g_clip_c2s.data_size = pending + data_bytes;
+    }
+    return g_clip_c2s.data + g_clip_c2s.read_bytes_done;
+}
+
+/*****************************************************************************/
+/* gives the requestor the next chunk if it is waiting for one, the empty
+   chunk once all the data is through */
+static void
+ss_send_chunk(void)
+{
+    char *data;
+    int data_bytes;
+
+    data_bytes = g_clip_c2s.read_bytes_done - g_clip_c2s.incr_bytes_done;
+    if (!g_clip_c2s.streaming)
+    {
+        return;
+    }
+    if (g_clip_c2s.incr_in_progress)
+    {
+        LOG_DEVEL(LOG_LEVEL_DEBUG, "ss_send_chunk: incr_in_progress set");
+    }
+    else if ((data_bytes < 1) && g_clip_c2s.doing_response_ss)
+    {
+        LOG_DEVEL(LOG_LEVEL_DEBUG, "ss_send_chunk: waiting for the client");
+    }
+    else
+    {
+        data = g_clip_c2s.data + g_clip_c2s.incr_bytes_done;
+        if (data_bytes > g_incr_max_req_size)
+        {
+            data_bytes = g_incr_max_req_size;
+        }
+        g_clip_c2s.incr_bytes_done += data_bytes;
+        XChangeProperty(g_display, g_clip_c2s.window,
+                        g_clip_c2s.property, g_clip_c2s.type, 8,
+                        PropModeReplace, (tui8 *)data, data_bytes);
+        if (data_bytes < 1)
+        {
+            LOG_DEVEL(LOG_LEVEL_DEBUG, "ss_send_chunk: INCR done");
+            /* nothing is kept, the next paste asks the client again */
+            ss_drop();
+            return;
+        }
+        g_clip_c2s.incr_in_progress = 1;
+    }
+    ss_update_hold();
+}
+
 /*****************************************************************************/
 static int
 ss_part(char *data, int data_bytes)
 {
     int index;
+    int count;
     char *text;
 
     LOG_DEVEL(LOG_LEVEL_DEBUG, "ss_part: data_bytes %d read_bytes_done %d "
               "incr_bytes_done %d", data_bytes,
               g_clip_c2s.read_bytes_done,
               g_clip_c2s.incr_bytes_done);
+    if (!g_clip_c2s.streaming)
+    {
+        /* dropped, the rest of the response is ignored */
+        return 0;
+    }
     /* copy to buffer */
     if (g_clip_c2s.type == g_utf8_atom)
     {
         /* todo unicode */
-        text = (char *)g_malloc(data_bytes, 0);
-        index = 0;
-        data_bytes /= 2;
+        text = ss_reserve(data_bytes / 2 + 1);
+        if (text == NULL)
+        {
+            ss_drop();
+            return 1;
+        }
+        count = 0;
+        index = g_clip_c2s.skip_byte;
         while (index < data_bytes)
         {
-            text[index] = data[index * 2];
-            index++;
+            text[count] = data[index];
+            count++;
+            index += 2;
         }
-        text[index] = 0;
-        g_memcpy(g_clip_c2s.data + g_clip_c2s.read_bytes_done, text, data_bytes);
-        g_clip_c2s.read_bytes_done += data_bytes;
-        g_free(text);
+        g_clip_c2s.skip_byte = index - data_bytes;
+        g_clip_c2s.read_bytes_done += count;
     }
     else
     {
-        g_memcpy(g_clip_c2s.data + g_clip_c2s.read_bytes_done, data, data_bytes);
+        text = ss_reserve(data_bytes);
+        if (text == NULL)
+        {
+            ss_drop();
+            return 1;
+        }
+        g_memcpy(text, data, data_bytes);
         g_clip_c2s.read_bytes_done += data_bytes;
     }
-    if (g_clip_c2s.incr_in_progress)
-    {
-        LOG_DEVEL(LOG_LEVEL_DEBUG, "ss_part: incr_in_progress set");
-        return 0;
-    }
-    if (g_clip_c2s.read_bytes_done <= g_clip_c2s.incr_bytes_done)
-    {
-        LOG_DEVEL(LOG_LEVEL_DEBUG, "ss_part: read_bytes_done < incr_bytes_done");
-        return 0;
-    }
-    data = g_clip_c2s.data + g_clip_c2s.incr_bytes_done;
-    data_bytes = g_clip_c2s.read_bytes_done - g_clip_c2s.incr_bytes_done;
-    if (data_bytes > g_incr_max_req_size)
-    {
-        data_bytes = g_incr_max_req_size;
-    }
-    g_clip_c2s.incr_bytes_done += data_bytes;
-    XChangeProperty(g_display, g_clip_c2s.window,
-                    g_clip_c2s.property, g_clip_c2s.type, 8,
-                    PropModeReplace, (tui8 *)data, data_bytes);
-    g_clip_c2s.incr_in_progress = 1;
+    ss_send_chunk();
     return 0;
 }
 
@@ -1406,34 +1590,10 @@ ss_part(char *data, int data_bytes)
 static int
 ss_end(void)
 {
-    char *data;
-    int data_bytes;
-
     LOG_DEVEL(LOG_LEVEL_DEBUG, "ss_end:");
     g_clip_c2s.doing_response_ss = 0;
     g_clip_c2s.in_request = 0;
-
-    if (g_clip_c2s.incr_in_progress)
-    {
-        LOG_DEVEL(LOG_LEVEL_DEBUG, "ss_end: incr_in_progress set");
-        return 0;
-    }
-    if (g_clip_c2s.read_bytes_done <= g_clip_c2s.incr_bytes_done)
-    {
-        LOG_DEVEL(LOG_LEVEL_DEBUG, "ss_end: read_bytes_done < incr_bytes_done");
-        return 0;
-    }
-    data = g_clip_c2s.data + g_clip_c2s.incr_bytes_done;
-    data_bytes = g_clip_c2s.read_bytes_done - g_clip_c2s.incr_bytes_done;
-    if (data_bytes > g_incr_max_req_size)
-    {
-        data_bytes = g_incr_max_req_size;
-    }
-    g_clip_c2s.incr_bytes_done += data_bytes;
-    XChangeProperty(g_display, g_clip_c2s.window,
-                    g_clip_c2s.property, g_clip_c2s.type, 8,
-                    PropModeReplace, (tui8 *)data, data_bytes);
-    g_clip_c2s.incr_in_progress = 1;
+    ss_send_chunk();
     return 0;
 }
 
@@ -1462,15 +1622,32 @@ ss_start(char *data, int data_bytes, int total_bytes)
     val1[0] = incr_bytes; /* a guess */
     val1[1] = 0;
 
+    if (g_clip_c2s.streaming)
+    {
+        ss_drop();
+    }
     g_clip_c2s.doing_response_ss = 1;
     g_clip_c2s.incr_bytes_done = 0;
     g_clip_c2s.read_bytes_done = 0;
+    g_clip_c2s.skip_byte = 0;
+    g_clip_c2s.converted = 0;
     g_clip_c2s.type = req->target;
     g_clip_c2s.property = req->property;
     g_clip_c2s.window = req->requestor;
     g_free(g_clip_c2s.data);
-    g_clip_c2s.data = (char *)g_malloc(incr_bytes + 64, 0);
+    /* one chunk in the property and SS_HIGH_WATER waiting, never the
+       whole paste */
+    g_clip_c2s.data_size = SS_HIGH_WATER + g_incr_max_req_size;
+    g_clip_c2s.data = (char *)g_malloc(g_clip_c2s.data_size, 0);
     g_clip_c2s.total_bytes = incr_bytes;
+    if (g_clip_c2s.data == NULL)
+    {
+        /* the response is still read, see ss_part() */
+        g_clip_c2s.data_size = 0;
+        clipboard_refuse_selection(req);
+        return 1;
+    }
+    g_clip_c2s.streaming = 1;
 
     XChangeProperty(g_display, req->requestor, req->property,
                     g_incr_atom, 32, PropModeReplace, (tui8 *)val1, 1);
@@ -1673,6 +1850,9 @@ clipboard_event_selection_owner_notify(XEvent *xevent)
         LOG_DEVEL(LOG_LEVEL_DEBUG, "clipboard_event_selection_owner_notify: skipping, "
                   "owner == g_wnd");
         g_got_selection = 1;
+        /* the client's data now, the next owner is a new selection */
+        g_clip_s2c.owner = 0;
+        g_clip_s2c.converted = 0;
         return 0;
     }
 
@@ -1680,6 +1860,16 @@ clipboard_event_selection_owner_notify(XEvent *xevent)
     if (lxevent->owner != 0) /* nil owner comes when selection */
     {
         /* window is closed */
+        if ((lxevent->owner == g_clip_s2c.owner) &&
+                (lxevent->selection_timestamp == g_clip_s2c.owner_time))
+        {
+            LOG_DEVEL(LOG_LEVEL_DEBUG, "clipboard_event_selection_owner_notify: "
+                      "same owner and time, already announced");
+            return 0;
+        }
+        g_clip_s2c.owner = lxevent->owner;
+        g_clip_s2c.owner_time = lxevent->selection_timestamp;
+        g_clip_s2c.converted = 0;
         XConvertSelection(g_display, g_clipboard_atom, g_targets_atom,
                           g_clip_property_atom, g_wnd, lxevent->timestamp);
     }
@@ -1867,6 +2057,20 @@ clipboard_event_selection_notify(XEvent *xevent)
             g_clip_s2c.total_bytes = 0;
             g_free(g_clip_s2c.data);
             g_clip_s2c.data = 0;
+            g_clip_s2c.data_size = 0;
+            /* the INCR value is a lower bound on the size, allocating it
+               now saves growing the buffer for most chunks */
+            if ((fmt == 32) && (n_items > 0) &&
+                    (((long *)data)[0] > 0) &&
+                    (((long *)data)[0] <= S2C_INCR_MAX_HINT))
+            {
+                g_clip_s2c.data_size = (int)(((long *)data)[0]) + 1;
+                g_clip_s2c.data = (char *)g_malloc(g_clip_s2c.data_size, 0);
+                if (g_clip_s2c.data == 0)
+                {
+                    g_clip_s2c.data_size = 0;
+                }
+            }
             //LOG_DEVEL_HEXDUMP(LOG_LEVEL_TRACE, "", data, sizeof(long));
             g_free(data);
             return 0;
@@ -1929,6 +2133,7 @@ clipboard_event_selection_notify(XEvent *xevent)
                 {
                     g_free(g_clip_s2c.data);
                     g_clip_s2c.total_bytes = data_size;
+                    g_clip_s2c.converted = 1;
                     g_clip_s2c.data = (char *) g_malloc(g_clip_s2c.total_bytes + 1, 0);
                     g_memcpy(g_clip_s2c.data, data, g_clip_s2c.total_bytes);
                     g_clip_s2c.data[g_clip_s2c.total_bytes] = 0;
@@ -1952,6 +2157,7 @@ clipboard_event_selection_notify(XEvent *xevent)
                 {
                     g_free(g_clip_s2c.data);
                     g_clip_s2c.total_bytes = data_size;
+                    g_clip_s2c.converted = 1;
                     g_clip_s2c.data = (char *) g_malloc(g_clip_s2c.total_bytes + 1, 0);
                     g_memcpy(g_clip_s2c.data, data, g_clip_s2c.total_bytes);
                     g_clip_s2c.data[g_clip_s2c.total_bytes] = 0;
@@ -1967,6 +2173,7 @@ clipboard_event_selection_notify(XEvent *xevent)
                 {
                     g_free(g_clip_s2c.data);
                     g_clip_s2c.total_bytes = data_size;
+                    g_clip_s2c.converted = 1;
                     g_clip_s2c.data = (char *) g_malloc(data_size, 0);
                     g_memcpy(g_clip_s2c.data, data, data_size);
                     clipboard_send_data_response_for_image(g_clip_s2c.data + 14,
@@ -1981,6 +2188,7 @@ clipboard_event_selection_notify(XEvent *xevent)
                 {
                     g_free(g_clip_s2c.data);
                     g_clip_s2c.total_bytes = data_size;
+                    g_clip_s2c.converted = 1;
                     g_clip_s2c.data = (char *) g_malloc(g_clip_s2c.total_bytes + 1, 0);
                     g_memcpy(g_clip_s2c.data, data, g_clip_s2c.total_bytes);
                     g_clip_s2c.data[g_clip_s2c.total_bytes] = 0;
@@ -1996,6 +2204,7 @@ clipboard_event_selection_notify(XEvent *xevent)
                 {
                     g_free(g_clip_s2c.data);
                     g_clip_s2c.total_bytes = data_size;
+                    g_clip_s2c.converted = 1;
                     g_clip_s2c.data = (char *) g_malloc(g_clip_s2c.total_bytes + 1, 0);
                     g_memcpy(g_clip_s2c.data, data, g_clip_s2c.total_bytes);
                     g_clip_s2c.data[g_clip_s2c.total_bytes] = 0;
@@ -2168,6 +2377,13 @@ clipboard_event_selection_request(XEvent *xevent)
     }
     else if ((lxev->target == XA_STRING) || (lxev->target == g_utf8_atom))
     {
+        if ((g_clip_c2s.xrdp_clip_type == XRDP_CB_TEXT) && g_clip_c2s.converted)
+        {
+            LOG_DEVEL(LOG_LEVEL_DEBUG, "clipboard_event_selection_request: "
+                      "text from the cache");
+            clipboard_provide_selection_c2s(lxev, lxev->target);
+            return 0;
+        }
         g_memcpy(&g_saved_selection_req_event, lxev,
                  sizeof(g_saved_selection_req_event));
         g_clip_c2s.type = lxev->target;
@@ -2275,6 +2491,7 @@ clipboard_event_property_notify(XEvent *xevent)
     int rv;
     int format_in_bytes;
     int new_data_len;
+    int new_size;
     int data_bytes;
     char *cptr;
 
@@ -2292,6 +2509,12 @@ clipboard_event_property_notify(XEvent *xevent)
         /* this is used for when copying a large clipboard to the other app,
            it will delete the property so we know to send the next one */
 
+        if (g_clip_c2s.streaming)
+        {
+            g_clip_c2s.incr_in_progress = 0;
+            ss_send_chunk();
+            return 0;
+        }
         if ((g_clip_c2s.data == 0) || (g_clip_c2s.total_bytes < 1))
         {
             LOG_DEVEL(LOG_LEVEL_DEBUG, "clipboard_event_property_notify: INCR error");
@@ -2350,9 +2573,15 @@ clipboard_event_property_notify(XEvent *xevent)
             LOG_DEVEL(LOG_LEVEL_DEBUG, "clipboard_event_property_notify: INCR done");
             /* clipboard INCR cycle has completed */
             g_clip_s2c.incr_in_progress = 0;
+            if (g_clip_s2c.data != 0)
+            {
+                g_clip_s2c.data[g_clip_s2c.total_bytes] = 0;
+            }
+            /* only a type the client was sent is kept for the next paste */
             if (g_clip_s2c.type == g_image_bmp_atom)
             {
                 g_clip_s2c.xrdp_clip_type = XRDP_CB_BITMAP;
+                g_clip_s2c.converted = (g_clip_s2c.data != 0);
                 //LOG_DEVEL_HEXDUMP(LOG_LEVEL_TRACE, "", g_last_clip_data, 64);
                 /* skip header */
                 clipboard_send_data_response(g_clip_s2c.xrdp_clip_type,
@@ -2363,6 +2592,7 @@ clipboard_event_property_notify(XEvent *xevent)
                      (g_clip_s2c.type == g_utf8_atom))
             {
                 g_clip_s2c.xrdp_clip_type = XRDP_CB_TEXT;
+                g_clip_s2c.converted = (g_clip_s2c.data != 0);
                 clipboard_send_data_response(g_clip_s2c.xrdp_clip_type,
                                              g_clip_s2c.data,
                                              g_clip_s2c.total_bytes);
@@ -2389,26 +2619,38 @@ clipboard_event_property_notify(XEvent *xevent)
 
             format_in_bytes = FORMAT_TO_BYTES(actual_format_return);
             new_data_len = nitems_returned * format_in_bytes;
-            cptr = (char *) g_malloc(g_clip_s2c.total_bytes + new_data_len, 0);
-            g_memcpy(cptr, g_clip_s2c.data, g_clip_s2c.total_bytes);
-            g_free(g_clip_s2c.data);
-
-            if (cptr == NULL)
+            /* room for a nil too, the text is sent as a string */
+            new_size = g_clip_s2c.total_bytes + new_data_len + 1;
+            if (new_size > g_clip_s2c.data_size)
             {
-                g_clip_s2c.data = 0;
-
-                /* cannot add any more data */
-                if (data != 0)
+                /* grow by half at least, not once for every chunk */
+                if (new_size < g_clip_s2c.data_size + g_clip_s2c.data_size / 2)
                 {
-                    XFree(data);
+                    new_size = g_clip_s2c.data_size + g_clip_s2c.data_size / 2;
                 }
+                cptr = (char *) g_malloc(new_size, 0);
+                if (cptr == NULL)
+                {
+                    g_free(g_clip_s2c.data);
+                    g_clip_s2c.data = 0;
+                    g_clip_s2c.data_size = 0;
 
-                XDeleteProperty(g_display, g_wnd, g_clip_s2c.property);
-                return 0;
+                    /* cannot add any more data */
+                    if (data != 0)
+                    {
+                        XFree(data);
+                    }
+
+                    XDeleteProperty(g_display, g_wnd, g_clip_s2c.property);
+                    return 0;
+                }
+                g_memcpy(cptr, g_clip_s2c.data, g_clip_s2c.total_bytes);
+                g_free(g_clip_s2c.data);
+                g_clip_s2c.data = cptr;
+                g_clip_s2c.data_size = new_size;
             }
 
             LOG_DEVEL(LOG_LEVEL_DEBUG, "clipboard_event_property_notify: new_data_len %d", new_data_len);
-            g_clip_s2c.data = cptr;
             g_memcpy(g_clip_s2c.data + g_clip_s2c.total_bytes, data, new_data_len);
             g_clip_s2c.total_bytes += new_data_len;
 
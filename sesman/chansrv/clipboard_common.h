@@ -91,12 +91,15 @@ struct clip_s2c /* server to client, pasting from linux app to mstsc */
 {
     int incr_in_progress;
     int total_bytes;
+    int data_size; /* bytes allocated at data during INCR */
     char *data;
     Atom type; /* UTF8_STRING, image/bmp, ... */
     Atom property; /* XRDP_CLIP_PROPERTY_ATOM, _QT_SELECTION, ... */
     int xrdp_clip_type; /* XRDP_CB_TEXT, XRDP_CB_BITMAP, XRDP_CB_FILE, ... */
-    int converted;
+    int converted; /* data holds xrdp_clip_type of the current selection */
     Time clip_time;
+    Window owner; /* the selection data is cached for, with owner_time */
+    Time owner_time;
 };
 
 struct clip_c2s /* client to server, pasting from mstsc to linux app */
@@ -113,6 +116,9 @@ struct clip_c2s /* client to server, pasting from mstsc to linux app */
     int converted;
     int in_request; /* a data request has been sent to client */
     int doing_response_ss; /* doing response short circuit */
+    int streaming; /* data only holds what the requestor hasn't got yet */
+    int data_size; /* bytes allocated at data while streaming */
+    int skip_byte; /* a UTF-16 unit was split between two fragments */
     Time clip_time;
 };
 
@@ -104,7 +104,6 @@ int g_is_drive_redir_supported = 0;
 int g_is_smartcard_redir_supported = 0;
 int g_drive_redir_version = 1;
 char g_full_name_for_filesystem[1024];
-tui32 g_completion_id = 1;
 
 tui32 g_clientID;           /* unique client ID - announced by client */
 tui32 g_device_id;          /* unique device ID - announced by client */
@@ -907,6 +906,7 @@ devredir_proc_device_iocompletion(struct stream *s)
     tui32      CompletionId;
     tui32      IoStatus32;
     tui32      Length;
+    tui32      FileId;
     enum COMPLETION_TYPE comp_type;
 
     xstream_rd_u32_le(s, DeviceId);
@@ -954,14 +954,16 @@ devredir_proc_device_iocompletion(struct stream *s)
                 }
                 else
                 {
-                    xstream_rd_u32_le(s, irp->FileId);
+                    xstream_rd_u32_le(s, FileId);
+                    devredir_irp_set_fileid(irp, FileId);
                     devredir_send_drive_dir_request(irp, DeviceId,
                                                     1, irp->pathname);
                 }
                 break;
 
             case CID_CREATE_REQ:
-                xstream_rd_u32_le(s, irp->FileId);
+                xstream_rd_u32_le(s, FileId);
+                devredir_irp_set_fileid(irp, FileId);
 
                 xfuse_devredir_cb_create_file(
                     (struct state_create *) irp->fuse_info,
@@ -973,7 +975,8 @@ devredir_proc_device_iocompletion(struct stream *s)
                 break;
 
             case CID_OPEN_REQ:
-                xstream_rd_u32_le(s, irp->FileId);
+                xstream_rd_u32_le(s, FileId);
+                devredir_irp_set_fileid(irp, FileId);
 
                 xfuse_devredir_cb_open_file((struct state_open *) irp->fuse_info,
                                             IoStatus, DeviceId, irp->FileId);
@@ -1014,7 +1017,8 @@ devredir_proc_device_iocompletion(struct stream *s)
                 break;
 
             case CID_RMDIR_OR_FILE:
-                xstream_rd_u32_le(s, irp->FileId);
+                xstream_rd_u32_le(s, FileId);
+                devredir_irp_set_fileid(irp, FileId);
                 devredir_proc_cid_rmdir_or_file(irp, IoStatus);
                 break;
 
@@ -1023,7 +1027,8 @@ devredir_proc_device_iocompletion(struct stream *s)
                 break;
 
             case CID_RENAME_FILE:
-                xstream_rd_u32_le(s, irp->FileId);
+                xstream_rd_u32_le(s, FileId);
+                devredir_irp_set_fileid(irp, FileId);
                 devredir_proc_cid_rename_file(irp, IoStatus);
                 break;
 
@@ -1156,7 +1161,6 @@ devredir_get_dir_listing(struct state_dirscan *fusep, tui32 device_id,
         strcpy(irp->pathname, path);
         devredir_cvt_slash(irp->pathname);
 
-        irp->CompletionId = g_completion_id++;
         irp->completion_type = CID_CREATE_DIR_REQ;
         irp->DeviceId = device_id;
         irp->fuse_info = fusep;
@@ -1220,7 +1224,6 @@ devredir_lookup_entry(struct state_lookup *fusep, tui32 device_id,
          * Allocate an IRP to open the file, read the basic attributes,
          * read the standard attributes, and then close the file
          */
-        irp->CompletionId = g_completion_id++;
         irp->completion_type = CID_LOOKUP;
         irp->DeviceId = device_id;
         irp->gen.lookup.state = E_LOOKUP_GET_FH;
@@ -1278,7 +1281,6 @@ devredir_setattr_for_entry(struct state_setattr *fusep, tui32 device_id,
          * Allocate an IRP to open the file, update the attributes
          * and close the file.
          */
-        irp->CompletionId = g_completion_id++;
         irp->completion_type = CID_SETATTR;
         irp->DeviceId = device_id;
         irp->fuse_info = fusep;
@@ -1331,7 +1333,6 @@ devredir_file_create(struct state_create *fusep, tui32 device_id,
         devredir_cvt_slash(irp->pathname);
 
         irp->completion_type = CID_CREATE_REQ;
-        irp->CompletionId = g_completion_id++;
         irp->DeviceId = device_id;
         irp->fuse_info = fusep;
 
@@ -1384,7 +1385,6 @@ devredir_file_open(struct state_open *fusep, tui32 device_id,
         devredir_cvt_slash(irp->pathname);
 
         irp->completion_type = CID_OPEN_REQ;
-        irp->CompletionId = g_completion_id++;
         irp->DeviceId = device_id;
 
         irp->fuse_info = fusep;
@@ -1439,8 +1439,6 @@ int devredir_file_close(struct state_close *fusep, tui32 device_id,
     {
         return -1;
     }
-
-    irp->CompletionId = g_completion_id++;
 #else
     if ((irp = devredir_irp_find_by_fileid(FileId)) == NULL)
     {
@@ -1480,7 +1478,6 @@ devredir_rmdir_or_file(struct state_remove *fusep, tui32 device_id,
         /* convert / to windows compatible \ */
         devredir_cvt_slash(irp->pathname);
 
-        irp->CompletionId = g_completion_id++;
         irp->completion_type = CID_RMDIR_OR_FILE;
         irp->DeviceId = device_id;
 
@@ -1541,7 +1538,6 @@ devredir_file_read(struct state_read *fusep, tui32 DeviceId, tui32 FileId,
         new_irp->DeviceId = DeviceId;
         new_irp->FileId = FileId;
         new_irp->completion_type = CID_READ;
-        new_irp->CompletionId = g_completion_id++;
         new_irp->fuse_info = fusep;
 
         devredir_insert_DeviceIoRequest(s,
@@ -1600,7 +1596,6 @@ devredir_file_write(struct state_write *fusep, tui32 DeviceId, tui32 FileId,
         new_irp->DeviceId = DeviceId;
         new_irp->FileId = FileId;
         new_irp->completion_type = CID_WRITE;
-        new_irp->CompletionId = g_completion_id++;
         new_irp->fuse_info = fusep;
         /* Offset needed after write to calculate new EOF */
         new_irp->gen.write.offset = Offset;
@@ -1665,7 +1660,6 @@ int devredir_file_rename(struct state_rename *fusep, tui32 device_id,
         devredir_cvt_slash(irp->gen.rename.new_name);
 
         irp->completion_type = CID_RENAME_FILE;
-        irp->CompletionId = g_completion_id++;
         irp->DeviceId = device_id;
 
         irp->fuse_info = fusep;
@@ -2043,6 +2037,7 @@ devredir_proc_cid_lookup(IRP *irp,
                          enum NTSTATUS IoStatus)
 {
     tui32 Length;
+    tui32 FileId;
 
     LOG_DEVEL(LOG_LEVEL_DEBUG, "entry state is %d", irp->gen.lookup.state);
     if (IoStatus != STATUS_SUCCESS)
@@ -2058,7 +2053,8 @@ devredir_proc_cid_lookup(IRP *irp,
         {
             case E_LOOKUP_GET_FH:
                 /* We've been sent the file ID */
-                xstream_rd_u32_le(s_in, irp->FileId);
+                xstream_rd_u32_le(s_in, FileId);
+                devredir_irp_set_fileid(irp, FileId);
                 issue_lookup(irp, FileBasicInformation);
                 irp->gen.lookup.state = E_LOOKUP_CHECK_BASIC;
                 break;
@@ -2221,6 +2217,7 @@ devredir_proc_cid_setattr(IRP *irp,
 #define TO_SET_BASIC_ATTRS (TO_SET_MODE | \
                             TO_SET_ATIME | TO_SET_MTIME)
     tui32 Length;
+    tui32 FileId;
 
     LOG_DEVEL(LOG_LEVEL_DEBUG, "entry state is %d", irp->gen.setattr.state);
     if (IoStatus != STATUS_SUCCESS)
@@ -2236,7 +2233,8 @@ devredir_proc_cid_setattr(IRP *irp,
         {
             case E_SETATTR_GET_FH:
                 /* We've been sent the file ID */
-                xstream_rd_u32_le(s_in, irp->FileId);
+                xstream_rd_u32_le(s_in, FileId);
+                devredir_irp_set_fileid(irp, FileId);
                 break;
 
             case E_SETATTR_CHECK_BASIC:
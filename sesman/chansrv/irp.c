@@ -31,10 +31,281 @@
 #include "string_calls.h"
 #include "irp.h"
 
-IRP *g_irp_head = NULL;
+/* Initial number of slots in an IRP table, a power of two */
+#define IRP_TABLE_INITIAL_SIZE 64
+
+/*
+ * An open addressing hash table of IRPs with linear probing.
+ *
+ * The table is kept at most half full. Removing an entry moves later
+ * entries of its probe sequence back, so no tombstones are needed.
+ */
+struct irp_table
+{
+    IRP          **slots;
+    unsigned int   size;             /* Number of slots, a power of two */
+    unsigned int   count;            /* Number of slots in use          */
+    tui32        (*key)(const IRP *irp);
+};
+
+static tui32 completion_id_key(const IRP *irp);
+static tui32 file_id_key(const IRP *irp);
+
+/* Every IRP, by CompletionId */
+static struct irp_table g_by_completion_id = { NULL, 0, 0, completion_id_key };
+
+/* The first IRP given each FileId with devredir_irp_set_fileid(). Later
+ * IRPs with the same FileId are on its fileid_next list */
+static struct irp_table g_by_file_id = { NULL, 0, 0, file_id_key };
+
+/* The CompletionId last handed out. CompletionIds are not reused until
+ * the counter wraps, and never while in use, so a late completion for a
+ * deleted IRP is rejected rather than matched with a newer one */
+static tui32 g_completion_id = 0;
+
+/*****************************************************************************/
+static tui32
+completion_id_key(const IRP *irp)
+{
+    return irp->CompletionId;
+}
+
+/*****************************************************************************/
+static tui32
+file_id_key(const IRP *irp)
+{
+    return irp->FileId;
+}
+
+/*****************************************************************************/
+static unsigned int
+irp_table_home(const struct irp_table *table, tui32 key)
+{
+    /* Multiplying by an odd number maps consecutive keys to distinct
+     * slots, and spreads out keys which are a power of two apart */
+    return (unsigned int)(key * 2654435769U) & (table->size - 1);
+}
+
+/*****************************************************************************/
+static IRP *
+irp_table_find(const struct irp_table *table, tui32 key)
+{
+    unsigned int i;
+    IRP *irp;
+
+    if (table->count == 0)
+    {
+        return NULL;
+    }
+
+    for (i = irp_table_home(table, key);
+            (irp = table->slots[i]) != NULL;
+            i = (i + 1) & (table->size - 1))
+    {
+        if (table->key(irp) == key)
+        {
+            return irp;
+        }
+    }
+
+    return NULL;
+}
+
+/*****************************************************************************/
+static void
+irp_table_place(struct irp_table *table, IRP *irp)
+{
+    unsigned int i = irp_table_home(table, table->key(irp));
+
+    while (table->slots[i] != NULL)
+    {
+        i = (i + 1) & (table->size - 1);
+    }
+    table->slots[i] = irp;
+}
+
+/*****************************************************************************/
+static int
+irp_table_resize(struct irp_table *table, unsigned int size)
+{
+    IRP **old_slots = table->slots;
+    unsigned int old_size = table->size;
+    unsigned int i;
+    IRP **slots;
+
+    if ((slots = g_new0(IRP *, size)) == NULL)
+    {
+        return 1;
+    }
+
+    table->slots = slots;
+    table->size = size;
+    for (i = 0; i < old_size; ++i)
+    {
+        if (old_slots[i] != NULL)
+        {
+            irp_table_place(table, old_slots[i]);
+        }
+    }
+    g_free(old_slots);
+
+    return 0;
+}
+
+/*****************************************************************************/
+/* returns 0 on success, 1 if out of memory */
+static int
+irp_table_add(struct irp_table *table, IRP *irp)
+{
+    if ((table->count + 1) * 2 > table->size &&
+            irp_table_resize(table, (table->size == 0) ?
+                             IRP_TABLE_INITIAL_SIZE : table->size * 2) != 0)
+    {
+        return 1;
+    }
+
+    irp_table_place(table, irp);
+    ++table->count;
+
+    return 0;
+}
+
+/*****************************************************************************/
+/* returns the slot holding irp, or -1 */
+static int
+irp_table_slot_of(const struct irp_table *table, const IRP *irp)
+{
+    unsigned int i;
+
+    if (table->count == 0)
+    {
+        return -1;
+    }
+
+    for (i = irp_table_home(table, table->key(irp));
+            table->slots[i] != NULL;
+            i = (i + 1) & (table->size - 1))
+    {
+        if (table->slots[i] == irp)
+        {
+            return (int)i;
+        }
+    }
+
+    return -1;
+}
+
+/*****************************************************************************/
+static void
+irp_table_remove(struct irp_table *table, IRP *irp)
+{
+    unsigned int mask = table->size - 1;
+    unsigned int hole;
+    unsigned int i;
+    unsigned int home;
+    int slot;
+    IRP *entry;
+
+    if ((slot = irp_table_slot_of(table, irp)) < 0)
+    {
+        return;
+    }
+
+    hole = (unsigned int)slot;
+    table->slots[hole] = NULL;
+    --table->count;
+
+    /* An entry after the hole which is no longer reachable from its home
+     * slot is moved in to the hole, leaving a new hole behind it */
+    for (i = (hole + 1) & mask; (entry = table->slots[i]) != NULL;
+            i = (i + 1) & mask)
+    {
+        home = irp_table_home(table, table->key(entry));
+        if (((i - home) & mask) >= ((i - hole) & mask))
+        {
+            table->slots[hole] = entry;
+            table->slots[i] = NULL;
+            hole = i;
+        }
+    }
+
+    /* Give back memory after a burst, a failure here is harmless */
+    if (table->size > IRP_TABLE_INITIAL_SIZE && table->count * 8 < table->size)
+    {
+        irp_table_resize(table, table->size / 2);
+    }
+}
+
+/*****************************************************************************/
+static tui32
+next_completion_id(void)
+{
+    do
+    {
+        ++g_completion_id;
+    }
+    while (g_completion_id == 0 ||
+            irp_table_find(&g_by_completion_id, g_completion_id) != NULL);
+
+    return g_completion_id;
+}
+
+/*****************************************************************************/
+/* Takes irp out of the FileId index, if it is in it */
+static void
+remove_from_fileid_index(IRP *irp)
+{
+    IRP *p = irp_table_find(&g_by_file_id, irp->FileId);
+    int slot;
+
+    if (p == irp)
+    {
+        if (irp->fileid_next == NULL)
+        {
+            irp_table_remove(&g_by_file_id, irp);
+        }
+        else if ((slot = irp_table_slot_of(&g_by_file_id, irp)) >= 0)
+        {
+            /* Same key, so the next IRP can take over the slot */
+            g_by_file_id.slots[slot] = irp->fileid_next;
+        }
+    }
+    else
+    {
+        while (p != NULL && p->fileid_next != irp)
+        {
+            p = p->fileid_next;
+        }
+
+        if (p != NULL)
+        {
+            p->fileid_next = irp->fileid_next;
+        }
+    }
+
+    irp->fileid_next = NULL;
+}
+
+/*****************************************************************************/
+/* Gives a new IRP its CompletionId and adds it to the table */
+static IRP *
+devredir_irp_add(IRP *irp)
+{
+    irp->CompletionId = next_completion_id();
+    if (irp_table_add(&g_by_completion_id, irp) != 0)
+    {
+        LOG_DEVEL(LOG_LEVEL_ERROR, "system out of memory!");
+        g_free(irp);
+        return NULL;
+    }
+
+    LOG_DEVEL(LOG_LEVEL_DEBUG, "new IRP=%p completion_id=%d",
+              irp, irp->CompletionId);
+    return irp;
+}
 
 /**
- * Create a new IRP and append to linked list
+ * Create a new IRP and give it a CompletionId
  *
  * @return new IRP or NULL on error
  *****************************************************************************/
@@ -42,7 +313,6 @@ IRP *g_irp_head = NULL;
 IRP *devredir_irp_new(void)
 {
     IRP *irp;
-    IRP *irp_last;
 
     LOG_DEVEL(LOG_LEVEL_DEBUG, "entered");
 
@@ -54,24 +324,11 @@ IRP *devredir_irp_new(void)
         return NULL;
     }
 
-    /* insert at end of linked list */
-    if ((irp_last = devredir_irp_get_last()) == NULL)
-    {
-        /* list is empty, this is the first entry */
-        g_irp_head = irp;
-    }
-    else
-    {
-        irp_last->next = irp;
-        irp->prev = irp_last;
-    }
-
-    LOG_DEVEL(LOG_LEVEL_DEBUG, "new IRP=%p", irp);
-    return irp;
+    return devredir_irp_add(irp);
 }
 
 /**
- * Create a new IRP with a copied pathname, and append to linked list.
+ * Create a new IRP with a copied pathname, and give it a CompletionId
  *
  * Allocation is made in such a way that the IRP can be freed with a single
  * free() operation
@@ -92,8 +349,8 @@ IRP *devredir_irp_with_pathname_new(const char *pathname)
 }
 
 /**
- * Create a new IRP with space allocated for a pathname, and append to
- * linked list.
+ * Create a new IRP with space allocated for a pathname, and give it a
+ * CompletionId
  *
  * Allocation is made in such a way that the IRP can be freed with a single
  * free() operation
@@ -104,7 +361,6 @@ IRP *devredir_irp_with_pathname_new(const char *pathname)
 IRP *devredir_irp_with_pathnamelen_new(unsigned int pathnamelen)
 {
     IRP *irp;
-    IRP *irp_last;
 
     LOG_DEVEL(LOG_LEVEL_DEBUG, "entered");
 
@@ -118,90 +374,61 @@ IRP *devredir_irp_with_pathnamelen_new(unsigned int pathnamelen)
 
     irp->pathname = (char *)irp + sizeof(IRP); /* Initialise pathname pointer */
 
-    /* insert at end of linked list */
-    if ((irp_last = devredir_irp_get_last()) == NULL)
-    {
-        /* list is empty, this is the first entry */
-        g_irp_head = irp;
-    }
-    else
-    {
-        irp_last->next = irp;
-        irp->prev = irp_last;
-    }
-
-    LOG_DEVEL(LOG_LEVEL_DEBUG, "new IRP=%p", irp);
-    return irp;
+    return devredir_irp_add(irp);
 }
 
 /**
- * Delete specified IRP from linked list
+ * Delete specified IRP
  *
  * @return 0 on success, -1 on failure
  *****************************************************************************/
 
 int devredir_irp_delete(IRP *irp)
 {
-    IRP *lirp = g_irp_head;
-
-    if ((irp == NULL) || (lirp == NULL))
+    if ((irp == NULL) ||
+            (irp_table_find(&g_by_completion_id, irp->CompletionId) != irp))
     {
-        return -1;
+        return -1;    /* did not find specified irp */
     }
 
     LOG_DEVEL(LOG_LEVEL_DEBUG, "irp=%p completion_id=%d type=%d",
               irp, irp->CompletionId, irp->completion_type);
 
-    devredir_irp_dump(); // LK_TODO
+    irp_table_remove(&g_by_completion_id, irp);
+    remove_from_fileid_index(irp);
+    g_free(irp);
 
-    while (lirp)
-    {
-        if (lirp == irp)
-        {
-            break;
-        }
+    return 0;
+}
 
-        lirp = lirp->next;
-    }
+/**
+ * Set the FileId the client returned for an IRP, so it can be found
+ * with devredir_irp_find_by_fileid()
+ *****************************************************************************/
 
-    if (lirp == NULL)
-    {
-        return -1;    /* did not find specified irp */
-    }
+void devredir_irp_set_fileid(IRP *irp, tui32 FileId)
+{
+    IRP *p;
+
+    remove_from_fileid_index(irp);
+    irp->FileId = FileId;
 
-    if (lirp->prev == NULL)
+    if ((p = irp_table_find(&g_by_file_id, FileId)) == NULL)
     {
-        /* we are at head of linked list */
-        if (lirp->next == NULL)
+        if (irp_table_add(&g_by_file_id, irp) != 0)
         {
-            /* only one element in list */
-            g_free(lirp);
-            g_irp_head = NULL;
-            devredir_irp_dump(); // LK_TODO
-            return 0;
+            LOG(LOG_LEVEL_ERROR, "Out of memory indexing FileId %d", FileId);
         }
-
-        lirp->next->prev = NULL;
-        g_irp_head = lirp->next;
-        g_free(lirp);
-    }
-    else if (lirp->next == NULL)
-    {
-        /* we are at tail of linked list */
-        lirp->prev->next = NULL;
-        g_free(lirp);
     }
     else
     {
-        /* we are in between */
-        lirp->prev->next = lirp->next;
-        lirp->next->prev = lirp->prev;
-        g_free(lirp);
+        /* Keep the oldest first, it's the one which opened the file */
+        while (p->fileid_next != NULL)
+        {
+            p = p->fileid_next;
+        }
+        p->fileid_next = irp;
     }
-
-    devredir_irp_dump(); // LK_TODO
-
-    return 0;
 }
 
 /**
@@ -210,75 +437,42 @@ int devredir_irp_delete(IRP *irp)
 
 IRP *devredir_irp_find(tui32 completion_id)
 {
-    IRP *irp = g_irp_head;
-
-    while (irp)
-    {
-        if (irp->CompletionId == completion_id)
-        {
-            LOG_DEVEL(LOG_LEVEL_DEBUG, "returning irp=%p", irp);
-            return irp;
-        }
-
-        irp = irp->next;
-    }
+    IRP *irp = irp_table_find(&g_by_completion_id, completion_id);
 
-    LOG_DEVEL(LOG_LEVEL_DEBUG, "returning irp=NULL");
-    return NULL;
+    LOG_DEVEL(LOG_LEVEL_DEBUG, "returning irp=%p", irp);
+    return irp;
 }
 
 IRP *devredir_irp_find_by_fileid(tui32 FileId)
 {
-    IRP *irp = g_irp_head;
+    IRP *irp = irp_table_find(&g_by_file_id, FileId);
 
-    while (irp)
-    {
-        if (irp->FileId == FileId)
-        {
-            LOG_DEVEL(LOG_LEVEL_DEBUG, "returning irp=%p", irp);
-            return irp;
-        }
-
-        irp = irp->next;
-    }
-
-    LOG_DEVEL(LOG_LEVEL_DEBUG, "returning irp=NULL");
-    return NULL;
+    LOG_DEVEL(LOG_LEVEL_DEBUG, "returning irp=%p", irp);
+    return irp;
 }
 
 /**
- * Return last IRP in linked list
+ * Return number of IRPs in use
  *****************************************************************************/
 
-IRP *devredir_irp_get_last(void)
+unsigned int devredir_irp_count(void)
 {
-    IRP *irp = g_irp_head;
-
-    while (irp)
-    {
-        if (irp->next == NULL)
-        {
-            break;
-        }
-
-        irp = irp->next;
-    }
-
-    LOG_DEVEL(LOG_LEVEL_DEBUG, "returning irp=%p", irp);
-    return irp;
+    return g_by_completion_id.count;
 }
 
 void devredir_irp_dump(void)
 {
-    IRP *irp = g_irp_head;
+    unsigned int i;
+    IRP *irp;
 
     LOG_DEVEL(LOG_LEVEL_DEBUG, "------- dumping IRPs --------");
-    while (irp)
+    for (i = 0; i < g_by_completion_id.size; ++i)
     {
-        LOG_DEVEL(LOG_LEVEL_DEBUG, "        completion_id=%d\tcompletion_type=%d\tFileId=%d",
-                  irp->CompletionId, irp->completion_type, irp->FileId);
-
-        irp = irp->next;
+        if ((irp = g_by_completion_id.slots[i]) != NULL)
+        {
+            LOG_DEVEL(LOG_LEVEL_DEBUG, "        completion_id=%d\tcompletion_type=%d\tFileId=%d",
+                      irp->CompletionId, irp->completion_type, irp->FileId);
+        }
     }
     LOG_DEVEL(LOG_LEVEL_DEBUG, "------- dumping IRPs done ---");
 }
@@ -80,9 +80,11 @@ typedef struct irp IRP;
 
 struct irp
 {
-    tui32      CompletionId;        /* unique number                     */
+    tui32      CompletionId;        /* unique number, set on creation    */
     tui32      DeviceId;            /* identifies remote device          */
-    tui32      FileId;              /* RDP client provided unique number */
+    tui32      FileId;              /* RDP client provided unique number
+                                     * Set with devredir_irp_set_fileid()
+                                     * if the IRP is to be found by it   */
     char       completion_type;     /* describes I/O type                */
     char       *pathname;           /* absolute pathname
                                      * Allocate with
@@ -96,8 +98,7 @@ struct irp
         struct irp_rename  rename;  /* Use by rename                     */
     } gen;                          /* Additional state data for some ops */
     void      *fuse_info;           /* Fuse info pointer for FUSE calls  */
-    IRP       *next;                /* point to next IRP                 */
-    IRP       *prev;                /* point to previous IRP             */
+    IRP       *fileid_next;         /* next IRP with the same FileId     */
     int        scard_index;         /* used to smart card to locate dev  */
 
     void     (*callback)(struct stream *s, IRP *irp, tui32 DeviceId,
@@ -105,6 +106,7 @@ struct irp
     void      *user_data;
 };
 
+/* All the constructors give the IRP a CompletionId which is not in use */
 IRP * devredir_irp_new(void);
 /* As above, but allocates sufficent space for the specified
  * pathname, and copies it in to the pathname field */
@@ -114,9 +116,11 @@ IRP * devredir_irp_with_pathname_new(const char *pathname);
  * significantly */
 IRP * devredir_irp_with_pathnamelen_new(unsigned int pathnamelen);
 int   devredir_irp_delete(IRP *irp);
+void  devredir_irp_set_fileid(IRP *irp, tui32 FileId);
 IRP * devredir_irp_find(tui32 completion_id);
+/* Returns the oldest IRP given this FileId with devredir_irp_set_fileid() */
 IRP * devredir_irp_find_by_fileid(tui32 FileId);
-IRP * devredir_irp_get_last(void);
+unsigned int devredir_irp_count(void);
 void  devredir_irp_dump(void);
 
 #endif /* end ifndef __IRP_H */
@@ -35,6 +35,7 @@
 #include <X11/extensions/Xrandr.h>
 #include <X11/cursorfont.h>
 #include "chansrv.h"
+#include "chansrv_reactor.h"
 #include "rail.h"
 #include "xcommon.h"
 #include "log.h"
@@ -70,6 +71,7 @@ static struct list *g_window_list = 0;
 
 static int g_got_focus = 0;
 static int g_focus_counter = 0;
+static struct reactor_timer *g_popdown_timer = 0; /* my_timeout() pending */
 static Window g_focus_win = 0;
 
 static int g_xrr_event_base = 0; /* non zero means we got extension */
@@ -354,6 +356,8 @@ rail_deinit(void)
         g_window_list = 0;
         /* no longer window manager */
         XSelectInput(g_display, g_root_window, 0);
+        reactor_cancel_timer(g_popdown_timer);
+        g_popdown_timer = 0;
         g_rail_up = 0;
     }
 
@@ -551,6 +555,7 @@ void
 my_timeout(void *data)
 {
     LOG_DEVEL(LOG_LEVEL_DEBUG, "my_timeout: g_got_focus %d", g_got_focus);
+    g_popdown_timer = 0;
     if (g_focus_counter == (int)(long)data)
     {
         LOG_DEVEL(LOG_LEVEL_DEBUG, "my_timeout: g_focus_counter %d", g_focus_counter);
@@ -581,6 +586,9 @@ rail_process_activate(struct stream *s, int size)
     }
 
     g_focus_counter++;
+    /* a newer activate supersedes a pending popdown */
+    reactor_cancel_timer(g_popdown_timer);
+    g_popdown_timer = 0;
     g_got_focus = enabled;
     LOG_DEVEL(LOG_LEVEL_DEBUG, "  window_id 0x%8.8x enabled %d", window_id, enabled);
 
@@ -621,7 +629,9 @@ rail_process_activate(struct stream *s, int size)
     {
         LOG_DEVEL(LOG_LEVEL_DEBUG, "  window attributes: override_redirect %d",
                   window_attributes.override_redirect);
-        add_timeout(200, my_timeout, (void *)(long)g_focus_counter);
+        g_popdown_timer = reactor_add_timer(chansrv_get_reactor(), 200,
+                                            my_timeout,
+                                            (void *)(long)g_focus_counter);
     }
     return 0;
 }
@@ -118,7 +118,6 @@ static tui32 g_device_id = 0;
 static int   g_scard_index = 0;
 
 /* externs */
-extern tui32 g_completion_id;
 extern int   g_rdpdr_chan_id;    /* in chansrv.c */
 
 
@@ -343,7 +342,6 @@ scard_send_establish_context(void *user_data, int scope)
     }
 
     irp->scard_index = g_scard_index;
-    irp->CompletionId = g_completion_id++;
     irp->DeviceId = g_device_id;
     irp->callback = scard_handle_EstablishContext_Return;
     irp->user_data = user_data;
@@ -371,7 +369,6 @@ scard_send_release_context(void *user_data,
     }
 
     irp->scard_index = g_scard_index;
-    irp->CompletionId = g_completion_id++;
     irp->DeviceId = g_device_id;
     irp->callback = scard_handle_ReleaseContext_Return;
     irp->user_data = user_data;
@@ -398,7 +395,6 @@ scard_send_is_valid_context(void *user_data, char *context, int context_bytes)
     }
 
     irp->scard_index = g_scard_index;
-    irp->CompletionId = g_completion_id++;
     irp->DeviceId = g_device_id;
     irp->callback = scard_handle_IsContextValid_Return;
     irp->user_data = user_data;
@@ -425,7 +421,6 @@ scard_send_list_readers(void *user_data, char *context, int context_bytes,
         return 1;
     }
     irp->scard_index = g_scard_index;
-    irp->CompletionId = g_completion_id++;
     irp->DeviceId = g_device_id;
     irp->callback = scard_handle_ListReaders_Return;
     irp->user_data = user_data;
@@ -461,7 +456,6 @@ scard_send_get_status_change(void *user_data, char *context, int context_bytes,
     }
 
     irp->scard_index = g_scard_index;
-    irp->CompletionId = g_completion_id++;
     irp->DeviceId = g_device_id;
     irp->callback = scard_handle_GetStatusChange_Return;
     irp->user_data = user_data;
@@ -493,7 +487,6 @@ scard_send_connect(void *user_data, char *context, int context_bytes,
     }
 
     irp->scard_index = g_scard_index;
-    irp->CompletionId = g_completion_id++;
     irp->DeviceId = g_device_id;
     irp->callback = scard_handle_Connect_Return;
     irp->user_data = user_data;
@@ -529,7 +522,6 @@ scard_send_reconnect(void *user_data, char *context, int context_bytes,
     }
 
     irp->scard_index = g_scard_index;
-    irp->CompletionId = g_completion_id++;
     irp->DeviceId = g_device_id;
     irp->callback = scard_handle_Reconnect_Return;
     irp->user_data = user_data;
@@ -560,7 +552,6 @@ scard_send_begin_transaction(void *user_data, char *context, int context_bytes,
     }
 
     irp->scard_index = g_scard_index;
-    irp->CompletionId = g_completion_id++;
     irp->DeviceId = g_device_id;
     irp->callback = scard_handle_BeginTransaction_Return;
     irp->user_data = user_data;
@@ -593,7 +584,6 @@ scard_send_end_transaction(void *user_data, char *context, int context_bytes,
     }
 
     irp->scard_index = g_scard_index;
-    irp->CompletionId = g_completion_id++;
     irp->DeviceId = g_device_id;
     irp->callback = scard_handle_EndTransaction_Return;
     irp->user_data = user_data;
@@ -626,7 +616,6 @@ scard_send_status(void *user_data, int wide, char *context, int context_bytes,
     }
 
     irp->scard_index = g_scard_index;
-    irp->CompletionId = g_completion_id++;
     irp->DeviceId = g_device_id;
     irp->callback = scard_handle_Status_Return;
     irp->user_data = user_data;
@@ -658,7 +647,6 @@ scard_send_disconnect(void *user_data, char *context, int context_bytes,
     }
 
     irp->scard_index = g_scard_index;
-    irp->CompletionId = g_completion_id++;
     irp->DeviceId = g_device_id;
     irp->callback = scard_handle_Disconnect_Return;
     irp->user_data = user_data;
@@ -691,7 +679,6 @@ scard_send_transmit(void *user_data, char *context, int context_bytes,
     }
 
     irp->scard_index = g_scard_index;
-    irp->CompletionId = g_completion_id++;
     irp->DeviceId = g_device_id;
     irp->callback = scard_handle_Transmit_Return;
     irp->user_data = user_data;
@@ -723,7 +710,6 @@ scard_send_control(void *user_data, char *context, int context_bytes,
     }
 
     irp->scard_index = g_scard_index;
-    irp->CompletionId = g_completion_id++;
     irp->DeviceId = g_device_id;
     irp->callback = scard_handle_Control_Return;
     irp->user_data = user_data;
@@ -753,7 +739,6 @@ scard_send_cancel(void *user_data, char *context, int context_bytes)
     }
 
     irp->scard_index = g_scard_index;
-    irp->CompletionId = g_completion_id++;
     irp->DeviceId = g_device_id;
     irp->callback = scard_handle_Cancel_Return;
     irp->user_data = user_data;
@@ -781,7 +766,6 @@ scard_send_get_attrib(void *user_data, char *card, int card_bytes,
     }
 
     irp->scard_index = g_scard_index;
-    irp->CompletionId = g_completion_id++;
     irp->DeviceId = g_device_id;
     irp->callback = scard_handle_GetAttrib_Return;
     irp->user_data = user_data;
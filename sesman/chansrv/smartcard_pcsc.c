@@ -40,6 +40,7 @@
 #include "devredir.h"
 #include "trans.h"
 #include "chansrv.h"
+#include "chansrv_reactor.h"
 #include "list.h"
 
 #if PCSC_STANDIN
@@ -71,6 +72,7 @@ struct pcsc_uds_client
     struct trans *con;     /* the connection to the app */
     struct list *contexts; /* list of struct pcsc_context */
     struct pcsc_context *connect_context;
+    struct reactor_source *source;
 };
 
 static struct list *g_uds_clients = 0; /* struct pcsc_uds_client */
@@ -263,6 +265,7 @@ free_uds_client(struct pcsc_uds_client *uds_client)
         }
         list_delete(uds_client->contexts);
     }
+    reactor_remove(uds_client->source);
     trans_delete(uds_client->con);
     g_free(uds_client);
     return 0;
@@ -365,29 +368,15 @@ context_add_card(struct pcsc_uds_client *uds_client,
 }
 
 /*****************************************************************************/
+/* the clients are reactor sources, see uds_client_ready() */
 int
 scard_pcsc_get_wait_objs(tbus *objs, int *count, int *timeout)
 {
-    struct pcsc_uds_client *uds_client;
-    int index;
-
     LOG_DEVEL(LOG_LEVEL_DEBUG, "scard_pcsc_get_wait_objs:");
     if (g_lis != 0)
     {
         trans_get_wait_objs(g_lis, objs, count);
     }
-    if (g_uds_clients != 0)
-    {
-        for (index = 0; index < g_uds_clients->count; index++)
-        {
-            uds_client = (struct pcsc_uds_client *)
-                         list_get_item(g_uds_clients, index);
-            if (uds_client != 0)
-            {
-                trans_get_wait_objs(uds_client->con, objs, count);
-            }
-        }
-    }
     return 0;
 }
 
@@ -395,9 +384,6 @@ scard_pcsc_get_wait_objs(tbus *objs, int *count, int *timeout)
 int
 scard_pcsc_check_wait_objs(void)
 {
-    struct pcsc_uds_client *uds_client;
-    int index;
-
     LOG_DEVEL(LOG_LEVEL_DEBUG, "scard_pcsc_check_wait_objs:");
     if (g_lis != 0)
     {
@@ -407,25 +393,6 @@ scard_pcsc_check_wait_objs(void)
                 "scard_pcsc_check_wait_objs: g_lis trans_check_wait_objs error");
         }
     }
-    if (g_uds_clients != 0)
-    {
-        index = 0;
-        while (index < g_uds_clients->count)
-        {
-            uds_client = (struct pcsc_uds_client *)
-                         list_get_item(g_uds_clients, index);
-            if (uds_client != 0)
-            {
-                if (trans_check_wait_objs(uds_client->con) != 0)
-                {
-                    free_uds_client(uds_client);
-                    list_remove_item(g_uds_clients, index);
-                    continue;
-                }
-            }
-            index++;
-        }
-    }
     return 0;
 }
 
@@ -1800,6 +1767,22 @@ my_pcsc_trans_data_in(struct trans *trans)
     return error;
 }
 
+/*****************************************************************************/
+/* called by the reactor when the connection is readable */
+static void
+uds_client_ready(void *data)
+{
+    struct pcsc_uds_client *uds_client;
+
+    uds_client = (struct pcsc_uds_client *) data;
+    if (trans_check_wait_objs(uds_client->con) != 0)
+    {
+        list_remove_item(g_uds_clients,
+                         list_index_of(g_uds_clients, (tintptr) uds_client));
+        free_uds_client(uds_client);
+    }
+}
+
 /*****************************************************************************/
 /* got a new connection from libpcsclite */
 int
@@ -1831,6 +1814,16 @@ my_pcsc_trans_conn_in(struct trans *trans, struct trans *new_trans)
     }
     uds_client->con->trans_data_in = my_pcsc_trans_data_in;
     uds_client->con->header_size = 8;
+    /* replies use trans_force_write(), only reads are waited for */
+    uds_client->source = reactor_add(chansrv_get_reactor(),
+                                     uds_client->con->sck, REACTOR_READ,
+                                     uds_client_ready, uds_client);
+    if (uds_client->source == 0)
+    {
+        /* also closes the connection */
+        free_uds_client(uds_client);
+        return 1;
+    }
 
     if (g_uds_clients == 0)
     {
@@ -28,6 +28,8 @@
 #include <config_ac.h>
 #endif
 
+#include <stdio.h>
+
 #include "arch.h"
 #include "list.h"
 #include "file.h"
@@ -38,7 +40,7 @@
 /***************************************************************************//**
  *
  * @brief Reads sesman [global] configuration section
- * @param file configuration file descriptor
+ * @param ini snapshot of the configuration file
  * @param cf pointer to a config struct
  * @param param_n parameter name list
  * @param param_v parameter value list
@@ -46,7 +48,7 @@
  *
  */
 static int
-config_read_globals(int file, struct config_sesman *cf, struct list *param_n,
+config_read_globals(const struct file_snapshot *ini, struct config_sesman *cf, struct list *param_n,
                     struct list *param_v)
 {
     int i;
@@ -64,8 +66,11 @@ config_read_globals(int file, struct config_sesman *cf, struct list *param_n,
     cf->default_wm = 0;
     cf->auth_file_path = 0;
     cf->reconnect_sh = 0;
+    cf->metrics_file = 0;
+    cf->auth_workers = SESMAN_AUTH_WORKERS_DEFAULT;
+    cf->listen_unix = 1;
 
-    file_read_section(file, SESMAN_CFG_GLOBALS, param_n, param_v);
+    file_snapshot_read_section(ini, SESMAN_CFG_GLOBALS, param_n, param_v);
 
     for (i = 0; i < param_n->count; i++)
     {
@@ -99,6 +104,19 @@ config_read_globals(int file, struct config_sesman *cf, struct list *param_n,
         {
             cf->reconnect_sh = g_strdup((char *)list_get_item(param_v, i));
         }
+        else if (g_strcasecmp(buf, SESMAN_CFG_AUTH_WORKERS) == 0)
+        {
+            cf->auth_workers = g_atoi((char *)list_get_item(param_v, i));
+        }
+        else if (g_strcasecmp(buf, SESMAN_CFG_METRICS_FILE) == 0)
+        {
+            g_free(cf->metrics_file);
+            cf->metrics_file = g_strdup((char *)list_get_item(param_v, i));
+        }
+        else if (g_strcasecmp(buf, SESMAN_CFG_UNIX_SOCKET) == 0)
+        {
+            cf->listen_unix = g_text2bool((char *)list_get_item(param_v, i));
+        }
     }
 
     /* checking for missing required parameters */
@@ -112,6 +130,15 @@ config_read_globals(int file, struct config_sesman *cf, struct list *param_n,
         g_strncpy(cf->listen_port, "3350", 5);
     }
 
+    if (cf->auth_workers < 1)
+    {
+        cf->auth_workers = 1;
+    }
+    else if (cf->auth_workers > SESMAN_AUTH_WORKERS_MAX)
+    {
+        cf->auth_workers = SESMAN_AUTH_WORKERS_MAX;
+    }
+
     if ('\0' == cf->user_wm[0])
     {
         cf->enable_user_wm = 0;
@@ -165,7 +192,7 @@ config_read_globals(int file, struct config_sesman *cf, struct list *param_n,
 /***************************************************************************//**
  *
  * @brief Reads sesman [Security] configuration section
- * @param file configuration file descriptor
+ * @param ini snapshot of the configuration file
  * @param sc pointer to a config_security struct
  * @param param_n parameter name list
  * @param param_v parameter value list
@@ -173,7 +200,7 @@ config_read_globals(int file, struct config_sesman *cf, struct list *param_n,
  *
  */
 static int
-config_read_security(int file, struct config_security *sc,
+config_read_security(const struct file_snapshot *ini, struct config_security *sc,
                      struct list *param_n,
                      struct list *param_v)
 {
@@ -191,7 +218,7 @@ config_read_security(int file, struct config_security *sc,
     sc->ts_admins_enable = 0;
     sc->restrict_outbound_clipboard = 0;
 
-    file_read_section(file, SESMAN_CFG_SECURITY, param_n, param_v);
+    file_snapshot_read_section(ini, SESMAN_CFG_SECURITY, param_n, param_v);
 
     for (i = 0; i < param_n->count; i++)
     {
@@ -242,7 +269,7 @@ config_read_security(int file, struct config_security *sc,
 /***************************************************************************//**
  *
  * @brief Reads sesman [Sessions] configuration section
- * @param file configuration file descriptor
+ * @param ini snapshot of the configuration file
  * @param ss pointer to a config_sessions struct
  * @param param_n parameter name list
  * @param param_v parameter value list
@@ -250,7 +277,7 @@ config_read_security(int file, struct config_security *sc,
  *
  */
 static int
-config_read_sessions(int file, struct config_sessions *se, struct list *param_n,
+config_read_sessions(const struct file_snapshot *ini, struct config_sessions *se, struct list *param_n,
                      struct list *param_v)
 {
     int i;
@@ -267,7 +294,7 @@ config_read_sessions(int file, struct config_sessions *se, struct list *param_n,
     se->kill_disconnected = 0;
     se->policy = SESMAN_CFG_SESS_POLICY_DFLT;
 
-    file_read_section(file, SESMAN_CFG_SESSIONS, param_n, param_v);
+    file_snapshot_read_section(ini, SESMAN_CFG_SESSIONS, param_n, param_v);
 
     for (i = 0; i < param_n->count; i++)
     {
@@ -335,10 +362,115 @@ config_read_sessions(int file, struct config_sessions *se, struct list *param_n,
     return 0;
 }
 
+/***************************************************************************//**
+ *
+ * @brief Reads sesman [SessionPool] configuration section
+ * @param ini snapshot of the configuration file
+ * @param sp pointer to a config_session_pool struct
+ * @param param_n parameter name list
+ * @param param_v parameter value list
+ * @return 0 on success, 1 on failure
+ *
+ */
+static int
+config_read_session_pool(const struct file_snapshot *ini, struct config_session_pool *sp,
+                         struct list *param_n, struct list *param_v)
+{
+    int i;
+    int width;
+    int height;
+    int bpp;
+    int bytes;
+    char *buf;
+    const char *value;
+    const char *end;
+
+    list_clear(param_v);
+    list_clear(param_n);
+
+    /* setting defaults */
+    sp->idle_servers = 0;
+    sp->users = list_create();
+    sp->users->auto_free = 1;
+    sp->num_classes = 0;
+
+    file_snapshot_read_section(ini, SESMAN_CFG_POOL, param_n, param_v);
+
+    for (i = 0; i < param_n->count; i++)
+    {
+        buf = (char *)list_get_item(param_n, i);
+        value = (const char *)list_get_item(param_v, i);
+
+        if (0 == g_strcasecmp(buf, SESMAN_CFG_POOL_IDLE))
+        {
+            sp->idle_servers = g_atoi(value);
+        }
+        else if (0 == g_strcasecmp(buf, SESMAN_CFG_POOL_USERS))
+        {
+            /* comma separated user names */
+            while (value != NULL && sp->users->count < SESMAN_POOL_MAX_USERS)
+            {
+                while (*value == ' ')
+                {
+                    value++;
+                }
+                end = g_strchr(value, ',');
+                bytes = (end != NULL) ? (int)(end - value) : g_strlen(value);
+                while (bytes > 0 && value[bytes - 1] == ' ')
+                {
+                    bytes--;
+                }
+                if (bytes > 0)
+                {
+                    list_add_item(sp->users,
+                                  (tintptr) g_strndup(value, bytes));
+                }
+                value = (end != NULL) ? end + 1 : NULL;
+            }
+        }
+        else if (0 == g_strcasecmp(buf, SESMAN_CFG_POOL_CLASSES))
+        {
+            /* comma separated WIDTHxHEIGHTxBPP */
+            while (value != NULL && sp->num_classes < SESMAN_POOL_MAX_CLASSES)
+            {
+                if (sscanf(value, " %dx%dx%d", &width, &height, &bpp) == 3 &&
+                        width > 0 && height > 0 && bpp > 0)
+                {
+                    sp->classes[sp->num_classes].width = width;
+                    sp->classes[sp->num_classes].height = height;
+                    sp->classes[sp->num_classes].bpp = bpp;
+                    sp->num_classes++;
+                }
+                value = g_strchr(value, ',');
+                if (value != NULL)
+                {
+                    value++;
+                }
+            }
+        }
+    }
+
+    if (sp->idle_servers < 0)
+    {
+        sp->idle_servers = 0;
+    }
+    else if (sp->idle_servers > SESMAN_POOL_MAX_IDLE)
+    {
+        sp->idle_servers = SESMAN_POOL_MAX_IDLE;
+    }
+
+    if (sp->users->count == 0 || sp->num_classes == 0)
+    {
+        sp->idle_servers = 0;
+    }
+
+    return 0;
+}
+
 /***************************************************************************//**
  *
  * @brief Reads sesman [X11rdp] configuration section
- * @param file configuration file descriptor
+ * @param ini snapshot of the configuration file
  * @param cs pointer to a config_sesman struct
  * @param param_n parameter name list
  * @param param_v parameter value list
@@ -346,7 +478,7 @@ config_read_sessions(int file, struct config_sessions *se, struct list *param_n,
  *
  */
 static int
-config_read_rdp_params(int file, struct config_sesman *cs, struct list *param_n,
+config_read_rdp_params(const struct file_snapshot *ini, struct config_sesman *cs, struct list *param_n,
                        struct list *param_v)
 {
     int i;
@@ -357,7 +489,7 @@ config_read_rdp_params(int file, struct config_sesman *cs, struct list *param_n,
     cs->rdp_params = list_create();
     cs->rdp_params->auto_free = 1;
 
-    file_read_section(file, SESMAN_CFG_RDP_PARAMS, param_n, param_v);
+    file_snapshot_read_section(ini, SESMAN_CFG_RDP_PARAMS, param_n, param_v);
 
     for (i = 0; i < param_n->count; i++)
     {
@@ -370,7 +502,7 @@ config_read_rdp_params(int file, struct config_sesman *cs, struct list *param_n,
 /***************************************************************************//**
  *
  * @brief Reads sesman [Xorg] configuration section
- * @param file configuration file descriptor
+ * @param ini snapshot of the configuration file
  * @param cs pointer to a config_sesman struct
  * @param param_n parameter name list
  * @param param_v parameter value list
@@ -378,7 +510,7 @@ config_read_rdp_params(int file, struct config_sesman *cs, struct list *param_n,
  *
  */
 static int
-config_read_xorg_params(int file, struct config_sesman *cs,
+config_read_xorg_params(const struct file_snapshot *ini, struct config_sesman *cs,
                         struct list *param_n, struct list *param_v)
 {
     int i;
@@ -389,7 +521,7 @@ config_read_xorg_params(int file, struct config_sesman *cs,
     cs->xorg_params = list_create();
     cs->xorg_params->auto_free = 1;
 
-    file_read_section(file, SESMAN_CFG_XORG_PARAMS, param_n, param_v);
+    file_snapshot_read_section(ini, SESMAN_CFG_XORG_PARAMS, param_n, param_v);
 
     for (i = 0; i < param_n->count; i++)
     {
@@ -403,7 +535,7 @@ config_read_xorg_params(int file, struct config_sesman *cs,
 /***************************************************************************//**
  *
  * @brief Reads sesman [Xvnc] configuration section
- * @param file configuration file descriptor
+ * @param ini snapshot of the configuration file
  * @param cs pointer to a config_sesman struct
  * @param param_n parameter name list
  * @param param_v parameter value list
@@ -411,7 +543,7 @@ config_read_xorg_params(int file, struct config_sesman *cs,
  *
  */
 static int
-config_read_vnc_params(int file, struct config_sesman *cs, struct list *param_n,
+config_read_vnc_params(const struct file_snapshot *ini, struct config_sesman *cs, struct list *param_n,
                        struct list *param_v)
 {
     int i;
@@ -422,7 +554,7 @@ config_read_vnc_params(int file, struct config_sesman *cs, struct list *param_n,
     cs->vnc_params = list_create();
     cs->vnc_params->auto_free = 1;
 
-    file_read_section(file, SESMAN_CFG_VNC_PARAMS, param_n, param_v);
+    file_snapshot_read_section(ini, SESMAN_CFG_VNC_PARAMS, param_n, param_v);
 
     for (i = 0; i < param_n->count; i++)
     {
@@ -434,7 +566,7 @@ config_read_vnc_params(int file, struct config_sesman *cs, struct list *param_n,
 
 /******************************************************************************/
 static int
-config_read_session_variables(int file, struct config_sesman *cs,
+config_read_session_variables(const struct file_snapshot *ini, struct config_sesman *cs,
                               struct list *param_n, struct list *param_v)
 {
     int i;
@@ -447,7 +579,7 @@ config_read_session_variables(int file, struct config_sesman *cs,
     cs->env_values = list_create();
     cs->env_values->auto_free = 1;
 
-    file_read_section(file, SESMAN_CFG_SESSION_VARIABLES, param_n, param_v);
+    file_snapshot_read_section(ini, SESMAN_CFG_SESSION_VARIABLES, param_n, param_v);
 
     for (i = 0; i < param_n->count; i++)
     {
@@ -471,41 +603,42 @@ config_read(const char *sesman_ini)
     {
         if ((cfg->sesman_ini = g_strdup(sesman_ini)) != NULL)
         {
-            int fd;
-            if ((fd = g_file_open_ex(cfg->sesman_ini, 1, 0, 0, 0)) != -1)
+            /* the file is checked and parsed once, the sections below
+               are read from the same parsed copy */
+            struct file_snapshot *ini;
+            ini = file_snapshot_create(cfg->sesman_ini);
+            if (ini != NULL)
             {
-                struct list *sec;
                 struct list *param_n;
                 struct list *param_v;
-                sec = list_create();
-                sec->auto_free = 1;
-                file_read_sections(fd, sec);
                 param_n = list_create();
                 param_n->auto_free = 1;
                 param_v = list_create();
                 param_v->auto_free = 1;
 
                 /* read global config */
-                config_read_globals(fd, cfg, param_n, param_v);
+                config_read_globals(ini, cfg, param_n, param_v);
 
                 /* read Xvnc/X11rdp/Xorg parameter list */
-                config_read_vnc_params(fd, cfg, param_n, param_v);
-                config_read_rdp_params(fd, cfg, param_n, param_v);
-                config_read_xorg_params(fd, cfg, param_n, param_v);
+                config_read_vnc_params(ini, cfg, param_n, param_v);
+                config_read_rdp_params(ini, cfg, param_n, param_v);
+                config_read_xorg_params(ini, cfg, param_n, param_v);
 
                 /* read security config */
-                config_read_security(fd, &(cfg->sec), param_n, param_v);
+                config_read_security(ini, &(cfg->sec), param_n, param_v);
 
                 /* read session config */
-                config_read_sessions(fd, &(cfg->sess), param_n, param_v);
+                config_read_sessions(ini, &(cfg->sess), param_n, param_v);
+
+                /* read pre-started X server config */
+                config_read_session_pool(ini, &(cfg->pool), param_n, param_v);
 
-                config_read_session_variables(fd, cfg, param_n, param_v);
+                config_read_session_variables(ini, cfg, param_n, param_v);
 
                 /* cleanup */
-                list_delete(sec);
                 list_delete(param_v);
                 list_delete(param_n);
-                g_file_close(fd);
+                file_snapshot_delete(ini);
                 all_ok = 1;
             }
         }
@@ -535,12 +668,16 @@ config_dump(struct config_sesman *config)
     g_writeln("Global configuration:");
     g_writeln("    ListenAddress:            %s", config->listen_address);
     g_writeln("    ListenPort:               %s", config->listen_port);
+    g_writeln("    ListenUnixSocket:         %d", config->listen_unix);
     g_writeln("    EnableUserWindowManager:  %d", config->enable_user_wm);
     g_writeln("    UserWindowManager:        %s", config->user_wm);
     g_writeln("    DefaultWindowManager:     %s", config->default_wm);
     g_writeln("    ReconnectScript:          %s", config->reconnect_sh);
+    g_writeln("    AuthWorkers:              %d", config->auth_workers);
     g_writeln("    AuthFilePath:             %s",
               ((config->auth_file_path) ? (config->auth_file_path) : ("disabled")));
+    g_writeln("    MetricsFile:              %s",
+              ((config->metrics_file) ? (config->metrics_file) : ("disabled")));
 
     /* Session configuration */
     g_writeln("Session configuration:");
@@ -551,6 +688,22 @@ config_dump(struct config_sesman *config)
     g_writeln("    DisconnectedTimeLimit:    %d", se->max_disc_time);
     g_writeln("    Policy:                   %d", se->policy);
 
+    /* Pre-started X server configuration */
+    g_writeln("Session pool configuration:");
+    g_writeln("    IdleServers:              %d", config->pool.idle_servers);
+    for (i = 0; i < config->pool.users->count; i++)
+    {
+        g_writeln("    User %02d                   %s", i,
+                  (char *)list_get_item(config->pool.users, i));
+    }
+    for (i = 0; i < config->pool.num_classes; i++)
+    {
+        g_writeln("    Class %02d                  %dx%dx%d", i,
+                  config->pool.classes[i].width,
+                  config->pool.classes[i].height,
+                  config->pool.classes[i].bpp);
+    }
+
     /* Security configuration */
     g_writeln("Security configuration:");
     g_writeln("    AllowRootLogin:           %d", sc->allow_root);
@@ -641,6 +794,8 @@ config_free(struct config_sesman *cs)
         g_free(cs->default_wm);
         g_free(cs->reconnect_sh);
         g_free(cs->auth_file_path);
+        g_free(cs->metrics_file);
+        list_delete(cs->pool.users);
         list_delete(cs->rdp_params);
         list_delete(cs->vnc_params);
         list_delete(cs->xorg_params);
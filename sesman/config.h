@@ -40,6 +40,12 @@
 #define SESMAN_CFG_MAX_SESSION       "MaxSessions"
 #define SESMAN_CFG_AUTH_FILE_PATH    "AuthFilePath"
 #define SESMAN_CFG_RECONNECT_SH      "ReconnectScript"
+#define SESMAN_CFG_AUTH_WORKERS      "AuthWorkers"
+#define SESMAN_CFG_UNIX_SOCKET       "ListenUnixSocket"
+#define SESMAN_CFG_METRICS_FILE      "MetricsFile"
+
+#define SESMAN_AUTH_WORKERS_DEFAULT  4
+#define SESMAN_AUTH_WORKERS_MAX      64
 
 #define SESMAN_CFG_RDP_PARAMS        "X11rdp"
 #define SESMAN_CFG_XORG_PARAMS       "Xorg"
@@ -69,6 +75,15 @@
 #define SESMAN_CFG_SESS_DISC_LIMIT   "DisconnectedTimeLimit"
 #define SESMAN_CFG_SESS_X11DISPLAYOFFSET "X11DisplayOffset"
 
+#define SESMAN_CFG_POOL              "SessionPool"
+#define SESMAN_CFG_POOL_IDLE         "IdleServers"
+#define SESMAN_CFG_POOL_USERS        "Users"
+#define SESMAN_CFG_POOL_CLASSES      "Classes"
+
+#define SESMAN_POOL_MAX_CLASSES      8
+#define SESMAN_POOL_MAX_IDLE         16
+#define SESMAN_POOL_MAX_USERS        16
+
 #define SESMAN_CFG_SESS_POLICY_S "Policy"
 #define SESMAN_CFG_SESS_POLICY_DFLT_S "Default"
 #define SESMAN_CFG_SESS_POLICY_UBD_S "UBD"
@@ -174,6 +189,46 @@ struct config_sessions
   enum SESMAN_CFG_SESS_POLICY policy;
 };
 
+/**
+ *
+ * @struct config_pool_class
+ * @brief geometry and depth of a class of pre-started X servers
+ *
+ */
+struct config_pool_class
+{
+  int width;
+  int height;
+  int bpp;
+};
+
+/**
+ *
+ * @struct config_session_pool
+ * @brief struct that contains the pre-started X server configuration
+ *
+ */
+struct config_session_pool
+{
+  /**
+   * @var idle_servers
+   * @brief idle Xorg servers kept per class, 0 disables the pool
+   */
+  int idle_servers;
+  /**
+   * @var users
+   * @brief accounts idle servers are kept for, each server runs as the
+   *        account it is handed to
+   */
+  struct list *users;
+  /**
+   * @var num_classes
+   * @brief number of entries in classes
+   */
+  int num_classes;
+  struct config_pool_class classes[SESMAN_POOL_MAX_CLASSES];
+};
+
 /**
  *
  * @struct config_sesman
@@ -202,6 +257,11 @@ struct config_sesman
    * @brief Listening port
    */
   char listen_port[16];
+  /**
+   * @var listen_unix
+   * @brief Also accept SCP connections on SESMAN_UNIX_STR
+   */
+  int listen_unix;
   /**
    * @var enable_user_wm
    * @brief Flag that enables user specific wm
@@ -227,6 +287,16 @@ struct config_sesman
    * @brief Auth file path
    */
   char* auth_file_path;
+  /**
+   * @var auth_workers
+   * @brief Number of threads serving SCP logins concurrently
+   */
+  int auth_workers;
+  /**
+   * @var metrics_file
+   * @brief File the login latency histograms are written to, or 0
+   */
+  char *metrics_file;
   /**
    * @var vnc_params
    * @brief Xvnc additional parameter list
@@ -257,6 +327,11 @@ struct config_sesman
    * @brief Session configuration options struct
    */
   struct config_sessions sess;
+  /**
+   * @var pool
+   * @brief Pre-started X server configuration
+   */
+  struct config_session_pool pool;
 
   /**
    * @var env_names
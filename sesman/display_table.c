@@ -0,0 +1,443 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Copyright (C) Jay Sorg 2004-2021
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ *
+ * @file display_table.c
+ * @brief Table of X displays in use on the machine
+ *
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include <config_ac.h>
+#endif
+
+#include <dirent.h>
+#include <unistd.h>
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+#include "display_table.h"
+#include "log.h"
+#include "os_calls.h"
+#include "string_calls.h"
+#include "xrdp_sockets.h"
+
+struct display_table_file
+{
+    int dir;            /* index in g_dirs */
+    const char *format; /* file name with a single %d for the display */
+};
+
+struct display_table_dir
+{
+    const char *path;
+    int wd;
+};
+
+static struct display_table_dir g_dirs[] =
+{
+    { "/tmp/.X11-unix", -1 },
+    { "/tmp", -1 },
+    { XRDP_SOCKET_PATH, -1 }
+};
+
+#define DISPLAY_TABLE_NUM_DIRS \
+    ((int)(sizeof(g_dirs) / sizeof(g_dirs[0])))
+
+/* the files x_server_running_check_ports() used to stat, one bit each
+   in g_display_files, the order matches the DISPLAY_TABLE_FILE_* bits */
+static const struct display_table_file g_files[] =
+{
+    { 0, "X%d" },
+    { 1, ".X%d-lock" },
+    { 2, XRDP_CHANSRV_BASE_STR },
+    { 2, CHANSRV_PORT_OUT_BASE_STR },
+    { 2, CHANSRV_PORT_IN_BASE_STR },
+    { 2, CHANSRV_API_BASE_STR },
+    { 2, XRDP_X11RDP_BASE_STR }
+};
+
+#define DISPLAY_TABLE_NUM_FILES \
+    ((int)(sizeof(g_files) / sizeof(g_files[0])))
+
+static tui8 *g_display_files = NULL;
+static int g_inotify_fd = -1;
+static tbus g_inotify_obj = 0;
+/* cleared when a watched directory goes away and can't be watched again,
+   callers then probe the filesystem */
+static int g_active = 0;
+
+/*****************************************************************************/
+/* returns the display number if name matches format, else -1 */
+static int
+display_table_match(const char *name, const char *format)
+{
+    const char *pct;
+    int prefix_len;
+    int display;
+
+    pct = g_strchr(format, '%');
+    if (pct == NULL || pct[1] != 'd')
+    {
+        return -1;
+    }
+    prefix_len = (int)(pct - format);
+    if (g_strncmp(name, format, prefix_len) != 0)
+    {
+        return -1;
+    }
+    name += prefix_len;
+    if (*name < '0' || *name > '9')
+    {
+        return -1;
+    }
+    display = 0;
+    while (*name >= '0' && *name <= '9')
+    {
+        display = display * 10 + (*name - '0');
+        if (display >= DISPLAY_TABLE_MAX)
+        {
+            return -1;
+        }
+        name++;
+    }
+    if (g_strcmp(name, pct + 2) != 0)
+    {
+        return -1;
+    }
+    return display;
+}
+
+/*****************************************************************************/
+static void
+display_table_update(int dir, const char *name, int exists)
+{
+    int index;
+    int display;
+
+    for (index = 0; index < DISPLAY_TABLE_NUM_FILES; index++)
+    {
+        if (g_files[index].dir != dir)
+        {
+            continue;
+        }
+        display = display_table_match(name, g_files[index].format);
+        if (display < 0)
+        {
+            continue;
+        }
+        if (exists)
+        {
+            g_display_files[display] |= 1 << index;
+        }
+        else
+        {
+            g_display_files[display] &= ~(1 << index);
+        }
+        LOG_DEVEL(LOG_LEVEL_DEBUG, "display_table_update: %s/%s %s, "
+                  "display %d flags 0x%2.2x", g_dirs[dir].path, name,
+                  exists ? "added" : "removed", display,
+                  g_display_files[display]);
+        return;
+    }
+}
+
+/*****************************************************************************/
+static void
+display_table_scan(void)
+{
+    int dir;
+    DIR *dp;
+    struct dirent *entry;
+
+    g_memset(g_display_files, 0, DISPLAY_TABLE_MAX);
+    for (dir = 0; dir < DISPLAY_TABLE_NUM_DIRS; dir++)
+    {
+        dp = opendir(g_dirs[dir].path);
+        if (dp == NULL)
+        {
+            continue;
+        }
+        while ((entry = readdir(dp)) != NULL)
+        {
+            display_table_update(dir, entry->d_name, 1);
+        }
+        closedir(dp);
+    }
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+/*****************************************************************************/
+static int
+display_table_watch(int dir)
+{
+    g_dirs[dir].wd = inotify_add_watch(g_inotify_fd, g_dirs[dir].path,
+                                       IN_CREATE | IN_DELETE |
+                                       IN_MOVED_FROM | IN_MOVED_TO |
+                                       IN_MOVE_SELF | IN_ONLYDIR);
+    if (g_dirs[dir].wd < 0)
+    {
+        LOG(LOG_LEVEL_WARNING, "display_table_watch: can't watch %s (%s), "
+            "probing displays instead", g_dirs[dir].path, g_get_strerror());
+        return 1;
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+/* the watch on dir is gone (the directory was deleted or moved), watch
+   the path again, which may be a new directory, and rescan */
+static void
+display_table_rewatch(int dir)
+{
+    g_dirs[dir].wd = -1;
+    if (!g_active)
+    {
+        return;
+    }
+    LOG(LOG_LEVEL_INFO, "display_table_rewatch: %s was removed, rescanning",
+        g_dirs[dir].path);
+    if (display_table_watch(dir) != 0)
+    {
+        g_active = 0;
+        return;
+    }
+    display_table_scan();
+}
+#endif
+
+/*****************************************************************************/
+int
+display_table_init(void)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+    int dir;
+
+    g_display_files = (tui8 *)g_malloc(DISPLAY_TABLE_MAX, 1);
+    if (g_display_files == NULL)
+    {
+        return 1;
+    }
+    g_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (g_inotify_fd < 0)
+    {
+        LOG(LOG_LEVEL_WARNING, "display_table_init: inotify_init1 failed "
+            "(%s), probing displays instead", g_get_strerror());
+        display_table_deinit();
+        return 1;
+    }
+    /* watch before scanning so nothing created in between is missed */
+    for (dir = 0; dir < DISPLAY_TABLE_NUM_DIRS; dir++)
+    {
+        if (display_table_watch(dir) != 0)
+        {
+            display_table_deinit();
+            return 1;
+        }
+    }
+    display_table_scan();
+    g_active = 1;
+    g_inotify_obj = g_create_wait_obj_from_socket(g_inotify_fd, 0);
+    LOG(LOG_LEVEL_INFO, "display table active, watching %d directories",
+        DISPLAY_TABLE_NUM_DIRS);
+    return 0;
+#else
+    return 1;
+#endif
+}
+
+/*****************************************************************************/
+void
+display_table_deinit(void)
+{
+    int dir;
+
+    if (g_inotify_obj != 0)
+    {
+        g_delete_wait_obj_from_socket(g_inotify_obj);
+        g_inotify_obj = 0;
+    }
+    if (g_inotify_fd >= 0)
+    {
+        close(g_inotify_fd);
+        g_inotify_fd = -1;
+    }
+    for (dir = 0; dir < DISPLAY_TABLE_NUM_DIRS; dir++)
+    {
+        g_dirs[dir].wd = -1;
+    }
+    g_active = 0;
+    g_free(g_display_files);
+    g_display_files = NULL;
+}
+
+/*****************************************************************************/
+tbus
+display_table_get_wait_obj(void)
+{
+    return g_inotify_obj;
+}
+
+/*****************************************************************************/
+int
+display_table_check_wait_obj(void)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *event;
+    int bytes;
+    int offset;
+    int dir;
+
+    if (g_inotify_fd < 0)
+    {
+        return 0;
+    }
+    for (;;)
+    {
+        bytes = read(g_inotify_fd, buf, sizeof(buf));
+        if (bytes <= 0)
+        {
+            break;
+        }
+        for (offset = 0; offset < bytes;
+                offset += sizeof(struct inotify_event) + event->len)
+        {
+            event = (const struct inotify_event *)(buf + offset);
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                LOG(LOG_LEVEL_INFO, "display_table_check_wait_obj: "
+                    "event queue overflow, rescanning");
+                display_table_scan();
+                continue;
+            }
+            for (dir = 0; dir < DISPLAY_TABLE_NUM_DIRS; dir++)
+            {
+                if (g_dirs[dir].wd != event->wd)
+                {
+                    continue;
+                }
+                if (event->mask & IN_MOVE_SELF)
+                {
+                    /* the watch follows the moved directory, drop it, the
+                       IN_IGNORED that follows watches the path again */
+                    inotify_rm_watch(g_inotify_fd, event->wd);
+                }
+                else if (event->mask & IN_IGNORED)
+                {
+                    /* also sent after IN_DELETE_SELF */
+                    display_table_rewatch(dir);
+                }
+                else if (event->len > 0)
+                {
+                    display_table_update(dir, event->name,
+                                         (event->mask &
+                                          (IN_CREATE | IN_MOVED_TO)) != 0);
+                }
+                break;
+            }
+        }
+    }
+#endif
+    return 0;
+}
+
+/*****************************************************************************/
+int
+display_table_in_use(int display)
+{
+    if (!g_active || display < 0 || display >= DISPLAY_TABLE_MAX)
+    {
+        return -1;
+    }
+    return g_display_files[display] != 0;
+}
+
+/*****************************************************************************/
+int
+display_table_get_files(int display)
+{
+    if (!g_active || display < 0 || display >= DISPLAY_TABLE_MAX)
+    {
+        return -1;
+    }
+    return g_display_files[display];
+}
+
+/*****************************************************************************/
+int
+display_table_wait_for_file(const char *dir, const char *name, int timeout_ms)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    char path[256];
+    const struct inotify_event *event;
+    int fd;
+    int rv;
+    int bytes;
+    int offset;
+    int start;
+    int remaining;
+
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (inotify_add_watch(fd, dir, IN_CREATE | IN_MOVED_TO | IN_ONLYDIR) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    /* the watch is in place, so a file created after this check is
+       reported */
+    g_snprintf(path, sizeof(path), "%s/%s", dir, name);
+    rv = g_file_exist(path) ? 1 : 0;
+    start = g_time3();
+    while (rv == 0)
+    {
+        remaining = timeout_ms - (g_time3() - start);
+        if (remaining <= 0)
+        {
+            break;
+        }
+        if (!g_sck_can_recv(fd, remaining))
+        {
+            continue;
+        }
+        bytes = read(fd, buf, sizeof(buf));
+        for (offset = 0; offset < bytes;
+                offset += sizeof(struct inotify_event) + event->len)
+        {
+            event = (const struct inotify_event *)(buf + offset);
+            if (event->len > 0 && g_strcmp(event->name, name) == 0)
+            {
+                rv = 1;
+            }
+        }
+    }
+    close(fd);
+    return rv;
+#else
+    return -1;
+#endif
+}
@@ -0,0 +1,116 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Copyright (C) Jay Sorg 2004-2021
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ *
+ * @file display_table.h
+ * @brief Table of X displays in use on the machine
+ *
+ * The table records, per display, which of the X server and xrdp socket
+ * and lock files exist. It is filled by a directory scan at startup and
+ * kept up to date with inotify, so checking a display does not touch
+ * the filesystem.
+ *
+ */
+
+#ifndef DISPLAY_TABLE_H
+#define DISPLAY_TABLE_H
+
+#include "arch.h"
+
+#define DISPLAY_TABLE_MAX 8192
+
+/* files returned by display_table_get_files() */
+#define DISPLAY_TABLE_FILE_X11     (1 << 0) /* /tmp/.X11-unix/X<n> */
+#define DISPLAY_TABLE_FILE_CHANSRV (1 << 2) /* chansrv socket */
+
+/**
+ *
+ * @brief scans the socket directories and starts watching them
+ * @return 0 if the table is active, non-zero if callers must probe the
+ *         filesystem themselves
+ *
+ */
+int
+display_table_init(void);
+
+/**
+ *
+ * @brief stops watching and releases the table
+ *
+ */
+void
+display_table_deinit(void);
+
+/**
+ *
+ * @brief wait object set when the watched directories change
+ * @return the wait object or 0 if the table is not active
+ *
+ */
+tbus
+display_table_get_wait_obj(void);
+
+/**
+ *
+ * @brief applies the pending directory changes to the table
+ *
+ */
+int
+display_table_check_wait_obj(void);
+
+/**
+ *
+ * @brief looks up a display
+ * @param display the display to check
+ * @return 1 if a file of the display exists, 0 if none does, -1 if the
+ *         table can't tell
+ *
+ */
+int
+display_table_in_use(int display);
+
+/**
+ *
+ * @brief which files of a display exist
+ * @param display the display to check
+ * @return a mask of DISPLAY_TABLE_FILE_* bits, -1 if the table can't tell
+ *
+ */
+int
+display_table_get_files(int display);
+
+/**
+ *
+ * @brief waits for a file to be created in a directory
+ *
+ * Used for X server readiness, the server creates its socket in
+ * /tmp/.X11-unix once it accepts connections. Works for any socket
+ * directory, it does not need the table to be active.
+ *
+ * @param dir directory to watch
+ * @param name file name in dir
+ * @param timeout_ms how long to wait
+ * @return 1 if the file exists, 0 on timeout, -1 if the directory can't
+ *         be watched and the caller must poll
+ *
+ */
+int
+display_table_wait_for_file(const char *dir, const char *name, int timeout_ms);
+
+#endif
@@ -148,6 +148,7 @@ enum SCP_SERVER_STATES_E
   SCP_SERVER_STATE_START_MANAGE,
   SCP_SERVER_STATE_MNG_LISTREQ,
   SCP_SERVER_STATE_MNG_ACTION,
+  SCP_SERVER_STATE_MNG_METRICSREQ,
   SCP_SERVER_STATE_END
 };
 
@@ -267,6 +267,97 @@ scp_v1c_mng_get_session_list(struct SCP_CONNECTION *c, int *scount,
     return SCP_CLIENT_STATE_LIST_OK;
 }
 
+/* 008 */
+enum SCP_CLIENT_STATES_E
+scp_v1c_mng_get_metrics(struct SCP_CONNECTION *c, char *text, int text_bytes)
+{
+    tui32 version = 1;
+    tui32 size = 12;
+    tui16 cmd = SCP_CMD_MNG_METRICS_REQ;
+    tui16 tlen;
+
+    init_stream(c->out_s, c->out_s->size);
+
+    /* we request the metrics */
+    out_uint32_be(c->out_s, version);                 /* version */
+    out_uint32_be(c->out_s, size);                    /* size    */
+    out_uint16_be(c->out_s, SCP_COMMAND_SET_MANAGE); /* cmdset  */
+    out_uint16_be(c->out_s, cmd);                     /* cmd     */
+
+    if (0 != scp_tcp_force_send(c->in_sck, c->out_s->data, size))
+    {
+        LOG(LOG_LEVEL_WARNING, "[v1c_mng:%d] connection aborted: network error", __LINE__);
+        return SCP_CLIENT_STATE_NETWORK_ERR;
+    }
+
+    /* then we wait for server response */
+    init_stream(c->in_s, c->in_s->size);
+
+    if (0 != scp_tcp_force_recv(c->in_sck, c->in_s->data, 8))
+    {
+        LOG(LOG_LEVEL_WARNING, "[v1c_mng:%d] connection aborted: network error", __LINE__);
+        return SCP_CLIENT_STATE_NETWORK_ERR;
+    }
+
+    in_uint32_be(c->in_s, version);
+
+    if (version != 1)
+    {
+        LOG(LOG_LEVEL_WARNING, "[v1c_mng:%d] connection aborted: version error", __LINE__);
+        return SCP_CLIENT_STATE_VERSION_ERR;
+    }
+
+    in_uint32_be(c->in_s, size);
+
+    if (size < 14 || size > SCP_MAX_MESSAGE_SIZE)
+    {
+        LOG(LOG_LEVEL_WARNING, "[v1c_mng:%d] connection aborted: size error", __LINE__);
+        return SCP_CLIENT_STATE_SIZE_ERR;
+    }
+
+    init_stream(c->in_s, c->in_s->size);
+
+    if (0 != scp_tcp_force_recv(c->in_sck, c->in_s->data, size - 8))
+    {
+        LOG(LOG_LEVEL_WARNING, "[v1c_mng:%d] connection aborted: network error", __LINE__);
+        return SCP_CLIENT_STATE_NETWORK_ERR;
+    }
+
+    in_uint16_be(c->in_s, cmd);
+
+    if (cmd != SCP_COMMAND_SET_MANAGE)
+    {
+        LOG(LOG_LEVEL_WARNING, "[v1c_mng:%d] connection aborted: sequence error", __LINE__);
+        return SCP_CLIENT_STATE_SEQUENCE_ERR;
+    }
+
+    in_uint16_be(c->in_s, cmd);
+
+    if (cmd != SCP_CMD_MNG_METRICS)
+    {
+        LOG(LOG_LEVEL_WARNING, "[v1c_mng:%d] connection aborted: sequence error", __LINE__);
+        return SCP_CLIENT_STATE_SEQUENCE_ERR;
+    }
+
+    in_uint16_be(c->in_s, tlen);
+
+    if (tlen > size - 14 || text_bytes < 1)
+    {
+        LOG(LOG_LEVEL_WARNING, "[v1c_mng:%d] connection aborted: size error", __LINE__);
+        return SCP_CLIENT_STATE_SIZE_ERR;
+    }
+
+    if (tlen > text_bytes - 1)
+    {
+        tlen = text_bytes - 1;
+    }
+
+    in_uint8a(c->in_s, text, tlen);
+    text[tlen] = '\0';
+
+    return SCP_CLIENT_STATE_OK;
+}
+
 /* 043 * /
 enum SCP_CLIENT_STATES_E
 scp_v1c_select_session(struct SCP_CONNECTION* c, struct SCP_SESSION* s,
@@ -52,4 +52,8 @@ enum SCP_CLIENT_STATES_E
 scp_v1c_mng_get_session_list(struct SCP_CONNECTION* c, int* scount,
                          struct SCP_DISCONNECTED_SESSION** s);
 
+/* 008 */
+enum SCP_CLIENT_STATES_E
+scp_v1c_mng_get_metrics(struct SCP_CONNECTION* c, char* text, int text_bytes);
+
 #endif
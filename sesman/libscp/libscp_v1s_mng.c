@@ -378,6 +378,41 @@ scp_v1s_mng_list_sessions(struct SCP_CONNECTION *c, struct SCP_SESSION *s,
     return _scp_v1s_mng_check_response(c, s);
 }
 
+/* 009 */
+enum SCP_SERVER_STATES_E
+scp_v1s_mng_send_metrics(struct SCP_CONNECTION *c, struct SCP_SESSION *s,
+                         const char *text)
+{
+    int tlen;
+
+    init_stream(c->out_s, c->out_s->size);
+
+    /* forcing message not to exceed SCP_MAX_MESSAGE_SIZE */
+    tlen = g_strlen(text);
+
+    if (tlen > SCP_MAX_MESSAGE_SIZE - 14)
+    {
+        tlen = SCP_MAX_MESSAGE_SIZE - 14;
+    }
+
+    out_uint32_be(c->out_s, 1);
+    /* packet size: 4 + 4 + 2 + 2 + 2 + strlen(text)*/
+    /* version + size + cmdset + cmd + textlen + text */
+    out_uint32_be(c->out_s, tlen + 14);
+    out_uint16_be(c->out_s, SCP_COMMAND_SET_MANAGE);
+    out_uint16_be(c->out_s, SCP_CMD_MNG_METRICS);
+    out_uint16_be(c->out_s, tlen);
+    out_uint8p(c->out_s, text, tlen);
+
+    if (0 != scp_tcp_force_send(c->in_sck, c->out_s->data, tlen + 14))
+    {
+        LOG(LOG_LEVEL_WARNING, "[v1s_mng:%d] connection aborted: network error", __LINE__);
+        return SCP_SERVER_STATE_NETWORK_ERR;
+    }
+
+    return _scp_v1s_mng_check_response(c, s);
+}
+
 static enum SCP_SERVER_STATES_E
 _scp_v1s_mng_check_response(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
 {
@@ -439,6 +474,11 @@ _scp_v1s_mng_check_response(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
         LOG(LOG_LEVEL_INFO, "[v1s_mng:%d] request session list", __LINE__);
         return SCP_SERVER_STATE_MNG_LISTREQ;
     }
+    else if (cmd == SCP_CMD_MNG_METRICS_REQ) /* request metrics */
+    {
+        LOG(LOG_LEVEL_INFO, "[v1s_mng:%d] request metrics", __LINE__);
+        return SCP_SERVER_STATE_MNG_METRICSREQ;
+    }
     else if (cmd == SCP_CMD_MNG_ACTION) /* execute an action */
     {
         /*in_uint8(c->in_s, dim);
@@ -75,4 +75,16 @@ scp_v1s_mng_list_sessions(struct SCP_CONNECTION* c, struct SCP_SESSION* s,
                           int sescnt, struct SCP_DISCONNECTED_SESSION* ds);
 //                           SCP_SID* sid);
 
+/**
+ *
+ * @brief sends the login latency metrics
+ * @param c connection descriptor
+ * @param text the metrics as text, truncated to fit a message
+ *
+ */
+/* 009 */
+enum SCP_SERVER_STATES_E
+scp_v1s_mng_send_metrics(struct SCP_CONNECTION* c, struct SCP_SESSION* s,
+                         const char *text);
+
 #endif
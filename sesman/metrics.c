@@ -0,0 +1,380 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Copyright (C) Jay Sorg 2004-2021
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ *
+ * @file metrics.c
+ * @brief Login latency histograms
+ *
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include <config_ac.h>
+#endif
+
+#include <stdio.h>
+
+#include "metrics.h"
+#include "display_table.h"
+#include "list.h"
+#include "log.h"
+#include "os_calls.h"
+#include "string_calls.h"
+#include "thread_calls.h"
+
+/* values below 2^METRICS_SUB_BITS get a bucket each, above that every
+   power of two is split in 2^METRICS_SUB_BITS buckets */
+#define METRICS_SUB_BITS 3
+#define METRICS_SUB_COUNT (1 << METRICS_SUB_BITS)
+#define METRICS_MAX_BITS 40 /* about 12 days in microseconds */
+#define METRICS_BUCKETS \
+    (METRICS_SUB_COUNT + (METRICS_MAX_BITS - METRICS_SUB_BITS) * METRICS_SUB_COUNT)
+
+/* a session whose sockets didn't appear after this is not waited for */
+#define METRICS_PENDING_TIMEOUT_US (120 * 1000000LL)
+
+struct metrics_histogram
+{
+    tui64 count;
+    tui64 sum;
+    tui64 max;
+    tui64 buckets[METRICS_BUCKETS];
+};
+
+/* a started session waiting for its X server and chansrv sockets */
+struct metrics_pending
+{
+    int display;
+    int phases_left; /* DISPLAY_TABLE_FILE_* bits not seen yet */
+    tui64 start_us;
+};
+
+static const char *g_phase_names[METRICS_PHASE_COUNT] =
+{
+    "scp",
+    "auth",
+    "session_start",
+    "xserver",
+    "chansrv"
+};
+
+static const double g_quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+static struct metrics_histogram *g_histograms = NULL;
+static tbus g_metrics_lock = 0;
+static int g_generation = 0; /* bumped on each record */
+static int g_written_generation = 0;
+static struct list *g_pending = NULL; /* main thread only */
+
+/*****************************************************************************/
+static int
+metrics_bucket(tui64 value)
+{
+    int bits;
+
+    if (value < METRICS_SUB_COUNT)
+    {
+        return (int)value;
+    }
+    if (value >> METRICS_MAX_BITS)
+    {
+        return METRICS_BUCKETS - 1;
+    }
+    bits = 0;
+    while ((value >> bits) >= 2 * METRICS_SUB_COUNT)
+    {
+        bits++;
+    }
+    /* value >> bits is in [METRICS_SUB_COUNT, 2 * METRICS_SUB_COUNT) */
+    return (int)(METRICS_SUB_COUNT + bits * METRICS_SUB_COUNT +
+                 ((value >> bits) - METRICS_SUB_COUNT));
+}
+
+/*****************************************************************************/
+/* highest value that falls in a bucket */
+static tui64
+metrics_bucket_high(int bucket)
+{
+    int bits;
+    tui64 sub;
+
+    if (bucket < METRICS_SUB_COUNT)
+    {
+        return (tui64)bucket;
+    }
+    bits = (bucket - METRICS_SUB_COUNT) / METRICS_SUB_COUNT;
+    sub = (tui64)((bucket - METRICS_SUB_COUNT) % METRICS_SUB_COUNT);
+    return ((METRICS_SUB_COUNT + sub + 1) << bits) - 1;
+}
+
+/*****************************************************************************/
+/* called with g_metrics_lock held */
+static tui64
+metrics_quantile(const struct metrics_histogram *h, double quantile)
+{
+    tui64 rank;
+    tui64 seen;
+    tui64 value;
+    int bucket;
+
+    if (h->count == 0)
+    {
+        return 0;
+    }
+    rank = (tui64)(quantile * (double)h->count);
+    if (rank >= h->count)
+    {
+        rank = h->count - 1;
+    }
+    seen = 0;
+    for (bucket = 0; bucket < METRICS_BUCKETS; bucket++)
+    {
+        seen += h->buckets[bucket];
+        if (seen > rank)
+        {
+            value = metrics_bucket_high(bucket);
+            return value < h->max ? value : h->max;
+        }
+    }
+    return h->max;
+}
+
+/*****************************************************************************/
+int
+metrics_init(void)
+{
+    g_histograms = g_new0(struct metrics_histogram, METRICS_PHASE_COUNT);
+    g_metrics_lock = tc_mutex_create();
+    g_pending = list_create();
+    if (g_histograms == NULL || g_metrics_lock == 0 || g_pending == NULL)
+    {
+        LOG(LOG_LEVEL_ERROR, "metrics_init: out of memory");
+        metrics_deinit();
+        return 1;
+    }
+    g_pending->auto_free = 1;
+    return 0;
+}
+
+/*****************************************************************************/
+void
+metrics_deinit(void)
+{
+    list_delete(g_pending);
+    g_pending = NULL;
+    if (g_metrics_lock != 0)
+    {
+        tc_mutex_delete(g_metrics_lock);
+        g_metrics_lock = 0;
+    }
+    g_free(g_histograms);
+    g_histograms = NULL;
+}
+
+/*****************************************************************************/
+void
+metrics_record(enum metrics_phase phase, tui64 start_us)
+{
+    struct metrics_histogram *h;
+    tui64 elapsed;
+
+    if (g_histograms == NULL || phase < 0 || phase >= METRICS_PHASE_COUNT)
+    {
+        return;
+    }
+    elapsed = g_time4() - start_us;
+    tc_mutex_lock(g_metrics_lock);
+    h = &g_histograms[phase];
+    h->count++;
+    h->sum += elapsed;
+    if (elapsed > h->max)
+    {
+        h->max = elapsed;
+    }
+    h->buckets[metrics_bucket(elapsed)]++;
+    g_generation++;
+    tc_mutex_unlock(g_metrics_lock);
+}
+
+/*****************************************************************************/
+void
+metrics_session_started(int display, tui64 start_us)
+{
+    struct metrics_pending *pending;
+
+    if (g_pending == NULL || display_table_get_files(display) < 0)
+    {
+        /* no inotify, the sockets can't be seen appearing */
+        return;
+    }
+    pending = g_new0(struct metrics_pending, 1);
+    if (pending == NULL)
+    {
+        return;
+    }
+    pending->display = display;
+    pending->phases_left = DISPLAY_TABLE_FILE_X11 | DISPLAY_TABLE_FILE_CHANSRV;
+    pending->start_us = start_us;
+    list_add_item(g_pending, (tintptr)pending);
+    /* a pooled X server is already there */
+    metrics_check_displays();
+}
+
+/*****************************************************************************/
+void
+metrics_check_displays(void)
+{
+    struct metrics_pending *pending;
+    int index;
+    int files;
+    tui64 now;
+
+    if (g_pending == NULL)
+    {
+        return;
+    }
+    now = g_time4();
+    for (index = g_pending->count - 1; index >= 0; index--)
+    {
+        pending = (struct metrics_pending *)list_get_item(g_pending, index);
+        files = display_table_get_files(pending->display);
+        if (files < 0)
+        {
+            files = 0;
+        }
+        files &= pending->phases_left;
+        if (files & DISPLAY_TABLE_FILE_X11)
+        {
+            metrics_record(METRICS_XSERVER, pending->start_us);
+        }
+        if (files & DISPLAY_TABLE_FILE_CHANSRV)
+        {
+            metrics_record(METRICS_CHANSRV, pending->start_us);
+        }
+        pending->phases_left &= ~files;
+        if (pending->phases_left == 0 ||
+                now - pending->start_us > METRICS_PENDING_TIMEOUT_US)
+        {
+            list_remove_item(g_pending, index);
+        }
+    }
+}
+
+/*****************************************************************************/
+int
+metrics_format(char *text, int text_bytes)
+{
+    const struct metrics_histogram *h;
+    int phase;
+    int index;
+    int len;
+
+    if (text_bytes < 1)
+    {
+        return 0;
+    }
+    text[0] = '\0';
+    if (g_histograms == NULL)
+    {
+        return 0;
+    }
+    len = g_snprintf(text, text_bytes,
+                     "# TYPE xrdp_sesman_login_phase_seconds summary\n");
+    tc_mutex_lock(g_metrics_lock);
+    for (phase = 0; phase < METRICS_PHASE_COUNT && len < text_bytes; phase++)
+    {
+        h = &g_histograms[phase];
+        for (index = 0;
+                index < (int)(sizeof(g_quantiles) / sizeof(g_quantiles[0])) &&
+                len < text_bytes; index++)
+        {
+            len += g_snprintf(text + len, text_bytes - len,
+                              "xrdp_sesman_login_phase_seconds"
+                              "{phase=\"%s\",quantile=\"%g\"} %.6f\n",
+                              g_phase_names[phase], g_quantiles[index],
+                              metrics_quantile(h, g_quantiles[index]) / 1e6);
+        }
+        if (len < text_bytes)
+        {
+            len += g_snprintf(text + len, text_bytes - len,
+                              "xrdp_sesman_login_phase_seconds_sum"
+                              "{phase=\"%s\"} %.6f\n"
+                              "xrdp_sesman_login_phase_seconds_count"
+                              "{phase=\"%s\"} %llu\n"
+                              "xrdp_sesman_login_phase_max_seconds"
+                              "{phase=\"%s\"} %.6f\n",
+                              g_phase_names[phase], h->sum / 1e6,
+                              g_phase_names[phase],
+                              (unsigned long long)h->count,
+                              g_phase_names[phase], h->max / 1e6);
+        }
+    }
+    tc_mutex_unlock(g_metrics_lock);
+    return len < text_bytes ? len : text_bytes - 1;
+}
+
+/*****************************************************************************/
+int
+metrics_write_file(const char *file_name)
+{
+    char text[4096];
+    char tmp_name[256];
+    int generation;
+    int len;
+    int fd;
+    int rv;
+
+    if (g_histograms == NULL || file_name == NULL || file_name[0] == '\0')
+    {
+        return 0;
+    }
+    tc_mutex_lock(g_metrics_lock);
+    generation = g_generation;
+    tc_mutex_unlock(g_metrics_lock);
+    if (generation == g_written_generation)
+    {
+        return 0;
+    }
+
+    len = metrics_format(text, sizeof(text));
+    g_snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", file_name);
+    fd = g_file_open_ex(tmp_name, 0, 1, 1, 1);
+    if (fd < 0)
+    {
+        LOG(LOG_LEVEL_WARNING, "metrics_write_file: can't open %s (%s)",
+            tmp_name, g_get_strerror());
+        return 1;
+    }
+    rv = g_file_write(fd, text, len) == len ? 0 : 1;
+    g_file_close(fd);
+    /* readers never see a partly written file */
+    if (rv == 0)
+    {
+        g_chmod_hex(tmp_name, 0x644);
+        rv = rename(tmp_name, file_name);
+    }
+    if (rv != 0)
+    {
+        LOG(LOG_LEVEL_WARNING, "metrics_write_file: can't write %s",
+            file_name);
+        g_file_delete(tmp_name);
+        return 1;
+    }
+    g_written_generation = generation;
+    return 0;
+}
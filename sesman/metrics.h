@@ -0,0 +1,118 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Copyright (C) Jay Sorg 2004-2021
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ *
+ * @file metrics.h
+ * @brief Login latency histograms
+ *
+ * Each login phase has a log-linear histogram of its duration in
+ * microseconds, with eight sub-buckets per power of two so quantiles are
+ * within 12.5%. The histograms are reported through the SCP management
+ * interface and can be written to a file in the Prometheus text format.
+ *
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "arch.h"
+
+enum metrics_phase
+{
+    METRICS_SCP = 0,       /* an auth worker serving one SCP connection */
+    METRICS_AUTH,          /* auth_userpass() */
+    METRICS_SESSION_START, /* session_start_fork() in the main thread */
+    METRICS_XSERVER,       /* session start until the X server socket */
+    METRICS_CHANSRV,       /* session start until the chansrv socket */
+    METRICS_PHASE_COUNT
+};
+
+/**
+ *
+ * @brief creates the histograms
+ * @return 0 on success
+ *
+ */
+int
+metrics_init(void);
+
+/**
+ *
+ * @brief frees the histograms
+ *
+ */
+void
+metrics_deinit(void);
+
+/**
+ *
+ * @brief records the end of a phase, callable from any thread
+ * @param phase the phase
+ * @param start_us g_time4() when the phase started
+ *
+ */
+void
+metrics_record(enum metrics_phase phase, tui64 start_us);
+
+/**
+ *
+ * @brief notes a session start, so the X server and chansrv phases are
+ *        recorded when their sockets appear in the display table
+ * @param display the display of the session
+ * @param start_us g_time4() when the session start was requested
+ *
+ * called with the main thread
+ *
+ */
+void
+metrics_session_started(int display, tui64 start_us);
+
+/**
+ *
+ * @brief records the phases of the started sessions whose sockets
+ *        appeared, called with the main thread after the display table
+ *        changed
+ *
+ */
+void
+metrics_check_displays(void);
+
+/**
+ *
+ * @brief prints the histograms as Prometheus text
+ * @param text output buffer
+ * @param text_bytes size of text
+ * @return length of the text, which is truncated to fit
+ *
+ */
+int
+metrics_format(char *text, int text_bytes);
+
+/**
+ *
+ * @brief writes the histograms to a file if they changed since the last
+ *        call
+ * @param file_name the file, replaced atomically
+ * @return 0 on success or if nothing changed
+ *
+ */
+int
+metrics_write_file(const char *file_name);
+
+#endif
@@ -31,10 +31,40 @@
 #include <config_ac.h>
 #endif
 
+#include <signal.h>
+#include <pthread.h>
+
 #include "sesman.h"
+#include "fifo.h"
+#include "thread_calls.h"
 
 extern struct config_sesman *g_cfg; /* in sesman.c */
 
+/* auth worker pool, connections accepted by the main loop are queued here
+   and served by g_pool_size threads */
+static tbus g_pool_mutex = 0;   /* protects everything below */
+static tbus g_pool_sem = 0;     /* one count per connection released */
+static tbus g_pool_idle_event = 0; /* set when paused and no worker busy */
+static FIFO *g_pool_queue = NULL;
+static int *g_pool_sck = NULL;  /* socket each worker is serving, or -1 */
+static int g_pool_size = 0;
+static int g_pool_busy = 0;     /* connections released to the workers */
+static int g_pool_held = 0;     /* connections queued while paused */
+static int g_pool_paused = 0;
+static int g_pool_term = 0;
+/* getpwnam, getspnam, crypt and getgr* return static buffers, the
+   workers take turns to call them */
+static tbus g_userdb_mutex = 0;
+/* a worker in the auth module can hold locks inside PAM, NSS or the
+   resolver that a child forked by the main thread would wait on for good,
+   so a fork waits for the workers to leave the auth module and holds new
+   ones off, see scp_auth_enter() and scp_fork_begin() */
+static tbus g_gate_mutex = 0;   /* held by the main thread while it forks */
+static tbus g_gate_count_mutex = 0; /* protects the two below */
+static int g_gate_inside = 0;   /* workers in the auth module */
+static int g_gate_waiting = 0;  /* the main thread waits for g_gate_sem */
+static tbus g_gate_sem = 0;
+
 /******************************************************************************/
 void *
 scp_process_start(void *sck)
@@ -108,3 +138,286 @@ scp_process_start(void *sck)
 
     return 0;
 }
+
+/******************************************************************************/
+static THREAD_RV THREAD_CC
+scp_pool_worker(void *arg)
+{
+    int index;
+    int sck;
+    tui64 start;
+
+    index = (int)(tintptr)arg;
+    LOG_DEVEL(LOG_LEVEL_DEBUG, "scp_pool_worker: worker %d started", index);
+    for (;;)
+    {
+        tc_sem_dec(g_pool_sem);
+        tc_mutex_lock(g_pool_mutex);
+        if (g_pool_term)
+        {
+            tc_mutex_unlock(g_pool_mutex);
+            break;
+        }
+        sck = (int)(tintptr)fifo_remove_item(g_pool_queue);
+        g_pool_sck[index] = sck;
+        tc_mutex_unlock(g_pool_mutex);
+
+        start = g_time4();
+        scp_process_start((void *)(tintptr)sck);
+        metrics_record(METRICS_SCP, start);
+
+        tc_mutex_lock(g_pool_mutex);
+        /* clear the slot before closing so a forked child never closes
+           a reused descriptor */
+        g_pool_sck[index] = -1;
+        g_sck_close(sck);
+        g_pool_busy--;
+        if (g_pool_paused && g_pool_busy == 0)
+        {
+            g_set_wait_obj(g_pool_idle_event);
+        }
+        tc_mutex_unlock(g_pool_mutex);
+    }
+    return 0;
+}
+
+/******************************************************************************/
+int
+scp_pool_init(int num_workers)
+{
+    int index;
+    sigset_t sigmask;
+    sigset_t oldmask;
+
+    g_pool_mutex = tc_mutex_create();
+    g_userdb_mutex = tc_mutex_create();
+    g_gate_mutex = tc_mutex_create();
+    g_gate_count_mutex = tc_mutex_create();
+    g_gate_sem = tc_sem_create(0);
+    g_pool_sem = tc_sem_create(0);
+    g_pool_idle_event = g_create_wait_obj("xrdp_sesman_pool_idle");
+    g_pool_queue = fifo_create();
+    g_pool_sck = g_new(int, num_workers);
+    if (g_pool_mutex == 0 || g_userdb_mutex == 0 || g_gate_mutex == 0 ||
+            g_gate_count_mutex == 0 || g_gate_sem == 0 || g_pool_sem == 0 ||
+            g_pool_idle_event == 0 ||
+            g_pool_queue == NULL || g_pool_sck == NULL)
+    {
+        LOG(LOG_LEVEL_ERROR, "scp_pool_init: out of memory");
+        return 1;
+    }
+
+    /* signals are handled by the main thread only, the workers inherit
+       this mask */
+    sigfillset(&sigmask);
+    pthread_sigmask(SIG_BLOCK, &sigmask, &oldmask);
+    for (index = 0; index < num_workers; index++)
+    {
+        g_pool_sck[index] = -1;
+        if (tc_thread_create(scp_pool_worker, (void *)(tintptr)index) != 0)
+        {
+            LOG(LOG_LEVEL_ERROR, "scp_pool_init: failed to start worker %d",
+                index);
+            break;
+        }
+        g_pool_size++;
+    }
+    pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+
+    if (g_pool_size == 0)
+    {
+        return 1;
+    }
+    LOG(LOG_LEVEL_INFO, "started %d auth workers", g_pool_size);
+    return 0;
+}
+
+/******************************************************************************/
+void
+scp_pool_stop(void)
+{
+    int index;
+
+    if (g_pool_mutex == 0)
+    {
+        return;
+    }
+    /* workers blocked in a session start can not be joined, they end
+       with the process */
+    tc_mutex_lock(g_pool_mutex);
+    g_pool_term = 1;
+    tc_mutex_unlock(g_pool_mutex);
+    for (index = 0; index < g_pool_size; index++)
+    {
+        tc_sem_inc(g_pool_sem);
+    }
+}
+
+/******************************************************************************/
+int
+scp_pool_add(int sck)
+{
+    int rv;
+
+    tc_mutex_lock(g_pool_mutex);
+    rv = fifo_add_item(g_pool_queue, (void *)(tintptr)sck);
+    if (rv == 0)
+    {
+        if (g_pool_paused)
+        {
+            g_pool_held++;
+        }
+        else
+        {
+            g_pool_busy++;
+            tc_sem_inc(g_pool_sem);
+        }
+    }
+    tc_mutex_unlock(g_pool_mutex);
+    return rv;
+}
+
+/******************************************************************************/
+int
+scp_pool_pause(void)
+{
+    int idle;
+
+    tc_mutex_lock(g_pool_mutex);
+    g_pool_paused = 1;
+    idle = g_pool_busy == 0;
+    if (!idle)
+    {
+        g_reset_wait_obj(g_pool_idle_event);
+    }
+    tc_mutex_unlock(g_pool_mutex);
+    return idle;
+}
+
+/******************************************************************************/
+void
+scp_pool_resume(void)
+{
+    tc_mutex_lock(g_pool_mutex);
+    g_pool_paused = 0;
+    g_reset_wait_obj(g_pool_idle_event);
+    while (g_pool_held > 0)
+    {
+        g_pool_held--;
+        g_pool_busy++;
+        tc_sem_inc(g_pool_sem);
+    }
+    tc_mutex_unlock(g_pool_mutex);
+}
+
+/******************************************************************************/
+tbus
+scp_pool_get_idle_event(void)
+{
+    return g_pool_idle_event;
+}
+
+/******************************************************************************/
+/* called in a child forked by the main thread, only that thread exists so
+   no locking */
+void
+scp_pool_close_sockets(void)
+{
+    int index;
+    int sck;
+
+    for (index = 0; index < g_pool_size; index++)
+    {
+        if (g_pool_sck[index] >= 0)
+        {
+            g_sck_close(g_pool_sck[index]);
+        }
+    }
+    while (g_pool_queue != NULL && !fifo_is_empty(g_pool_queue))
+    {
+        sck = (int)(tintptr)fifo_remove_item(g_pool_queue);
+        g_sck_close(sck);
+    }
+    g_delete_wait_obj(g_pool_idle_event);
+}
+
+/******************************************************************************/
+void
+scp_auth_enter(void)
+{
+    if (g_gate_mutex != 0)
+    {
+        tc_mutex_lock(g_gate_mutex);
+        tc_mutex_lock(g_gate_count_mutex);
+        g_gate_inside++;
+        tc_mutex_unlock(g_gate_count_mutex);
+        tc_mutex_unlock(g_gate_mutex);
+    }
+}
+
+/******************************************************************************/
+void
+scp_auth_leave(void)
+{
+    if (g_gate_mutex != 0)
+    {
+        tc_mutex_lock(g_gate_count_mutex);
+        g_gate_inside--;
+        if (g_gate_waiting && g_gate_inside == 0)
+        {
+            g_gate_waiting = 0;
+            tc_sem_inc(g_gate_sem);
+        }
+        tc_mutex_unlock(g_gate_count_mutex);
+    }
+}
+
+/******************************************************************************/
+void
+scp_fork_begin(void)
+{
+    int wait;
+
+    if (g_gate_mutex != 0)
+    {
+        tc_mutex_lock(g_gate_mutex);
+        tc_mutex_lock(g_gate_count_mutex);
+        wait = g_gate_inside > 0;
+        g_gate_waiting = wait;
+        tc_mutex_unlock(g_gate_count_mutex);
+        if (wait)
+        {
+            tc_sem_dec(g_gate_sem);
+        }
+    }
+}
+
+/******************************************************************************/
+void
+scp_fork_end(void)
+{
+    if (g_gate_mutex != 0)
+    {
+        tc_mutex_unlock(g_gate_mutex);
+    }
+}
+
+/******************************************************************************/
+void
+scp_userdb_lock(void)
+{
+    if (g_userdb_mutex != 0)
+    {
+        tc_mutex_lock(g_userdb_mutex);
+    }
+}
+
+/******************************************************************************/
+void
+scp_userdb_unlock(void)
+{
+    if (g_userdb_mutex != 0)
+    {
+        tc_mutex_unlock(g_userdb_mutex);
+    }
+}
@@ -42,4 +42,119 @@
 void*
 scp_process_start(void* sck);
 
+/**
+ *
+ * @brief starts the auth worker pool
+ * @param num_workers number of worker threads
+ * @return 0 on success
+ *
+ */
+int
+scp_pool_init(int num_workers);
+
+/**
+ *
+ * @brief tells the auth workers to exit once they are idle
+ *
+ */
+void
+scp_pool_stop(void);
+
+/**
+ *
+ * @brief queues an accepted connection for the auth workers
+ * @param sck the connection socket, closed by the worker when done
+ * @return 0 on success
+ *
+ */
+int
+scp_pool_add(int sck);
+
+/**
+ *
+ * @brief stops handing new connections to the auth workers
+ * @return non-zero if no worker is busy, otherwise the idle event is set
+ *         once the last one finishes
+ *
+ */
+int
+scp_pool_pause(void);
+
+/**
+ *
+ * @brief hands connections queued while paused to the auth workers
+ *
+ */
+void
+scp_pool_resume(void);
+
+/**
+ *
+ * @brief wait object set when the pool is paused and idle
+ *
+ */
+tbus
+scp_pool_get_idle_event(void);
+
+/**
+ *
+ * @brief closes the connection sockets held by the pool, used in a
+ *        forked child
+ *
+ */
+void
+scp_pool_close_sockets(void);
+
+/**
+ *
+ * @brief called by a worker before it calls into the auth module or the
+ *        user database, which may take locks of their own
+ *
+ */
+void
+scp_auth_enter(void);
+
+/**
+ *
+ * @brief called by a worker when it is out of the auth module again
+ *
+ */
+void
+scp_auth_leave(void);
+
+/**
+ *
+ * @brief called by the main thread before it forks, waits until no
+ *        worker is between scp_auth_enter() and scp_auth_leave() and
+ *        keeps them out until scp_fork_end()
+ *
+ */
+void
+scp_fork_begin(void);
+
+/**
+ *
+ * @brief called after a fork, in the parent and the child
+ *
+ */
+void
+scp_fork_end(void);
+
+/**
+ *
+ * @brief serialises the getpw*, getgr*, getspnam and crypt calls, which
+ *        return static buffers
+ *
+ */
+void
+scp_userdb_lock(void);
+
+/**
+ *
+ * @brief releases the lock taken by scp_userdb_lock()
+ *
+ */
+void
+scp_userdb_unlock(void);
+
 #endif
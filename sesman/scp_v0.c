@@ -40,9 +40,15 @@ scp_v0_process(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
     tbus data;
     struct session_item *s_item;
     int errorcode = 0;
+    int allowed;
     bool_t do_auth_end = 1;
+    tui64 auth_start;
 
+    auth_start = g_time4();
+    scp_auth_enter();
     data = auth_userpass(s->username, s->password, &errorcode);
+    scp_auth_leave();
+    metrics_record(METRICS_AUTH, auth_start);
 
     if (s->type == SCP_GW_AUTHENTICATION)
     {
@@ -50,7 +56,10 @@ scp_v0_process(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
         /* g_writeln("SCP_GW_AUTHENTICATION message received"); */
         if (data)
         {
-            if (1 == access_login_allowed(s->username))
+            scp_auth_enter();
+            allowed = access_login_allowed(s->username);
+            scp_auth_leave();
+            if (1 == allowed)
             {
                 /* the user is member of the correct groups. */
                 scp_v0s_replyauthentication(c, errorcode);
@@ -96,13 +105,17 @@ scp_v0_process(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
                     s_item->pid);
             }
 
+            g_free(s_item);
             session_reconnect(display, s->username, data);
         }
         else
         {
             LOG_DEVEL(LOG_LEVEL_DEBUG, "pre auth");
 
-            if (1 == access_login_allowed(s->username))
+            scp_auth_enter();
+            allowed = access_login_allowed(s->username);
+            scp_auth_leave();
+            if (1 == allowed)
             {
                 tui8 guid[16];
 
@@ -161,6 +174,8 @@ scp_v0_process(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
     }
     if (do_auth_end)
     {
+        scp_auth_enter();
         auth_end(data);
+        scp_auth_leave();
     }
 }
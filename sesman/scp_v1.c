@@ -51,11 +51,17 @@ scp_v1_process(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
     int scount;
     SCP_SID sid;
     bool_t do_auth_end = 1;
+    int allowed;
+    tui64 auth_start;
 
     retries = g_cfg->sec.login_retry;
     current_try = retries;
 
+    auth_start = g_time4();
+    scp_auth_enter();
     data = auth_userpass(s->username, s->password, NULL);
+    scp_auth_leave();
+    metrics_record(METRICS_AUTH, auth_start);
     /*LOG_DEVEL(LOG_LEVEL_DEBUG, "user: %s\npass: %s", s->username, s->password);*/
 
     while ((!data) && ((retries == 0) || (current_try > 0)))
@@ -70,7 +76,11 @@ scp_v1_process(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
         {
             case SCP_SERVER_STATE_OK:
                 /* all ok, we got new username and password */
+                auth_start = g_time4();
+                scp_auth_enter();
                 data = auth_userpass(s->username, s->password, NULL);
+                scp_auth_leave();
+                metrics_record(METRICS_AUTH, auth_start);
 
                 /* one try less */
                 if (current_try > 0)
@@ -96,7 +106,10 @@ scp_v1_process(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
     }
 
     /* testing if login is allowed*/
-    if (0 == access_login_allowed(s->username))
+    scp_auth_enter();
+    allowed = access_login_allowed(s->username);
+    scp_auth_leave();
+    if (0 == allowed)
     {
         scp_v1s_deny_connection(c, "Access to Terminal Server not allowed.");
         LOG(LOG_LEVEL_INFO,
@@ -210,7 +223,9 @@ scp_v1_process(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
     /* cleanup */
     if (do_auth_end)
     {
+        scp_auth_enter();
         auth_end(data);
+        scp_auth_leave();
     }
     g_free(slist);
 }
@@ -45,8 +45,12 @@ scp_v1_mng_process(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
     struct SCP_DISCONNECTED_SESSION *slist = 0;
     int scount;
     int end = 0;
+    int allowed;
+    char text[SCP_MAX_MESSAGE_SIZE];
 
+    scp_auth_enter();
     data = auth_userpass(s->username, s->password, NULL);
+    scp_auth_leave();
     /*LOG_DEVEL(LOG_LEVEL_DEBUG, "user: %s\npass: %s", s->username, s->password);*/
 
     if (!data)
@@ -54,17 +58,24 @@ scp_v1_mng_process(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
         scp_v1s_mng_deny_connection(c, "Login failed");
         LOG(LOG_LEVEL_INFO,
             "[MNG] Login failed for user %s. Connection terminated", s->username);
+        scp_auth_enter();
         auth_end(data);
+        scp_auth_leave();
         return;
     }
 
     /* testing if login is allowed */
-    if (0 == access_login_mng_allowed(s->username))
+    scp_auth_enter();
+    allowed = access_login_mng_allowed(s->username);
+    scp_auth_leave();
+    if (0 == allowed)
     {
         scp_v1s_mng_deny_connection(c, "Access to Terminal Server not allowed.");
         LOG(LOG_LEVEL_INFO,
             "[MNG] User %s not allowed on TS. Connection terminated", s->username);
+        scp_auth_enter();
         auth_end(data);
+        scp_auth_leave();
         return;
     }
 
@@ -92,6 +103,12 @@ scp_v1_mng_process(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
                 e = scp_v1s_mng_list_sessions(c, s, scount, slist);
                 g_free(slist);
                 break;
+
+            case SCP_SERVER_STATE_MNG_METRICSREQ:
+                /* login latency histograms */
+                metrics_format(text, sizeof(text));
+                e = scp_v1s_mng_send_metrics(c, s, text);
+                break;
             default:
                 /* we check the other errors */
                 parseCommonStates(e, "scp_v1s_mng_list_sessions()");
@@ -101,7 +118,9 @@ scp_v1_mng_process(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
     }
 
     /* cleanup */
+    scp_auth_enter();
     auth_end(data);
+    scp_auth_leave();
 }
 
 static void parseCommonStates(enum SCP_SERVER_STATES_E e, const char *f)
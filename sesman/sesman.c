@@ -33,6 +33,14 @@
 #include "sesman.h"
 #include "xrdp_configure_options.h"
 #include "string_calls.h"
+#include "xrdp_sockets.h"
+
+/* milliseconds between two writes of the metrics file */
+#define SESMAN_METRICS_INTERVAL 10000
+/* logins are held for at most this long (ms) while a config reload waits
+   for the auth workers, then retried after SESMAN_RELOAD_RETRY */
+#define SESMAN_RELOAD_WAIT 1000
+#define SESMAN_RELOAD_RETRY 5000
 
 struct sesman_startup_params
 {
@@ -45,11 +53,15 @@ struct sesman_startup_params
 };
 
 int g_sck;
+int g_unix_sck = -1;
 int g_pid;
 unsigned char g_fixedkey[8] = { 23, 82, 107, 6, 35, 78, 88, 7 };
 struct config_sesman *g_cfg; /* defined in config.h */
 
 tintptr g_term_event = 0;
+tintptr g_reload_event = 0;
+tintptr g_sigchld_event = 0;
+extern tbus g_sync_event; /* in session.c */
 
 /*****************************************************************************/
 /**
@@ -187,6 +199,79 @@ static int sesman_listen_test(struct config_sesman *cfg)
 
     return rv;
 }
+
+/*****************************************************************************/
+/* opens the local listener xrdp uses when sesman runs on the same machine,
+   returns -1 if it is disabled or can't be set up */
+static int
+sesman_listen_unix(void)
+{
+    int sck;
+
+    if (!g_cfg->listen_unix)
+    {
+        return -1;
+    }
+    /* a socket file left by a sesman which didn't exit cleanly */
+    if (g_file_exist(SESMAN_UNIX_STR))
+    {
+        g_file_delete(SESMAN_UNIX_STR);
+    }
+    sck = g_tcp_local_socket();
+    if (sck < 0)
+    {
+        LOG(LOG_LEVEL_WARNING, "can't create unix socket, "
+            "accepting TCP connections only");
+        return -1;
+    }
+    g_tcp_set_non_blocking(sck);
+    if (g_tcp_local_bind(sck, SESMAN_UNIX_STR) != 0 ||
+            g_tcp_listen(sck) != 0)
+    {
+        LOG(LOG_LEVEL_WARNING, "can't listen on %s: %d (%s), "
+            "accepting TCP connections only",
+            SESMAN_UNIX_STR, g_get_errno(), g_get_strerror());
+        g_tcp_close(sck);
+        return -1;
+    }
+    /* xrdp doesn't run as root */
+    g_chmod_hex(SESMAN_UNIX_STR, 0x0666);
+    LOG(LOG_LEVEL_INFO, "listening to %s", SESMAN_UNIX_STR);
+    return sck;
+}
+
+/*****************************************************************************/
+/* accepts a connection on a listening socket and hands it to the auth
+   workers, returns non-zero on a fatal error */
+static int
+sesman_accept(int sck)
+{
+    int in_sck;
+
+    in_sck = g_tcp_accept(sck);
+
+    if ((in_sck == -1) && g_tcp_last_error_would_block(sck))
+    {
+        /* should not get here */
+        g_sleep(100);
+    }
+    else if (in_sck == -1)
+    {
+        /* error, should not get here */
+        return 1;
+    }
+    else
+    {
+        /* we've got a connection, so we pass it to the auth workers */
+        LOG_DEVEL(LOG_LEVEL_DEBUG, "new connection");
+        if (scp_pool_add(in_sck) != 0)
+        {
+            g_sck_close(in_sck);
+        }
+    }
+    return 0;
+}
+
 /******************************************************************************/
 /**
  *
@@ -196,13 +281,22 @@ static int sesman_listen_test(struct config_sesman *cfg)
 static int
 sesman_main_loop(void)
 {
-    int in_sck;
     int error;
     int robjs_count;
     int cont;
+    int timeout;
+    int metrics_time = 0;
     int rv = 0;
+    int reload_pending = 0;
+    int reload_paused = 0;
+    int reload_start = 0;
+    int reload_delay = 0;
+    int reload_left;
     tbus sck_obj;
-    tbus robjs[8];
+    tbus unix_obj = 0;
+    tbus pool_idle_obj;
+    tbus display_obj;
+    tbus robjs[9];
 
     g_sck = g_tcp_socket();
     if (g_sck < 0)
@@ -223,6 +317,13 @@ sesman_main_loop(void)
             LOG(LOG_LEVEL_INFO, "listening to port %s on %s",
                 g_cfg->listen_port, g_cfg->listen_address);
             sck_obj = g_create_wait_obj_from_socket(g_sck, 0);
+            g_unix_sck = sesman_listen_unix();
+            if (g_unix_sck >= 0)
+            {
+                unix_obj = g_create_wait_obj_from_socket(g_unix_sck, 0);
+            }
+            pool_idle_obj = scp_pool_get_idle_event();
+            display_obj = display_table_get_wait_obj();
             cont = 1;
 
             while (cont)
@@ -230,10 +331,32 @@ sesman_main_loop(void)
                 /* build the wait obj list */
                 robjs_count = 0;
                 robjs[robjs_count++] = sck_obj;
+                if (unix_obj != 0)
+                {
+                    robjs[robjs_count++] = unix_obj;
+                }
                 robjs[robjs_count++] = g_term_event;
+                robjs[robjs_count++] = g_sync_event;
+                robjs[robjs_count++] = g_sigchld_event;
+                robjs[robjs_count++] = g_reload_event;
+                robjs[robjs_count++] = pool_idle_obj;
+                if (display_obj != 0)
+                {
+                    robjs[robjs_count++] = display_obj;
+                }
 
                 /* wait */
-                if (g_obj_wait(robjs, robjs_count, 0, 0, -1) != 0)
+                timeout = g_cfg->metrics_file != 0 ? SESMAN_METRICS_INTERVAL : -1;
+                if (reload_pending)
+                {
+                    reload_left = reload_delay - (g_time3() - reload_start);
+                    reload_left = MAX(reload_left, 0);
+                    if (timeout < 0 || reload_left < timeout)
+                    {
+                        timeout = reload_left;
+                    }
+                }
+                if (g_obj_wait(robjs, robjs_count, 0, 0, timeout) != 0)
                 {
                     /* error, should not get here */
                     g_sleep(100);
@@ -244,31 +367,99 @@ sesman_main_loop(void)
                     break;
                 }
 
-                if (g_is_wait_obj_set(sck_obj)) /* incoming connection */
+                if (display_obj != 0 && g_is_wait_obj_set(display_obj))
+                {
+                    /* X or xrdp sockets came or went */
+                    display_table_check_wait_obj();
+                    metrics_check_displays();
+                }
+
+                if (g_cfg->metrics_file != 0 &&
+                        g_time3() - metrics_time >= SESMAN_METRICS_INTERVAL)
+                {
+                    metrics_write_file(g_cfg->metrics_file);
+                    metrics_time = g_time3();
+                }
+
+                if (g_is_wait_obj_set(g_sync_event)) /* worker request */
+                {
+                    session_sync_start();
+                }
+
+                if (g_is_wait_obj_set(g_sigchld_event)) /* child exited */
                 {
-                    in_sck = g_tcp_accept(g_sck);
+                    sig_sesman_session_end_sync();
+                }
 
-                    if ((in_sck == -1) && g_tcp_last_error_would_block(g_sck))
+                if (g_is_wait_obj_set(g_reload_event)) /* SIGHUP */
+                {
+                    g_reset_wait_obj(g_reload_event);
+                    if (!reload_pending)
+                    {
+                        reload_pending = 1;
+                        reload_start = g_time3();
+                        reload_delay = 0;
+                    }
+                }
+
+                /* g_cfg can only be replaced when no worker uses it, new
+                   logins are held meanwhile but a slow one in progress
+                   only delays the reload, it does not block the others */
+                if (reload_pending && !reload_paused &&
+                        g_time3() - reload_start >= reload_delay)
+                {
+                    scp_pool_pause();
+                    reload_paused = 1;
+                    reload_start = g_time3();
+                    reload_delay = SESMAN_RELOAD_WAIT;
+                }
+                if (reload_paused)
+                {
+                    if (scp_pool_pause())
                     {
-                        /* should not get here */
-                        g_sleep(100);
+                        sig_sesman_reload_cfg_sync();
+                        scp_pool_resume();
+                        reload_pending = 0;
+                        reload_paused = 0;
                     }
-                    else if (in_sck == -1)
+                    else if (g_time3() - reload_start >= reload_delay)
+                    {
+                        LOG(LOG_LEVEL_WARNING, "config reload deferred, "
+                            "auth workers still busy");
+                        scp_pool_resume();
+                        reload_paused = 0;
+                        reload_start = g_time3();
+                        reload_delay = SESMAN_RELOAD_RETRY;
+                    }
+                }
+
+                if (g_is_wait_obj_set(sck_obj)) /* incoming connection */
+                {
+                    if (sesman_accept(g_sck) != 0)
                     {
-                        /* error, should not get here */
                         break;
                     }
-                    else
+                }
+
+                if (unix_obj != 0 && g_is_wait_obj_set(unix_obj))
+                {
+                    /* local connection from xrdp */
+                    if (sesman_accept(g_unix_sck) != 0)
                     {
-                        /* we've got a connection, so we pass it to scp code */
-                        LOG_DEVEL(LOG_LEVEL_DEBUG, "new connection");
-                        scp_process_start((void *)(tintptr)in_sck);
-                        g_sck_close(in_sck);
+                        break;
                     }
                 }
             }
 
+            scp_pool_stop();
             g_delete_wait_obj_from_socket(sck_obj);
+            if (g_unix_sck >= 0)
+            {
+                g_delete_wait_obj_from_socket(unix_obj);
+                g_tcp_close(g_unix_sck);
+                g_unix_sck = -1;
+                g_file_delete(SESMAN_UNIX_STR);
+            }
         }
         else
         {
@@ -585,8 +776,27 @@ main(int argc, char **argv)
 
     g_snprintf(text, 255, "xrdp_sesman_%8.8x_main_term", g_pid);
     g_term_event = g_create_wait_obj(text);
+    g_snprintf(text, 255, "xrdp_sesman_%8.8x_main_reload", g_pid);
+    g_reload_event = g_create_wait_obj(text);
+    if (sig_sesman_child_init() != 0)
+    {
+        LOG(LOG_LEVEL_ERROR, "failed to set up SIGCHLD handling");
+    }
+
+    /* reconcile the displays in use once, inotify keeps it current */
+    display_table_init();
 
-    error = sesman_main_loop();
+    /* the histograms live until exit, the auth workers are not joined */
+    if (metrics_init() != 0 || session_init() != 0 ||
+            scp_pool_init(g_cfg->auth_workers) != 0)
+    {
+        error = 1;
+    }
+    else
+    {
+        session_pool_fill();
+        error = sesman_main_loop();
+    }
 
     /* clean up PID file on exit */
     if (daemon)
@@ -595,6 +805,9 @@ main(int argc, char **argv)
     }
 
     g_delete_wait_obj(g_term_event);
+    g_delete_wait_obj(g_reload_event);
+    sig_sesman_child_deinit();
+    display_table_deinit();
 
     if (!daemon)
     {
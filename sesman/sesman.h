@@ -36,6 +36,8 @@
 #include "config.h"
 #include "sig.h"
 #include "session.h"
+#include "display_table.h"
+#include "metrics.h"
 #include "access.h"
 #include "scp.h"
 
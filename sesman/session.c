@@ -33,6 +33,8 @@
 #include "config_ac.h"
 #endif
 
+#include <signal.h>
+
 #ifdef HAVE_SYS_PRCTL_H
 #include <sys/prctl.h>
 #endif
@@ -42,6 +44,7 @@
 #include "xauth.h"
 #include "xrdp_sockets.h"
 #include "string_calls.h"
+#include "thread_calls.h"
 
 #ifndef PR_SET_NO_NEW_PRIVS
 #define PR_SET_NO_NEW_PRIVS 38
@@ -50,11 +53,74 @@
 extern unsigned char g_fixedkey[8];
 extern struct config_sesman *g_cfg; /* in sesman.c */
 extern int g_sck; /* in sesman.c */
+extern int g_unix_sck; /* in sesman.c */
 struct session_chain *g_sessions;
 int g_session_count;
 
+/* session registry indexes, g_sessions keeps every session for full
+   walks, lookups by pid and user go through the hash buckets and display
+   allocation through the bitmap */
+#define SESSION_HASH_BITS 10
+#define SESSION_HASH_SIZE (1 << SESSION_HASH_BITS)
+#define SESSION_HASH_MASK (SESSION_HASH_SIZE - 1)
+
+static struct session_chain *g_sessions_by_pid[SESSION_HASH_SIZE];
+static struct session_chain *g_sessions_by_user[SESSION_HASH_SIZE];
+static tui32 *g_display_bitmap = NULL; /* bit set if display in use */
+static int g_display_bitmap_words = 0;
+
+/* idle X servers started ahead of logins, owned by the main thread */
+struct session_pool_item
+{
+    int pid;
+    int display;
+    int width;
+    int height;
+    int bpp;
+    int start_time;
+    char cookie[33];
+    char username[256]; /* runs as this user, only handed to them */
+};
+
+static struct list *g_pool_items = NULL;
+static int g_pool_class_failed[SESMAN_POOL_MAX_USERS][SESMAN_POOL_MAX_CLASSES];
+/* idle servers of a user and class that died in a row, reset when one of
+   them is handed out */
+static int g_pool_class_deaths[SESMAN_POOL_MAX_USERS][SESMAN_POOL_MAX_CLASSES];
+static struct config_sesman *g_pool_cfg = NULL; /* config the flags are for */
+
 extern tbus g_term_event; /* in sesman.c */
 
+/* g_sessions is only changed by the main thread, the auth workers take
+   this lock to read it */
+static tbus g_session_lock = 0;
+
+/* requests from the auth workers that the main thread must run, forking
+   is only done from the main thread */
+#define SESSION_SYNC_START     0
+#define SESSION_SYNC_RECONNECT 1
+
+/* seconds the X server and chansrv get to exit after SIGTERM */
+#define SESSION_END_KILL_TIME  10
+
+/* an idle pooled server that exits sooner than this (seconds) failed to
+   start, its class is not refilled until the configuration is reloaded */
+#define SESSION_POOL_MIN_LIFE  10
+/* nor is a class whose idle servers keep dying later on */
+#define SESSION_POOL_MAX_DEATHS 5
+
+tbus g_sync_event = 0;
+static tbus g_sync_mutex = 0; /* one request at a time */
+static tbus g_sync_sem = 0;   /* posted when the request is done */
+static int g_sync_cmd;
+static long g_sync_data;
+static tui8 g_sync_type;
+static struct SCP_CONNECTION *g_sync_con;
+static struct SCP_SESSION *g_sync_s;
+static int g_sync_display;
+static char *g_sync_username;
+static int g_sync_result;
+
 /**
  * Creates a string consisting of all parameters that is hosted in the param list
  * @param self
@@ -90,16 +156,210 @@ dumpItemsToString(struct list *self, char *outstr, int len)
 }
 
 
+/******************************************************************************/
+/* user names are compared case insensitively by session_get_byuser so the
+   hash folds case */
+static int
+session_hash_user(const char *name)
+{
+    tui32 hash;
+    char c;
+
+    hash = 2166136261U;
+    while (*name != 0)
+    {
+        c = *name;
+        if (c >= 'A' && c <= 'Z')
+        {
+            c += 'a' - 'A';
+        }
+        hash = (hash ^ (tui8)c) * 16777619U;
+        name++;
+    }
+    return (int)(hash & SESSION_HASH_MASK);
+}
+
+/******************************************************************************/
+static int
+session_hash_pid(int pid)
+{
+    return (int)(((tui32)pid * 2654435761U) >> (32 - SESSION_HASH_BITS));
+}
+
+/******************************************************************************/
+static int
+session_display_set_used(int display, int used)
+{
+    int word;
+    int words;
+    tui32 *bitmap;
+
+    if (display < 0)
+    {
+        return 1;
+    }
+    word = display >> 5;
+    if (word >= g_display_bitmap_words)
+    {
+        if (!used)
+        {
+            return 0;
+        }
+        words = (word + 32) & ~31;
+        bitmap = (tui32 *)g_malloc(words * sizeof(tui32), 1);
+        if (bitmap == NULL)
+        {
+            return 1;
+        }
+        if (g_display_bitmap != NULL)
+        {
+            g_memcpy(bitmap, g_display_bitmap,
+                     g_display_bitmap_words * sizeof(tui32));
+            g_free(g_display_bitmap);
+        }
+        g_display_bitmap = bitmap;
+        g_display_bitmap_words = words;
+    }
+    if (used)
+    {
+        g_display_bitmap[word] |= 1U << (display & 31);
+    }
+    else
+    {
+        g_display_bitmap[word] &= ~(1U << (display & 31));
+    }
+    return 0;
+}
+
+/******************************************************************************/
+/* returns the first display from first to last inclusive with a clear
+   bit, or -1 */
+static int
+session_display_find_free(int first, int last)
+{
+    int display;
+    int word;
+    tui32 bits;
+
+    display = first;
+    while (display <= last)
+    {
+        word = display >> 5;
+        if (word >= g_display_bitmap_words)
+        {
+            return display;
+        }
+        bits = ~g_display_bitmap[word] & (0xffffffffU << (display & 31));
+        if (bits != 0)
+        {
+            display = (word << 5);
+            while ((bits & 1) == 0)
+            {
+                bits >>= 1;
+                display++;
+            }
+            return display <= last ? display : -1;
+        }
+        display = (word + 1) << 5;
+    }
+    return -1;
+}
+
+/******************************************************************************/
+/* called with g_session_lock held */
+static void
+session_registry_add(struct session_chain *chain)
+{
+    int index;
+
+    chain->prev = 0;
+    chain->next = g_sessions;
+    if (g_sessions != 0)
+    {
+        g_sessions->prev = chain;
+    }
+    g_sessions = chain;
+
+    index = session_hash_pid(chain->item->pid);
+    chain->pid_next = g_sessions_by_pid[index];
+    g_sessions_by_pid[index] = chain;
+
+    index = session_hash_user(chain->item->name);
+    chain->user_next = g_sessions_by_user[index];
+    g_sessions_by_user[index] = chain;
+
+    session_display_set_used(chain->item->display, 1);
+    g_session_count++;
+}
+
+/******************************************************************************/
+/* called with g_session_lock held */
+static void
+session_registry_remove(struct session_chain *chain)
+{
+    struct session_chain **pp;
+
+    if (chain->prev != 0)
+    {
+        chain->prev->next = chain->next;
+    }
+    else
+    {
+        g_sessions = chain->next;
+    }
+    if (chain->next != 0)
+    {
+        chain->next->prev = chain->prev;
+    }
+
+    pp = &(g_sessions_by_pid[session_hash_pid(chain->item->pid)]);
+    while (*pp != 0 && *pp != chain)
+    {
+        pp = &((*pp)->pid_next);
+    }
+    if (*pp != 0)
+    {
+        *pp = chain->pid_next;
+    }
+
+    pp = &(g_sessions_by_user[session_hash_user(chain->item->name)]);
+    while (*pp != 0 && *pp != chain)
+    {
+        pp = &((*pp)->user_next);
+    }
+    if (*pp != 0)
+    {
+        *pp = chain->user_next;
+    }
+
+    session_display_set_used(chain->item->display, 0);
+    g_session_count--;
+}
+
+/******************************************************************************/
+/* called with g_session_lock held */
+static struct session_chain *
+session_registry_find_pid(int pid)
+{
+    struct session_chain *chain;
+
+    chain = g_sessions_by_pid[session_hash_pid(pid)];
+    while (chain != 0 && chain->item->pid != pid)
+    {
+        chain = chain->pid_next;
+    }
+    return chain;
+}
+
 /******************************************************************************/
 struct session_item *
 session_get_bydata(const char *name, int width, int height, int bpp, int type,
                    const char *client_ip)
 {
     struct session_chain *tmp;
+    struct session_item *dummy;
     enum SESMAN_CFG_SESS_POLICY policy = g_cfg->sess.policy;
 
-    tmp = g_sessions;
-
     /* convert from SCP_SESSION_TYPE namespace to SESMAN_SESSION_TYPE namespace */
     switch (type)
     {
@@ -120,6 +380,8 @@ session_get_bydata(const char *name, int width, int height, int bpp, int type,
         "session_get_bydata: search policy %d U %s W %d H %d bpp %d T %d IP %s",
         policy, name, width, height, bpp, type, client_ip);
 
+    tc_mutex_lock(g_session_lock);
+    tmp = g_sessions_by_user[session_hash_user(name)];
     while (tmp != 0)
     {
         LOG(LOG_LEVEL_DEBUG,
@@ -140,11 +402,18 @@ session_get_bydata(const char *name, int width, int height, int bpp, int type,
                 tmp->item->bpp == bpp &&
                 tmp->item->type == type)
         {
-            return tmp->item;
+            dummy = g_new(struct session_item, 1);
+            if (dummy != 0)
+            {
+                g_memcpy(dummy, tmp->item, sizeof(struct session_item));
+            }
+            tc_mutex_unlock(g_session_lock);
+            return dummy;
         }
 
-        tmp = tmp->next;
+        tmp = tmp->user_next;
     }
+    tc_mutex_unlock(g_session_lock);
 
     return 0;
 }
@@ -287,125 +556,762 @@ x_server_running(int display)
 }
 
 /******************************************************************************/
-/* called with the main thread
-   returns boolean */
+/* called with the main thread */
 static int
-session_is_display_in_chain(int display)
+session_get_avail_display_from_chain(void)
 {
-    struct session_chain *chain;
-    struct session_item *item;
+    int display;
+    int first;
+    int last;
+    int in_use;
 
-    chain = g_sessions;
+    first = g_cfg->sess.x11_display_offset;
+    last = first + g_cfg->sess.max_sessions;
+    display = session_display_find_free(first, last);
 
-    while (chain != 0)
+    while (display >= 0)
     {
-        item = chain->item;
+        /* the display table answers from memory, probe only when it can't */
+        in_use = display_table_in_use(display);
+        if (in_use < 0)
+        {
+            in_use = x_server_running_check_ports(display);
+        }
+        if (!in_use)
+        {
+            return display;
+        }
+        LOG(LOG_LEVEL_DEBUG, "display %d is in use outside sesman", display);
+
+        display = session_display_find_free(display + 1, last);
+    }
+
+    LOG(LOG_LEVEL_ERROR, "X server -- no display in range (%d to %d) is available",
+        first, last);
+    return 0;
+}
+
+/******************************************************************************/
+static int
+wait_for_xserver(int display)
+{
+    int i;
+    int rv;
+    char text[32];
+
+    /* give X a bit to start */
+    /* wait up to 10 secs for x server to start */
+    i = 0;
+
+    LOG(LOG_LEVEL_DEBUG, "Waiting for X server to start on display %d", display);
 
-        if (item->display == display)
+    /* the server is ready once its socket appears, be told instead of
+       polling */
+    g_snprintf(text, sizeof(text), "X%d", display);
+    rv = display_table_wait_for_file("/tmp/.X11-unix", text, 10000);
+    if (rv == 1)
+    {
+        return 0;
+    }
+    if (rv == 0)
+    {
+        LOG(LOG_LEVEL_WARNING,
+            "Timed out waiting for X server on display %d to startup",
+            display);
+        return 0;
+    }
+
+    while (!x_server_running(display))
+    {
+        i++;
+
+        if (i > 40)
         {
-            return 1;
+            LOG(LOG_LEVEL_WARNING,
+                "Timed out waiting for X server on display %d to startup",
+                display);
+            break;
         }
 
-        chain = chain->next;
+        g_sleep(250);
     }
 
     return 0;
 }
 
+/******************************************************************************/
+static int
+session_start_chansrv(char *username, int display)
+{
+    struct list *chansrv_params;
+    char exe_path[262];
+    int chansrv_pid;
+
+    chansrv_pid = g_fork();
+    if (chansrv_pid == 0)
+    {
+        LOG(LOG_LEVEL_INFO,
+            "Starting the xrdp channel server for display %d", display);
+
+        chansrv_params = list_create();
+        chansrv_params->auto_free = 1;
+
+        /* building parameters */
+        g_snprintf(exe_path, sizeof(exe_path), "%s/xrdp-chansrv",
+                   XRDP_SBIN_PATH);
+        
+        list_add_item(chansrv_params, (intptr_t) g_strdup(exe_path));
+        list_add_item(chansrv_params, 0); /* mandatory */
+
+        env_set_user(username, 0, display,
+                     g_cfg->env_names,
+                     g_cfg->env_values);
+
+        /* executing chansrv */
+        g_execvp(exe_path, (char **) (chansrv_params->items));
+        
+        /* should not get here */
+        list_delete(chansrv_params);
+        g_exit(1);
+    }
+    return chansrv_pid;
+}
+
+/******************************************************************************/
+/* environment read by the X server, in the X server child */
+static void
+session_set_xserver_env(void)
+{
+    char text[256];
+
+    g_snprintf(text, 255, "%d", g_cfg->sess.max_idle_time);
+    g_setenv("XRDP_SESMAN_MAX_IDLE_TIME", text, 1);
+    g_snprintf(text, 255, "%d", g_cfg->sess.max_disc_time);
+    g_setenv("XRDP_SESMAN_MAX_DISC_TIME", text, 1);
+    g_snprintf(text, 255, "%d", g_cfg->sess.kill_disconnected);
+    g_setenv("XRDP_SESMAN_KILL_DISCONNECTED", text, 1);
+    g_setenv("XRDP_SOCKET_PATH", XRDP_SOCKET_PATH, 1);
+}
+
+/******************************************************************************/
+/* Xorg command line, in the X server child */
+static struct list *
+session_xorg_params(const char *screen, const char *authfile, char **xserver)
+{
+    struct list *xserver_params;
+
+    xserver_params = list_create();
+    xserver_params->auto_free = 1;
+
+    /* get path of Xorg from config */
+    *xserver = g_strdup((const char *)list_get_item(g_cfg->xorg_params, 0));
+
+    /* these are the must have parameters */
+    list_add_item(xserver_params, (tintptr) g_strdup(*xserver));
+    list_add_item(xserver_params, (tintptr) g_strdup(screen));
+    list_add_item(xserver_params, (tintptr) g_strdup("-auth"));
+    list_add_item(xserver_params, (tintptr) g_strdup(authfile));
+
+    /* additional parameters from sesman.ini file */
+    list_append_list_strdup(g_cfg->xorg_params, xserver_params, 1);
+
+    /* make sure it ends with a zero */
+    list_add_item(xserver_params, 0);
+
+    return xserver_params;
+}
+
+/******************************************************************************/
+/* true if the X server or chansrv of a session is still running, the X
+   server of a pooled session is a child of the main sesman process, not
+   of the session process, so it can't be waited for */
+static int
+session_pid_alive(int pid, int is_child, int *running)
+{
+    if (*running && !is_child && kill(pid, 0) != 0)
+    {
+        *running = 0;
+    }
+    return *running;
+}
+
+/******************************************************************************/
+/* in the session process
+   waits until the window manager or the X server exits, whichever is
+   first, then ends the session. The X server and chansrv are stopped
+   together and reaped in the order they exit */
+static void
+session_monitor(long data, int display, int window_manager_pid,
+                int display_pid, int x_is_child, int chansrv_pid)
+{
+    int pid;
+    int index;
+    int wm_wait_time;
+    int x_running;
+    int wm_running;
+    int chansrv_running;
+    struct exit_status exit_status;
+
+    x_running = display_pid > 0;
+    wm_running = window_manager_pid > 0;
+    chansrv_running = chansrv_pid > 0;
+
+    /* Monitor the amount of time we wait for the
+     * window manager. This is approximately how long the window
+     * manager was running for */
+    LOG(LOG_LEVEL_INFO, "Session in progress on display %d, waiting "
+        "until the window manager (pid %d) exits to end the session",
+        display, window_manager_pid);
+    wm_wait_time = g_time1();
+    while ((pid = g_waitchild_status(&exit_status, 1)) >= 0)
+    {
+        if (pid == window_manager_pid)
+        {
+            wm_wait_time = g_time1() - wm_wait_time;
+            if (exit_status.exit_code > 0)
+            {
+                LOG(LOG_LEVEL_WARNING, "Window manager (pid %d, display %d) "
+                    "exited with non-zero exit code %d and signal %d. This "
+                    "could indicate a window manager config problem",
+                    window_manager_pid, display, exit_status.exit_code,
+                    exit_status.signal_no);
+            }
+            if (wm_wait_time < 10)
+            {
+                /* This could be a config issue. Log a significant error */
+                LOG(LOG_LEVEL_WARNING, "Window manager (pid %d, display %d) "
+                    "exited quickly (%d secs). This could indicate a window "
+                    "manager config problem",
+                    window_manager_pid, display, wm_wait_time);
+            }
+            else
+            {
+                LOG(LOG_LEVEL_DEBUG, "Window manager (pid %d, display %d) "
+                    "was running for %d seconds.",
+                    window_manager_pid, display, wm_wait_time);
+            }
+            wm_running = 0;
+            break;
+        }
+        if (pid == display_pid)
+        {
+            /* the window manager goes with its display */
+            x_running = 0;
+            LOG(LOG_LEVEL_WARNING,
+                "X server on display %d (pid %d) exited before the window "
+                "manager with exit code %d and signal number %d",
+                display, display_pid, exit_status.exit_code,
+                exit_status.signal_no);
+            break;
+        }
+        if (pid == chansrv_pid)
+        {
+            chansrv_running = 0;
+            LOG(LOG_LEVEL_INFO,
+                "xrdp channel server for display %d (pid %d) "
+                "exit code %d and signal number %d",
+                display, chansrv_pid, exit_status.exit_code,
+                exit_status.signal_no);
+        }
+    }
+
+    if (wm_running)
+    {
+        /* the user's processes must be gone before the PAM session is
+           closed */
+        LOG(LOG_LEVEL_INFO, "Terminating the window manager (pid %d) on "
+            "display %d", window_manager_pid, display);
+        kill(-window_manager_pid, SIGTERM);
+        for (index = 0; ; index++)
+        {
+            pid = g_waitchild_status(&exit_status, 0);
+            if (pid == window_manager_pid || pid < 0)
+            {
+                wm_running = 0;
+                break;
+            }
+            if (pid == chansrv_pid)
+            {
+                chansrv_running = 0;
+                LOG(LOG_LEVEL_INFO,
+                    "xrdp channel server for display %d (pid %d) "
+                    "exit code %d and signal number %d",
+                    display, chansrv_pid, exit_status.exit_code,
+                    exit_status.signal_no);
+            }
+            if (pid > 0)
+            {
+                continue;
+            }
+            if (index == SESSION_END_KILL_TIME * 10)
+            {
+                LOG(LOG_LEVEL_WARNING, "Window manager (pid %d, display %d) "
+                    "still running %d seconds after SIGTERM, killing it",
+                    window_manager_pid, display, SESSION_END_KILL_TIME);
+                kill(-window_manager_pid, SIGKILL);
+            }
+            else if (index >= SESSION_END_KILL_TIME * 20)
+            {
+                LOG(LOG_LEVEL_ERROR, "Window manager (pid %d, display %d) "
+                    "did not exit", window_manager_pid, display);
+                break;
+            }
+            g_sleep(100);
+        }
+    }
+
+    LOG(LOG_LEVEL_INFO,
+        "Calling auth_stop_session and auth_end from pid %d",
+        g_getpid());
+    auth_stop_session(data);
+    auth_end(data);
+
+    if (x_running)
+    {
+        LOG(LOG_LEVEL_INFO,
+            "Terminating X server (pid %d) on display %d",
+            display_pid, display);
+        g_sigterm(display_pid);
+    }
+    if (chansrv_running)
+    {
+        LOG(LOG_LEVEL_INFO, "Terminating the xrdp channel server (pid %d) "
+            "on display %d", chansrv_pid, display);
+        g_sigterm(chansrv_pid);
+    }
+
+    /* make sure socket cleanup happen after child process exit */
+    for (index = 0; ; index++)
+    {
+        pid = g_waitchild_status(&exit_status, 0);
+        if (pid == display_pid)
+        {
+            x_running = 0;
+            LOG(LOG_LEVEL_INFO,
+                "X server on display %d (pid %d) returned exit code %d "
+                "and signal number %d",
+                display, display_pid, exit_status.exit_code,
+                exit_status.signal_no);
+        }
+        else if (pid == chansrv_pid)
+        {
+            chansrv_running = 0;
+            LOG(LOG_LEVEL_INFO,
+                "xrdp channel server for display %d (pid %d) "
+                "exit code %d and signal number %d",
+                display, chansrv_pid, exit_status.exit_code,
+                exit_status.signal_no);
+        }
+        else if (pid < 0)
+        {
+            /* no children left */
+            chansrv_running = 0;
+            x_running = x_running && !x_is_child;
+        }
+        if (!session_pid_alive(display_pid, x_is_child, &x_running) &&
+                !chansrv_running)
+        {
+            break;
+        }
+        if (pid > 0)
+        {
+            continue;
+        }
+        if (index == SESSION_END_KILL_TIME * 10)
+        {
+            LOG(LOG_LEVEL_WARNING, "Session on display %d still running %d "
+                "seconds after the window manager exited, killing it",
+                display, SESSION_END_KILL_TIME);
+            if (x_running)
+            {
+                kill(display_pid, SIGKILL);
+            }
+            if (chansrv_running)
+            {
+                kill(chansrv_pid, SIGKILL);
+            }
+        }
+        else if (index >= SESSION_END_KILL_TIME * 20)
+        {
+            LOG(LOG_LEVEL_ERROR, "Session on display %d did not exit, "
+                "leaving its sockets in place", display);
+            return;
+        }
+        g_sleep(100);
+    }
+
+    cleanup_sockets(display);
+}
+
 /******************************************************************************/
 /* called with the main thread */
 static int
-session_get_avail_display_from_chain(void)
+session_alloc_display(void)
+{
+    int display;
+
+    display = session_get_avail_display_from_chain();
+    if (display != 0)
+    {
+        tc_mutex_lock(g_session_lock);
+        session_display_set_used(display, 1);
+        tc_mutex_unlock(g_session_lock);
+    }
+    return display;
+}
+
+/******************************************************************************/
+/* called with the main thread */
+static void
+session_release_display(int display)
+{
+    tc_mutex_lock(g_session_lock);
+    session_display_set_used(display, 0);
+    tc_mutex_unlock(g_session_lock);
+}
+
+/******************************************************************************/
+/* the file the cookie of a pooled server is kept in until it is handed
+   out, one per display so a user's Xauthority only gets the cookies of
+   the servers in use */
+static void
+session_pool_authfile(const char *home, int display, char *path, int bytes)
+{
+    g_snprintf(path, bytes, "%s/.xrdp-pool-%d.Xauthority", home, display);
+}
+
+/******************************************************************************/
+/* called with the main thread, the auth workers are kept out of PAM and
+   NSS while it forks so the child finds none of their locks held */
+static int
+session_fork(void)
+{
+    int pid;
+
+    scp_fork_begin();
+    pid = g_fork();
+    scp_fork_end();
+    if (pid == 0)
+    {
+        sig_sesman_child_forked();
+    }
+    return pid;
+}
+
+/******************************************************************************/
+/* called with the main thread
+   starts an idle Xorg server as a pool user, it is only ever handed to
+   that user */
+static int
+session_pool_start_one(const char *username,
+                       const struct config_pool_class *cls)
+{
+    struct session_pool_item *item;
+    struct list *xserver_params;
+    char *xserver;
+    char screen[32];
+    char text[256];
+    char authfile[256];
+    char cookie_bin[16];
+    int display;
+    int pid;
+    int index;
+
+    display = session_alloc_display();
+    if (display == 0)
+    {
+        return 1;
+    }
+    item = g_new0(struct session_pool_item, 1);
+    if (item == NULL)
+    {
+        session_release_display(display);
+        return 1;
+    }
+    g_random(cookie_bin, 16);
+    g_bytes_to_hexstr(cookie_bin, 16, item->cookie, 33);
+    g_strncpy(item->username, username, sizeof(item->username) - 1);
+
+    pid = session_fork();
+    if (pid == -1)
+    {
+        LOG(LOG_LEVEL_ERROR, "Failed to fork for a pooled X server on "
+            "display %d", display);
+        session_release_display(display);
+        g_free(item);
+        return 1;
+    }
+    if (pid == 0)
+    {
+        g_delete_wait_obj(g_term_event);
+        g_delete_wait_obj(g_sync_event);
+        g_tcp_close(g_sck);
+        if (g_unix_sck >= 0)
+        {
+            g_tcp_close(g_unix_sck);
+        }
+        scp_pool_close_sockets();
+        if (env_set_user(username, 0, display,
+                         g_cfg->env_names, g_cfg->env_values) != 0)
+        {
+            LOG(LOG_LEVEL_ERROR, "Can't switch to session pool user %s",
+                username);
+            g_exit(1);
+        }
+        session_set_xserver_env();
+
+        session_pool_authfile(g_getenv("HOME") != NULL ?
+                              g_getenv("HOME") : ".",
+                              display, authfile, sizeof(authfile));
+        if (add_xauth_cookie_value(display, authfile, item->cookie) != 0)
+        {
+            LOG(LOG_LEVEL_ERROR, "Error setting the xauth cookie for pooled "
+                "display %d in file %s", display, authfile);
+            g_exit(1);
+        }
+#ifdef HAVE_SYS_PRCTL_H
+        if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0)
+        {
+            LOG(LOG_LEVEL_WARNING, "[session pool] (display %d): Failed to "
+                "disable setuid on X server: %s", display, g_get_strerror());
+        }
+#endif
+        g_sprintf(screen, ":%d", display);
+        xserver_params = session_xorg_params(screen, authfile, &xserver);
+        /* the cookie file is removed when the server is handed out, a
+           reset would read it again */
+        for (index = 0; index < xserver_params->count - 1; index++)
+        {
+            if (g_strcmp((const char *)list_get_item(xserver_params, index),
+                         "-noreset") == 0)
+            {
+                break;
+            }
+        }
+        if (index == xserver_params->count - 1)
+        {
+            list_insert_item(xserver_params, index,
+                             (tintptr) g_strdup("-noreset"));
+        }
+        g_sprintf(text, "%d", cls->width);
+        g_setenv("XRDP_START_WIDTH", text, 1);
+        g_sprintf(text, "%d", cls->height);
+        g_setenv("XRDP_START_HEIGHT", text, 1);
+
+        LOG(LOG_LEVEL_INFO, "Starting pooled X server on display %d: %s",
+            display, dumpItemsToString(xserver_params, text, 256));
+        g_execvp(xserver, (char **)xserver_params->items);
+        LOG(LOG_LEVEL_ERROR, "Error starting pooled X server on display %d",
+            display);
+        g_exit(1);
+    }
+
+    item->pid = pid;
+    item->display = display;
+    item->width = cls->width;
+    item->height = cls->height;
+    item->bpp = cls->bpp;
+    item->start_time = g_time1();
+    list_add_item(g_pool_items, (tintptr)item);
+    LOG(LOG_LEVEL_DEBUG, "pooled X server pid %d display %d %dx%dx%d "
+        "started for user %s", pid, display, cls->width, cls->height,
+        cls->bpp, username);
+    return 0;
+}
+
+/******************************************************************************/
+/* the index of the configured class of a pooled server, or -1 */
+static int
+session_pool_class(const struct session_pool_item *item)
+{
+    const struct config_pool_class *cls;
+    int cls_index;
+
+    for (cls_index = 0; cls_index < g_cfg->pool.num_classes; cls_index++)
+    {
+        cls = &(g_cfg->pool.classes[cls_index]);
+        if (item->width == cls->width && item->height == cls->height &&
+                item->bpp == cls->bpp)
+        {
+            return cls_index;
+        }
+    }
+    return -1;
+}
+
+/******************************************************************************/
+/* the index of the configured user of a pooled server, or -1 */
+static int
+session_pool_user(const struct session_pool_item *item)
 {
-    int display;
-
-    display = g_cfg->sess.x11_display_offset;
+    int user_index;
 
-    while ((display - g_cfg->sess.x11_display_offset) <= g_cfg->sess.max_sessions)
+    for (user_index = 0; user_index < g_cfg->pool.users->count; user_index++)
     {
-        if (!session_is_display_in_chain(display))
+        if (g_strcmp((const char *)list_get_item(g_cfg->pool.users,
+                     user_index), item->username) == 0)
         {
-            if (!x_server_running_check_ports(display))
-            {
-                return display;
-            }
+            return user_index;
         }
-
-        display++;
     }
-
-    LOG(LOG_LEVEL_ERROR, "X server -- no display in range (%d to %d) is available",
-        g_cfg->sess.x11_display_offset,
-        g_cfg->sess.x11_display_offset + g_cfg->sess.max_sessions);
-    return 0;
+    return -1;
 }
 
 /******************************************************************************/
-static int
-wait_for_xserver(int display)
+/* called with the main thread
+   hands out an idle server of the user with the same depth, preferring
+   one with the same geometry, the caller owns the returned item */
+static struct session_pool_item *
+session_pool_take(const char *username, int width, int height, int bpp)
 {
-    int i;
-
-    /* give X a bit to start */
-    /* wait up to 10 secs for x server to start */
-    i = 0;
+    struct session_pool_item *item;
+    int index;
+    int found;
+    int user_index;
 
-    LOG(LOG_LEVEL_DEBUG, "Waiting for X server to start on display %d", display);
-    
-    while (!x_server_running(display))
+    found = -1;
+    for (index = 0; index < g_pool_items->count; index++)
     {
-        i++;
-
-        if (i > 40)
+        item = (struct session_pool_item *)list_get_item(g_pool_items, index);
+        if (item->bpp != bpp || g_strcmp(item->username, username) != 0)
+        {
+            continue;
+        }
+        found = index;
+        if (item->width == width && item->height == height)
         {
-            LOG(LOG_LEVEL_WARNING,
-                "Timed out waiting for X server on display %d to startup",
-                display);
             break;
         }
-
-        g_sleep(250);
     }
-
-    return 0;
+    if (found < 0)
+    {
+        return NULL;
+    }
+    item = (struct session_pool_item *)list_get_item(g_pool_items, found);
+    /* the class works, forget about earlier deaths */
+    user_index = session_pool_user(item);
+    index = session_pool_class(item);
+    if (user_index >= 0 && index >= 0)
+    {
+        g_pool_class_deaths[user_index][index] = 0;
+    }
+    /* the list must not free the item */
+    g_pool_items->items[found] = 0;
+    list_remove_item(g_pool_items, found);
+    return item;
 }
 
 /******************************************************************************/
-static int
-session_start_chansrv(char *username, int display)
+void
+session_pool_fill(void)
 {
-    struct list *chansrv_params;
-    char exe_path[262];
-    int chansrv_pid;
+    struct session_pool_item *item;
+    const struct config_pool_class *cls;
+    const char *username;
+    int index;
+    int user_index;
+    int cls_index;
+    int count;
 
-    chansrv_pid = g_fork();
-    if (chansrv_pid == 0)
+    if (g_pool_items == NULL)
     {
-        LOG(LOG_LEVEL_INFO,
-            "Starting the xrdp channel server for display %d", display);
-
-        chansrv_params = list_create();
-        chansrv_params->auto_free = 1;
-
-        /* building parameters */
-        g_snprintf(exe_path, sizeof(exe_path), "%s/xrdp-chansrv",
-                   XRDP_SBIN_PATH);
-        
-        list_add_item(chansrv_params, (intptr_t) g_strdup(exe_path));
-        list_add_item(chansrv_params, 0); /* mandatory */
+        return;
+    }
+    if (g_pool_cfg != g_cfg)
+    {
+        /* configuration reloaded, try failed classes again */
+        g_memset(g_pool_class_failed, 0, sizeof(g_pool_class_failed));
+        g_memset(g_pool_class_deaths, 0, sizeof(g_pool_class_deaths));
+        g_pool_cfg = g_cfg;
+    }
+    for (user_index = 0; user_index < g_cfg->pool.users->count; user_index++)
+    {
+        username = (const char *)list_get_item(g_cfg->pool.users, user_index);
+        for (cls_index = 0; cls_index < g_cfg->pool.num_classes; cls_index++)
+        {
+            cls = &(g_cfg->pool.classes[cls_index]);
+            if (g_pool_class_failed[user_index][cls_index])
+            {
+                continue;
+            }
+            count = 0;
+            for (index = 0; index < g_pool_items->count; index++)
+            {
+                item = (struct session_pool_item *)
+                       list_get_item(g_pool_items, index);
+                if (item->width == cls->width &&
+                        item->height == cls->height &&
+                        item->bpp == cls->bpp &&
+                        g_strcmp(item->username, username) == 0)
+                {
+                    count++;
+                }
+            }
+            while (count < g_cfg->pool.idle_servers)
+            {
+                if (session_pool_start_one(username, cls) != 0)
+                {
+                    break;
+                }
+                count++;
+            }
+        }
+    }
+}
 
-        env_set_user(username, 0, display,
-                     g_cfg->env_names,
-                     g_cfg->env_values);
+/******************************************************************************/
+int
+session_pool_child_exited(int pid)
+{
+    struct session_pool_item *item;
+    const struct config_pool_class *cls;
+    int index;
+    int user_index;
+    int cls_index;
 
-        /* executing chansrv */
-        g_execvp(exe_path, (char **) (chansrv_params->items));
-        
-        /* should not get here */
-        list_delete(chansrv_params);
-        g_exit(1);
+    if (g_pool_items == NULL)
+    {
+        return 0;
     }
-    return chansrv_pid;
+    for (index = 0; index < g_pool_items->count; index++)
+    {
+        item = (struct session_pool_item *)list_get_item(g_pool_items, index);
+        if (item->pid != pid)
+        {
+            continue;
+        }
+        LOG(LOG_LEVEL_INFO, "pooled X server pid %d on display %d exited "
+            "while idle", pid, item->display);
+        user_index = session_pool_user(item);
+        cls_index = session_pool_class(item);
+        if (user_index >= 0 && cls_index >= 0)
+        {
+            cls = &(g_cfg->pool.classes[cls_index]);
+            g_pool_class_deaths[user_index][cls_index]++;
+            /* don't restart a server that can't start or keeps dying */
+            if (g_time1() - item->start_time < SESSION_POOL_MIN_LIFE)
+            {
+                LOG(LOG_LEVEL_ERROR, "pooled X server %dx%dx%d of user %s "
+                    "failed to start, not refilling this class",
+                    cls->width, cls->height, cls->bpp, item->username);
+                g_pool_class_failed[user_index][cls_index] = 1;
+            }
+            else if (g_pool_class_deaths[user_index][cls_index] >=
+                     SESSION_POOL_MAX_DEATHS)
+            {
+                LOG(LOG_LEVEL_ERROR, "pooled X servers %dx%dx%d of user %s "
+                    "exited %d times in a row while idle, not refilling "
+                    "this class", cls->width, cls->height, cls->bpp,
+                    item->username,
+                    g_pool_class_deaths[user_index][cls_index]);
+                g_pool_class_failed[user_index][cls_index] = 1;
+            }
+        }
+        session_release_display(item->display);
+        list_remove_item(g_pool_items, index);
+        return 1;
+    }
+    return 0;
 }
 
 /******************************************************************************/
@@ -432,6 +1338,7 @@ session_start_fork(tbus data, tui8 type, struct SCP_CONNECTION *c,
     int chansrv_pid;
     int display_pid;
     int window_manager_pid;
+    struct session_pool_item *pool_item = NULL;
 
     /* initialize (zero out) local variables: */
     g_memset(&ltime, 0, sizeof(time_t));
@@ -470,7 +1377,24 @@ session_start_fork(tbus data, tui8 type, struct SCP_CONNECTION *c,
         return 0;
     }
 
-    display = session_get_avail_display_from_chain();
+    /* an Xorg session can go to an idle pre-started server */
+    if (type == SESMAN_SESSION_TYPE_XORG)
+    {
+        pool_item = session_pool_take(s->username,
+                                      s->width, s->height, s->bpp);
+    }
+
+    if (pool_item != NULL)
+    {
+        display = pool_item->display;
+        LOG(LOG_LEVEL_INFO, "[session start] using pooled X server pid %d "
+            "on display %d for user %s",
+            pool_item->pid, display, s->username);
+    }
+    else
+    {
+        display = session_get_avail_display_from_chain();
+    }
 
     if (display == 0)
     {
@@ -479,8 +1403,8 @@ session_start_fork(tbus data, tui8 type, struct SCP_CONNECTION *c,
         return 0;
     }
 
-    pid = g_fork(); /* parent is fork from tcp accept,
-                       child forks X and wm, then becomes scp */
+    pid = session_fork(); /* parent is fork from tcp accept,
+                             child forks X and wm, then becomes scp */
 
     if (pid == -1)
     {
@@ -488,6 +1412,12 @@ session_start_fork(tbus data, tui8 type, struct SCP_CONNECTION *c,
             "[session start] (display %d): Failed to fork for scp with "
             "errno: %d, description: %s",
             display, g_get_errno(), g_get_strerror());
+        if (pool_item != NULL)
+        {
+            g_sigterm(pool_item->pid);
+            session_release_display(display);
+            g_free(pool_item);
+        }
     }
     else if (pid == 0)
     {
@@ -496,8 +1426,14 @@ session_start_fork(tbus data, tui8 type, struct SCP_CONNECTION *c,
             display, g_getpid());
         auth_start_session(data, display);
         g_delete_wait_obj(g_term_event);
+        g_delete_wait_obj(g_sync_event);
         g_tcp_close(g_sck);
+        if (g_unix_sck >= 0)
+        {
+            g_tcp_close(g_unix_sck);
+        }
         g_tcp_close(c->in_sck);
+        scp_pool_close_sockets();
         g_sprintf(geometry, "%dx%d", s->width, s->height);
         g_sprintf(depth, "%d", s->bpp);
         g_sprintf(screen, ":%d", display);
@@ -557,12 +1493,43 @@ session_start_fork(tbus data, tui8 type, struct SCP_CONNECTION *c,
         }
         else if (window_manager_pid == 0)
         {
+            /* its own process group, so the session can signal the
+               window manager and everything it started */
+            g_setpgid(0, 0);
             wait_for_xserver(display);
             env_set_user(s->username,
                          0,
                          display,
                          g_cfg->env_names,
                          g_cfg->env_values);
+            if (pool_item != NULL)
+            {
+                /* the pooled server runs as the user, move its cookie
+                   to the user's Xauthority */
+                session_pool_authfile(g_getenv("HOME") != NULL ?
+                                      g_getenv("HOME") : ".",
+                                      display, authfile, sizeof(authfile));
+                if (g_file_exist(authfile) && g_file_delete(authfile) == 0)
+                {
+                    LOG(LOG_LEVEL_WARNING, "[session pool] (display %d): "
+                        "can't delete %s (%s)", display, authfile,
+                        g_get_strerror());
+                }
+                if (g_getenv("XAUTHORITY") != NULL)
+                {
+                    g_snprintf(authfile, 255, "%s", g_getenv("XAUTHORITY"));
+                }
+                else
+                {
+                    g_snprintf(authfile, 255, "%s", ".Xauthority");
+                }
+                if (add_xauth_cookie_value(display, authfile,
+                                           pool_item->cookie) != 0)
+                {
+                    LOG(LOG_LEVEL_ERROR, "Error setting the xauth cookie for "
+                        "display %d in file %s", display, authfile);
+                }
+            }
             if (x_server_running(display))
             {
                 auth_set_env(data);
@@ -645,8 +1612,18 @@ session_start_fork(tbus data, tui8 type, struct SCP_CONNECTION *c,
         }
         else
         {
-            display_pid = g_fork(); /* parent becomes scp,
-                                child becomes X */
+            /* also set here, the child may not have run yet */
+            g_setpgid(window_manager_pid, window_manager_pid);
+            if (pool_item != NULL)
+            {
+                /* X is already running */
+                display_pid = pool_item->pid;
+            }
+            else
+            {
+                display_pid = g_fork(); /* parent becomes scp,
+                                    child becomes X */
+            }
             if (display_pid == -1)
             {
                 LOG(LOG_LEVEL_ERROR,
@@ -672,13 +1649,7 @@ session_start_fork(tbus data, tui8 type, struct SCP_CONNECTION *c,
                 }
 
                 /* setting Xserver environment variables */
-                g_snprintf(text, 255, "%d", g_cfg->sess.max_idle_time);
-                g_setenv("XRDP_SESMAN_MAX_IDLE_TIME", text, 1);
-                g_snprintf(text, 255, "%d", g_cfg->sess.max_disc_time);
-                g_setenv("XRDP_SESMAN_MAX_DISC_TIME", text, 1);
-                g_snprintf(text, 255, "%d", g_cfg->sess.kill_disconnected);
-                g_setenv("XRDP_SESMAN_KILL_DISCONNECTED", text, 1);
-                g_setenv("XRDP_SOCKET_PATH", XRDP_SOCKET_PATH, 1);
+                session_set_xserver_env();
 
                 /* prepare the Xauthority stuff */
                 if (g_getenv("XAUTHORITY") != NULL)
@@ -721,24 +1692,8 @@ session_start_fork(tbus data, tui8 type, struct SCP_CONNECTION *c,
                     }
 #endif
 
-                    xserver_params = list_create();
-                    xserver_params->auto_free = 1;
-
-                    /* get path of Xorg from config */
-                    xserver = g_strdup((const char *)list_get_item(g_cfg->xorg_params, 0));
-
-                    /* these are the must have parameters */
-                    list_add_item(xserver_params, (tintptr) g_strdup(xserver));
-                    list_add_item(xserver_params, (tintptr) g_strdup(screen));
-                    list_add_item(xserver_params, (tintptr) g_strdup("-auth"));
-                    list_add_item(xserver_params, (tintptr) g_strdup(authfile));
-
-                    /* additional parameters from sesman.ini file */
-                    list_append_list_strdup(g_cfg->xorg_params, xserver_params, 1);
-
-                    /* make sure it ends with a zero */
-                    list_add_item(xserver_params, 0);
-
+                    xserver_params = session_xorg_params(screen, authfile,
+                                                         &xserver);
                     pp1 = (char **) xserver_params->items;
 
                     /* some args are passed via env vars */
@@ -835,11 +1790,6 @@ session_start_fork(tbus data, tui8 type, struct SCP_CONNECTION *c,
             }
             else
             {
-                int wm_wait_time;
-                struct exit_status wm_exit_status;
-                struct exit_status xserver_exit_status;
-                struct exit_status chansrv_exit_status;
-
                 wait_for_xserver(display);
                 chansrv_pid = session_start_chansrv(s->username, display);
 
@@ -847,68 +1797,8 @@ session_start_fork(tbus data, tui8 type, struct SCP_CONNECTION *c,
                     "Session started successfully for user %s on display %d",
                     s->username, display);
 
-                /* Monitor the amount of time we wait for the
-                 * window manager. This is approximately how long the window
-                 * manager was running for */
-                LOG(LOG_LEVEL_INFO, "Session in progress on display %d, waiting "
-                    "until the window manager (pid %d) exits to end the session", 
-                    display, window_manager_pid);
-                wm_wait_time = g_time1();
-                wm_exit_status = g_waitpid_status(window_manager_pid);
-                wm_wait_time = g_time1() - wm_wait_time;
-                if (wm_exit_status.exit_code > 0)
-                {
-                    LOG(LOG_LEVEL_WARNING, "Window manager (pid %d, display %d) "
-                        "exited with non-zero exit code %d and signal %d. This "
-                        "could indicate a window manager config problem",
-                        window_manager_pid, display, wm_exit_status.exit_code,
-                        wm_exit_status.signal_no);
-                }
-                if (wm_wait_time < 10)
-                {
-                    /* This could be a config issue. Log a significant error */
-                    LOG(LOG_LEVEL_WARNING, "Window manager (pid %d, display %d) "
-                        "exited quickly (%d secs). This could indicate a window "
-                        "manager config problem",
-                        window_manager_pid, display, wm_wait_time);
-                }
-                else
-                {
-                    LOG(LOG_LEVEL_DEBUG, "Window manager (pid %d, display %d) "
-                        "was running for %d seconds.",
-                        window_manager_pid, display, wm_wait_time);
-                }
-                LOG(LOG_LEVEL_INFO, 
-                    "Calling auth_stop_session and auth_end from pid %d",
-                    g_getpid());
-                auth_stop_session(data);
-                auth_end(data);
-
-                LOG(LOG_LEVEL_INFO,
-                    "Terminating X server (pid %d) on display %d", 
-                    display_pid, display);
-                g_sigterm(display_pid);
-
-                LOG(LOG_LEVEL_INFO, "Terminating the xrdp channel server (pid %d) "
-                    "on display %d", chansrv_pid, display);
-                g_sigterm(chansrv_pid);
-
-                /* make sure socket cleanup happen after child process exit */
-                xserver_exit_status = g_waitpid_status(display_pid);
-                LOG(LOG_LEVEL_INFO,
-                    "X server on display %d (pid %d) returned exit code %d "
-                    "and signal number %d",
-                    display, display_pid, xserver_exit_status.exit_code, 
-                    xserver_exit_status.signal_no);
-
-                chansrv_exit_status = g_waitpid_status(chansrv_pid);
-                LOG(LOG_LEVEL_INFO,
-                    "xrdp channel server for display %d (pid %d) "
-                    "exit code %d and signal number %d",
-                    display, chansrv_pid, chansrv_exit_status.exit_code,
-                    chansrv_exit_status.signal_no);
-
-                cleanup_sockets(display);
+                session_monitor(data, display, window_manager_pid,
+                                display_pid, pool_item == NULL, chansrv_pid);
                 g_deinit();
                 g_exit(0);
             }
@@ -943,9 +1833,16 @@ session_start_fork(tbus data, tui8 type, struct SCP_CONNECTION *c,
         temp->item->type = type;
         temp->item->status = SESMAN_SESSION_STATUS_ACTIVE;
 
-        temp->next = g_sessions;
-        g_sessions = temp;
-        g_session_count++;
+        if (pool_item != NULL)
+        {
+            g_free(pool_item);
+            /* replace the server handed out */
+            session_pool_fill();
+        }
+
+        tc_mutex_lock(g_session_lock);
+        session_registry_add(temp);
+        tc_mutex_unlock(g_session_lock);
 
         return display;
     }
@@ -962,7 +1859,7 @@ session_reconnect_fork(int display, char *username, long data)
 {
     int pid;
 
-    pid = g_fork();
+    pid = session_fork();
 
     if (pid == -1)
     {
@@ -1004,6 +1901,56 @@ session_reconnect_fork(int display, char *username, long data)
     return display;
 }
 
+/******************************************************************************/
+int
+session_init(void)
+{
+    g_session_lock = tc_mutex_create();
+    g_sync_mutex = tc_mutex_create();
+    g_sync_sem = tc_sem_create(0);
+    g_sync_event = g_create_wait_obj("xrdp_sesman_sync");
+    g_pool_items = list_create();
+    if (g_pool_items != NULL)
+    {
+        g_pool_items->auto_free = 1;
+    }
+    if (g_session_lock == 0 || g_sync_mutex == 0 || g_sync_sem == 0 ||
+            g_sync_event == 0 || g_pool_items == NULL)
+    {
+        LOG(LOG_LEVEL_ERROR, "session_init: failed to create sync objects");
+        return 1;
+    }
+    return 0;
+}
+
+/******************************************************************************/
+/* called with the main thread when g_sync_event is set */
+int
+session_sync_start(void)
+{
+    tui64 start;
+
+    g_reset_wait_obj(g_sync_event);
+    if (g_sync_cmd == SESSION_SYNC_START)
+    {
+        start = g_time4();
+        g_sync_result = session_start_fork(g_sync_data, g_sync_type,
+                                           g_sync_con, g_sync_s);
+        metrics_record(METRICS_SESSION_START, start);
+        if (g_sync_result > 0)
+        {
+            metrics_session_started(g_sync_result, start);
+        }
+    }
+    else
+    {
+        g_sync_result = session_reconnect_fork(g_sync_display,
+                                               g_sync_username, g_sync_data);
+    }
+    tc_sem_inc(g_sync_sem);
+    return 0;
+}
+
 /******************************************************************************/
 /* called by a worker thread, ask the main thread to call session_sync_start
    and wait till done */
@@ -1011,7 +1958,19 @@ int
 session_start(long data, tui8 type, struct SCP_CONNECTION *c,
               struct SCP_SESSION *s)
 {
-    return session_start_fork(data, type, c, s);
+    int display;
+
+    tc_mutex_lock(g_sync_mutex);
+    g_sync_cmd = SESSION_SYNC_START;
+    g_sync_data = data;
+    g_sync_type = type;
+    g_sync_con = c;
+    g_sync_s = s;
+    g_set_wait_obj(g_sync_event);
+    tc_sem_dec(g_sync_sem);
+    display = g_sync_result;
+    tc_mutex_unlock(g_sync_mutex);
+    return display;
 }
 
 /******************************************************************************/
@@ -1020,70 +1979,53 @@ session_start(long data, tui8 type, struct SCP_CONNECTION *c,
 int
 session_reconnect(int display, char *username, long data)
 {
-    return session_reconnect_fork(display, username, data);
+    int rv;
+
+    tc_mutex_lock(g_sync_mutex);
+    g_sync_cmd = SESSION_SYNC_RECONNECT;
+    g_sync_display = display;
+    g_sync_username = username;
+    g_sync_data = data;
+    g_set_wait_obj(g_sync_event);
+    tc_sem_dec(g_sync_sem);
+    rv = g_sync_result;
+    tc_mutex_unlock(g_sync_mutex);
+    return rv;
 }
 
 /******************************************************************************/
-int
-session_kill(int pid)
+static int
+session_kill_locked(int pid)
 {
     struct session_chain *tmp;
-    struct session_chain *prev;
 
-    tmp = g_sessions;
-    prev = 0;
+    tmp = session_registry_find_pid(pid);
 
-    while (tmp != 0)
+    if (tmp == 0)
     {
-        if (tmp->item == 0)
-        {
-            LOG(LOG_LEVEL_ERROR, "session descriptor for "
-                "pid %d is null!", pid);
-
-            if (prev == 0)
-            {
-                /* prev does no exist, so it's the first element - so we set
-                   g_sessions */
-                g_sessions = tmp->next;
-            }
-            else
-            {
-                prev->next = tmp->next;
-            }
-
-            return SESMAN_SESSION_KILL_NULLITEM;
-        }
-
-        if (tmp->item->pid == pid)
-        {
-            /* deleting the session */
-            LOG(LOG_LEVEL_INFO, 
-                "++ terminated session:  username %s, display :%d.0, session_pid %d, ip %s", 
-                tmp->item->name, tmp->item->display, tmp->item->pid, tmp->item->client_ip);
-            g_free(tmp->item);
-
-            if (prev == 0)
-            {
-                /* prev does no exist, so it's the first element - so we set
-                   g_sessions */
-                g_sessions = tmp->next;
-            }
-            else
-            {
-                prev->next = tmp->next;
-            }
+        return SESMAN_SESSION_KILL_NOTFOUND;
+    }
 
-            g_free(tmp);
-            g_session_count--;
-            return SESMAN_SESSION_KILL_OK;
-        }
+    /* deleting the session */
+    LOG(LOG_LEVEL_INFO,
+        "++ terminated session:  username %s, display :%d.0, session_pid %d, ip %s",
+        tmp->item->name, tmp->item->display, tmp->item->pid, tmp->item->client_ip);
+    session_registry_remove(tmp);
+    g_free(tmp->item);
+    g_free(tmp);
+    return SESMAN_SESSION_KILL_OK;
+}
 
-        /* go on */
-        prev = tmp;
-        tmp = tmp->next;
-    }
+/******************************************************************************/
+int
+session_kill(int pid)
+{
+    int rv;
 
-    return SESMAN_SESSION_KILL_NOTFOUND;
+    tc_mutex_lock(g_session_lock);
+    rv = session_kill_locked(pid);
+    tc_mutex_unlock(g_session_lock);
+    return rv;
 }
 
 /******************************************************************************/
@@ -1091,6 +2033,8 @@ void
 session_sigkill_all(void)
 {
     struct session_chain *tmp;
+    struct session_pool_item *item;
+    int index;
 
     tmp = g_sessions;
 
@@ -1108,6 +2052,13 @@ session_sigkill_all(void)
         /* go on */
         tmp = tmp->next;
     }
+
+    for (index = 0; g_pool_items != NULL && index < g_pool_items->count;
+            index++)
+    {
+        item = (struct session_pool_item *)list_get_item(g_pool_items, index);
+        g_sigterm(item->pid);
+    }
 }
 
 /******************************************************************************/
@@ -1125,31 +2076,33 @@ session_get_bypid(int pid)
         return 0;
     }
 
-    tmp = g_sessions;
+    tc_mutex_lock(g_session_lock);
+    tmp = session_registry_find_pid(pid);
 
-    while (tmp != 0)
+    if (tmp != 0)
     {
-        if (tmp->item == 0)
-        {
-            LOG(LOG_LEVEL_ERROR, "session descriptor for pid %d is null!", pid);
-            g_free(dummy);
-            return 0;
-        }
-
-        if (tmp->item->pid == pid)
-        {
-            g_memcpy(dummy, tmp->item, sizeof(struct session_item));
-            return dummy;
-        }
-
-        /* go on */
-        tmp = tmp->next;
+        g_memcpy(dummy, tmp->item, sizeof(struct session_item));
+        tc_mutex_unlock(g_session_lock);
+        return dummy;
     }
+    tc_mutex_unlock(g_session_lock);
 
     g_free(dummy);
     return 0;
 }
 
+/******************************************************************************/
+/* a NULL user walks every session, otherwise just the user's hash bucket */
+static struct session_chain *
+session_byuser_first(const char *user)
+{
+    if (user == NULL)
+    {
+        return g_sessions;
+    }
+    return g_sessions_by_user[session_hash_user(user)];
+}
+
 /******************************************************************************/
 struct SCP_DISCONNECTED_SESSION *
 session_get_byuser(const char *user, int *cnt, unsigned char flags)
@@ -1161,7 +2114,8 @@ session_get_byuser(const char *user, int *cnt, unsigned char flags)
 
     count = 0;
 
-    tmp = g_sessions;
+    tc_mutex_lock(g_session_lock);
+    tmp = session_byuser_first(user);
 
     LOG(LOG_LEVEL_DEBUG, "searching for session by user: %s", user);
     while (tmp != 0)
@@ -1179,11 +2133,12 @@ session_get_byuser(const char *user, int *cnt, unsigned char flags)
         }
 
         /* go on */
-        tmp = tmp->next;
+        tmp = (user == NULL) ? tmp->next : tmp->user_next;
     }
 
     if (count == 0)
     {
+        tc_mutex_unlock(g_session_lock);
         (*cnt) = 0;
         return 0;
     }
@@ -1193,11 +2148,12 @@ session_get_byuser(const char *user, int *cnt, unsigned char flags)
 
     if (sess == 0)
     {
+        tc_mutex_unlock(g_session_lock);
         (*cnt) = 0;
         return 0;
     }
 
-    tmp = g_sessions;
+    tmp = session_byuser_first(user);
     index = 0;
 
     while (tmp != 0)
@@ -1242,8 +2198,9 @@ session_get_byuser(const char *user, int *cnt, unsigned char flags)
         }
 
         /* go on */
-        tmp = tmp->next;
+        tmp = (user == NULL) ? tmp->next : tmp->user_next;
     }
+    tc_mutex_unlock(g_session_lock);
 
     (*cnt) = count;
     return sess;
@@ -82,13 +82,16 @@ struct session_item
 struct session_chain
 {
   struct session_chain* next;
+  struct session_chain* prev;
+  struct session_chain* pid_next; /* same pid hash bucket */
+  struct session_chain* user_next; /* same user name hash bucket */
   struct session_item* item;
 };
 
 /**
  *
  * @brief finds a session matching the supplied parameters
- * @return session data or 0
+ * @return a copy of the session data, to be freed with g_free(), or 0
  *
  */
 struct session_item*
@@ -98,6 +101,43 @@ session_get_bydata(const char *name, int width, int height, int bpp, int type,
   #define session_find_item(a, b, c, d, e, f) session_get_bydata(a, b, c, d, e, f);
 #endif
 
+/**
+ *
+ * @brief creates the session list lock and the main thread sync objects
+ * @return 0 on success
+ *
+ */
+int
+session_init(void);
+
+/**
+ *
+ * @brief runs a session start or reconnect requested by an auth worker
+ * @note must be called from the main thread when g_sync_event is set
+ *
+ */
+int
+session_sync_start(void);
+
+/**
+ *
+ * @brief starts idle X servers until the session pool is full
+ * @note called with the main thread
+ *
+ */
+void
+session_pool_fill(void);
+
+/**
+ *
+ * @brief removes an idle pooled X server that exited
+ * @param pid the process that exited
+ * @return non-zero if pid was an idle pooled server
+ *
+ */
+int
+session_pool_child_exited(int pid);
+
 /**
  *
  * @brief starts a session
@@ -29,13 +29,25 @@
 #endif
 
 #include <signal.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_SIGNALFD_H
+#include <sys/signalfd.h>
+#endif
 
 #include "sesman.h"
+#include "file.h"
 
 extern int g_sck;
 extern int g_pid;
 extern struct config_sesman *g_cfg; /* in sesman.c */
 extern tbus g_term_event;
+extern tbus g_reload_event;
+extern tbus g_sigchld_event;
+
+/* SIGCHLD is read from here by the main loop, -1 when the signal handler
+   sets g_sigchld_event through a pipe instead */
+static int g_sigchld_fd = -1;
+static sigset_t g_sigchld_oldmask;
 
 /******************************************************************************/
 void
@@ -64,17 +76,28 @@ sig_sesman_shutdown(int sig)
 /******************************************************************************/
 void
 sig_sesman_reload_cfg(int sig)
+{
+    if (g_getpid() != g_pid)
+    {
+        return;
+    }
+
+    /* the auth workers read g_cfg, the main loop swaps it once they
+       are idle */
+    g_set_wait_obj(g_reload_event);
+}
+
+/******************************************************************************/
+void
+sig_sesman_reload_cfg_sync(void)
 {
     int error;
     struct config_sesman *cfg;
 
     LOG(LOG_LEVEL_WARNING, "receiving SIGHUP %d", 1);
 
-    if (g_getpid() != g_pid)
-    {
-        LOG_DEVEL(LOG_LEVEL_DEBUG, "g_getpid() [%d] differs from g_pid [%d]", g_getpid(), g_pid);
-        return;
-    }
+    /* parse the files again even if an edit kept their size and mtime */
+    file_cache_flush();
 
     if ((cfg = config_read(g_cfg->sesman_ini)) == NULL)
     {
@@ -110,24 +133,129 @@ sig_sesman_reload_cfg(int sig)
     }
 
     LOG(LOG_LEVEL_INFO, "configuration reloaded, log subsystem restarted");
+
+    session_pool_fill();
 }
 
 /******************************************************************************/
 void
 sig_sesman_session_end(int sig)
 {
-    int pid;
-
     if (g_getpid() != g_pid)
     {
         return;
     }
 
-    pid = g_waitchild();
+    /* reaped by the main loop, session_kill() takes a lock */
+    g_set_wait_obj(g_sigchld_event);
+}
+
+/******************************************************************************/
+int
+sig_sesman_child_init(void)
+{
+    char text[256];
+#ifdef HAVE_SYS_SIGNALFD_H
+    sigset_t mask;
+
+    /* blocked before the auth workers start so they inherit it, only the
+       signalfd sees SIGCHLD */
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &mask, &g_sigchld_oldmask) == 0)
+    {
+        g_sigchld_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (g_sigchld_fd < 0)
+        {
+            LOG(LOG_LEVEL_WARNING, "sig_sesman_child_init: signalfd "
+                "failed (%s), using a SIGCHLD handler", g_get_strerror());
+            sigprocmask(SIG_SETMASK, &g_sigchld_oldmask, NULL);
+        }
+    }
+    if (g_sigchld_fd >= 0)
+    {
+        g_sigchld_event = g_create_wait_obj_from_socket(g_sigchld_fd, 0);
+        return 0;
+    }
+#endif
+    g_snprintf(text, 255, "xrdp_sesman_%8.8x_main_sigchld", g_pid);
+    g_sigchld_event = g_create_wait_obj(text);
+    return g_sigchld_event == 0;
+}
+
+/******************************************************************************/
+void
+sig_sesman_child_deinit(void)
+{
+    if (g_sigchld_fd >= 0)
+    {
+        close(g_sigchld_fd);
+        g_sigchld_fd = -1;
+        sigprocmask(SIG_SETMASK, &g_sigchld_oldmask, NULL);
+    }
+    else
+    {
+        g_delete_wait_obj(g_sigchld_event);
+    }
+    g_sigchld_event = 0;
+}
+
+/******************************************************************************/
+void
+sig_sesman_child_forked(void)
+{
+    if (g_sigchld_fd >= 0)
+    {
+        /* what the child execs must get SIGCHLD */
+        close(g_sigchld_fd);
+        g_sigchld_fd = -1;
+        sigprocmask(SIG_SETMASK, &g_sigchld_oldmask, NULL);
+        g_sigchld_event = 0;
+    }
+}
+
+/******************************************************************************/
+/* drains the SIGCHLD notifications, any number of exits may be behind
+   one of them */
+static void
+sig_sesman_child_reset(void)
+{
+#ifdef HAVE_SYS_SIGNALFD_H
+    struct signalfd_siginfo si;
+
+    if (g_sigchld_fd >= 0)
+    {
+        while (read(g_sigchld_fd, &si, sizeof(si)) == sizeof(si))
+        {
+        }
+        return;
+    }
+#endif
+    g_reset_wait_obj(g_sigchld_event);
+}
+
+/******************************************************************************/
+void
+sig_sesman_session_end_sync(void)
+{
+    int pid;
+    int pool_exited = 0;
+
+    sig_sesman_child_reset();
+
+    while ((pid = g_waitchild()) > 0)
+    {
+        if (session_kill(pid) == SESMAN_SESSION_KILL_NOTFOUND &&
+                session_pool_child_exited(pid))
+        {
+            pool_exited = 1;
+        }
+    }
 
-    if (pid > 0)
+    /* servers handed out are replaced when they are taken */
+    if (pool_exited)
     {
-        session_kill(pid);
+        session_pool_fill();
     }
 }
 
@@ -173,7 +301,7 @@ sig_handler_thread(void *arg)
             case SIGCHLD:
                 /* a session died */
                 LOG_DEVEL(LOG_LEVEL_DEBUG, "sesman received SIGCHLD");
-                sig_sesman_session_end(SIGCHLD);
+                sig_sesman_session_end_sync();
                 break;
             case SIGINT:
                 /* we die */
@@ -45,6 +45,15 @@ sig_sesman_shutdown(int sig);
 void
 sig_sesman_reload_cfg(int sig);
 
+/**
+ *
+ * @brief rereads the configuration, called from the main loop after
+ *        SIGHUP once the auth workers are idle
+ *
+ */
+void
+sig_sesman_reload_cfg_sync(void);
+
 /**
  *
  * @brief SIGCHLD handling code
@@ -54,6 +63,41 @@ sig_sesman_reload_cfg(int sig);
 void
 sig_sesman_session_end(int sig);
 
+/**
+ *
+ * @brief sets up g_sigchld_event, a signalfd where available, call before
+ *        any thread is started
+ * @return 0 on success
+ *
+ */
+int
+sig_sesman_child_init(void);
+
+/**
+ *
+ * @brief releases g_sigchld_event
+ *
+ */
+void
+sig_sesman_child_deinit(void);
+
+/**
+ *
+ * @brief gives a child of the main process back the SIGCHLD handling it
+ *        had before sig_sesman_child_init
+ *
+ */
+void
+sig_sesman_child_forked(void);
+
+/**
+ *
+ * @brief reaps exited children, called from the main loop after SIGCHLD
+ *
+ */
+void
+sig_sesman_session_end_sync(void);
+
 /**
  *
  * @brief signal handling thread
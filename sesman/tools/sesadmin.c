@@ -40,6 +40,7 @@ char port[257];
 
 void cmndList(struct SCP_CONNECTION *c);
 void cmndKill(struct SCP_CONNECTION *c, struct SCP_SESSION *s);
+void cmndMetrics(struct SCP_CONNECTION *c);
 void cmndHelp(void);
 
 int inputSession(struct SCP_SESSION *s);
@@ -166,6 +167,10 @@ int main(int argc, char **argv)
     {
         cmndKill(c, s);
     }
+    else if (0 == g_strncmp(cmnd, "metrics", 8))
+    {
+        cmndMetrics(c);
+    }
 
     g_tcp_close(sock);
     scp_session_destroy(s);
@@ -187,6 +192,7 @@ void cmndHelp(void)
     fprintf(stderr, "               it can be one of those:\n");
     fprintf(stderr, "               list\n");
     fprintf(stderr, "               kill:<sid>\n");
+    fprintf(stderr, "               metrics\n");
 }
 
 static void
@@ -237,3 +243,16 @@ void cmndKill(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
 {
 
 }
+
+void cmndMetrics(struct SCP_CONNECTION *c)
+{
+    char text[SCP_MAX_MESSAGE_SIZE];
+
+    if (scp_v1c_mng_get_metrics(c, text, sizeof(text)) != SCP_CLIENT_STATE_OK)
+    {
+        printf("Error getting metrics.\n");
+        return;
+    }
+
+    printf("%s", text);
+}
@@ -51,9 +51,9 @@ static int
 auth_account_disabled(struct spwd *stp);
 
 /******************************************************************************/
-/* returns boolean */
-long
-auth_userpass(const char *user, const char *pass, int *errorcode)
+/* returns boolean, called with scp_userdb_lock() held */
+static long
+auth_userpass_locked(const char *user, const char *pass)
 {
     const char *encr;
     const char *epass;
@@ -98,6 +98,19 @@ auth_userpass(const char *user, const char *pass, int *errorcode)
     return (strcmp(encr, epass) == 0);
 }
 
+/******************************************************************************/
+/* returns boolean */
+long
+auth_userpass(const char *user, const char *pass, int *errorcode)
+{
+    long rv;
+
+    scp_userdb_lock();
+    rv = auth_userpass_locked(user, pass);
+    scp_userdb_unlock();
+    return rv;
+}
+
 /******************************************************************************/
 /* returns error */
 int
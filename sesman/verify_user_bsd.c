@@ -50,7 +50,12 @@ extern struct config_sesman *g_cfg; /* in sesman.c */
 long
 auth_userpass(const char *user, const char *pass, int *errorcode)
 {
-    int ret = auth_userokay(user, NULL, "auth-xrdp", pass);
+    int ret;
+
+    /* looks the user up with getpwnam */
+    scp_userdb_lock();
+    ret = auth_userokay(user, NULL, "auth-xrdp", pass);
+    scp_userdb_unlock();
     return ret;
 }
 
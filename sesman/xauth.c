@@ -31,23 +31,32 @@
 #include "log.h"
 #include "os_calls.h"
 #include "string_calls.h"
+#include "xauth.h"
 
 
 /******************************************************************************/
 int
 add_xauth_cookie(int display, const char *file)
 {
-    FILE *dp;
     char cookie_str[33];
     char cookie_bin[16];
-    char xauth_str[256];
-    int ret;
 
     g_random(cookie_bin, 16);
     g_bytes_to_hexstr(cookie_bin, 16, cookie_str, 33);
 
-    g_sprintf(xauth_str, "xauth -q -f %s add :%d . %s",
-              file, display, cookie_str);
+    return add_xauth_cookie_value(display, file, cookie_str);
+}
+
+/******************************************************************************/
+int
+add_xauth_cookie_value(int display, const char *file, const char *cookie_str)
+{
+    FILE *dp;
+    char xauth_str[256];
+    int ret;
+
+    g_snprintf(xauth_str, sizeof(xauth_str), "xauth -q -f %s add :%d . %s",
+               file, display, cookie_str);
 
     dp = popen(xauth_str, "r");
     if (dp == NULL)
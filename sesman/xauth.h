@@ -38,4 +38,15 @@
 int
 add_xauth_cookie(int display, const char *file);
 
+/**
+ * @brief add a given cookie for the display to an XAUTHORITY file
+ *        used to give a user access to a server started with that cookie
+ * @param display The session display
+ * @param file The XAUTHORITY file to add the entry to
+ * @param cookie_str The cookie as 32 hex digits
+ * @return 0 if adding the cookie is ok
+ */
+int
+add_xauth_cookie_value(int display, const char *file, const char *cookie_str);
+
 #endif
@@ -0,0 +1,9 @@
+#ifndef TEST_CHANSRV_H
+#define TEST_CHANSRV_H
+
+#include <check.h>
+
+Suite *make_suite_test_irp(void);
+Suite *make_suite_test_xfs(void);
+
+#endif /* TEST_CHANSRV_H */
@@ -0,0 +1,155 @@
+#if defined(HAVE_CONFIG_H)
+#include "config_ac.h"
+#endif
+
+#include <stdio.h>
+
+#include "os_calls.h"
+#include "parse.h"
+#include "test_chansrv.h"
+#include "irp.h"
+
+/* IRPs driven through create, find and delete */
+#define MANY_IRPS 100000
+
+/*****************************************************************************/
+START_TEST(test_irp_new__always__gives_distinct_completion_ids)
+{
+    IRP *irp1 = devredir_irp_new();
+    IRP *irp2 = devredir_irp_with_pathname_new("\\dir\\file");
+
+    ck_assert_ptr_ne(irp1, NULL);
+    ck_assert_ptr_ne(irp2, NULL);
+    ck_assert_int_ne(irp1->CompletionId, 0);
+    ck_assert_int_ne(irp1->CompletionId, irp2->CompletionId);
+    ck_assert_str_eq(irp2->pathname, "\\dir\\file");
+    ck_assert_ptr_eq(devredir_irp_find(irp1->CompletionId), irp1);
+    ck_assert_ptr_eq(devredir_irp_find(irp2->CompletionId), irp2);
+
+    ck_assert_int_eq(devredir_irp_delete(irp1), 0);
+    ck_assert_int_eq(devredir_irp_delete(irp2), 0);
+    ck_assert_int_eq(devredir_irp_count(), 0);
+}
+END_TEST
+
+/*****************************************************************************/
+START_TEST(test_irp_find__when_irp_deleted__rejects_stale_completion_id)
+{
+    IRP *irp = devredir_irp_new();
+    tui32 stale_id = irp->CompletionId;
+    IRP *later[16];
+    int i;
+
+    ck_assert_int_eq(devredir_irp_delete(irp), 0);
+
+    /* new IRPs don't take over the completion ID */
+    for (i = 0; i < 16; ++i)
+    {
+        later[i] = devredir_irp_new();
+        ck_assert_ptr_ne(later[i], NULL);
+        ck_assert_int_ne(later[i]->CompletionId, stale_id);
+    }
+    ck_assert_ptr_eq(devredir_irp_find(stale_id), NULL);
+
+    for (i = 0; i < 16; ++i)
+    {
+        devredir_irp_delete(later[i]);
+    }
+}
+END_TEST
+
+/*****************************************************************************/
+START_TEST(test_irp_find_by_fileid__when_fileid_shared__returns_oldest)
+{
+    IRP *opener = devredir_irp_new();
+    IRP *other = devredir_irp_new();
+
+    devredir_irp_set_fileid(opener, 42);
+    devredir_irp_set_fileid(other, 42);
+
+    ck_assert_ptr_eq(devredir_irp_find_by_fileid(42), opener);
+    ck_assert_ptr_eq(devredir_irp_find_by_fileid(43), NULL);
+
+    devredir_irp_delete(opener);
+    ck_assert_ptr_eq(devredir_irp_find_by_fileid(42), other);
+
+    devredir_irp_set_fileid(other, 43);
+    ck_assert_ptr_eq(devredir_irp_find_by_fileid(42), NULL);
+    ck_assert_ptr_eq(devredir_irp_find_by_fileid(43), other);
+
+    devredir_irp_delete(other);
+    ck_assert_ptr_eq(devredir_irp_find_by_fileid(43), NULL);
+}
+END_TEST
+
+/*****************************************************************************/
+START_TEST(test_irp__many_irps__create_find_delete)
+{
+    IRP **irps;
+    tui32 *ids;
+    int start;
+    int i;
+    int j;
+
+    irps = g_new0(IRP *, MANY_IRPS);
+    ids = g_new0(tui32, MANY_IRPS);
+    ck_assert_ptr_ne(irps, NULL);
+    ck_assert_ptr_ne(ids, NULL);
+
+    start = g_time3();
+    for (i = 0; i < MANY_IRPS; ++i)
+    {
+        irps[i] = devredir_irp_new();
+        ck_assert_ptr_ne(irps[i], NULL);
+        ids[i] = irps[i]->CompletionId;
+        devredir_irp_set_fileid(irps[i], (tui32)i + 1);
+    }
+    ck_assert_int_eq(devredir_irp_count(), MANY_IRPS);
+
+    for (i = 0; i < MANY_IRPS; ++i)
+    {
+        ck_assert_ptr_eq(devredir_irp_find(ids[i]), irps[i]);
+        ck_assert_ptr_eq(devredir_irp_find_by_fileid((tui32)i + 1), irps[i]);
+    }
+
+    /* delete in a scattered order, checking neighbours are still found */
+    for (i = 0; i < MANY_IRPS; ++i)
+    {
+        j = (int)(((long long)i * 7919) % MANY_IRPS);
+        ck_assert_int_eq(devredir_irp_delete(irps[j]), 0);
+        ck_assert_ptr_eq(devredir_irp_find(ids[j]), NULL);
+        ck_assert_ptr_eq(devredir_irp_find_by_fileid((tui32)j + 1), NULL);
+        if (j + 1 < MANY_IRPS && devredir_irp_find(ids[j + 1]) != NULL)
+        {
+            ck_assert_ptr_eq(devredir_irp_find(ids[j + 1]), irps[j + 1]);
+        }
+    }
+    ck_assert_int_eq(devredir_irp_count(), 0);
+
+    printf("# %d IRPs created, found and deleted in %d ms\n",
+           MANY_IRPS, g_time3() - start);
+    fflush(stdout);
+
+    g_free(irps);
+    g_free(ids);
+}
+END_TEST
+
+/*****************************************************************************/
+Suite *
+make_suite_test_irp(void)
+{
+    Suite *s;
+    TCase *tc_irp;
+
+    s = suite_create("Irp");
+
+    tc_irp = tcase_create("irp");
+    suite_add_tcase(s, tc_irp);
+    tcase_add_test(tc_irp, test_irp_new__always__gives_distinct_completion_ids);
+    tcase_add_test(tc_irp, test_irp_find__when_irp_deleted__rejects_stale_completion_id);
+    tcase_add_test(tc_irp, test_irp_find_by_fileid__when_fileid_shared__returns_oldest);
+    tcase_add_test(tc_irp, test_irp__many_irps__create_find_delete);
+
+    return s;
+}
@@ -0,0 +1,270 @@
+#if defined(HAVE_CONFIG_H)
+#include "config_ac.h"
+#endif
+
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include "os_calls.h"
+#include "test_chansrv.h"
+#include "chansrv_xfs.h"
+
+#define NAME_LEN 64
+
+/* entries in the directory used to measure lookups */
+#define BIG_DIR_ENTRIES 50000
+
+static struct xfs_fs *g_fs;
+
+/*****************************************************************************/
+static void
+setup(void)
+{
+    g_fs = xfs_create_xfs_fs(0, g_getuid(), g_getgid());
+    ck_assert_ptr_ne(g_fs, NULL);
+}
+
+/*****************************************************************************/
+static void
+teardown(void)
+{
+    xfs_delete_xfs_fs(g_fs);
+    g_fs = NULL;
+}
+
+/*****************************************************************************/
+/* a directory which behaves like a share on a redirected drive */
+static fuse_ino_t
+add_share(const char *name)
+{
+    XFS_INODE *xinode;
+
+    xinode = xfs_add_entry(g_fs, FUSE_ROOT_ID, name, S_IFDIR | 0755);
+    ck_assert_ptr_ne(xinode, NULL);
+    xinode->is_redirected = 1;
+    return xinode->inum;
+}
+
+/*****************************************************************************/
+static fuse_ino_t
+add_file(fuse_ino_t parent, const char *name)
+{
+    XFS_INODE *xinode;
+
+    xinode = xfs_add_entry(g_fs, parent, name, S_IFREG | 0644);
+    ck_assert_ptr_ne(xinode, NULL);
+    return xinode->inum;
+}
+
+/*****************************************************************************/
+static void
+fill_dir(fuse_ino_t parent, int count)
+{
+    char name[NAME_LEN];
+    int i;
+
+    for (i = 0; i < count; ++i)
+    {
+        g_snprintf(name, sizeof(name), "file%05d.txt", i);
+        add_file(parent, name);
+    }
+}
+
+/*****************************************************************************/
+START_TEST(test_xfs_lookup__when_entry_added__finds_it)
+{
+    fuse_ino_t inum = add_file(FUSE_ROOT_ID, "one");
+    XFS_INODE *xinode;
+
+    xinode = xfs_lookup_in_dir(g_fs, FUSE_ROOT_ID, "one");
+
+    ck_assert_ptr_ne(xinode, NULL);
+    ck_assert_int_eq(xinode->inum, inum);
+    ck_assert_ptr_eq(xfs_lookup_in_dir(g_fs, FUSE_ROOT_ID, "two"), NULL);
+}
+END_TEST
+
+/*****************************************************************************/
+START_TEST(test_xfs_lookup__when_dir_is_local__is_case_sensitive)
+{
+    add_file(FUSE_ROOT_ID, "readme");
+
+    ck_assert_ptr_eq(xfs_lookup_in_dir(g_fs, FUSE_ROOT_ID, "README"), NULL);
+    ck_assert_ptr_ne(xfs_add_entry(g_fs, FUSE_ROOT_ID, "README",
+                                   S_IFREG | 0644), NULL);
+}
+END_TEST
+
+/*****************************************************************************/
+START_TEST(test_xfs_lookup__when_dir_is_redirected__ignores_case)
+{
+    fuse_ino_t share = add_share("share");
+    fuse_ino_t inum = add_file(share, "ReadMe.TXT");
+    XFS_INODE *xinode;
+
+    xinode = xfs_lookup_in_dir(g_fs, share, "readme.txt");
+
+    ck_assert_ptr_ne(xinode, NULL);
+    ck_assert_int_eq(xinode->inum, inum);
+    ck_assert_str_eq(xinode->name, "ReadMe.TXT");
+    /* the same name in another case is the same file */
+    ck_assert_ptr_eq(xfs_add_entry(g_fs, share, "README.TXT",
+                                   S_IFREG | 0644), NULL);
+}
+END_TEST
+
+/*****************************************************************************/
+START_TEST(test_xfs_lookup__when_entry_removed__doesnt_find_it)
+{
+    fuse_ino_t share = add_share("share");
+    fuse_ino_t inum;
+
+    fill_dir(share, 100);
+    inum = xfs_lookup_in_dir(g_fs, share, "file00042.txt")->inum;
+
+    xfs_remove_entry(g_fs, inum);
+
+    ck_assert_ptr_eq(xfs_lookup_in_dir(g_fs, share, "file00042.txt"), NULL);
+    ck_assert_ptr_ne(xfs_lookup_in_dir(g_fs, share, "file00041.txt"), NULL);
+    ck_assert_ptr_ne(xfs_lookup_in_dir(g_fs, share, "file00043.txt"), NULL);
+}
+END_TEST
+
+/*****************************************************************************/
+START_TEST(test_xfs_lookup__when_dir_grows__finds_every_entry)
+{
+    fuse_ino_t share = add_share("share");
+    char name[NAME_LEN];
+    XFS_INODE *xinode;
+    int i;
+
+    fill_dir(share, 5000);
+
+    for (i = 0; i < 5000; ++i)
+    {
+        g_snprintf(name, sizeof(name), "FILE%05d.TXT", i);
+        xinode = xfs_lookup_in_dir(g_fs, share, name);
+        ck_assert_ptr_ne(xinode, NULL);
+        g_snprintf(name, sizeof(name), "file%05d.txt", i);
+        ck_assert_str_eq(xinode->name, name);
+    }
+}
+END_TEST
+
+/*****************************************************************************/
+START_TEST(test_xfs_move__when_renamed_in_dir__finds_new_name_only)
+{
+    fuse_ino_t share = add_share("share");
+    fuse_ino_t inum;
+
+    fill_dir(share, 100);
+    inum = add_file(share, "old");
+
+    ck_assert_int_eq(xfs_move_entry(g_fs, inum, share, "new"), 0);
+
+    ck_assert_ptr_eq(xfs_lookup_in_dir(g_fs, share, "old"), NULL);
+    ck_assert_int_eq(xfs_lookup_in_dir(g_fs, share, "new")->inum, inum);
+}
+END_TEST
+
+/*****************************************************************************/
+START_TEST(test_xfs_move__when_only_case_changes__keeps_entry)
+{
+    fuse_ino_t share = add_share("share");
+    fuse_ino_t inum = add_file(share, "name");
+    XFS_INODE *xinode;
+
+    ck_assert_int_eq(xfs_move_entry(g_fs, inum, share, "NAME"), 0);
+
+    xinode = xfs_lookup_in_dir(g_fs, share, "name");
+    ck_assert_ptr_ne(xinode, NULL);
+    ck_assert_int_eq(xinode->inum, inum);
+    ck_assert_str_eq(xinode->name, "NAME");
+}
+END_TEST
+
+/*****************************************************************************/
+START_TEST(test_xfs_move__when_moved_between_dirs__replaces_target)
+{
+    fuse_ino_t share = add_share("share");
+    fuse_ino_t src;
+    fuse_ino_t dst;
+    fuse_ino_t inum;
+
+    src = xfs_add_entry(g_fs, share, "src", S_IFDIR | 0755)->inum;
+    dst = xfs_add_entry(g_fs, share, "dst", S_IFDIR | 0755)->inum;
+    fill_dir(dst, 100);
+    inum = add_file(src, "moving");
+
+    ck_assert_int_eq(xfs_move_entry(g_fs, inum, dst, "file00010.txt"), 0);
+
+    ck_assert_ptr_eq(xfs_lookup_in_dir(g_fs, src, "moving"), NULL);
+    ck_assert_int_eq(xfs_lookup_in_dir(g_fs, dst, "file00010.txt")->inum,
+                     inum);
+    ck_assert_ptr_ne(xfs_lookup_in_dir(g_fs, dst, "file00011.txt"), NULL);
+}
+END_TEST
+
+/*****************************************************************************/
+START_TEST(test_xfs_lookup__in_big_dir__measures_lookups_per_second)
+{
+    fuse_ino_t share = add_share("share");
+    char name[NAME_LEN];
+    int start;
+    int elapsed;
+    int i;
+
+    fill_dir(share, BIG_DIR_ENTRIES);
+
+    start = g_time3();
+    for (i = 0; i < BIG_DIR_ENTRIES; ++i)
+    {
+        g_snprintf(name, sizeof(name), "file%05d.txt", i);
+        ck_assert_ptr_ne(xfs_lookup_in_dir(g_fs, share, name), NULL);
+    }
+    elapsed = g_time3() - start;
+
+    printf("# %d lookups in a directory of %d entries took %d ms "
+           "(%.0f lookups/s)\n", BIG_DIR_ENTRIES, BIG_DIR_ENTRIES, elapsed,
+           BIG_DIR_ENTRIES * 1000.0 / (elapsed > 0 ? elapsed : 1));
+    fflush(stdout);
+    /* walking the list of children took tens of seconds */
+    ck_assert_int_lt(elapsed, 10000);
+}
+END_TEST
+
+/*****************************************************************************/
+Suite *
+make_suite_test_xfs(void)
+{
+    Suite *s;
+    TCase *tc_lookup;
+    TCase *tc_move;
+    TCase *tc_perf;
+
+    s = suite_create("Xfs");
+
+    tc_lookup = tcase_create("xfs_lookup_in_dir");
+    tcase_add_checked_fixture(tc_lookup, setup, teardown);
+    suite_add_tcase(s, tc_lookup);
+    tcase_add_test(tc_lookup, test_xfs_lookup__when_entry_added__finds_it);
+    tcase_add_test(tc_lookup, test_xfs_lookup__when_dir_is_local__is_case_sensitive);
+    tcase_add_test(tc_lookup, test_xfs_lookup__when_dir_is_redirected__ignores_case);
+    tcase_add_test(tc_lookup, test_xfs_lookup__when_entry_removed__doesnt_find_it);
+    tcase_add_test(tc_lookup, test_xfs_lookup__when_dir_grows__finds_every_entry);
+
+    tc_move = tcase_create("xfs_move_entry");
+    tcase_add_checked_fixture(tc_move, setup, teardown);
+    suite_add_tcase(s, tc_move);
+    tcase_add_test(tc_move, test_xfs_move__when_renamed_in_dir__finds_new_name_only);
+    tcase_add_test(tc_move, test_xfs_move__when_only_case_changes__keeps_entry);
+    tcase_add_test(tc_move, test_xfs_move__when_moved_between_dirs__replaces_target);
+
+    tc_perf = tcase_create("xfs_lookup_perf");
+    tcase_add_checked_fixture(tc_perf, setup, teardown);
+    tcase_set_timeout(tc_perf, 60);
+    suite_add_tcase(s, tc_perf);
+    tcase_add_test(tc_perf, test_xfs_lookup__in_big_dir__measures_lookups_per_second);
+
+    return s;
+}
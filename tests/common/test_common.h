@@ -5,5 +5,6 @@
 #include <check.h>
 
 Suite *make_suite_test_string(void);
+Suite *make_suite_test_file_cache(void);
 
 #endif /* TEST_COMMON_H */
\ No newline at end of file
@@ -13,6 +13,7 @@ int main (void)
     SRunner *sr;
 
     sr = srunner_create (make_suite_test_string());
+    srunner_add_suite(sr, make_suite_test_file_cache());
     //   srunner_add_suite(sr, make_list_suite());
 
     srunner_set_tap(sr, "-");
@@ -0,0 +1,199 @@
+#if defined(HAVE_CONFIG_H)
+#include "config_ac.h"
+#endif
+
+#include <stdlib.h>
+
+#include "test_common.h"
+#include "arch.h"
+#include "os_calls.h"
+#include "string_calls.h"
+#include "list.h"
+#include "file.h"
+
+/* more files than the cache holds */
+#define TEST_FILES 200
+
+static char g_dir[256];
+static struct list *g_names;
+static struct list *g_values;
+
+/*****************************************************************************/
+static void
+file_path(char *path, int bytes, int number)
+{
+    g_snprintf(path, bytes, "%s/test%d.ini", g_dir, number);
+}
+
+/*****************************************************************************/
+/* writes a file with one section holding key=value */
+static void
+write_ini(int number, const char *value)
+{
+    char path[256];
+    char text[256];
+    int fd;
+    int len;
+
+    file_path(path, sizeof(path), number);
+    len = g_snprintf(text, sizeof(text), "[Section]\nkey=%s\n", value);
+    /* rewritten in place, so only the times tell a new version apart */
+    fd = g_file_open_ex(path, 0, 1, 1, 1);
+    ck_assert_int_ge(fd, 0);
+    ck_assert_int_eq(g_file_write(fd, text, len), len);
+    g_file_close(fd);
+}
+
+/*****************************************************************************/
+/* reads key from the section, returns the number of parses it took */
+static int
+read_key(int number, const char *expected)
+{
+    char path[256];
+    int parses;
+    int after;
+    int files;
+
+    file_path(path, sizeof(path), number);
+    file_cache_get_stats(&parses, &files);
+    ck_assert_int_eq(file_by_name_read_section(path, "Section",
+                     g_names, g_values), 0);
+    ck_assert_int_eq(g_values->count, 1);
+    ck_assert_str_eq((const char *)list_get_item(g_values, 0), expected);
+    file_cache_get_stats(&after, &files);
+    return after - parses;
+}
+
+/*****************************************************************************/
+static void
+setup(void)
+{
+    g_snprintf(g_dir, sizeof(g_dir), "/tmp/test_file_cache.XXXXXX");
+    ck_assert_ptr_ne(mkdtemp(g_dir), NULL);
+    g_names = list_create();
+    g_names->auto_free = 1;
+    g_values = list_create();
+    g_values->auto_free = 1;
+    file_cache_flush();
+}
+
+/*****************************************************************************/
+static void
+teardown(void)
+{
+    char path[256];
+    int number;
+
+    file_cache_flush();
+    for (number = 0; number <= TEST_FILES; number++)
+    {
+        file_path(path, sizeof(path), number);
+        g_file_delete(path);
+    }
+    g_remove_dir(g_dir);
+    list_delete(g_names);
+    list_delete(g_values);
+}
+
+/*****************************************************************************/
+START_TEST(test_file_cache__when_file_unchanged__parses_once)
+{
+    write_ini(0, "one");
+
+    ck_assert_int_eq(read_key(0, "one"), 1);
+    ck_assert_int_eq(read_key(0, "one"), 0);
+    ck_assert_int_eq(read_key(0, "one"), 0);
+}
+END_TEST
+
+/*****************************************************************************/
+START_TEST(test_file_cache__when_file_rewritten_same_size__parses_again)
+{
+    write_ini(0, "one");
+    ck_assert_int_eq(read_key(0, "one"), 1);
+
+    /* same size, and most likely the same second as the first write */
+    write_ini(0, "two");
+    ck_assert_int_eq(read_key(0, "two"), 1);
+    ck_assert_int_eq(read_key(0, "two"), 0);
+}
+END_TEST
+
+/*****************************************************************************/
+START_TEST(test_file_cache__when_file_rewritten__snapshot_keeps_old_parse)
+{
+    struct file_snapshot *ini;
+    char path[256];
+
+    write_ini(0, "one");
+    file_path(path, sizeof(path), 0);
+    ini = file_snapshot_create(path);
+    ck_assert_ptr_ne(ini, NULL);
+
+    write_ini(0, "two");
+    ck_assert_int_eq(read_key(0, "two"), 1);
+
+    /* the old parse is out of the cache but still held by the snapshot */
+    ck_assert_int_eq(file_snapshot_read_section(ini, "Section",
+                     g_names, g_values), 0);
+    ck_assert_str_eq((const char *)list_get_item(g_values, 0), "one");
+    file_snapshot_delete(ini);
+}
+END_TEST
+
+/*****************************************************************************/
+START_TEST(test_file_cache__when_cache_full__evicts_least_recently_used)
+{
+    char value[32];
+    int number;
+    int parses;
+    int files;
+    int limit;
+
+    for (number = 0; number < TEST_FILES; number++)
+    {
+        g_snprintf(value, sizeof(value), "v%d", number);
+        write_ini(number, value);
+        ck_assert_int_eq(read_key(number, value), 1);
+    }
+    file_cache_get_stats(&parses, &limit);
+    ck_assert_int_gt(limit, 1);
+    ck_assert_int_lt(limit, TEST_FILES);
+
+    /* the oldest cached file is used again, so the next new file evicts
+       the one after it */
+    number = TEST_FILES - limit;
+    g_snprintf(value, sizeof(value), "v%d", number);
+    ck_assert_int_eq(read_key(number, value), 0);
+
+    write_ini(TEST_FILES, "new");
+    ck_assert_int_eq(read_key(TEST_FILES, "new"), 1);
+    file_cache_get_stats(&parses, &files);
+    ck_assert_int_eq(files, limit);
+
+    ck_assert_int_eq(read_key(number, value), 0);
+    g_snprintf(value, sizeof(value), "v%d", number + 1);
+    ck_assert_int_eq(read_key(number + 1, value), 1);
+    ck_assert_int_eq(read_key(0, "v0"), 1);
+}
+END_TEST
+
+/******************************************************************************/
+Suite *
+make_suite_test_file_cache(void)
+{
+    Suite *s;
+    TCase *tc_cache;
+
+    s = suite_create("FileCache");
+
+    tc_cache = tcase_create("file_cache");
+    tcase_add_checked_fixture(tc_cache, setup, teardown);
+    suite_add_tcase(s, tc_cache);
+    tcase_add_test(tc_cache, test_file_cache__when_file_unchanged__parses_once);
+    tcase_add_test(tc_cache, test_file_cache__when_file_rewritten_same_size__parses_again);
+    tcase_add_test(tc_cache, test_file_cache__when_file_rewritten__snapshot_keeps_old_parse);
+    tcase_add_test(tc_cache, test_file_cache__when_cache_full__evicts_least_recently_used);
+
+    return s;
+}
@@ -0,0 +1,8 @@
+#ifndef TEST_XRDP_H
+#define TEST_XRDP_H
+
+#include <check.h>
+
+Suite *make_suite_test_cache(void);
+
+#endif /* TEST_XRDP_H */
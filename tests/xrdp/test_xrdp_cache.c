@@ -0,0 +1,402 @@
+#if defined(HAVE_CONFIG_H)
+#include "config_ac.h"
+#endif
+
+#include "xrdp.h"
+#include "test_xrdp.h"
+
+/* a 256x256 screen is 16 tiles */
+#define SCREEN_DIM 256
+#define TILES_PER_FRAME ((SCREEN_DIM / 64) * (SCREEN_DIM / 64))
+#define FRAMES 20
+
+static struct xrdp_client_info g_client_info;
+static struct xrdp_session g_session;
+static struct xrdp_wm g_wm;
+static struct xrdp_painter *g_painter;
+static struct xrdp_bitmap *g_src;
+
+/* counted by the stubs below */
+static int g_bitmaps_sent;
+static int g_mem_blts;
+
+/*****************************************************************************/
+/* stubs for the parts of xrdp and libxrdp the painter and the cache call,
+   the libxrdp ones count what would go to the client */
+int
+xrdp_wm_get_vis_region(struct xrdp_wm *self, struct xrdp_bitmap *bitmap,
+                       int x, int y, int cx, int cy,
+                       struct xrdp_region *region, int clip_children)
+{
+    struct xrdp_rect rect;
+
+    /* no windows, all of the screen is visible */
+    MAKERECT(rect, x, y, cx, cy);
+    xrdp_region_add_rect(region, &rect);
+    return 0;
+}
+
+int
+xrdp_font_item_compare(struct xrdp_font_char *font1,
+                       struct xrdp_font_char *font2)
+{
+    return 0;
+}
+
+void
+xrdp_mm_scroll_invalidate(struct xrdp_mm *self)
+{
+}
+
+int
+xrdp_wm_set_pointer(struct xrdp_wm *self, int cache_idx)
+{
+    return 0;
+}
+
+int
+xrdp_wm_send_pointer(struct xrdp_wm *self, int cache_idx,
+                     char *data, char *mask, int x, int y, int bpp)
+{
+    return 0;
+}
+
+int
+libxrdp_orders_send_palette(struct xrdp_session *session, int *palette,
+                            int cache_id)
+{
+    return 0;
+}
+
+int
+libxrdp_orders_send_raw_bitmap(struct xrdp_session *session,
+                               int width, int height, int bpp, char *data,
+                               int cache_id, int cache_idx)
+{
+    g_bitmaps_sent++;
+    return 0;
+}
+
+int
+libxrdp_orders_send_bitmap(struct xrdp_session *session,
+                           int width, int height, int bpp, char *data,
+                           int cache_id, int cache_idx)
+{
+    g_bitmaps_sent++;
+    return 0;
+}
+
+int
+libxrdp_orders_send_font(struct xrdp_session *session,
+                         struct xrdp_font_char *font_char,
+                         int font_index, int char_index)
+{
+    return 0;
+}
+
+int
+libxrdp_orders_send_raw_bitmap2(struct xrdp_session *session,
+                                int width, int height, int bpp, char *data,
+                                int cache_id, int cache_idx)
+{
+    g_bitmaps_sent++;
+    return 0;
+}
+
+int
+libxrdp_orders_send_bitmap2(struct xrdp_session *session,
+                            int width, int height, int bpp, char *data,
+                            int cache_id, int cache_idx, int hints)
+{
+    g_bitmaps_sent++;
+    return 0;
+}
+
+int
+libxrdp_orders_send_bitmap3(struct xrdp_session *session,
+                            int width, int height, int bpp, char *data,
+                            int cache_id, int cache_idx, int hints)
+{
+    g_bitmaps_sent++;
+    return 0;
+}
+
+int
+libxrdp_orders_send_brush(struct xrdp_session *session,
+                          int width, int height, int bpp, int type,
+                          int size, char *data, int cache_id)
+{
+    return 0;
+}
+
+int
+libxrdp_orders_init(struct xrdp_session *session)
+{
+    return 0;
+}
+
+int
+libxrdp_orders_send(struct xrdp_session *session)
+{
+    return 0;
+}
+
+int
+libxrdp_orders_rect(struct xrdp_session *session, int x, int y,
+                    int cx, int cy, int color, struct xrdp_rect *rect)
+{
+    return 0;
+}
+
+int
+libxrdp_orders_screen_blt(struct xrdp_session *session, int x, int y,
+                          int cx, int cy, int srcx, int srcy,
+                          int rop, struct xrdp_rect *rect)
+{
+    return 0;
+}
+
+int
+libxrdp_orders_pat_blt(struct xrdp_session *session, int x, int y,
+                       int cx, int cy, int rop, int bg_color,
+                       int fg_color, struct xrdp_brush *brush,
+                       struct xrdp_rect *rect)
+{
+    return 0;
+}
+
+int
+libxrdp_orders_dest_blt(struct xrdp_session *session, int x, int y,
+                        int cx, int cy, int rop,
+                        struct xrdp_rect *rect)
+{
+    return 0;
+}
+
+int
+libxrdp_orders_line(struct xrdp_session *session, int mix_mode,
+                    int startx, int starty,
+                    int endx, int endy, int rop, int bg_color,
+                    struct xrdp_pen *pen,
+                    struct xrdp_rect *rect)
+{
+    return 0;
+}
+
+int
+libxrdp_orders_composite_blt(struct xrdp_session *session, int srcidx,
+                             int srcformat, int srcwidth, int srcrepeat,
+                             int *srctransform, int mskflags,
+                             int mskidx, int mskformat, int mskwidth,
+                             int mskrepeat, int op, int srcx, int srcy,
+                             int mskx, int msky, int dstx, int dsty,
+                             int width, int height, int dstformat,
+                             struct xrdp_rect *rect)
+{
+    return 0;
+}
+
+int
+libxrdp_orders_text(struct xrdp_session *session,
+                    int font, int flags, int mixmode,
+                    int fg_color, int bg_color,
+                    int clip_left, int clip_top,
+                    int clip_right, int clip_bottom,
+                    int box_left, int box_top,
+                    int box_right, int box_bottom,
+                    int x, int y, char *data, int data_len,
+                    struct xrdp_rect *rect)
+{
+    return 0;
+}
+
+int
+libxrdp_orders_send_create_os_surface(struct xrdp_session *session, int id,
+                                      int width, int height,
+                                      struct list *del_list)
+{
+    return 0;
+}
+
+int
+libxrdp_orders_send_switch_os_surface(struct xrdp_session *session, int id)
+{
+    return 0;
+}
+
+int
+libxrdp_orders_mem_blt(struct xrdp_session *session, int cache_id,
+                       int color_table, int x, int y, int cx, int cy,
+                       int rop, int srcx, int srcy,
+                       int cache_idx, struct xrdp_rect *rect)
+{
+    g_mem_blts++;
+    return 0;
+}
+
+/*****************************************************************************/
+static void
+make_cache(int entries)
+{
+    g_client_info.cache1_entries = entries;
+    g_client_info.cache1_size = 64 * 64 * 4;
+    g_client_info.bitmap_cache_version = 2;
+    g_wm.cache = xrdp_cache_create(&g_wm, &g_session, &g_client_info);
+    ck_assert_ptr_ne(g_wm.cache, NULL);
+}
+
+/*****************************************************************************/
+static void
+setup(void)
+{
+    g_bitmaps_sent = 0;
+    g_mem_blts = 0;
+    g_memset(&g_client_info, 0, sizeof(g_client_info));
+    g_memset(&g_session, 0, sizeof(g_session));
+    g_memset(&g_wm, 0, sizeof(g_wm));
+    g_session.client_info = &g_client_info;
+    g_wm.session = &g_session;
+    g_wm.screen = xrdp_bitmap_create(SCREEN_DIM, SCREEN_DIM, 32,
+                                     WND_TYPE_SCREEN, &g_wm);
+    ck_assert_ptr_ne(g_wm.screen, NULL);
+    g_src = xrdp_bitmap_create(SCREEN_DIM, SCREEN_DIM, 32,
+                               WND_TYPE_BITMAP, &g_wm);
+    ck_assert_ptr_ne(g_src, NULL);
+    g_painter = xrdp_painter_create(&g_wm, &g_session);
+    ck_assert_ptr_ne(g_painter, NULL);
+}
+
+/*****************************************************************************/
+static void
+teardown(void)
+{
+    xrdp_painter_delete(g_painter);
+    g_painter = NULL;
+    xrdp_cache_delete(g_wm.cache);
+    g_wm.cache = NULL;
+    xrdp_bitmap_delete(g_src);
+    g_src = NULL;
+    xrdp_bitmap_delete(g_wm.screen);
+    g_wm.screen = NULL;
+}
+
+/*****************************************************************************/
+/* every pixel of every tile depends on frame, so no tile repeats */
+static void
+draw_frame(int frame)
+{
+    unsigned int *pixels;
+    int index;
+
+    pixels = (unsigned int *)g_src->data;
+    for (index = 0; index < SCREEN_DIM * SCREEN_DIM; index++)
+    {
+        pixels[index] = (unsigned int)(frame * 0x10001 + index);
+    }
+}
+
+/*****************************************************************************/
+/* every tile is drawn, sent or not */
+static void
+paint_screen(void)
+{
+    int mem_blts;
+
+    mem_blts = g_mem_blts;
+    ck_assert_int_eq(xrdp_painter_copy(g_painter, g_src, g_wm.screen,
+                                       0, 0, SCREEN_DIM, SCREEN_DIM,
+                                       0, 0), 0);
+    ck_assert_int_eq(g_mem_blts - mem_blts, TILES_PER_FRAME);
+}
+
+/*****************************************************************************/
+START_TEST(test_cache_paint__when_screen_unchanged__allocates_nothing)
+{
+    int frame;
+
+    make_cache(600);
+    draw_frame(0);
+    paint_screen();
+    ck_assert_int_eq(g_wm.cache->tile_allocs, TILES_PER_FRAME);
+    ck_assert_int_eq(g_bitmaps_sent, TILES_PER_FRAME);
+
+    for (frame = 1; frame < FRAMES; frame++)
+    {
+        paint_screen();
+    }
+    /* every tile matched its shadow, nothing copied, allocated or sent */
+    ck_assert_int_eq(g_wm.cache->tile_allocs, TILES_PER_FRAME);
+    ck_assert_int_eq(g_wm.cache->tile_reuses, 0);
+    ck_assert_int_eq(g_bitmaps_sent, TILES_PER_FRAME);
+}
+END_TEST
+
+/*****************************************************************************/
+START_TEST(test_cache_paint__when_frames_repeat__reuses_pooled_tiles)
+{
+    int frame;
+    int allocs;
+
+    make_cache(600);
+    for (frame = 0; frame < 3; frame++)
+    {
+        draw_frame(frame & 1);
+        paint_screen();
+    }
+    allocs = g_wm.cache->tile_allocs;
+
+    /* the tiles are in the cache, found by crc after the copy */
+    for (; frame < FRAMES; frame++)
+    {
+        draw_frame(frame & 1);
+        paint_screen();
+    }
+    ck_assert_int_eq(g_wm.cache->tile_allocs, allocs);
+    ck_assert_int_eq(g_bitmaps_sent, 2 * TILES_PER_FRAME);
+}
+END_TEST
+
+/*****************************************************************************/
+START_TEST(test_cache_paint__when_cache_full__reuses_evicted_tiles)
+{
+    int frame;
+    int allocs;
+
+    /* room for two frames, every later tile evicts one */
+    make_cache(2 * TILES_PER_FRAME);
+    draw_frame(0);
+    paint_screen();
+    draw_frame(1);
+    paint_screen();
+    draw_frame(2);
+    paint_screen();
+    allocs = g_wm.cache->tile_allocs;
+
+    for (frame = 3; frame < FRAMES; frame++)
+    {
+        draw_frame(frame);
+        paint_screen();
+    }
+    ck_assert_int_eq(g_wm.cache->tile_allocs, allocs);
+    ck_assert_int_eq(g_bitmaps_sent, FRAMES * TILES_PER_FRAME);
+}
+END_TEST
+
+/*****************************************************************************/
+Suite *
+make_suite_test_cache(void)
+{
+    Suite *s;
+    TCase *tc_paint;
+
+    s = suite_create("Cache");
+
+    tc_paint = tcase_create("xrdp_cache_tiles");
+    tcase_add_checked_fixture(tc_paint, setup, teardown);
+    suite_add_tcase(s, tc_paint);
+    tcase_add_test(tc_paint, test_cache_paint__when_screen_unchanged__allocates_nothing);
+    tcase_add_test(tc_paint, test_cache_paint__when_frames_repeat__reuses_pooled_tiles);
+    tcase_add_test(tc_paint, test_cache_paint__when_cache_full__reuses_evicted_tiles);
+
+    return s;
+}
@@ -174,7 +174,8 @@ get_char_from_scan_code(int device_flags, int scan_code, int *keys,
 
 /*****************************************************************************/
 static int
-km_read_section(int fd, const char *section_name, struct xrdp_key_info *keymap)
+km_read_section(const char *filename, const char *section_name,
+                struct xrdp_key_info *keymap)
 {
     struct list *names;
     struct list *values;
@@ -189,7 +190,7 @@ km_read_section(int fd, const char *section_name, struct xrdp_key_info *keymap)
     values = list_create();
     values->auto_free = 1;
 
-    if (file_read_section(fd, section_name, names, values) == 0)
+    if (file_by_name_read_section(filename, section_name, names, values) == 0)
     {
         for (index = names->count - 1; index >= 0; index--)
         {
@@ -231,7 +232,6 @@ km_read_section(int fd, const char *section_name, struct xrdp_key_info *keymap)
 int
 get_keymaps(int keylayout, struct xrdp_keymap *keymap)
 {
-    int fd;
     int basic_key_layout = keylayout & 0x0000ffff;
     char *filename;
     struct xrdp_keymap *lkeymap;
@@ -258,36 +258,30 @@ get_keymaps(int keylayout, struct xrdp_keymap *keymap)
 
     if (g_file_exist(filename))
     {
-        fd = g_file_open(filename);
         LOG(LOG_LEVEL_INFO, "Loading keymap file %s", filename);
-
-        if (fd != -1)
+        lkeymap = (struct xrdp_keymap *)g_malloc(sizeof(struct xrdp_keymap), 0);
+        /* make a copy of the built-in keymap */
+        g_memcpy(lkeymap, keymap, sizeof(struct xrdp_keymap));
+        /* clear the keymaps */
+        g_memset(keymap, 0, sizeof(struct xrdp_keymap));
+        /* read the keymaps, usually preloaded by the listener */
+        km_read_section(filename, "noshift", keymap->keys_noshift);
+        km_read_section(filename, "shift", keymap->keys_shift);
+        km_read_section(filename, "altgr", keymap->keys_altgr);
+        km_read_section(filename, "shiftaltgr", keymap->keys_shiftaltgr);
+        km_read_section(filename, "capslock", keymap->keys_capslock);
+        km_read_section(filename, "capslockaltgr", keymap->keys_capslockaltgr);
+        km_read_section(filename, "shiftcapslock", keymap->keys_shiftcapslock);
+        km_read_section(filename, "shiftcapslockaltgr", keymap->keys_shiftcapslockaltgr);
+
+        if (g_memcmp(lkeymap, keymap, sizeof(struct xrdp_keymap)) != 0)
         {
-            lkeymap = (struct xrdp_keymap *)g_malloc(sizeof(struct xrdp_keymap), 0);
-            /* make a copy of the built-in keymap */
-            g_memcpy(lkeymap, keymap, sizeof(struct xrdp_keymap));
-            /* clear the keymaps */
-            g_memset(keymap, 0, sizeof(struct xrdp_keymap));
-            /* read the keymaps */
-            km_read_section(fd, "noshift", keymap->keys_noshift);
-            km_read_section(fd, "shift", keymap->keys_shift);
-            km_read_section(fd, "altgr", keymap->keys_altgr);
-            km_read_section(fd, "shiftaltgr", keymap->keys_shiftaltgr);
-            km_read_section(fd, "capslock", keymap->keys_capslock);
-            km_read_section(fd, "capslockaltgr", keymap->keys_capslockaltgr);
-            km_read_section(fd, "shiftcapslock", keymap->keys_shiftcapslock);
-            km_read_section(fd, "shiftcapslockaltgr", keymap->keys_shiftcapslockaltgr);
-
-            if (g_memcmp(lkeymap, keymap, sizeof(struct xrdp_keymap)) != 0)
-            {
-                LOG(LOG_LEVEL_WARNING,
-                    "local keymap file for 0x%08x found and doesn't match "
-                    "built in keymap, using local keymap file", keylayout);
-            }
-
-            g_free(lkeymap);
-            g_file_close(fd);
+            LOG(LOG_LEVEL_WARNING,
+                "local keymap file for 0x%08x found and doesn't match "
+                "built in keymap, using local keymap file", keylayout);
         }
+
+        g_free(lkeymap);
     }
     else
     {
@@ -64,6 +64,18 @@ xrdp_cache_reset(struct xrdp_cache *self,
 int
 xrdp_cache_add_bitmap(struct xrdp_cache *self, struct xrdp_bitmap *bitmap,
                       int hints);
+struct xrdp_bitmap *
+xrdp_cache_get_tile_bitmap(struct xrdp_cache *self,
+                           int width, int height, int bpp);
+void
+xrdp_cache_put_tile_bitmap(struct xrdp_cache *self,
+                           struct xrdp_bitmap *bitmap);
+int
+xrdp_cache_find_tile(struct xrdp_cache *self, struct xrdp_bitmap *src,
+                     int x, int y, int cx, int cy);
+void
+xrdp_cache_set_tile(struct xrdp_cache *self, int x, int y, int cx, int cy,
+                    int bitmap_id);
 int
 xrdp_cache_add_palette(struct xrdp_cache *self, int *palette);
 int
@@ -175,6 +187,10 @@ struct xrdp_region *
 xrdp_region_create(struct xrdp_wm *wm);
 void
 xrdp_region_delete(struct xrdp_region *self);
+void
+xrdp_region_reset(struct xrdp_region *self);
+int
+xrdp_region_contains_rect(struct xrdp_region *self, struct xrdp_rect *rect);
 int
 xrdp_region_add_rect(struct xrdp_region *self, struct xrdp_rect *rect);
 int
@@ -262,6 +278,10 @@ xrdp_painter_fill_rect(struct xrdp_painter *self,
                        struct xrdp_bitmap *bitmap,
                        int x, int y, int cx, int cy);
 int
+xrdp_painter_fill_rects(struct xrdp_painter *self,
+                        struct xrdp_bitmap *dst,
+                        int num_rects, const short *rects);
+int
 xrdp_painter_draw_bitmap(struct xrdp_painter *self,
                          struct xrdp_bitmap *bitmap,
                          struct xrdp_bitmap *to_draw,
@@ -359,6 +379,16 @@ xrdp_login_wnd_create(struct xrdp_wm *self);
 int
 load_xrdp_config(struct xrdp_config *config, const char *xrdp_ini, int bpp);
 
+/* xrdp_assets.c */
+int
+xrdp_assets_init(const char *xrdp_ini);
+void
+xrdp_assets_deinit(void);
+int
+xrdp_assets_refresh(void);
+int
+xrdp_assets_get_file(const char *file_name, struct stream *s);
+
 /* xrdp_bitmap_compress.c */
 int
 xrdp_bitmap_compress(char *in_data, int width, int height,
@@ -406,6 +436,8 @@ int
 xrdp_mm_check_wait_objs(struct xrdp_mm *self);
 int
 xrdp_mm_frame_ack(struct xrdp_mm *self, int frame_id);
+void
+xrdp_mm_scroll_invalidate(struct xrdp_mm *self);
 int
 server_begin_update(struct xrdp_mod *mod);
 int
@@ -418,6 +450,10 @@ int
 server_screen_blt(struct xrdp_mod *mod, int x, int y, int cx, int cy,
                   int srcx, int srcy);
 int
+server_fill_rects(struct xrdp_mod *mod, int num_rects, short *rects);
+int
+server_screen_blts(struct xrdp_mod *mod, int num_rects, short *rects);
+int
 server_paint_rect(struct xrdp_mod *mod, int x, int y, int cx, int cy,
                   char *data, int width, int height, int srcx, int srcy);
 int
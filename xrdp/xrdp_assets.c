@@ -0,0 +1,349 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Copyright (C) Jay Sorg 2004-2021
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * read only cache of the files needed to show the login screen
+ *
+ * The listener loads the font, the cursors and the login bitmaps once.
+ * Forked connections inherit the cache and threads share it, it is never
+ * changed while a connection may read it. An entry whose file changed on
+ * disk since it was loaded is not used, callers then read the file as
+ * before. xrdp.ini and the keymaps are parsed here too, the parsed copies
+ * are kept by file_by_name_read_section().
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include <config_ac.h>
+#endif
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "xrdp.h"
+#include "string_calls.h"
+
+struct xrdp_asset
+{
+    char *file_name;
+    off_t size; /* size and mtime when loaded */
+    time_t mtime;
+    char *data;
+    int data_bytes;
+};
+
+static struct list *g_assets = NULL;
+
+/*****************************************************************************/
+static int
+xrdp_assets_stat(const char *file_name, off_t *size, time_t *mtime)
+{
+    struct stat st;
+
+    if (stat(file_name, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        return 1;
+    }
+    *size = st.st_size;
+    *mtime = st.st_mtime;
+    return 0;
+}
+
+/*****************************************************************************/
+static int
+xrdp_assets_read_raw(struct xrdp_asset *asset)
+{
+    int fd;
+
+    if (asset->size < 1 || asset->size > 16 * 1024 * 1024)
+    {
+        return 1;
+    }
+    asset->data = (char *)g_malloc((int)asset->size, 0);
+    if (asset->data == NULL)
+    {
+        return 1;
+    }
+    fd = g_file_open_ex(asset->file_name, 1, 0, 0, 0);
+    if (fd < 0)
+    {
+        return 1;
+    }
+    asset->data_bytes = g_file_read(fd, asset->data, (int)asset->size);
+    g_file_close(fd);
+    return asset->data_bytes == (int)asset->size ? 0 : 1;
+}
+
+/*****************************************************************************/
+static void
+xrdp_assets_delete(struct xrdp_asset *asset)
+{
+    if (asset == NULL)
+    {
+        return;
+    }
+    g_free(asset->data);
+    g_free(asset->file_name);
+    g_free(asset);
+}
+
+/*****************************************************************************/
+static struct xrdp_asset *
+xrdp_assets_load_file(const char *file_name)
+{
+    struct xrdp_asset *asset;
+
+    asset = g_new0(struct xrdp_asset, 1);
+    if (asset == NULL)
+    {
+        return NULL;
+    }
+    asset->file_name = g_strdup(file_name);
+    if (asset->file_name == NULL ||
+            xrdp_assets_stat(file_name, &asset->size, &asset->mtime) != 0)
+    {
+        xrdp_assets_delete(asset);
+        return NULL;
+    }
+    if (xrdp_assets_read_raw(asset) != 0)
+    {
+        LOG(LOG_LEVEL_WARNING, "xrdp_assets_load_file: can't load %s",
+            file_name);
+        xrdp_assets_delete(asset);
+        return NULL;
+    }
+    LOG_DEVEL(LOG_LEVEL_DEBUG, "xrdp_assets_load_file: loaded %s", file_name);
+    return asset;
+}
+
+/*****************************************************************************/
+static void
+xrdp_assets_add(const char *file_name, int is_ini)
+{
+    struct xrdp_asset *asset;
+    struct list *sections;
+
+    if (is_ini)
+    {
+        /* nothing to keep here, reading it parses it once for everyone */
+        sections = list_create();
+        sections->auto_free = 1;
+        file_by_name_read_sections(file_name, sections);
+        list_delete(sections);
+        return;
+    }
+    asset = xrdp_assets_load_file(file_name);
+    if (asset != NULL)
+    {
+        list_add_item(g_assets, (tintptr)asset);
+    }
+}
+
+/*****************************************************************************/
+/* adds the files in dir with a name ending in suffix */
+static void
+xrdp_assets_add_dir(const char *dir, const char *prefix, const char *suffix,
+                    int is_ini)
+{
+    DIR *dp;
+    struct dirent *entry;
+    char file_name[256];
+    int len;
+    int suffix_len;
+
+    dp = opendir(dir);
+    if (dp == NULL)
+    {
+        return;
+    }
+    suffix_len = g_strlen(suffix);
+    while ((entry = readdir(dp)) != NULL)
+    {
+        len = g_strlen(entry->d_name);
+        if (len > suffix_len &&
+                g_strncmp(entry->d_name, prefix, g_strlen(prefix)) == 0 &&
+                g_strcmp(entry->d_name + len - suffix_len, suffix) == 0)
+        {
+            g_snprintf(file_name, sizeof(file_name), "%s/%s",
+                       dir, entry->d_name);
+            xrdp_assets_add(file_name, is_ini);
+        }
+    }
+    closedir(dp);
+}
+
+/*****************************************************************************/
+/* the entry for file_name if it is still current, else NULL */
+static struct xrdp_asset *
+xrdp_assets_find(const char *file_name)
+{
+    struct xrdp_asset *asset;
+    off_t size;
+    time_t mtime;
+    int index;
+
+    if (g_assets == NULL || file_name == NULL)
+    {
+        return NULL;
+    }
+    for (index = 0; index < g_assets->count; index++)
+    {
+        asset = (struct xrdp_asset *)list_get_item(g_assets, index);
+        if (g_strcmp(asset->file_name, file_name) == 0)
+        {
+            if (xrdp_assets_stat(file_name, &size, &mtime) != 0 ||
+                    size != asset->size || mtime != asset->mtime)
+            {
+                return NULL;
+            }
+            return asset;
+        }
+    }
+    return NULL;
+}
+
+/*****************************************************************************/
+/* the background and logo images can be anywhere */
+static void
+xrdp_assets_add_login_images(const char *xrdp_ini)
+{
+    struct list *names;
+    struct list *values;
+    const char *name;
+    const char *value;
+    int index;
+
+    names = list_create();
+    names->auto_free = 1;
+    values = list_create();
+    values->auto_free = 1;
+    if (file_by_name_read_section(xrdp_ini, "globals", names, values) == 0)
+    {
+        for (index = 0; index < names->count; index++)
+        {
+            name = (const char *)list_get_item(names, index);
+            value = (const char *)list_get_item(values, index);
+            if ((g_strcasecmp(name, "ls_background_image") == 0 ||
+                    g_strcasecmp(name, "ls_logo_filename") == 0) &&
+                    value[0] == '/' && xrdp_assets_find(value) == NULL)
+            {
+                xrdp_assets_add(value, 0);
+            }
+        }
+    }
+    list_delete(names);
+    list_delete(values);
+}
+
+/*****************************************************************************/
+int
+xrdp_assets_init(const char *xrdp_ini)
+{
+    char file_name[256];
+    int start;
+
+    g_assets = list_create();
+    if (g_assets == NULL)
+    {
+        return 1;
+    }
+    start = g_time3();
+    xrdp_assets_add(xrdp_ini, 1);
+    g_snprintf(file_name, sizeof(file_name), "%s/sesman.ini", XRDP_CFG_PATH);
+    xrdp_assets_add(file_name, 1);
+    g_snprintf(file_name, sizeof(file_name), "%s/xrdp_keyboard.ini",
+               XRDP_CFG_PATH);
+    xrdp_assets_add(file_name, 1);
+    xrdp_assets_add_dir(XRDP_CFG_PATH, "km-", ".ini", 1);
+    xrdp_assets_add_dir(XRDP_SHARE_PATH, "", ".bmp", 0);
+    xrdp_assets_add_dir(XRDP_SHARE_PATH, "", ".fv1", 0);
+    xrdp_assets_add_dir(XRDP_SHARE_PATH, "", ".cur", 0);
+    xrdp_assets_add_login_images(xrdp_ini);
+    LOG(LOG_LEVEL_INFO, "loaded the login screen files in %d ms, "
+        "%d cached as is", g_time3() - start, g_assets->count);
+    return 0;
+}
+
+/*****************************************************************************/
+void
+xrdp_assets_deinit(void)
+{
+    int index;
+
+    if (g_assets == NULL)
+    {
+        return;
+    }
+    for (index = 0; index < g_assets->count; index++)
+    {
+        xrdp_assets_delete((struct xrdp_asset *)list_get_item(g_assets, index));
+    }
+    list_delete(g_assets);
+    g_assets = NULL;
+}
+
+/*****************************************************************************/
+int
+xrdp_assets_refresh(void)
+{
+    struct xrdp_asset *asset;
+    struct xrdp_asset *fresh;
+    int index;
+
+    if (g_assets == NULL)
+    {
+        return 0;
+    }
+    for (index = 0; index < g_assets->count; index++)
+    {
+        asset = (struct xrdp_asset *)list_get_item(g_assets, index);
+        if (xrdp_assets_find(asset->file_name) == asset)
+        {
+            continue;
+        }
+        /* changed or removed, a failed reload drops the entry */
+        fresh = xrdp_assets_load_file(asset->file_name);
+        xrdp_assets_delete(asset);
+        if (fresh != NULL)
+        {
+            g_assets->items[index] = (tintptr)fresh;
+        }
+        else
+        {
+            list_remove_item(g_assets, index);
+            index--;
+        }
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+int
+xrdp_assets_get_file(const char *file_name, struct stream *s)
+{
+    struct xrdp_asset *asset;
+
+    asset = xrdp_assets_find(file_name);
+    if (asset == NULL)
+    {
+        return 1;
+    }
+    g_memset(s, 0, sizeof(struct stream));
+    s->data = asset->data;
+    s->p = s->data;
+    s->end = s->data + asset->data_bytes;
+    s->size = asset->data_bytes;
+    return 0;
+}
@@ -458,6 +458,74 @@ xrdp_bitmap_resize(struct xrdp_bitmap *self, int width, int height)
     return 0;
 }
 
+/* a bmp file read from the login asset cache, or from disk if it is not
+   cached */
+struct xrdp_bitmap_file
+{
+    int fd;
+    struct stream cached;
+};
+
+/*****************************************************************************/
+static int
+xrdp_bitmap_file_open(struct xrdp_bitmap_file *file, const char *filename)
+{
+    file->fd = -1;
+    if (xrdp_assets_get_file(filename, &file->cached) == 0)
+    {
+        return 0;
+    }
+    file->fd = g_file_open(filename);
+    return file->fd == -1 ? 1 : 0;
+}
+
+/*****************************************************************************/
+static int
+xrdp_bitmap_file_read(struct xrdp_bitmap_file *file, char *data, int len)
+{
+    if (file->fd != -1)
+    {
+        return g_file_read(file->fd, data, len);
+    }
+    if (len > (int)(file->cached.end - file->cached.p))
+    {
+        len = (int)(file->cached.end - file->cached.p);
+    }
+    if (len > 0)
+    {
+        g_memcpy(data, file->cached.p, len);
+        file->cached.p += len;
+    }
+    return len;
+}
+
+/*****************************************************************************/
+static int
+xrdp_bitmap_file_seek(struct xrdp_bitmap_file *file, int offset)
+{
+    if (file->fd != -1)
+    {
+        return g_file_seek(file->fd, offset);
+    }
+    if (offset < 0 || offset > file->cached.size)
+    {
+        return -1;
+    }
+    file->cached.p = file->cached.data + offset;
+    return offset;
+}
+
+/*****************************************************************************/
+static void
+xrdp_bitmap_file_close(struct xrdp_bitmap_file *file)
+{
+    if (file->fd != -1)
+    {
+        g_file_close(file->fd);
+        file->fd = -1;
+    }
+}
+
 /*****************************************************************************/
 /* load a bmp file */
 /* return 0 ok */
@@ -465,7 +533,7 @@ xrdp_bitmap_resize(struct xrdp_bitmap *self, int width, int height)
 int
 xrdp_bitmap_load(struct xrdp_bitmap *self, const char *filename, int *palette)
 {
-    int fd = 0;
+    struct xrdp_bitmap_file file;
     int i = 0;
     int j = 0;
     int k = 0;
@@ -487,16 +555,14 @@ xrdp_bitmap_load(struct xrdp_bitmap *self, const char *filename, int *palette)
         return 1;
     }
 
-    fd = g_file_open(filename);
-
-    if (fd != -1)
+    if (xrdp_bitmap_file_open(&file, filename) == 0)
     {
         /* read file type */
-        if (g_file_read(fd, type1, 2) != 2)
+        if (xrdp_bitmap_file_read(&file, type1, 2) != 2)
         {
             LOG(LOG_LEVEL_ERROR, "xrdp_bitmap_load: error bitmap file [%s] "
                 "read error", filename);
-            g_file_close(fd);
+            xrdp_bitmap_file_close(&file);
             return 1;
         }
 
@@ -504,26 +570,26 @@ xrdp_bitmap_load(struct xrdp_bitmap *self, const char *filename, int *palette)
         {
             LOG(LOG_LEVEL_ERROR, "xrdp_bitmap_load: error bitmap file [%s] "
                 "not BMP file", filename);
-            g_file_close(fd);
+            xrdp_bitmap_file_close(&file);
             return 1;
         }
 
         /* read file size */
         make_stream(s);
         init_stream(s, 8192);
-        g_file_read(fd, s->data, 4);
+        xrdp_bitmap_file_read(&file, s->data, 4);
         in_uint32_le(s, size);
         /* read bmp header */
-        if (g_file_seek(fd, 14) < 0)
+        if (xrdp_bitmap_file_seek(&file, 14) < 0)
         {
             LOG(LOG_LEVEL_ERROR, "xrdp_bitmap_load: seek error in file %s",
                 filename);
             free_stream(s);
-            g_file_close(fd);
+            xrdp_bitmap_file_close(&file);
             return 1;
         }
         init_stream(s, 8192);
-        g_file_read(fd, s->data, 40); /* size better be 40 */
+        xrdp_bitmap_file_read(&file, s->data, 40); /* size better be 40 */
         in_uint32_le(s, header.size);
         in_uint32_le(s, header.image_width);
         in_uint32_le(s, header.image_height);
@@ -542,13 +608,13 @@ xrdp_bitmap_load(struct xrdp_bitmap *self, const char *filename, int *palette)
             LOG(LOG_LEVEL_ERROR, "xrdp_bitmap_load: error bitmap file [%s] "
                 "bad bpp %d", filename, header.bit_count);
             free_stream(s);
-            g_file_close(fd);
+            xrdp_bitmap_file_close(&file);
             return 1;
         }
 
         if (header.bit_count == 24) /* 24 bit bitmap */
         {
-            if (g_file_seek(fd, 14 + header.size) < 0)
+            if (xrdp_bitmap_file_seek(&file, 14 + header.size) < 0)
             {
                 LOG(LOG_LEVEL_WARNING, "xrdp_bitmap_load: seek error in file %s",
                     filename);
@@ -561,7 +627,7 @@ xrdp_bitmap_load(struct xrdp_bitmap *self, const char *filename, int *palette)
             for (i = header.image_height - 1; i >= 0; i--)
             {
                 size = header.image_width * 3;
-                k = g_file_read(fd, s->data + i * size, size);
+                k = xrdp_bitmap_file_read(&file, s->data + i * size, size);
 
                 if (k != size)
                 {
@@ -605,13 +671,13 @@ xrdp_bitmap_load(struct xrdp_bitmap *self, const char *filename, int *palette)
         else if (header.bit_count == 8) /* 8 bit bitmap */
         {
             /* read palette */
-            if (g_file_seek(fd, 14 + header.size) < 0)
+            if (xrdp_bitmap_file_seek(&file, 14 + header.size) < 0)
             {
                 LOG(LOG_LEVEL_WARNING, "xrdp_bitmap_load: seek error in file %s",
                     filename);
             }
             init_stream(s, 8192);
-            g_file_read(fd, s->data, header.clr_used * sizeof(int));
+            xrdp_bitmap_file_read(&file, s->data, header.clr_used * sizeof(int));
 
             for (i = 0; i < header.clr_used; i++)
             {
@@ -626,7 +692,7 @@ xrdp_bitmap_load(struct xrdp_bitmap *self, const char *filename, int *palette)
             for (i = header.image_height - 1; i >= 0; i--)
             {
                 size = header.image_width;
-                k = g_file_read(fd, s->data + i * size, size);
+                k = xrdp_bitmap_file_read(&file, s->data + i * size, size);
 
                 if (k != size)
                 {
@@ -666,13 +732,13 @@ xrdp_bitmap_load(struct xrdp_bitmap *self, const char *filename, int *palette)
         else if (header.bit_count == 4) /* 4 bit bitmap */
         {
             /* read palette */
-            if (g_file_seek(fd, 14 + header.size) < 0)
+            if (xrdp_bitmap_file_seek(&file, 14 + header.size) < 0)
             {
                 LOG(LOG_LEVEL_WARNING, "xrdp_bitmap_load: seek error in file %s",
                     filename);
             }
             init_stream(s, 8192);
-            g_file_read(fd, s->data, header.clr_used * sizeof(int));
+            xrdp_bitmap_file_read(&file, s->data, header.clr_used * sizeof(int));
 
             for (i = 0; i < header.clr_used; i++)
             {
@@ -687,7 +753,7 @@ xrdp_bitmap_load(struct xrdp_bitmap *self, const char *filename, int *palette)
             for (i = header.image_height - 1; i >= 0; i--)
             {
                 size = header.image_width / 2;
-                k = g_file_read(fd, s->data + i * size, size);
+                k = xrdp_bitmap_file_read(&file, s->data + i * size, size);
 
                 if (k != size)
                 {
@@ -734,7 +800,7 @@ xrdp_bitmap_load(struct xrdp_bitmap *self, const char *filename, int *palette)
             }
         }
 
-        g_file_close(fd);
+        xrdp_bitmap_file_close(&file);
         free_stream(s);
     }
     else
@@ -1413,6 +1479,8 @@ xrdp_bitmap_invalidate(struct xrdp_bitmap *self, struct xrdp_rect *rect)
         return 0;
     }
 
+    /* window manager drawing is not tracked in the scroll shadow */
+    xrdp_mm_scroll_invalidate(self->wm->mm);
     painter = xrdp_painter_create(self->wm, self->wm->session);
     xrdp_painter_font_needed(painter);
     painter->rop = 0xcc; /* copy */
@@ -119,6 +119,22 @@ xrdp_cache_create(struct xrdp_wm *owner,
     return self;
 }
 
+/*****************************************************************************/
+static void
+xrdp_cache_free_tile_pool(struct xrdp_cache *self)
+{
+    int index;
+
+    LOG(LOG_LEVEL_DEBUG, "xrdp_cache_free_tile_pool: tile bitmaps "
+        "allocated %d reused %d", self->tile_allocs, self->tile_reuses);
+    for (index = 0; index < self->tile_pool_count; index++)
+    {
+        xrdp_bitmap_delete(self->tile_pool[index]);
+        self->tile_pool[index] = 0;
+    }
+    self->tile_pool_count = 0;
+}
+
 /*****************************************************************************/
 void
 xrdp_cache_delete(struct xrdp_cache *self)
@@ -131,6 +147,8 @@ xrdp_cache_delete(struct xrdp_cache *self)
         return;
     }
 
+    xrdp_cache_free_tile_pool(self);
+
     /* free all the cached bitmaps */
     for (i = 0; i < XRDP_MAX_BITMAP_CACHE_ID; i++)
     {
@@ -179,6 +197,8 @@ xrdp_cache_reset(struct xrdp_cache *self,
     int i;
     int j;
 
+    xrdp_cache_free_tile_pool(self);
+
     /* free all the cached bitmaps */
     for (i = 0; i < XRDP_MAX_BITMAP_CACHE_ID; i++)
     {
@@ -370,7 +390,7 @@ xrdp_cache_add_bitmap(struct xrdp_cache *self, struct xrdp_bitmap *bitmap,
     {
         lru_index = self->bitmap_items[cache_id][cache_idx].lru_index;
         self->bitmap_items[cache_id][cache_idx].stamp = self->bitmap_stamp;
-        xrdp_bitmap_delete(bitmap);
+        xrdp_cache_put_tile_bitmap(self, bitmap);
 
         /* update lru to end */
         xrdp_cache_update_lru(self, cache_id, lru_index);
@@ -420,7 +440,7 @@ xrdp_cache_add_bitmap(struct xrdp_cache *self, struct xrdp_bitmap *bitmap,
         LOG_DEVEL(LOG_LEVEL_DEBUG, "xrdp_cache_add_bitmap: removing index %d from crc16 %d",
                   iig, crc16);
         list16_remove_item(ll, iig);
-        xrdp_bitmap_delete(lbm);
+        xrdp_cache_put_tile_bitmap(self, lbm);
     }
 
     /* set, send bitmap and return */
@@ -484,6 +504,166 @@ xrdp_cache_add_bitmap(struct xrdp_cache *self, struct xrdp_bitmap *bitmap,
     return MAKELONG(cache_idx, cache_id);
 }
 
+/*****************************************************************************/
+/* returns a bitmap for a tile of at most XRDP_TILE_MAX_DIM square, taken
+   from the pool when one is free so cached painting does not allocate */
+struct xrdp_bitmap *
+xrdp_cache_get_tile_bitmap(struct xrdp_cache *self,
+                           int width, int height, int bpp)
+{
+    struct xrdp_bitmap *bitmap;
+    int Bpp;
+
+    if ((width > XRDP_TILE_MAX_DIM) || (height > XRDP_TILE_MAX_DIM))
+    {
+        return xrdp_bitmap_create(width, height, bpp, WND_TYPE_BITMAP,
+                                  self->wm);
+    }
+    if (self->tile_pool_count > 0)
+    {
+        self->tile_pool_count--;
+        bitmap = self->tile_pool[self->tile_pool_count];
+        self->tile_pool[self->tile_pool_count] = 0;
+        self->tile_reuses++;
+    }
+    else
+    {
+        /* allocate for the biggest tile so it can be reused for any */
+        bitmap = xrdp_bitmap_create(XRDP_TILE_MAX_DIM, XRDP_TILE_MAX_DIM,
+                                    32, WND_TYPE_BITMAP, self->wm);
+        if (bitmap == 0)
+        {
+            return 0;
+        }
+        bitmap->data_size = XRDP_TILE_MAX_DIM * XRDP_TILE_MAX_DIM * 4;
+        self->tile_allocs++;
+    }
+    Bpp = 4;
+    if (bpp == 8)
+    {
+        Bpp = 1;
+    }
+    else if ((bpp == 15) || (bpp == 16))
+    {
+        Bpp = 2;
+    }
+    bitmap->width = width;
+    bitmap->height = height;
+    bitmap->bpp = bpp;
+    bitmap->line_size = width * Bpp;
+    bitmap->crc32 = 0;
+    bitmap->crc16 = 0;
+    return bitmap;
+}
+
+/*****************************************************************************/
+/* gives a tile bitmap back to the pool, bitmaps that did not come from
+   xrdp_cache_get_tile_bitmap or that do not fit are deleted */
+void
+xrdp_cache_put_tile_bitmap(struct xrdp_cache *self,
+                           struct xrdp_bitmap *bitmap)
+{
+    if (bitmap == 0)
+    {
+        return;
+    }
+    if ((bitmap->data_size == 0) ||
+            (self->tile_pool_count >= XRDP_TILE_POOL_SIZE))
+    {
+        xrdp_bitmap_delete(bitmap);
+        return;
+    }
+    self->tile_pool[self->tile_pool_count] = bitmap;
+    self->tile_pool_count++;
+}
+
+/*****************************************************************************/
+static int
+xrdp_cache_tile_shadow_index(int x, int y, int cx, int cy)
+{
+    unsigned int hash;
+
+    hash = ((unsigned int) x) * 0x9e3779b1u;
+    hash ^= ((unsigned int) y) * 0x85ebca77u;
+    hash ^= ((unsigned int) ((cx << 16) | (cy & 0xffff))) * 0xc2b2ae3du;
+    hash ^= hash >> 16;
+    return (int) (hash & (XRDP_TILE_SHADOW_ENTRIES - 1));
+}
+
+/*****************************************************************************/
+/* returns the bitmap id of the cache entry last sent for the cx by cy
+   tile at x, y in src if it still holds exactly those pixels, else -1
+   the compare is row by row against the cached bitmap so no copy or
+   crc is needed for a tile that has not changed */
+int
+xrdp_cache_find_tile(struct xrdp_cache *self, struct xrdp_bitmap *src,
+                     int x, int y, int cx, int cy)
+{
+    struct xrdp_tile_shadow_item *item;
+    struct xrdp_bitmap *lbm;
+    int index;
+    int row;
+    int Bpp;
+    int lru_index;
+    char *s8;
+    char *d8;
+
+    item = self->tile_shadow + xrdp_cache_tile_shadow_index(x, y, cx, cy);
+    if (!item->valid || (item->x != x) || (item->y != y) ||
+            (item->cx != cx) || (item->cy != cy))
+    {
+        return -1;
+    }
+    if ((x < 0) || (y < 0) || (x + cx > src->width) ||
+            (y + cy > src->height) || (src->data == 0))
+    {
+        return -1;
+    }
+    lbm = self->bitmap_items[item->cache_id][item->cache_idx].bitmap;
+    if ((lbm == NULL) || (lbm->width != cx) || (lbm->height != cy) ||
+            (lbm->bpp != src->bpp))
+    {
+        item->valid = 0;
+        return -1;
+    }
+    Bpp = lbm->line_size / lbm->width;
+    s8 = src->data + y * src->line_size + x * Bpp;
+    d8 = lbm->data;
+    for (row = 0; row < cy; row++)
+    {
+        if (g_memcmp(s8, d8, cx * Bpp) != 0)
+        {
+            return -1;
+        }
+        s8 += src->line_size;
+        d8 += lbm->line_size;
+    }
+    self->bitmap_stamp++;
+    index = item->cache_idx;
+    self->bitmap_items[item->cache_id][index].stamp = self->bitmap_stamp;
+    lru_index = self->bitmap_items[item->cache_id][index].lru_index;
+    xrdp_cache_update_lru(self, item->cache_id, lru_index);
+    return MAKELONG(item->cache_idx, item->cache_id);
+}
+
+/*****************************************************************************/
+/* remember the bitmap id returned from xrdp_cache_add_bitmap for a tile */
+void
+xrdp_cache_set_tile(struct xrdp_cache *self, int x, int y, int cx, int cy,
+                    int bitmap_id)
+{
+    struct xrdp_tile_shadow_item *item;
+
+    item = self->tile_shadow + xrdp_cache_tile_shadow_index(x, y, cx, cy);
+    item->valid = 1;
+    item->x = x;
+    item->y = y;
+    item->cx = cx;
+    item->cy = cy;
+    item->cache_id = HIWORD(bitmap_id);
+    item->cache_idx = LOWORD(bitmap_id);
+}
+
 /*****************************************************************************/
 /* not used */
 /* not sure how to use a palette in rdp */
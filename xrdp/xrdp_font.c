@@ -71,6 +71,7 @@ xrdp_font_create(struct xrdp_wm *wm)
 {
     struct xrdp_font *self;
     struct stream *s;
+    struct stream cached;
     int fd;
     int b;
     int i;
@@ -102,61 +103,74 @@ xrdp_font_create(struct xrdp_wm *wm)
     self = (struct xrdp_font *)g_malloc(sizeof(struct xrdp_font), 1);
     self->wm = wm;
     make_stream(s);
-    init_stream(s, file_size + 1024);
-    fd = g_file_open(file_path);
+    b = 0;
 
-    if (fd != -1)
+    if (xrdp_assets_get_file(file_path, &cached) == 0)
     {
-        b = g_file_read(fd, s->data, file_size + 1024);
-        g_file_close(fd);
+        /* preloaded by the listener, s->data stays NULL so free_stream()
+           leaves the cache alone */
+        s->p = cached.p;
+        s->end = cached.end;
+        b = cached.size;
+    }
+    else
+    {
+        init_stream(s, file_size + 1024);
+        fd = g_file_open(file_path);
+
+        if (fd != -1)
+        {
+            b = g_file_read(fd, s->data, file_size + 1024);
+            g_file_close(fd);
+            s->end = s->data + (b > 0 ? b : 0);
+        }
+    }
+
+    if (b > 0)
+    {
+        in_uint8s(s, 4);
+        in_uint8a(s, self->name, 32);
+        in_uint16_le(s, self->size);
+        in_uint16_le(s, self->style);
+        in_uint8s(s, 8);
+        index = 32;
 
-        if (b > 0)
+        while (s_check_rem(s, 16))
         {
-            s->end = s->data + b;
-            in_uint8s(s, 4);
-            in_uint8a(s, self->name, 32);
-            in_uint16_le(s, self->size);
-            in_uint16_le(s, self->style);
-            in_uint8s(s, 8);
-            index = 32;
-
-            while (s_check_rem(s, 16))
+            f = self->font_items + index;
+            in_sint16_le(s, i);
+            f->width = i;
+            in_sint16_le(s, i);
+            f->height = i;
+            in_sint16_le(s, i);
+            f->baseline = i;
+            in_sint16_le(s, i);
+            f->offset = i;
+            in_sint16_le(s, i);
+            f->incby = i;
+            in_uint8s(s, 6);
+            datasize = FONT_DATASIZE(f);
+
+            if (datasize < 0 || datasize > 512)
+            {
+                /* shouldn't happen */
+                LOG(LOG_LEVEL_ERROR, "error in xrdp_font_create, datasize wrong "
+                    "width %d, height %d, datasize %d, index %d",
+                    f->width, f->height, datasize, index);
+                break;
+            }
+
+            if (s_check_rem(s, datasize))
             {
-                f = self->font_items + index;
-                in_sint16_le(s, i);
-                f->width = i;
-                in_sint16_le(s, i);
-                f->height = i;
-                in_sint16_le(s, i);
-                f->baseline = i;
-                in_sint16_le(s, i);
-                f->offset = i;
-                in_sint16_le(s, i);
-                f->incby = i;
-                in_uint8s(s, 6);
-                datasize = FONT_DATASIZE(f);
-
-                if (datasize < 0 || datasize > 512)
-                {
-                    /* shouldn't happen */
-                    LOG(LOG_LEVEL_ERROR, "error in xrdp_font_create, datasize wrong "
-                        "width %d, height %d, datasize %d, index %d",
-                        f->width, f->height, datasize, index);
-                    break;
-                }
-
-                if (s_check_rem(s, datasize))
-                {
-                    f->data = (char *)g_malloc(datasize, 0);
-                    in_uint8a(s, f->data, datasize);
-                }
-                else
-                {
-                    LOG(LOG_LEVEL_ERROR, "error in xrdp_font_create");
-                }
-
-                index++;
+                f->data = (char *)g_malloc(datasize, 0);
+                in_uint8a(s, f->data, datasize);
             }
+            else
+            {
+                LOG(LOG_LEVEL_ERROR, "error in xrdp_font_create");
+            }
+
+            index++;
         }
     }
 
@@ -776,6 +776,9 @@ xrdp_listen_fork(struct xrdp_listen *self, struct trans *server_trans)
     struct xrdp_process *process;
     struct trans *ltrans;
 
+    /* the child gets the cache as it is now, other processes may be
+       reading their copy so only reload before forking */
+    xrdp_assets_refresh();
     pid = g_fork();
 
     if (pid == 0)
@@ -875,6 +878,8 @@ xrdp_listen_main_loop(struct xrdp_listen *self)
         self->status = -1;
         return 1;
     }
+    /* files every login screen needs, shared by all connections */
+    xrdp_assets_init(self->startup_params->xrdp_ini);
     term_obj = g_get_term_event(); /*Global termination event */
     sync_obj = g_get_sync_event();
     done_obj = self->pro_done_event;
@@ -1003,6 +1008,7 @@ xrdp_listen_main_loop(struct xrdp_listen *self)
         }
     }
 
+    xrdp_assets_deinit();
     self->status = -1;
     return 0;
 }
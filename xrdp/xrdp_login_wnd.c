@@ -552,7 +552,6 @@ xrdp_wm_login_fill_in_combo(struct xrdp_wm *self, struct xrdp_bitmap *b)
     struct list *sections;
     struct list *section_names;
     struct list *section_values;
-    int fd;
     int i;
     int j;
     char *p;
@@ -568,9 +567,8 @@ xrdp_wm_login_fill_in_combo(struct xrdp_wm *self, struct xrdp_bitmap *b)
     section_names->auto_free = 1;
     section_values = list_create();
     section_values->auto_free = 1;
-    fd = g_file_open(xrdp_ini);
 
-    if (fd < 0)
+    if (file_by_name_read_sections(xrdp_ini, sections) != 0)
     {
         LOG(LOG_LEVEL_ERROR, "Could not read xrdp ini file %s",
             xrdp_ini);
@@ -580,12 +578,10 @@ xrdp_wm_login_fill_in_combo(struct xrdp_wm *self, struct xrdp_bitmap *b)
         return 1;
     }
 
-    file_read_sections(fd, sections);
-
     for (i = 0; i < sections->count; i++)
     {
         p = (char *)list_get_item(sections, i);
-        file_read_section(fd, p, section_names, section_values);
+        file_by_name_read_section(xrdp_ini, p, section_names, section_values);
 
         if ((g_strncasecmp(p, "globals", 255) == 0)
                 || (g_strncasecmp(p, "channels", 255) == 0)
@@ -622,7 +618,6 @@ xrdp_wm_login_fill_in_combo(struct xrdp_wm *self, struct xrdp_bitmap *b)
         }
     }
 
-    g_file_close(fd);
     list_delete(sections);
     list_delete(section_names);
     list_delete(section_values);
@@ -850,7 +845,6 @@ load_xrdp_config(struct xrdp_config *config, const char *xrdp_ini, int bpp)
 
     char *n;
     char *v;
-    int   fd;
     int   i;
 
     if (!config)
@@ -882,8 +876,8 @@ load_xrdp_config(struct xrdp_config *config, const char *xrdp_ini, int bpp)
     globals->ls_btn_cancel_width = 85;
     globals->ls_btn_cancel_height = 30;
 
-    /* open xrdp.ini file */
-    if ((fd = g_file_open(xrdp_ini)) < 0)
+    /* check xrdp.ini file */
+    if (!g_file_exist(xrdp_ini))
     {
         LOG(LOG_LEVEL_ERROR, "load_config: Could not read "
             "xrdp.ini file %s", xrdp_ini);
@@ -896,11 +890,10 @@ load_xrdp_config(struct xrdp_config *config, const char *xrdp_ini, int bpp)
     names->auto_free = 1;
     values->auto_free = 1;
 
-    if (file_read_section(fd, "globals", names, values) != 0)
+    if (file_by_name_read_section(xrdp_ini, "globals", names, values) != 0)
     {
         list_delete(names);
         list_delete(values);
-        g_file_close(fd);
         LOG(LOG_LEVEL_ERROR, "load_config: Could not read globals "
             "section from xrdp.ini file %s", xrdp_ini);
         return -1;
@@ -1247,6 +1240,5 @@ load_xrdp_config(struct xrdp_config *config, const char *xrdp_ini, int bpp)
 
     list_delete(names);
     list_delete(values);
-    g_file_close(fd);
     return 0;
 }
@@ -41,7 +41,11 @@
 #include "xrdp_encoder.h"
 #include "xrdp_sockets.h"
 
+/* chansrv messages bigger than this don't keep their buffer */
+#define XRDP_CHAN_IN_S_KEEP_BYTES (64 * 1024)
 
+static void
+xrdp_mm_scroll_free(struct xrdp_mm *self);
 
 /*****************************************************************************/
 struct xrdp_mm *
@@ -145,6 +149,8 @@ xrdp_mm_delete(struct xrdp_mm *self)
     /* shutdown thread */
     xrdp_encoder_delete(self->encoder);
 
+    xrdp_mm_scroll_free(self);
+
     trans_delete(self->sesman_trans);
     self->sesman_trans = 0;
     self->sesman_trans_up = 0;
@@ -468,6 +474,8 @@ xrdp_mm_setup_mod1(struct xrdp_mm *self)
             self->mod->server_composite = server_composite;
             self->mod->server_paint_rects = server_paint_rects;
             self->mod->server_session_info = server_session_info;
+            self->mod->server_fill_rects = server_fill_rects;
+            self->mod->server_screen_blts = server_screen_blts;
             self->mod->si = &(self->wm->session->si);
         }
     }
@@ -684,9 +692,11 @@ xrdp_mm_trans_send_channel_setup(struct xrdp_mm *self, struct trans *trans)
 
 /*****************************************************************************/
 /* returns error
-   data coming in from the channel handler, send it to the client */
+   data coming in from the channel handler, send it to the client
+   msg id 8 has a 16 bit length, msg id 20 a 32 bit one */
 static int
-xrdp_mm_trans_process_channel_data(struct xrdp_mm *self, struct stream *s)
+xrdp_mm_trans_process_channel_data(struct xrdp_mm *self, struct stream *s,
+                                   int id)
 {
     int size;
     int total_size;
@@ -696,8 +706,19 @@ xrdp_mm_trans_process_channel_data(struct xrdp_mm *self, struct stream *s)
 
     in_uint16_le(s, chan_id);
     in_uint16_le(s, chan_flags);
-    in_uint16_le(s, size);
+    if (id == 20)
+    {
+        in_uint32_le(s, size);
+    }
+    else
+    {
+        in_uint16_le(s, size);
+    }
     in_uint32_le(s, total_size);
+    if (size < 0 || !s_check_rem(s, size))
+    {
+        return 1;
+    }
     rv = 0;
 
     if (rv == 0)
@@ -1540,7 +1561,8 @@ xrdp_mm_chan_process_msg(struct xrdp_mm *self, struct trans *trans,
         switch (id)
         {
             case 8: /* channel data */
-                rv = xrdp_mm_trans_process_channel_data(self, s);
+            case 20: /* channel data, large */
+                rv = xrdp_mm_trans_process_channel_data(self, s, id);
                 break;
             case 10: /* rail alternate secondary drawing orders */
                 rv = xrdp_mm_process_rail_drawing_orders(self, s);
@@ -1574,6 +1596,24 @@ xrdp_mm_chan_process_msg(struct xrdp_mm *self, struct trans *trans,
     return rv;
 }
 
+/*****************************************************************************/
+/* makes room for a message of size bytes, the bytes read so far are kept */
+static void
+xrdp_mm_chan_grow_in_s(struct stream *s, int size)
+{
+    char *data;
+    int read_so_far;
+
+    read_so_far = (int)(s->end - s->data);
+    data = (char *)g_malloc(size, 0);
+    g_memcpy(data, s->data, read_so_far);
+    g_free(s->data);
+    s->p = data + (s->p - s->data);
+    s->end = data + read_so_far;
+    s->data = data;
+    s->size = size;
+}
+
 /*****************************************************************************/
 /* this is callback from trans obj
    returns error */
@@ -1603,6 +1643,17 @@ xrdp_mm_chan_data_in(struct trans *trans)
         in_uint8s(s, 4); /* id */
         in_uint32_le(s, size);
         LOG_DEVEL(LOG_LEVEL_DEBUG, "xrdp_mm_chan_data_in: got header, size %d", size);
+        if (size > XRDP_CHANSRV_MAX_FRAME_BYTES + 1024)
+        {
+            LOG(LOG_LEVEL_ERROR, "xrdp_mm_chan_data_in: bad message size %d",
+                size);
+            return 1;
+        }
+        if (size > s->size)
+        {
+            /* large channel data, keep the header already read */
+            xrdp_mm_chan_grow_in_s(s, size);
+        }
         if (size > 8)
         {
             self->chan_trans->header_size = size;
@@ -1614,6 +1665,13 @@ xrdp_mm_chan_data_in(struct trans *trans)
     error = xrdp_mm_chan_process_msg(self, trans, s);
     self->chan_trans->header_size = 8;
     trans->extra_flags = 0;
+    if (s->size > XRDP_CHAN_IN_S_KEEP_BYTES)
+    {
+        /* don't hold on to a large buffer between bursts */
+        g_free(s->data);
+        s->data = (char *)g_malloc(8192, 0);
+        s->size = 8192;
+    }
     init_stream(s, 0);
     LOG_DEVEL(LOG_LEVEL_DEBUG, "xrdp_mm_chan_data_in: got whole message, reset for "
               "next header");
@@ -1764,8 +1822,10 @@ xrdp_mm_process_login_response(struct xrdp_mm *self, struct stream *s)
     char port[256];
     tui8 guid[16];
     tui8 *pguid;
+    tui64 sesman_done;
 
     rv = 0;
+    sesman_done = g_time4();
     in_uint16_be(s, ok);
     in_uint16_be(s, display);
     pguid = 0;
@@ -1784,6 +1844,10 @@ xrdp_mm_process_login_response(struct xrdp_mm *self, struct stream *s)
         {
             if (xrdp_mm_setup_mod2(self, pguid) == 0)
             {
+                LOG(LOG_LEVEL_INFO, "login latency for display %d: sesman "
+                    "%d ms, module connect %d ms", display,
+                    (int)((sesman_done - self->login_start) / 1000),
+                    (int)((g_time4() - sesman_done) / 1000));
                 xrdp_mm_get_value(self, "ip", ip, 255);
                 xrdp_wm_set_login_state(self->wm, WMLS_CLEANUP);
                 self->wm->dragging = 0;
@@ -1821,7 +1885,6 @@ xrdp_mm_process_login_response(struct xrdp_mm *self, struct stream *s)
 static int
 xrdp_mm_get_sesman_port(char *port, int port_bytes)
 {
-    int fd;
     int error;
     int index;
     char *val;
@@ -1834,47 +1897,74 @@ xrdp_mm_get_sesman_port(char *port, int port_bytes)
     g_strncpy(port, "3350", port_bytes - 1);
     /* see if port is in sesman.ini file */
     g_snprintf(cfg_file, 255, "%s/sesman.ini", XRDP_CFG_PATH);
-    fd = g_file_open(cfg_file);
+    names = list_create();
+    names->auto_free = 1;
+    values = list_create();
+    values->auto_free = 1;
 
-    if (fd >= 0)
+    if (file_by_name_read_section(cfg_file, "Globals", names, values) == 0)
     {
-        names = list_create();
-        names->auto_free = 1;
-        values = list_create();
-        values->auto_free = 1;
-
-        if (file_read_section(fd, "Globals", names, values) == 0)
+        for (index = 0; index < names->count; index++)
         {
-            for (index = 0; index < names->count; index++)
-            {
-                val = (char *)list_get_item(names, index);
+            val = (char *)list_get_item(names, index);
 
-                if (val != 0)
+            if (val != 0)
+            {
+                if (g_strcasecmp(val, "ListenPort") == 0)
                 {
-                    if (g_strcasecmp(val, "ListenPort") == 0)
-                    {
-                        val = (char *)list_get_item(values, index);
-                        error = g_atoi(val);
-
-                        if ((error > 0) && (error < 65000))
-                        {
-                            g_strncpy(port, val, port_bytes - 1);
-                        }
+                    val = (char *)list_get_item(values, index);
+                    error = g_atoi(val);
 
-                        break;
+                    if ((error > 0) && (error < 65000))
+                    {
+                        g_strncpy(port, val, port_bytes - 1);
                     }
+
+                    break;
                 }
             }
         }
-
-        list_delete(names);
-        list_delete(values);
-        g_file_close(fd);
     }
 
+    list_delete(names);
+    list_delete(values);
     return 0;
 }
 
+/*****************************************************************************/
+/* returns non-zero if sesman at ip is on this machine and listens on its
+   unix socket, which saves the TCP handshake on each login */
+static int
+xrdp_mm_sesman_is_local(const char *ip)
+{
+    if (ip[0] != 0 &&
+            g_strcmp(ip, "127.0.0.1") != 0 &&
+            g_strcmp(ip, "::1") != 0 &&
+            g_strcasecmp(ip, "localhost") != 0)
+    {
+        return 0;
+    }
+    return g_file_exist(SESMAN_UNIX_STR);
+}
+
+/*****************************************************************************/
+/* returns non-zero if the peer of a connection to SESMAN_UNIX_STR runs as
+   root. The socket is in a world writable directory, so any local user
+   could have put a listener there to collect passwords */
+static int
+xrdp_mm_sesman_peer_is_root(int sck)
+{
+    int uid;
+
+    if (g_sck_get_peer_cred(sck, 0, &uid, 0) != 0 || uid != 0)
+    {
+        LOG(LOG_LEVEL_WARNING, "%s is not served by root, connecting to "
+            "sesman over TCP", SESMAN_UNIX_STR);
+        return 0;
+    }
+    return 1;
+}
+
 /*****************************************************************************/
 /* returns error
    data coming from client that need to go to channel handler */
@@ -1978,6 +2068,34 @@ xrdp_mm_sesman_data_in(struct trans *trans)
     return error;
 }
 
+/*****************************************************************************/
+/* creates the transport to sesman, over its unix socket if local is set,
+   port gets the TCP port or the socket path. Every login has its own
+   connection, SCP has no request ids to share one between xrdp processes */
+static struct trans *
+xrdp_mm_sesman_trans_create(struct xrdp_mm *self, int local,
+                            char *port, int port_bytes)
+{
+    struct trans *t;
+
+    if (local)
+    {
+        t = trans_create(TRANS_MODE_UNIX, 8192, 8192);
+        g_strncpy(port, SESMAN_UNIX_STR, port_bytes - 1);
+    }
+    else
+    {
+        t = trans_create(TRANS_MODE_TCP, 8192, 8192);
+        xrdp_mm_get_sesman_port(port, port_bytes);
+    }
+    t->is_term = g_is_term;
+    /* xrdp_mm_sesman_data_in is the callback that is called when data arrives */
+    t->trans_data_in = xrdp_mm_sesman_data_in;
+    t->header_size = 8;
+    t->callback_data = self;
+    return t;
+}
+
 #ifdef USE_PAM
 /*********************************************************************/
 /* return 0 on success */
@@ -1994,14 +2112,29 @@ access_control(char *username, char *password, char *srv)
     unsigned short int code;
     unsigned long size;
     int index;
-    int socket = g_tcp_socket();
+    int local = xrdp_mm_sesman_is_local(srv);
+    int socket = local ? g_tcp_local_socket() : g_tcp_socket();
     char port[8];
 
     if (socket != -1)
     {
-        xrdp_mm_get_sesman_port(port, sizeof(port));
         /* we use a blocking socket here */
-        reply = g_tcp_connect(socket, srv, port);
+        if (local)
+        {
+            reply = g_tcp_local_connect(socket, SESMAN_UNIX_STR);
+            if (reply == 0 && !xrdp_mm_sesman_peer_is_root(socket))
+            {
+                g_tcp_close(socket);
+                socket = g_tcp_socket();
+                local = 0;
+                reply = -1;
+            }
+        }
+        if (!local && socket != -1)
+        {
+            xrdp_mm_get_sesman_port(port, sizeof(port));
+            reply = g_tcp_connect(socket, srv, port);
+        }
 
         if (reply == 0)
         {
@@ -2420,7 +2553,8 @@ xrdp_mm_connect(struct xrdp_mm *self)
     char *name;
     char *value;
     char ip[256];
-    char port[8];
+    char port[256]; /* a TCP port or the sesman socket path */
+    int local;
     char chansrvport[256];
 #ifdef USE_PAM
     int use_pam_auth = 0;
@@ -2430,6 +2564,7 @@ xrdp_mm_connect(struct xrdp_mm *self)
 #endif
     char username[256];
     char password[256];
+    self->login_start = g_time4();
     username[0] = 0;
     password[0] = 0;
 
@@ -2539,15 +2674,11 @@ xrdp_mm_connect(struct xrdp_mm *self)
     {
         ok = 0;
         trans_delete(self->sesman_trans);
-        self->sesman_trans = trans_create(TRANS_MODE_TCP, 8192, 8192);
-        self->sesman_trans->is_term = g_is_term;
-        xrdp_mm_get_sesman_port(port, sizeof(port));
+        local = xrdp_mm_sesman_is_local(ip);
+        self->sesman_trans = xrdp_mm_sesman_trans_create(self, local, port,
+                                                         sizeof(port));
         xrdp_wm_log_msg(self->wm, LOG_LEVEL_DEBUG,
                         "connecting to sesman ip %s port %s", ip, port);
-        /* xrdp_mm_sesman_data_in is the callback that is called when data arrives */
-        self->sesman_trans->trans_data_in = xrdp_mm_sesman_data_in;
-        self->sesman_trans->header_size = 8;
-        self->sesman_trans->callback_data = self;
 
         /* try to connect up to 4 times */
         for (index = 0; index < 4; index++)
@@ -2567,6 +2698,17 @@ xrdp_mm_connect(struct xrdp_mm *self)
                 "trying again...");
         }
 
+        if (ok && local &&
+                !xrdp_mm_sesman_peer_is_root(self->sesman_trans->sck))
+        {
+            /* the credentials only go to a sesman running as root */
+            trans_delete(self->sesman_trans);
+            self->sesman_trans = xrdp_mm_sesman_trans_create(self, 0, port,
+                                                             sizeof(port));
+            ok = trans_connect(self->sesman_trans, ip, port, 3000) == 0;
+            self->sesman_trans_up = ok;
+        }
+
         if (ok)
         {
             /* fully connect */
@@ -2591,6 +2733,8 @@ xrdp_mm_connect(struct xrdp_mm *self)
         {
             if (xrdp_mm_setup_mod2(self, 0) == 0)
             {
+                LOG(LOG_LEVEL_INFO, "login latency: module connect %d ms",
+                    (int)((g_time4() - self->login_start) / 1000));
                 xrdp_wm_set_login_state(self->wm, WMLS_CLEANUP);
                 rv = 0; /*success*/
             }
@@ -3018,6 +3162,7 @@ server_fill_rect(struct xrdp_mod *mod, int x, int y, int cx, int cy)
     }
 
     wm = (struct xrdp_wm *)(mod->wm);
+    xrdp_mm_scroll_invalidate(wm->mm);
     xrdp_painter_fill_rect(p, wm->target_surface, x, y, cx, cy);
     return 0;
 }
@@ -3038,11 +3183,62 @@ server_screen_blt(struct xrdp_mod *mod, int x, int y, int cx, int cy,
     }
 
     wm = (struct xrdp_wm *)(mod->wm);
+    xrdp_mm_scroll_invalidate(wm->mm);
     p->rop = 0xcc;
     xrdp_painter_copy(p, wm->screen, wm->target_surface, x, y, cx, cy, srcx, srcy);
     return 0;
 }
 
+/*****************************************************************************/
+/* rects is num_rects * (x, y, cx, cy) */
+int
+server_fill_rects(struct xrdp_mod *mod, int num_rects, short *rects)
+{
+    struct xrdp_wm *wm;
+    struct xrdp_painter *p;
+
+    p = (struct xrdp_painter *)(mod->painter);
+
+    if (p == 0)
+    {
+        return 0;
+    }
+
+    wm = (struct xrdp_wm *)(mod->wm);
+    xrdp_mm_scroll_invalidate(wm->mm);
+    xrdp_painter_fill_rects(p, wm->target_surface, num_rects, rects);
+    return 0;
+}
+
+/*****************************************************************************/
+/* rects is num_rects * (x, y, cx, cy, srcx, srcy) */
+int
+server_screen_blts(struct xrdp_mod *mod, int num_rects, short *rects)
+{
+    struct xrdp_wm *wm;
+    struct xrdp_painter *p;
+    int index;
+
+    p = (struct xrdp_painter *)(mod->painter);
+
+    if (p == 0)
+    {
+        return 0;
+    }
+
+    wm = (struct xrdp_wm *)(mod->wm);
+    xrdp_mm_scroll_invalidate(wm->mm);
+    p->rop = 0xcc;
+    for (index = 0; index < num_rects; index++)
+    {
+        xrdp_painter_copy(p, wm->screen, wm->target_surface,
+                          rects[0], rects[1], rects[2], rects[3],
+                          rects[4], rects[5]);
+        rects += 6;
+    }
+    return 0;
+}
+
 /*****************************************************************************/
 int
 server_paint_rect(struct xrdp_mod *mod, int x, int y, int cx, int cy,
@@ -3060,6 +3256,7 @@ server_paint_rect(struct xrdp_mod *mod, int x, int y, int cx, int cy,
     }
 
     wm = (struct xrdp_wm *)(mod->wm);
+    xrdp_mm_scroll_invalidate(wm->mm);
     b = xrdp_bitmap_create_with_data(width, height, wm->screen->bpp, data, wm);
     xrdp_painter_copy(p, b, wm->target_surface, x, y, cx, cy, srcx, srcy);
     xrdp_bitmap_delete(b);
@@ -3082,6 +3279,7 @@ server_paint_rect_bpp(struct xrdp_mod *mod, int x, int y, int cx, int cy,
         return 0;
     }
     wm = (struct xrdp_wm *)(mod->wm);
+    xrdp_mm_scroll_invalidate(wm->mm);
     b = xrdp_bitmap_create_with_data(width, height, bpp, data, wm);
     xrdp_painter_copy(p, b, wm->target_surface, x, y, cx, cy, srcx, srcy);
     xrdp_bitmap_delete(b);
@@ -3109,6 +3307,7 @@ server_composite(struct xrdp_mod *mod, int srcidx, int srcformat,
         return 0;
     }
     wm = (struct xrdp_wm *)(mod->wm);
+    xrdp_mm_scroll_invalidate(wm->mm);
     b = 0;
     msk = 0;
     bi = xrdp_cache_get_os_bitmap(wm->cache, srcidx);
@@ -3139,6 +3338,277 @@ server_composite(struct xrdp_mod *mod, int srcidx, int srcformat,
     return 0;
 }
 
+/*****************************************************************************/
+/* smallest area worth looking for scrolled rows in */
+#define SCROLL_MIN_ROWS 16
+#define SCROLL_MIN_COLS 64
+/* row offsets tried per sample row, stops blank areas with many equal
+   rows from taking too long */
+#define SCROLL_MAX_CANDIDATES 8
+
+/*****************************************************************************/
+static void
+xrdp_mm_scroll_free(struct xrdp_mm *self)
+{
+    g_free(self->scroll_shadow);
+    self->scroll_shadow = 0;
+    g_free(self->scroll_hashes);
+    self->scroll_hashes = 0;
+    xrdp_region_delete(self->scroll_shadow_valid);
+    self->scroll_shadow_valid = 0;
+    self->scroll_shadow_width = 0;
+    self->scroll_shadow_height = 0;
+}
+
+/*****************************************************************************/
+/* called when something other than server_paint_rects draws to the
+   client, the shadow no longer matches the client screen */
+void
+xrdp_mm_scroll_invalidate(struct xrdp_mm *self)
+{
+    if ((self != 0) && (self->scroll_shadow_valid != 0))
+    {
+        xrdp_region_reset(self->scroll_shadow_valid);
+    }
+}
+
+/*****************************************************************************/
+/* returns error */
+static int
+xrdp_mm_scroll_setup(struct xrdp_mm *self, int width, int height)
+{
+    if ((self->scroll_shadow != 0) &&
+            (self->scroll_shadow_width == width) &&
+            (self->scroll_shadow_height == height))
+    {
+        return 0;
+    }
+    xrdp_mm_scroll_free(self);
+    if ((width < 1) || (height < 1) || (width > 16 * 1024) ||
+            (height > 16 * 1024))
+    {
+        return 1;
+    }
+    self->scroll_shadow = (char *) g_malloc(width * height * 4, 0);
+    self->scroll_hashes = (tui32 *) g_malloc(sizeof(tui32) * 2 * height, 0);
+    self->scroll_shadow_valid = xrdp_region_create(self->wm);
+    if ((self->scroll_shadow == 0) || (self->scroll_hashes == 0))
+    {
+        xrdp_mm_scroll_free(self);
+        return 1;
+    }
+    self->scroll_shadow_width = width;
+    self->scroll_shadow_height = height;
+    return 0;
+}
+
+/*****************************************************************************/
+static tui32
+xrdp_mm_scroll_row_hash(const char *data, int cx)
+{
+    const tui32 *p32;
+    tui32 hash;
+    int index;
+
+    p32 = (const tui32 *) data;
+    hash = 2166136261u;
+    for (index = 0; index < cx; index++)
+    {
+        hash = (hash ^ p32[index]) * 16777619u;
+    }
+    return hash;
+}
+
+/*****************************************************************************/
+/* looks for rows in the cx by cy box at x, y of the new frame that are
+   in the shadow dy rows away, returns the number of rows in the longest
+   such run, zero if nothing worth a screen blt was found */
+static int
+xrdp_mm_scroll_detect(struct xrdp_mm *self, const char *data,
+                      int x, int y, int cx, int cy,
+                      int *first_row, int *rdy)
+{
+    const char *src;
+    const char *dst;
+    tui32 *new_hash;
+    tui32 *old_hash;
+    struct xrdp_rect rect;
+    int line_size;
+    int sample;
+    int sample_row;
+    int candidates;
+    int row;
+    int dy;
+    int run;
+    int run_start;
+    int best;
+    int best_start;
+    int best_dy;
+    int k;
+
+    line_size = self->scroll_shadow_width * 4;
+    new_hash = self->scroll_hashes;
+    old_hash = self->scroll_hashes + self->scroll_shadow_height;
+    src = data + y * line_size + x * 4;
+    dst = self->scroll_shadow + y * line_size + x * 4;
+    for (row = 0; row < cy; row++)
+    {
+        new_hash[row] = xrdp_mm_scroll_row_hash(src, cx);
+        old_hash[row] = xrdp_mm_scroll_row_hash(dst, cx);
+        src += line_size;
+        dst += line_size;
+    }
+
+    best = 0;
+    best_start = 0;
+    best_dy = 0;
+    for (sample = 1; sample < 4; sample++)
+    {
+        sample_row = (cy * sample) / 4;
+        if (new_hash[sample_row] == old_hash[sample_row])
+        {
+            continue;
+        }
+        candidates = 0;
+        for (k = 0; (k < cy) && (candidates < SCROLL_MAX_CANDIDATES); k++)
+        {
+            if ((k == sample_row) || (old_hash[k] != new_hash[sample_row]))
+            {
+                continue;
+            }
+            candidates++;
+            dy = k - sample_row;
+            run = 0;
+            run_start = 0;
+            for (row = MAX(0, -dy); row < MIN(cy, cy - dy); row++)
+            {
+                if (new_hash[row] == old_hash[row + dy])
+                {
+                    if (run == 0)
+                    {
+                        run_start = row;
+                    }
+                    run++;
+                    if (run > best)
+                    {
+                        best = run;
+                        best_start = run_start;
+                        best_dy = dy;
+                    }
+                }
+                else
+                {
+                    run = 0;
+                }
+            }
+        }
+    }
+    if (best < SCROLL_MIN_ROWS)
+    {
+        return 0;
+    }
+
+    /* the client must still show the source rows */
+    rect.left = x;
+    rect.top = y + best_start + best_dy;
+    rect.right = x + cx;
+    rect.bottom = rect.top + best;
+    if (!xrdp_region_contains_rect(self->scroll_shadow_valid, &rect))
+    {
+        return 0;
+    }
+
+    /* hashes can collide, check the pixels */
+    src = data + (y + best_start) * line_size + x * 4;
+    dst = self->scroll_shadow + (y + best_start + best_dy) * line_size +
+          x * 4;
+    for (row = 0; row < best; row++)
+    {
+        if (g_memcmp(src, dst, cx * 4) != 0)
+        {
+            return 0;
+        }
+        src += line_size;
+        dst += line_size;
+    }
+    *first_row = best_start;
+    *rdy = best_dy;
+    return best;
+}
+
+/*****************************************************************************/
+/* paint one copied rect of a frame, rows that only moved on screen are
+   sent as a screen blt and only the rest is sent as bitmap data */
+static void
+xrdp_mm_scroll_paint_rect(struct xrdp_mm *self, struct xrdp_painter *p,
+                          struct xrdp_bitmap *b, const char *data,
+                          int x, int y, int cx, int cy)
+{
+    struct xrdp_wm *wm;
+    struct xrdp_rect rect;
+    const char *src;
+    char *dst;
+    int line_size;
+    int first_row;
+    int dy;
+    int rows;
+    int index;
+
+    wm = self->wm;
+    rows = 0;
+    first_row = 0;
+    dy = 0;
+    if ((self->scroll_shadow != 0) &&
+            (cx >= SCROLL_MIN_COLS) && (cy >= SCROLL_MIN_ROWS))
+    {
+        rows = xrdp_mm_scroll_detect(self, data, x, y, cx, cy,
+                                     &first_row, &dy);
+    }
+    if (rows > 0)
+    {
+        LOG_DEVEL(LOG_LEVEL_DEBUG, "xrdp_mm_scroll_paint_rect: x %d y %d "
+                  "cx %d rows %d dy %d", x, y + first_row, cx, rows, dy);
+        p->rop = 0xcc;
+        xrdp_painter_copy(p, wm->screen, wm->target_surface,
+                          x, y + first_row, cx, rows,
+                          x, y + first_row + dy);
+        if (first_row > 0)
+        {
+            xrdp_painter_copy(p, b, wm->target_surface,
+                              x, y, cx, first_row, x, y);
+        }
+        if (first_row + rows < cy)
+        {
+            xrdp_painter_copy(p, b, wm->target_surface,
+                              x, y + first_row + rows,
+                              cx, cy - (first_row + rows),
+                              x, y + first_row + rows);
+        }
+    }
+    else
+    {
+        xrdp_painter_copy(p, b, wm->target_surface, x, y, cx, cy, x, y);
+    }
+
+    if (self->scroll_shadow != 0)
+    {
+        line_size = self->scroll_shadow_width * 4;
+        src = data + y * line_size + x * 4;
+        dst = self->scroll_shadow + y * line_size + x * 4;
+        for (index = 0; index < cy; index++)
+        {
+            g_memcpy(dst, src, cx * 4);
+            src += line_size;
+            dst += line_size;
+        }
+        rect.left = x;
+        rect.top = y;
+        rect.right = x + cx;
+        rect.bottom = y + cy;
+        xrdp_region_add_rect(self->scroll_shadow_valid, &rect);
+    }
+}
+
 /*****************************************************************************/
 int
 server_paint_rects(struct xrdp_mod *mod, int num_drects, short *drects,
@@ -3220,11 +3690,30 @@ server_paint_rects(struct xrdp_mod *mod, int num_drects, short *drects,
     }
     b = xrdp_bitmap_create_with_data(width, height, wm->screen->bpp,
                                      data, wm);
+    /* scroll detection works on 32 bit pixels of full frames painted
+       to the screen */
+    if ((wm->target_surface != wm->screen) ||
+            (wm->screen->bpp < 24) || (width != wm->screen->width) ||
+            (height != wm->screen->height) ||
+            (xrdp_mm_scroll_setup(mm, width, height) != 0))
+    {
+        xrdp_mm_scroll_free(mm);
+    }
     s = crects;
     for (index = 0; index < num_crects; index++)
     {
-        xrdp_painter_copy(p, b, wm->target_surface, s[0], s[1], s[2], s[3],
-                          s[0], s[1]);
+        if ((s[0] < 0) || (s[1] < 0) || (s[2] < 1) || (s[3] < 1) ||
+                (s[0] + s[2] > width) || (s[1] + s[3] > height))
+        {
+            xrdp_mm_scroll_invalidate(mm);
+            xrdp_painter_copy(p, b, wm->target_surface, s[0], s[1],
+                              s[2], s[3], s[0], s[1]);
+        }
+        else
+        {
+            xrdp_mm_scroll_paint_rect(mm, p, b, data,
+                                      s[0], s[1], s[2], s[3]);
+        }
         s += 4;
     }
     xrdp_bitmap_delete(b);
@@ -3462,6 +3951,7 @@ server_draw_line(struct xrdp_mod *mod, int x1, int y1, int x2, int y2)
     }
 
     wm = (struct xrdp_wm *)(mod->wm);
+    xrdp_mm_scroll_invalidate(wm->mm);
     return xrdp_painter_line(p, wm->target_surface, x1, y1, x2, y2);
 }
 
@@ -3504,6 +3994,7 @@ server_draw_text(struct xrdp_mod *mod, int font,
     }
 
     wm = (struct xrdp_wm *)(mod->wm);
+    xrdp_mm_scroll_invalidate(wm->mm);
     return xrdp_painter_draw_text2(p, wm->target_surface, font, flags,
                                    mixmode, clip_left, clip_top,
                                    clip_right, clip_bottom,
@@ -3522,6 +4013,7 @@ server_reset(struct xrdp_mod *mod, int width, int height, int bpp)
     struct xrdp_wm *wm;
 
     wm = (struct xrdp_wm *)(mod->wm);
+    xrdp_mm_scroll_invalidate(wm->mm);
 
     if (wm->client_info == 0)
     {
@@ -3678,6 +4170,9 @@ server_switch_os_surface(struct xrdp_mod *mod, int rdpindex)
 
     LOG(LOG_LEVEL_DEBUG, "server_switch_os_surface: id 0x%x", rdpindex);
     wm = (struct xrdp_wm *)(mod->wm);
+    /* the shadow only follows the screen, drawing to or from an off
+       screen surface can leave the client out of step with it */
+    xrdp_mm_scroll_invalidate(wm->mm);
 
     if (rdpindex == -1)
     {
@@ -3764,6 +4259,7 @@ server_paint_rect_os(struct xrdp_mod *mod, int x, int y, int cx, int cy,
     }
 
     wm = (struct xrdp_wm *)(mod->wm);
+    xrdp_mm_scroll_invalidate(wm->mm);
     bi = xrdp_cache_get_os_bitmap(wm->cache, rdpindex);
 
     if (bi != 0)
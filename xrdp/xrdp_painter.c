@@ -795,6 +795,188 @@ xrdp_painter_fill_rect(struct xrdp_painter *self,
     return 0;
 }
 
+#if defined(XRDP_PAINTER)
+/*****************************************************************************/
+/* xrdp_painter_fill_rects() with libpainter, the screen, clip, rop and
+   colour are set up once for the whole batch */
+static int
+xrdp_painter_fill_rects_pt(struct xrdp_painter *self,
+                           struct xrdp_bitmap *dst,
+                           int num_rects, const short *rects)
+{
+    struct painter_bitmap dst_pb;
+    struct xrdp_bitmap *ldst;
+    struct xrdp_rect clip_rect;
+    struct xrdp_rect draw_rect;
+    struct xrdp_rect rect;
+    struct xrdp_region *region;
+    int index;
+    int k;
+    int dx;
+    int dy;
+    int x;
+    int y;
+    int cx;
+    int cy;
+    int rop;
+
+    ldst = self->wm->screen;
+
+    g_memset(&dst_pb, 0, sizeof(dst_pb));
+    dst_pb.format = get_pt_format(self);
+    dst_pb.width = ldst->width;
+    dst_pb.stride_bytes = ldst->line_size;
+    dst_pb.height = ldst->height;
+    dst_pb.data = ldst->data;
+
+    dx = 0;
+    dy = 0;
+    xrdp_bitmap_get_screen_clip(dst, self, &clip_rect, &dx, &dy);
+    region = xrdp_region_create(self->wm);
+
+    rop = self->rop;
+    switch (self->rop)
+    {
+        case 0x5a:
+            rop = PT_ROP_DSx;
+            break;
+        case 0xf0:
+            rop = PT_ROP_S;
+            break;
+        case 0xfb:
+            rop = PT_ROP_D;
+            break;
+        case 0xc0:
+            rop = PT_ROP_DSa;
+            break;
+    }
+    painter_set_rop(self->painter, rop);
+    painter_set_pattern_mode(self->painter, PT_PATTERN_MODE_OPAQUE);
+    painter_set_fgcolor(self->painter,
+                        get_rgb_from_rdp_color(self, self->fg_color));
+
+    for (index = 0; index < num_rects; index++)
+    {
+        x = rects[0];
+        y = rects[1];
+        cx = rects[2];
+        cy = rects[3];
+        rects += 4;
+        xrdp_region_reset(region);
+        xrdp_wm_get_vis_region(self->wm, dst, x, y, cx, cy, region,
+                               self->clip_children);
+        x += dx;
+        y += dy;
+        k = 0;
+        while (xrdp_region_get_rect(region, k, &rect) == 0)
+        {
+            if (rect_intersect(&rect, &clip_rect, &draw_rect))
+            {
+                painter_set_clip(self->painter,
+                                 draw_rect.left, draw_rect.top,
+                                 draw_rect.right - draw_rect.left,
+                                 draw_rect.bottom - draw_rect.top);
+                painter_fill_rect(self->painter, &dst_pb, x, y, cx, cy);
+                xrdp_painter_add_dirty_rect(self, x, y, cx, cy, &draw_rect);
+            }
+            k++;
+        }
+    }
+
+    painter_clear_clip(self->painter);
+    xrdp_region_delete(region);
+    return 0;
+}
+#endif
+
+/*****************************************************************************/
+/* rects is num_rects * (x, y, cx, cy)
+   solid fills to the screen only look up the clip once for the whole
+   batch, everything else goes through xrdp_painter_fill_rect */
+int
+xrdp_painter_fill_rects(struct xrdp_painter *self,
+                        struct xrdp_bitmap *dst,
+                        int num_rects, const short *rects)
+{
+    struct xrdp_rect clip_rect;
+    struct xrdp_rect draw_rect;
+    struct xrdp_rect rect;
+    struct xrdp_region *region;
+    int index;
+    int k;
+    int dx;
+    int dy;
+    int x;
+    int y;
+    int cx;
+    int cy;
+
+    LOG_DEVEL(LOG_LEVEL_DEBUG, "xrdp_painter_fill_rects: num_rects %d",
+              num_rects);
+
+    if (self == 0)
+    {
+        return 0;
+    }
+
+#if defined(XRDP_PAINTER)
+    if ((self->painter != 0) && (dst->type != WND_TYPE_OFFSCREEN) &&
+            (self->mix_mode == 0))
+    {
+        return xrdp_painter_fill_rects_pt(self, dst, num_rects, rects);
+    }
+#endif
+
+    if ((self->painter != 0) || (dst->type == WND_TYPE_OFFSCREEN) ||
+            (self->mix_mode != 0) || (self->rop != 0xcc))
+    {
+        for (index = 0; index < num_rects; index++)
+        {
+            xrdp_painter_fill_rect(self, dst, rects[0], rects[1],
+                                   rects[2], rects[3]);
+            rects += 4;
+        }
+        return 0;
+    }
+
+    if (dst->type == WND_TYPE_BITMAP) /* 0 */
+    {
+        return 0;
+    }
+
+    dx = 0;
+    dy = 0;
+    xrdp_bitmap_get_screen_clip(dst, self, &clip_rect, &dx, &dy);
+    region = xrdp_region_create(self->wm);
+
+    for (index = 0; index < num_rects; index++)
+    {
+        x = rects[0];
+        y = rects[1];
+        cx = rects[2];
+        cy = rects[3];
+        rects += 4;
+        xrdp_region_reset(region);
+        xrdp_wm_get_vis_region(self->wm, dst, x, y, cx, cy, region,
+                               self->clip_children);
+        x += dx;
+        y += dy;
+        k = 0;
+        while (xrdp_region_get_rect(region, k, &rect) == 0)
+        {
+            if (rect_intersect(&rect, &clip_rect, &draw_rect))
+            {
+                libxrdp_orders_rect(self->session, x, y, cx, cy,
+                                    self->fg_color, &draw_rect);
+            }
+            k++;
+        }
+    }
+
+    xrdp_region_delete(region);
+    return 0;
+}
+
 /*****************************************************************************/
 int
 xrdp_painter_draw_text(struct xrdp_painter *self,
@@ -1321,14 +1503,23 @@ xrdp_painter_copy(struct xrdp_painter *self,
             {
                 w = MIN(64, ((srcx + cx) - i));
                 h = MIN(64, ((srcy + cy) - j));
-                b = xrdp_bitmap_create(w, h, src->bpp, 0, self->wm);
+                bitmap_id = xrdp_cache_find_tile(self->wm->cache, src,
+                                                 i, j, w, h);
+                if (bitmap_id == -1)
+                {
+                    b = xrdp_cache_get_tile_bitmap(self->wm->cache,
+                                                   w, h, src->bpp);
 #if 1
-                xrdp_bitmap_copy_box_with_crc(src, b, i, j, w, h);
+                    xrdp_bitmap_copy_box_with_crc(src, b, i, j, w, h);
 #else
-                xrdp_bitmap_copy_box(src, b, i, j, w, h);
-                xrdp_bitmap_hash_crc(b);
+                    xrdp_bitmap_copy_box(src, b, i, j, w, h);
+                    xrdp_bitmap_hash_crc(b);
 #endif
-                bitmap_id = xrdp_cache_add_bitmap(self->wm->cache, b, self->wm->hints);
+                    bitmap_id = xrdp_cache_add_bitmap(self->wm->cache, b,
+                                                      self->wm->hints);
+                    xrdp_cache_set_tile(self->wm->cache, i, j, w, h,
+                                        bitmap_id);
+                }
                 cache_id = HIWORD(bitmap_id);
                 cache_idx = LOWORD(bitmap_id);
                 dstx = (x + i) - srcx;
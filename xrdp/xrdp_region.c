@@ -57,6 +57,15 @@ xrdp_region_delete(struct xrdp_region *self)
     g_free(self);
 }
 
+/*****************************************************************************/
+/* empty the region so it can be reused */
+void
+xrdp_region_reset(struct xrdp_region *self)
+{
+    pixman_region_fini(self->reg);
+    pixman_region_init(self->reg);
+}
+
 /*****************************************************************************/
 /* returns error */
 int
@@ -115,6 +124,21 @@ xrdp_region_intersect_rect(struct xrdp_region *self, struct xrdp_rect *rect)
 }
 
 
+/*****************************************************************************/
+/* returns boolean, true if rect is completely inside the region */
+int
+xrdp_region_contains_rect(struct xrdp_region *self, struct xrdp_rect *rect)
+{
+    struct pixman_box16 box;
+
+    box.x1 = rect->left;
+    box.y1 = rect->top;
+    box.x2 = rect->right;
+    box.y2 = rect->bottom;
+    return pixman_region_contains_rectangle(self->reg, &box) ==
+           PIXMAN_REGION_IN;
+}
+
 /*****************************************************************************/
 /* returns error */
 int
@@ -159,7 +159,11 @@ struct xrdp_mod
                               int flags, int frame_id);
     int (*server_session_info)(struct xrdp_mod *v, const char *data,
                                int data_bytes);
-    tintptr server_dumby[100 - 44]; /* align, 100 minus the number of server
+    int (*server_fill_rects)(struct xrdp_mod *v,
+                             int num_rects, short *rects);
+    int (*server_screen_blts)(struct xrdp_mod *v,
+                              int num_rects, short *rects);
+    tintptr server_dumby[100 - 46]; /* align, 100 minus the number of server
                                      functions above */
     /* common */
     tintptr handle; /* pointer to self as int */
@@ -209,6 +213,26 @@ struct xrdp_os_bitmap_item
     struct xrdp_bitmap *bitmap;
 };
 
+/* remembers which bitmap cache entry was last sent for a tile so an
+   unchanged tile can be found again with a row compare, must be a
+   power of 2 */
+#define XRDP_TILE_SHADOW_ENTRIES 4096
+
+/* free tile bitmaps kept by the cache for xrdp_painter_copy */
+#define XRDP_TILE_POOL_SIZE 16
+#define XRDP_TILE_MAX_DIM 64
+
+struct xrdp_tile_shadow_item
+{
+    int valid;
+    int x;
+    int y;
+    int cx;
+    int cy;
+    int cache_id;
+    int cache_idx;
+};
+
 struct xrdp_char_item
 {
     int stamp;
@@ -279,6 +303,13 @@ struct xrdp_cache
     struct xrdp_brush_item brush_items[64];
     struct xrdp_os_bitmap_item os_bitmap_items[2000];
     struct list *xrdp_os_del_list;
+    /* tile shadow */
+    struct xrdp_tile_shadow_item tile_shadow[XRDP_TILE_SHADOW_ENTRIES];
+    /* tile pool */
+    struct xrdp_bitmap *tile_pool[XRDP_TILE_POOL_SIZE];
+    int tile_pool_count;
+    int tile_allocs; /* tile bitmaps that needed a heap allocation */
+    int tile_reuses; /* tile bitmaps taken from the pool */
 };
 
 /* defined later */
@@ -301,6 +332,7 @@ struct xrdp_mm
     int display; /* 10 for :10.0, 11 for :11.0, etc */
     int code; /* 0=Xvnc session, 10=X11rdp session, 20=xorg driver mode */
     int sesman_controlled; /* true if this is a sesman session */
+    tui64 login_start; /* g_time4() when xrdp_mm_connect was called */
     struct trans *chan_trans; /* connection to chansrv */
     int chan_trans_up; /* true once connected to chansrv */
     int delete_chan_trans; /* boolean set when done with channel connection */
@@ -309,6 +341,13 @@ struct xrdp_mm
     int cs2xr_cid_map[256];
     int xr2cr_cid_map[256];
     int dynamic_monitor_chanid;
+    /* copy of the screen as last painted by server_paint_rects, used to
+       turn scrolled content into screen blts */
+    char *scroll_shadow;
+    int scroll_shadow_width;
+    int scroll_shadow_height;
+    struct xrdp_region *scroll_shadow_valid; /* matches the client */
+    tui32 *scroll_hashes; /* 2 * scroll_shadow_height */
 };
 
 struct xrdp_key_info
@@ -503,6 +542,7 @@ struct xrdp_bitmap
     int line_size; /* in bytes */
     int do_not_free_data;
     char *data;
+    int data_size; /* bytes allocated for data, only set for pooled tiles */
     /* for all but bitmap */
     int left;
     int top;
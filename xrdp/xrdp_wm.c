@@ -236,6 +236,7 @@ xrdp_wm_load_pointer(struct xrdp_wm *self, char *file_name, char *data,
     int pixel;
     int palette[16];
     struct stream *fs;
+    struct stream cached;
 
     if (!g_file_exist(file_name))
     {
@@ -246,18 +247,27 @@ xrdp_wm_load_pointer(struct xrdp_wm *self, char *file_name, char *data,
 
     make_stream(fs);
     init_stream(fs, 8192);
-    fd = g_file_open(file_name);
 
-    if (fd < 0)
+    if (xrdp_assets_get_file(file_name, &cached) == 0)
     {
-        LOG(LOG_LEVEL_ERROR, "xrdp_wm_load_pointer: error loading pointer from file [%s]",
-            file_name);
-        xstream_free(fs);
-        return 1;
+        g_memcpy(fs->data, cached.data,
+                 cached.size < 8192 ? cached.size : 8192);
     }
+    else
+    {
+        fd = g_file_open(file_name);
+
+        if (fd < 0)
+        {
+            LOG(LOG_LEVEL_ERROR, "xrdp_wm_load_pointer: error loading pointer from file [%s]",
+                file_name);
+            xstream_free(fs);
+            return 1;
+        }
 
-    g_file_read(fd, fs->data, 8192);
-    g_file_close(fd);
+        g_file_read(fd, fs->data, 8192);
+        g_file_close(fd);
+    }
     in_uint8s(fs, 6);
     in_uint8(fs, w);
     in_uint8(fs, h);
@@ -384,7 +394,6 @@ xrdp_wm_load_static_colors_plus(struct xrdp_wm *self, char *autorun_name)
     int gindex;
     int rindex;
 
-    int fd;
     int index;
     char *val;
     struct list *names;
@@ -407,16 +416,15 @@ xrdp_wm_load_static_colors_plus(struct xrdp_wm *self, char *autorun_name)
     self->background = HCOLOR(self->screen->bpp, 0x000000);
 
     /* now load them from the globals in xrdp.ini if defined */
-    fd = g_file_open(self->session->xrdp_ini);
-
-    if (fd >= 0)
+    if (g_file_exist(self->session->xrdp_ini))
     {
         names = list_create();
         names->auto_free = 1;
         values = list_create();
         values->auto_free = 1;
 
-        if (file_read_section(fd, "globals", names, values) == 0)
+        if (file_by_name_read_section(self->session->xrdp_ini, "globals",
+                                      names, values) == 0)
         {
             for (index = 0; index < names->count; index++)
             {
@@ -494,7 +502,6 @@ xrdp_wm_load_static_colors_plus(struct xrdp_wm *self, char *autorun_name)
 
         list_delete(names);
         list_delete(values);
-        g_file_close(fd);
     }
     else
     {
@@ -551,7 +558,6 @@ xrdp_wm_load_static_pointers(struct xrdp_wm *self)
 int
 xrdp_wm_init(struct xrdp_wm *self)
 {
-    int fd;
     int index;
     struct list *names;
     struct list *values;
@@ -619,8 +625,7 @@ xrdp_wm_init(struct xrdp_wm *self)
          * NOTE: this should eventually be accessed from self->xrdp_config
          */
 
-        fd = g_file_open(self->session->xrdp_ini);
-        if (fd != -1)
+        if (g_file_exist(self->session->xrdp_ini))
         {
             names = list_create();
             names->auto_free = 1;
@@ -629,7 +634,7 @@ xrdp_wm_init(struct xrdp_wm *self)
 
             /* pick up the first section name except for 'globals', 'Logging', 'channels'
              * in xrdp.ini and use it as default section name */
-            file_read_sections(fd, names);
+            file_by_name_read_sections(self->session->xrdp_ini, names);
             default_section_name[0] = '\0';
             for (index = 0; index < names->count; index++)
             {
@@ -671,7 +676,8 @@ xrdp_wm_init(struct xrdp_wm *self)
 
             /* if given section name doesn't match any sections configured
              * in xrdp.ini, fallback to default_section_name */
-            if (file_read_section(fd, section_name, names, values) != 0)
+            if (file_by_name_read_section(self->session->xrdp_ini, section_name,
+                                          names, values) != 0)
             {
                 LOG(LOG_LEVEL_INFO,
                     "Module \"%s\" specified by %s from %s port %s "
@@ -688,7 +694,8 @@ xrdp_wm_init(struct xrdp_wm *self)
             }
 
             /* look for the required module in xrdp.ini, fetch its parameters */
-            if (file_read_section(fd, section_name, names, values) == 0)
+            if (file_by_name_read_section(self->session->xrdp_ini, section_name,
+                                          names, values) == 0)
             {
                 for (index = 0; index < names->count; index++)
                 {
@@ -759,7 +766,6 @@ xrdp_wm_init(struct xrdp_wm *self)
 
             list_delete(names);
             list_delete(values);
-            g_file_close(fd);
         }
         else
         {
@@ -1258,6 +1258,177 @@ process_server_paint_rect_shmem_ex(struct mod *amod, struct stream *s)
     return rv;
 }
 
+/******************************************************************************/
+/* return error */
+static int
+lib_mod_ring_attach(struct mod *amod, int shmem_id, int num_slots,
+                    int slot_bytes)
+{
+    int index;
+    long segment_bytes;
+
+    if ((num_slots < 2) || (num_slots > XUP_FRAME_RING_MAX_SLOTS) ||
+            (slot_bytes < 1))
+    {
+        LOG(LOG_LEVEL_WARNING, "lib_mod_ring_attach: bad frame ring "
+            "num_slots %d slot_bytes %d", num_slots, slot_bytes);
+        return 1;
+    }
+    /* every slot the X server can name must be inside the segment */
+    segment_bytes = g_shmsize(shmem_id);
+    if ((segment_bytes < 0) ||
+            ((size_t)segment_bytes < (size_t)num_slots * (size_t)slot_bytes))
+    {
+        LOG(LOG_LEVEL_WARNING, "lib_mod_ring_attach: shmem_id %d of %ld "
+            "bytes can't hold %d slots of %d bytes", shmem_id,
+            segment_bytes, num_slots, slot_bytes);
+        return 1;
+    }
+    if (amod->screen_ring_pixels != 0)
+    {
+        g_shmdt(amod->screen_ring_pixels);
+        amod->screen_ring_pixels = 0;
+    }
+    amod->screen_ring_num_slots = 0;
+    amod->screen_ring_pixels = (char *) g_shmat(shmem_id);
+    if (amod->screen_ring_pixels == (void *) -1)
+    {
+        LOG(LOG_LEVEL_WARNING, "lib_mod_ring_attach: g_shmat failed for "
+            "shmem_id %d", shmem_id);
+        amod->screen_ring_pixels = 0;
+        return 1;
+    }
+    amod->screen_ring_shmem_id = shmem_id;
+    amod->screen_ring_num_slots = num_slots;
+    amod->screen_ring_slot_bytes = slot_bytes;
+    for (index = 0; index < XUP_FRAME_RING_MAX_SLOTS; index++)
+    {
+        amod->screen_ring_slot_in_use[index] = 0;
+    }
+    LOG(LOG_LEVEL_INFO, "lib_mod_ring_attach: using frame ring with "
+        "%d slots of %d bytes", num_slots, slot_bytes);
+    return 0;
+}
+
+/******************************************************************************/
+/* return error */
+static int
+send_frame_ring_ack(struct mod *mod)
+{
+    int len;
+    struct stream *s;
+
+    make_stream(s);
+    init_stream(s, 8192);
+    s_push_layer(s, iso_hdr, 4);
+    out_uint16_le(s, 109);
+    out_uint32_le(s, mod->screen_ring_shmem_id);
+    out_uint32_le(s, mod->screen_ring_num_slots);
+    out_uint32_le(s, mod->screen_ring_slot_bytes);
+    s_mark_end(s);
+    len = (int)(s->end - s->data);
+    s_pop_layer(s, iso_hdr);
+    out_uint32_le(s, len);
+    lib_send_copy(mod, s);
+    free_stream(s);
+    return 0;
+}
+
+/******************************************************************************/
+/* return error */
+static int
+process_server_paint_rect_shmem_ring(struct mod *amod, struct stream *s)
+{
+    int num_drects;
+    int num_crects;
+    int flags;
+    int frame_id;
+    int slot;
+    int width;
+    int height;
+    int Bpp;
+    int index;
+    int rv;
+    tsi16 *ldrects;
+    tsi16 *ldrects1;
+    tsi16 *lcrects;
+    tsi16 *lcrects1;
+    char *bmpdata;
+
+    /* dirty pixels */
+    in_uint16_le(s, num_drects);
+    ldrects = (tsi16 *) g_malloc(2 * 4 * num_drects, 0);
+    ldrects1 = ldrects;
+    for (index = 0; index < num_drects; index++)
+    {
+        in_sint16_le(s, ldrects1[0]);
+        in_sint16_le(s, ldrects1[1]);
+        in_sint16_le(s, ldrects1[2]);
+        in_sint16_le(s, ldrects1[3]);
+        ldrects1 += 4;
+    }
+
+    /* copied pixels */
+    in_uint16_le(s, num_crects);
+    lcrects = (tsi16 *) g_malloc(2 * 4 * num_crects, 0);
+    lcrects1 = lcrects;
+    for (index = 0; index < num_crects; index++)
+    {
+        in_sint16_le(s, lcrects1[0]);
+        in_sint16_le(s, lcrects1[1]);
+        in_sint16_le(s, lcrects1[2]);
+        in_sint16_le(s, lcrects1[3]);
+        lcrects1 += 4;
+    }
+
+    in_uint32_le(s, flags);
+    in_uint32_le(s, frame_id);
+    in_uint32_le(s, slot);
+
+    in_uint16_le(s, width);
+    in_uint16_le(s, height);
+
+    Bpp = amod->bpp > 16 ? 4 : (amod->bpp + 7) / 8;
+    bmpdata = 0;
+    if ((amod->screen_ring_pixels != 0) &&
+            (slot >= 0) && (slot < amod->screen_ring_num_slots) &&
+            ((size_t)width * (size_t)height * (size_t)Bpp <=
+             (size_t)amod->screen_ring_slot_bytes))
+    {
+        if (amod->screen_ring_slot_in_use[slot])
+        {
+            LOG(LOG_LEVEL_WARNING, "process_server_paint_rect_shmem_ring: "
+                "slot %d reused before frame %d was acked", slot,
+                amod->screen_ring_slot_frame_id[slot]);
+        }
+        amod->screen_ring_slot_frame_id[slot] = frame_id;
+        amod->screen_ring_slot_in_use[slot] = 1;
+        bmpdata = amod->screen_ring_pixels +
+                  (size_t)slot * (size_t)amod->screen_ring_slot_bytes;
+    }
+    else
+    {
+        LOG(LOG_LEVEL_ERROR, "process_server_paint_rect_shmem_ring: bad "
+            "slot %d width %d height %d", slot, width, height);
+    }
+    if (bmpdata != 0)
+    {
+        rv = amod->server_paint_rects(amod, num_drects, ldrects,
+                                      num_crects, lcrects,
+                                      bmpdata, width, height,
+                                      flags, frame_id);
+    }
+    else
+    {
+        rv = 1;
+    }
+
+    g_free(lcrects);
+    g_free(ldrects);
+
+    return rv;
+}
+
 /******************************************************************************/
 /* return error */
 static int
@@ -1376,6 +1547,92 @@ lib_send_server_monitor_full_invalidate(struct mod *mod, int width, int height)
     return rv;
 }
 
+/******************************************************************************/
+/* return error */
+static int
+send_xrdp_caps(struct mod *mod)
+{
+    int len;
+    struct stream *s;
+
+    make_stream(s);
+    init_stream(s, 8192);
+    s_push_layer(s, iso_hdr, 4);
+    out_uint16_le(s, 110);
+    out_uint32_le(s, XUP_XRDP_CAP_ORDER_BATCH);
+    s_mark_end(s);
+    len = (int)(s->end - s->data);
+    s_pop_layer(s, iso_hdr);
+    out_uint32_le(s, len);
+    lib_send_copy(mod, s);
+    free_stream(s);
+    return 0;
+}
+
+/******************************************************************************/
+/* return error
+   a batch is 'count' orders of the same type packed back to back
+   3  - fill rect, x, y, cx, cy
+   4  - screen blt, x, y, cx, cy, srcx, srcy
+   30 - draw text, same layout as order 30 */
+static int
+lib_mod_process_order_batch(struct mod *mod, int type, int count,
+                            struct stream *s)
+{
+    int rv;
+    int index;
+    int num_shorts;
+    short *rects;
+
+    rv = 0;
+    switch (type)
+    {
+        case 3: /* server_fill_rects */
+        case 4: /* server_screen_blts */
+            num_shorts = type == 3 ? 4 : 6;
+            if (!s_check_rem(s, count * num_shorts * 2))
+            {
+                LOG(LOG_LEVEL_ERROR, "lib_mod_process_order_batch: "
+                    "short batch, type %d count %d", type, count);
+                return 1;
+            }
+            rects = (short *) g_malloc(count * num_shorts * 2, 0);
+            if (rects == 0)
+            {
+                return 1;
+            }
+            for (index = 0; index < count * num_shorts; index++)
+            {
+                in_sint16_le(s, rects[index]);
+            }
+            if (type == 3)
+            {
+                rv = mod->server_fill_rects(mod, count, rects);
+            }
+            else
+            {
+                rv = mod->server_screen_blts(mod, count, rects);
+            }
+            g_free(rects);
+            break;
+        case 30: /* server_draw_text */
+            for (index = 0; index < count; index++)
+            {
+                rv = process_server_draw_text(mod, s);
+                if (rv != 0)
+                {
+                    break;
+                }
+            }
+            break;
+        default:
+            LOG_DEVEL(LOG_LEVEL_WARNING, "lib_mod_process_order_batch: "
+                      "unknown order type %d", type);
+            break;
+    }
+    return rv;
+}
+
 /******************************************************************************/
 /* return error */
 static int
@@ -1477,6 +1734,9 @@ lib_mod_process_orders(struct mod *mod, int type, struct stream *s)
         case 61: /* server_paint_rect_shmem_ex */
             rv = process_server_paint_rect_shmem_ex(mod, s);
             break;
+        case 62: /* server_paint_rect_shmem_ring */
+            rv = process_server_paint_rect_shmem_ring(mod, s);
+            break;
         default:
             LOG_DEVEL(LOG_LEVEL_WARNING, "lib_mod_process_orders: unknown order type %d", type);
             rv = 0;
@@ -1519,6 +1779,10 @@ lib_mod_process_message(struct mod *mod, struct stream *s)
     int rv;
     int len;
     int type;
+    int count;
+    int shmem_id;
+    int num_slots;
+    int slot_bytes;
     char *phold;
 
     LOG_DEVEL(LOG_LEVEL_TRACE, "lib_mod_process_message:");
@@ -1554,6 +1818,13 @@ lib_mod_process_message(struct mod *mod, struct stream *s)
 
                 switch (type)
                 {
+                    case XUP_CAP_FRAME_RING:
+                        in_uint32_le(s, shmem_id);
+                        in_uint32_le(s, num_slots);
+                        in_uint32_le(s, slot_bytes);
+                        lib_mod_ring_attach(mod, shmem_id, num_slots,
+                                            slot_bytes);
+                        break;
                     default:
                         LOG_DEVEL(LOG_LEVEL_TRACE, "lib_mod_process_message: unknown cap type %d len %d",
                                   type, len);
@@ -1564,6 +1835,12 @@ lib_mod_process_message(struct mod *mod, struct stream *s)
             }
 
             lib_send_client_info(mod);
+            send_xrdp_caps(mod);
+            if (mod->screen_ring_num_slots > 0)
+            {
+                /* X server only switches to order 62 after this */
+                send_frame_ring_ack(mod);
+            }
         }
         else if (type == 3) /* order list with len after type */
         {
@@ -1582,6 +1859,24 @@ lib_mod_process_message(struct mod *mod, struct stream *s)
                 s->p = phold + len;
             }
         }
+        else if (type == 4) /* order batches, type, count, len, packed orders */
+        {
+            for (index = 0; index < num_orders; index++)
+            {
+                phold = s->p;
+                in_uint16_le(s, type);
+                in_uint16_le(s, count);
+                in_uint32_le(s, len);
+                rv = lib_mod_process_order_batch(mod, type, count, s);
+
+                if (rv != 0)
+                {
+                    break;
+                }
+
+                s->p = phold + len;
+            }
+        }
         else
         {
             LOG_DEVEL(LOG_LEVEL_TRACE, "unknown type %d", type);
@@ -1610,6 +1905,12 @@ lib_mod_end(struct mod *mod)
         g_shmdt(mod->screen_shmem_pixels);
         mod->screen_shmem_pixels = 0;
     }
+    if (mod->screen_ring_pixels != 0)
+    {
+        g_shmdt(mod->screen_ring_pixels);
+        mod->screen_ring_pixels = 0;
+        mod->screen_ring_num_slots = 0;
+    }
     return 0;
 }
 
@@ -1683,7 +1984,20 @@ lib_mod_check_wait_objs(struct mod *mod)
 int
 lib_mod_frame_ack(struct mod *amod, int flags, int frame_id)
 {
+    int index;
+
     LOG_DEVEL(LOG_LEVEL_TRACE, "lib_mod_frame_ack: flags 0x%8.8x frame_id %d", flags, frame_id);
+    /* acks are cumulative, every ring slot holding this frame or an
+       older one can be drawn into again */
+    for (index = 0; index < amod->screen_ring_num_slots; index++)
+    {
+        if (amod->screen_ring_slot_in_use[index] &&
+                ((int)((unsigned int)amod->screen_ring_slot_frame_id[index] -
+                       (unsigned int)frame_id) <= 0))
+        {
+            amod->screen_ring_slot_in_use[index] = 0;
+        }
+    }
     send_paint_rect_ex_ack(amod, flags, frame_id);
     return 0;
 }
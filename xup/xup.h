@@ -30,6 +30,14 @@
 
 #define CURRENT_MOD_VER 5
 
+/* shared frame ring negotiated with the X server through the caps
+   message, see lib_mod_process_message */
+#define XUP_CAP_FRAME_RING 1
+#define XUP_FRAME_RING_MAX_SLOTS 8
+
+/* capabilities of this module, sent to the X server in message 110 */
+#define XUP_XRDP_CAP_ORDER_BATCH 0x00000001
+
 struct source_info;
 
 struct mod
@@ -151,8 +159,12 @@ struct mod
                               int num_crects, short *crects,
                               char *data, int width, int height,
                               int flags, int frame_id);
+    int (*server_session_info)(struct mod *v, const char *data,
+                               int data_bytes);
+    int (*server_fill_rects)(struct mod *v, int num_rects, short *rects);
+    int (*server_screen_blts)(struct mod *v, int num_rects, short *rects);
 
-    tintptr server_dumby[100 - 43]; /* align, 100 minus the number of server
+    tintptr server_dumby[100 - 46]; /* align, 100 minus the number of server
                                      functions above */
     /* common */
     tintptr handle; /* pointer to self as long */
@@ -174,4 +186,11 @@ struct mod
     int screen_shmem_id_mapped; /* boolean */
     char *screen_shmem_pixels;
     struct trans *trans;
+    /* frame ring, screen_ring_num_slots is zero when not in use */
+    int screen_ring_shmem_id;
+    char *screen_ring_pixels;
+    int screen_ring_num_slots;
+    int screen_ring_slot_bytes;
+    int screen_ring_slot_frame_id[XUP_FRAME_RING_MAX_SLOTS];
+    int screen_ring_slot_in_use[XUP_FRAME_RING_MAX_SLOTS]; /* boolean */
 };